@@ -1,42 +1,84 @@
 
 #include "context/context.h"
+#include "context/genstate.h"
+#include "context/sinks.h"
 #include "gedcom.h"
+#include "graph/family.h"
+#include "graph/kinship.h"
+#include "graph/relation.h"
+#include "incremental.h"
+#include "index/events.h"
+#include "index/fulltext.h"
+#include "index/merkle.h"
+#include "index/names.h"
+#include "index/places.h"
 #include "lexer.h"
 #include "parser.h"
+#include "query/path.h"
+#include "snapshot.h"
+#include "tags/date.h"
+#include "utils/bitset.h"
+#include "utils/hash64.h"
 #include "utils/hashmap.h"
+#include "utils/phonetic.h"
+#include "utils/pool.h"
 #include "utils/ptrarr.h"
+#include "utils/smallarr.h"
+#include "utils/stringbuilder.h"
+#include "utils/vec.h"
+#include "writer.h"
 #include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 struct ehm {
     int x;
     int y;
 };
 
+VEC_DEFINE(int_vec, int)
+VEC_DEFINE(ehm_vec, struct ehm)
+
 void
 test_dynarray(void)
 {
-    ptr_arr pa = pa_create(5);
-    struct ehm* e = malloc(sizeof *e);
-    e->x = 3;
-    e->y = 2;
+    struct int_vec digits;
+    struct ehm_vec ehms;
+
+    int_vec_init(&digits);
+    ehm_vec_init(&ehms);
 
-    pa_push(pa, (void*)5);
-    pa_push(pa, (void*)4);
-    pa_push(pa, (void*)3);
-    pa_push(pa, (void*)2);
-    pa_push(pa, (void*)1);
+    for (int i = 5; i > 0; i--) {
+        assert(int_vec_push(&digits, i) == ST_OK);
+    }
 
     for (int i = 0; i < 5; i++) {
-        printf("dig %d\n", (int)pa_pop(pa));
+        printf("dig %d\n", int_vec_pop(&digits));
+    }
+
+    // past VEC_MIN_CAP, so the vector has to grow
+    for (int i = 0; i < 100; i++) {
+        assert(ehm_vec_push(&ehms, (struct ehm){i, -i}) == ST_OK);
     }
 
-    pa_push(pa, e);
-    struct ehm* t = pa_pop(pa);
-    printf("%d, %d\n", t->x, t->y);
+    assert(ehms.len == 100 && ehms.cap >= 100);
+    assert(ehm_vec_get(&ehms, 42).y == -42);
+
+    ehm_vec_at(&ehms, 0)->x = 3;
+    ehm_vec_at(&ehms, 0)->y = 2;
+    ehm_vec_clear(&ehms);
+    assert(ehm_vec_push(&ehms, (struct ehm){3, 2}) == ST_OK);
+    assert(ehm_vec_shrink_to_fit(&ehms) == ST_OK && ehms.cap == 1);
 
-    free(e);
-    pa_free(pa);
+    struct ehm t = ehm_vec_pop(&ehms);
+    printf("%d, %d\n", t.x, t.y);
+
+    int_vec_destroy(&digits);
+    ehm_vec_destroy(&ehms);
 }
 
 void
@@ -45,11 +87,1562 @@ test_hashtable(void)
     struct hash_table* ht = ht_create(31);
 
     ht_set(ht, "testcase", (void*)(uintptr_t)4);
+
+    // grows the table several times
+    for (uintptr_t i = 1; i <= 1000; i++) {
+        char key[16];
+
+        snprintf(key, sizeof key, "key%zu", (size_t)i);
+        ht_set(ht, key, (void*)i);
+    }
+
+    for (uintptr_t i = 1; i <= 1000; i++) {
+        char key[16];
+
+        snprintf(key, sizeof key, "key%zu", (size_t)i);
+        assert(ht_get(ht, key) == (void*)i);
+    }
+
     printf("Hashtable test: %d\n", (int)(uintptr_t)ht_get(ht, "testcase"));
 
     ht_free(ht);
 }
 
+// Lexes, parses and builds text, on the shared pool if parallel
+struct ged_document*
+document_from_text(const char* text, struct context* ctx, bool recover,
+                   bool parallel)
+{
+    ctx_push(ctx, posctx_create("lexer"));
+
+    struct lex_lexer* lexer = lex_create(ctx);
+    assert(lexer);
+
+    lexer->recover = recover;
+
+    for (const char* c = text; *c; c++) {
+        lex_feed(lexer, *c);
+    }
+    lex_feed(lexer, EOF);
+
+    ctx_pop(ctx);
+
+    struct parser_result presult =
+        recover ? parser_parse_recover(lexer->token_first, ctx)
+                : parser_parse(lexer->token_first, ctx);
+
+    struct ged_document* doc =
+        parallel ? ged_document_from_parser_parallel(presult, ctx, true)
+                 : ged_document_from_parser(presult, ctx);
+
+    parser_result_destroy(&presult);
+    lex_free(lexer);
+
+    return doc;
+}
+
+// Index of rec in the records of doc, -1 if it is none of them
+long
+record_index(struct ged_document* doc, const struct ged_record* rec)
+{
+    for (size_t i = 0; i < pa_len(doc->records); i++) {
+        if (pa_get(doc->records, i) == rec) {
+            return (long)i;
+        }
+    }
+
+    return -1;
+}
+
+// Asserts that a and b hold the same records, and that their xref and
+// backref indices point at the same ones
+void
+assert_same_documents(struct ged_document* a, struct ged_document* b)
+{
+    assert(pa_len(a->records) == pa_len(b->records));
+    assert(ht_len(a->xrefs) == ht_len(b->xrefs));
+
+    for (size_t i = 0; i < pa_len(a->records); i++) {
+        struct ged_record* x = pa_get(a->records, i);
+        struct ged_record* y = pa_get(b->records, i);
+        char* xs = ged_record_to_string(x);
+        char* ys = ged_record_to_string(y);
+
+        assert(strcmp(xs, ys) == 0);
+
+        if (x->xref) {
+            assert((ht_get(a->xrefs, x->xref) == x) ==
+                   (ht_get(b->xrefs, y->xref) == y));
+        }
+
+        free(xs);
+        free(ys);
+    }
+
+    for (size_t i = 0; i < a->backrefs->len; i++) {
+        const char* target = a->backrefs->targets[i];
+        size_t na;
+        size_t nb;
+        const struct backref* ra = br_get(a->backrefs, target, &na);
+        const struct backref* rb = br_get(b->backrefs, target, &nb);
+
+        assert(na == nb);
+
+        for (size_t j = 0; j < na; j++) {
+            assert(record_index(a, ra[j].root) == record_index(b, rb[j].root));
+        }
+    }
+}
+
+void
+count_visit(uint32_t id, struct ged_record* indi, void* data)
+{
+    (void)id;
+    (void)indi;
+    (*(size_t*)data)++;
+}
+
+void
+test_incremental(void)
+{
+    const char* ann = "0 @I1@ INDI\n1 NAME Ann /Smith/\n1 FAMS @F1@\n";
+    const char* bob = "0 @I2@ INDI\n1 NAME Bob /Smith/\n1 FAMS @F1@\n";
+    const char* cid = "0 @I3@ INDI\n1 NAME Cid /Smith/\n1 FAMC @F1@\n";
+    const char* cy = "0 @I3@ INDI\n1 NAME Cy /Smith/\n1 FAMC @F1@\n";
+    const char* dan = "0 @I1@ INDI\n1 NAME Dan /Jones/\n1 FAMC @F1@\n";
+    const char* fam = "0 @F1@ FAM\n1 HUSB @I2@\n1 WIFE @I1@\n1 CHIL @I3@\n";
+
+    // each version edits the one before. dan declares @I1@ again, which is
+    // his once ann is removed, and hers again once she is back before him
+    const char* versions[][6] = {
+        {ann, bob, cid, fam},
+        {ann, bob, cid, fam, dan},
+        {bob, cid, fam, dan},
+        {dan, bob, cy, fam},
+        {ann, dan, bob, cy, fam},
+        {fam, cy, bob},
+        {ann, bob, cid, fam, dan},
+    };
+
+    struct context* ctx = ctx_create(WARNING);
+    struct inc_document* inc = NULL;
+
+    for (size_t v = 0; v < sizeof versions / sizeof *versions; v++) {
+        struct sbuilder text = sbuilder_new();
+
+        for (size_t i = 0; i < 6 && versions[v][i]; i++) {
+            sbuilder_write(&text, versions[v][i]);
+        }
+
+        const char* str = sbuilder_to_string(&text);
+
+        if (!inc) {
+            inc = inc_parse(str, strlen(str), ctx);
+            assert(inc);
+        } else {
+            assert(inc_reload(inc, str, strlen(str), ctx, NULL) == ST_OK);
+        }
+
+        struct context* fresh_ctx = ctx_create(WARNING);
+        struct ged_document* fresh =
+            document_from_text(str, fresh_ctx, false, false);
+
+        assert_same_documents(fresh, inc->doc);
+
+        for (size_t i = 0, r = 0; i < pa_len(fresh->records); i++, r++) {
+            struct ged_record* rec = pa_get(fresh->records, i);
+            struct ged_record* name = sa_get(&rec->children, 0);
+
+            while (!inc->ranges[r].rec) {
+                r++;
+            }
+
+            const struct ged_record* reused =
+                sa_get(&inc->ranges[r].rec->children, 0);
+            struct lex_token* tok = sa_get(&name->value, 0);
+
+            assert(tok->line == inc_line(&inc->ranges[r],
+                                         sa_get(&reused->value, 0)));
+        }
+
+        size_t fresh_names = 0;
+        size_t inc_names = 0;
+
+        nm_prefix(fresh->names, NM_SURNAME, "", count_visit, &fresh_names);
+        nm_prefix(inc->doc->names, NM_SURNAME, "", count_visit, &inc_names);
+        assert(fresh_names == inc_names);
+
+        ged_document_free(fresh);
+        ctx_free(fresh_ctx);
+        sbuilder_destroy(&text);
+    }
+
+    printf("Incremental test: %zu records\n", pa_len(inc->doc->records));
+
+    inc_free(inc);
+    ctx_free(ctx);
+}
+
+void
+test_dates(void)
+{
+    // 2451545 is 1 Jan 2000 (Gregorian)
+    static const struct {
+        const char* value;
+        date_e_calendar calendar;
+        date_e_qualifier qualifier;
+        int32_t lo;
+        int32_t hi;
+    } cases[] = {
+        {"1 JAN 2000", CAL_GREGORIAN, DQ_EXACT, 2451545, 2451545},
+        {"JAN 2000", CAL_GREGORIAN, DQ_EXACT, 2451545, 2451575},
+        {"29 FEB 2000", CAL_GREGORIAN, DQ_EXACT, 2451604, 2451604},
+        {"44 B.C.", CAL_GREGORIAN, DQ_EXACT, 1705355, 1705719},
+        {"@#DGREGORIAN@ 1 JAN 2000", CAL_GREGORIAN, DQ_EXACT, 2451545,
+         2451545},
+        {"@#DJULIAN@ 1 JAN 2000", CAL_JULIAN, DQ_EXACT, 2451558, 2451558},
+        {"@#DJULIAN@ 1 MAR 1750/51", CAL_JULIAN, DQ_EXACT, 2360670, 2360670},
+        {"@#DFRENCH R@ 1 VEND 1", CAL_FRENCH, DQ_EXACT, 2375840, 2375840},
+        {"@#DFRENCH R@ COMP 3", CAL_FRENCH, DQ_EXACT, 2376930, 2376935},
+        {"@#DHEBREW@ 1 TSH 5780", CAL_HEBREW, DQ_EXACT, 2458757, 2458757},
+        {"@#DHEBREW@ ADS 5779", CAL_HEBREW, DQ_EXACT, 2458551, 2458579},
+        {"ABT 2000", CAL_GREGORIAN, DQ_ABOUT, 2451545, 2451910},
+        {"CAL 2000", CAL_GREGORIAN, DQ_CALCULATED, 2451545, 2451910},
+        {"EST 2000", CAL_GREGORIAN, DQ_ESTIMATED, 2451545, 2451910},
+        {"BEF 2000", CAL_GREGORIAN, DQ_BEFORE, DATE_MIN, 2451544},
+        {"AFT 2000", CAL_GREGORIAN, DQ_AFTER, 2451911, DATE_MAX},
+        {"BET 2000 AND 2001", CAL_GREGORIAN, DQ_BETWEEN, 2451545, 2452275},
+        {"FROM 2000 TO 2001", CAL_GREGORIAN, DQ_PERIOD, 2451545, 2452275},
+        {"FROM 2000", CAL_GREGORIAN, DQ_PERIOD, 2451545, DATE_MAX},
+        {"TO 2000", CAL_GREGORIAN, DQ_PERIOD, DATE_MIN, 2451910},
+        {"INT 2000 (new year)", CAL_GREGORIAN, DQ_INTERPRETED, 2451545,
+         2451910},
+    };
+
+    // ADS only exists in leap years, 5780 is none
+    static const char* invalid[] = {
+        "",
+        "(unknown)",
+        "JAN",
+        "30 FEB 1900",
+        "29 FEB 1900",
+        "1900 garbage",
+        "BET 1900 AND 1800",
+        "@#DROMAN@ 1900",
+        "@#DHEBREW@ ADS 5780",
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; i++) {
+        struct ged_date date;
+
+        assert(date_parse(cases[i].value, &date) == ST_OK);
+        assert(date.calendar == cases[i].calendar);
+        assert(date.qualifier == cases[i].qualifier);
+        assert(date.lo == cases[i].lo && date.hi == cases[i].hi);
+    }
+
+    for (size_t i = 0; i < sizeof invalid / sizeof *invalid; i++) {
+        struct ged_date date;
+
+        assert(date_parse(invalid[i], &date) == ST_NOT_OK);
+    }
+
+    printf("Date test: %zu dates\n", sizeof cases / sizeof *cases);
+}
+
+void
+test_parallel_builder(void)
+{
+    struct sbuilder text = sbuilder_new();
+
+    for (int i = 0; i < 4000; i++) {
+        sbuilder_writef(&text, "0 @I%d@ INDI\n1 NAME N%d /S%d/\n", i, i,
+                        i % 7);
+        sbuilder_writef(&text, "1 FAMC @F%d@\n", i / 2);
+
+        // an error, a warning, and a critical error late in the text
+        if (i % 500 == 250) {
+            sbuilder_writef(&text, "0 @I%d@ INDI\n", i - 1);
+        } else if (i % 300 == 100) {
+            sbuilder_write(&text, "01 SEX M\n");
+        } else if (i == 3500) {
+            sbuilder_write(&text, "5 JUMP x\n");
+        }
+    }
+
+    const char* str = sbuilder_to_string(&text);
+    struct context* serial_ctx = ctx_create(DEBUG);
+    struct ged_document* serial =
+        document_from_text(str, serial_ctx, false, false);
+    char* serial_log = ctx_log_to_string(serial_ctx);
+
+    // up to more threads than cores, so the parallel stages interleave
+    for (size_t nthreads = 2; nthreads <= 8; nthreads *= 2) {
+        tp_shared_free();
+        assert(tp_shared_configure(nthreads) == ST_OK);
+
+        struct context* ctx = ctx_create(DEBUG);
+        struct ged_document* doc = document_from_text(str, ctx, false, true);
+        char* log = ctx_log_to_string(ctx);
+
+        assert_same_documents(serial, doc);
+        assert(serial_log && log && strcmp(serial_log, log) == 0);
+
+        free(log);
+        ged_document_free(doc);
+        ctx_free(ctx);
+    }
+
+    tp_shared_free();
+    tp_shared_configure(0);
+
+    printf("Parallel builder test: %zu records\n", pa_len(serial->records));
+
+    free(serial_log);
+    ged_document_free(serial);
+    ctx_free(serial_ctx);
+    sbuilder_destroy(&text);
+}
+
+void
+test_recovery(void)
+{
+    // a line with control characters and its child, a line without a tag,
+    // and a stray line at the end of the text
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NAME Ann /Smith/\n"
+                       "1 \x01\x02 broken\n"
+                       "2 DATE 2000\n"
+                       "1 SEX F\n"
+                       "0 @I2@ INDI\n"
+                       "1\n"
+                       "1 NAME Bob /Smith/\n"
+                       "0 @I3@ INDI\n"
+                       "1 \x01\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, true, false);
+    size_t skipped = 0;
+
+    assert(ctx_continue(ctx));
+    assert(pa_len(doc->records) == 3);
+    assert(sa_len(&((struct ged_record*)pa_get(doc->records, 0))->children) ==
+           2);
+    assert(sa_len(&((struct ged_record*)pa_get(doc->records, 1))->children) ==
+           1);
+
+    // one error per skipped span
+    for (size_t i = 0; i < ctx->len; i++) {
+        skipped += ctx->diags[i].code == CTX_C_TEXT_SKIPPED ||
+                   ctx->diags[i].code == CTX_C_LINES_SKIPPED;
+    }
+
+    assert(skipped == 3);
+
+    // without recovery the first broken line is critical
+    struct context* strict = ctx_create(WARNING);
+    struct ged_document* partial =
+        document_from_text(text, strict, false, false);
+
+    assert(!ctx_continue(strict));
+
+    printf("Recovery test: %zu records\n", pa_len(doc->records));
+
+    ged_document_free(partial);
+    ged_document_free(doc);
+    ctx_free(strict);
+    ctx_free(ctx);
+}
+
+// Value of rec with its CONC and CONT children joined
+void
+joined_value(const struct ged_record* rec, struct sbuilder* out)
+{
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+
+        sbuilder_write(out, tok->lexeme);
+    }
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        const struct ged_record* line = sa_get(&rec->children, i);
+
+        if (strcmp(line->tag, "CONT") == 0) {
+            sbuilder_write(out, "\n");
+        }
+
+        joined_value(line, out);
+    }
+}
+
+void
+test_writer(void)
+{
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc =
+        document_from_text("0 @I1@ INDI\n1 NOTE x\n", ctx, false, false);
+    struct ged_record* note =
+        sa_get(&((struct ged_record*)pa_get(doc->records, 0))->children, 0);
+    struct sbuilder value = sbuilder_new();
+
+    // longer than a line both before and after a line break
+    for (int i = 0; i < 200; i++) {
+        sbuilder_writef(&value, i == 80 || i == 81 ? "word%d\n" : "word%d ",
+                        i);
+    }
+
+    struct lex_token* tok = sa_get(&note->value, 0);
+
+    if (tok->lexeme != tok->short_lexeme) {
+        free(tok->lexeme);
+    }
+
+    tok->lexeme = NULL;
+    assert(lex_token_set_lexeme(tok, value.mem, value.len) == ST_OK);
+
+    FILE* fp = tmpfile();
+    struct ged_writer w;
+
+    assert(fp && gw_open_file(&w, fp) == ST_OK);
+    assert(gw_document(&w, doc) == ST_OK && gw_close(&w) == ST_OK);
+
+    struct sbuilder text = sbuilder_new();
+    char line[512];
+
+    rewind(fp);
+
+    while (fgets(line, sizeof line, fp)) {
+        assert(strlen(line) <= GW_LINE_MAX + 1);
+        sbuilder_write(&text, line);
+    }
+
+    fclose(fp);
+
+    struct ged_document* read =
+        document_from_text(sbuilder_to_string(&text), ctx, false, false);
+    struct ged_record* read_note =
+        sa_get(&((struct ged_record*)pa_get(read->records, 0))->children, 0);
+    struct sbuilder joined = sbuilder_new();
+
+    // every CONC and CONT line continues the NOTE, none of them each other
+    for (size_t i = 0; i < sa_len(&read_note->children); i++) {
+        struct ged_record* cont = sa_get(&read_note->children, i);
+
+        assert(cont->level == 2 && sa_len(&cont->children) == 0);
+    }
+
+    joined_value(read_note, &joined);
+
+    assert(ctx_continue(ctx) && sa_len(&read_note->children) > 2);
+    assert(strcmp(sbuilder_to_string(&joined), sbuilder_to_string(&value)) ==
+           0);
+
+    printf("Writer test: %zu continuation lines\n",
+           sa_len(&read_note->children));
+
+    sbuilder_destroy(&joined);
+    sbuilder_destroy(&text);
+    sbuilder_destroy(&value);
+    ged_document_free(read);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_critical_position(void)
+{
+    struct sbuilder text = sbuilder_new();
+
+    // a character the lexer cannot take, in the middle of the text
+    for (int i = 0; i < 10; i++) {
+        sbuilder_writef(&text, "0 @I%d@ INDI\n1 NAME N%d /S/\n", i, i);
+        sbuilder_write(&text, i == 4 ? "1 SEX \x01\n" : "1 SEX M\n");
+    }
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc =
+        document_from_text(sbuilder_to_string(&text), ctx, false, false);
+
+    // the records up to the error are kept, the one it is in included
+    assert(!ctx_continue(ctx));
+    assert(pa_len(doc->records) == 5);
+
+    printf("Critical position test: %zu records\n", pa_len(doc->records));
+
+    ged_document_free(doc);
+    ctx_free(ctx);
+    sbuilder_destroy(&text);
+}
+
+// Rewrites the hashes of the snapshot in mem, after it was modified
+void
+snapshot_rehash(uint8_t* mem)
+{
+    struct snap_header* h = (struct snap_header*)mem;
+
+    h->data_hash = 0;
+
+    for (int i = 0; i < SNAP_SECTIONS; i++) {
+        h->data_hash = hash64(mem + h->sections[i].offset, h->sections[i].size,
+                              h->data_hash);
+    }
+
+    h->header_hash = hash64(h, offsetof(struct snap_header, header_hash), 0);
+}
+
+void
+test_snapshot(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NAME Ann /Smith/\n"
+                       "2 GIVN Ann\n"
+                       "1 FAMS @F1@\n"
+                       "0 @I2@ INDI\n"
+                       "1 FAMC @F1@\n"
+                       "0 @F1@ FAM\n"
+                       "1 WIFE @I1@\n"
+                       "1 CHIL @I2@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    char path[] = "/tmp/snapshot_testXXXXXX";
+    int fd = mkstemp(path);
+    FILE* fp = fdopen(fd, "w+b");
+
+    assert(fp && snap_write(doc, 1, 2, fp) == ST_OK && fflush(fp) == 0);
+
+    struct snapshot* snap = snap_open(path, SNAP_VERIFY);
+
+    assert(snap && snap_matches(snap, 1, 2));
+
+    struct ged_document* copy = snap_to_document(snap, ctx);
+
+    assert_same_documents(doc, copy);
+    snap_close(snap);
+
+    // the first record made its own child, with the hashes still matching
+    long size = ftell(fp);
+    uint8_t* mem = malloc(size);
+
+    rewind(fp);
+    assert(mem && fread(mem, 1, size, fp) == (size_t)size);
+
+    struct snap_header* h = (struct snap_header*)mem;
+    struct snap_node* root = (struct snap_node*)(mem + h->sections[0].offset);
+
+    root->first_child = 0;
+    snapshot_rehash(mem);
+    rewind(fp);
+    assert(fwrite(mem, 1, size, fp) == (size_t)size && fflush(fp) == 0);
+
+    assert(snap_open(path, SNAP_VERIFY) == NULL);
+
+    printf("Snapshot test: %zu records\n", pa_len(copy->records));
+
+    free(mem);
+    fclose(fp);
+    remove(path);
+    ged_document_free(copy);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_backrefs(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 FAMS @F1@\n"
+                       "0 @I2@ INDI\n"
+                       "1 FAMC @F1@\n"
+                       "0 @F1@ FAM\n"
+                       "1 HUSB @I1@\n"
+                       "1 CHIL @I2@\n"
+                       "1 NOTE @N1@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    size_t count;
+    const struct backref* refs = ged_document_backrefs(doc, "@F1@", &count);
+
+    // in source order, each with the record holding it
+    assert(count == 2);
+    assert(refs[0].root == ged_document_xref(doc, "@I1@"));
+    assert(refs[1].root == ged_document_xref(doc, "@I2@"));
+    assert(strcmp(refs[1].node->tag, "FAMC") == 0);
+
+    refs = ged_document_backrefs(doc, "@I2@", &count);
+    assert(count == 1 && strcmp(refs[0].node->tag, "CHIL") == 0);
+
+    assert(ged_document_backrefs(doc, "@F2@", &count) == NULL && !count);
+
+    // the note is referenced, but never declared
+    assert(ged_document_backrefs(doc, "@N1@", &count) && count == 1);
+    assert(ctx->len == 1);
+
+    printf("Backref test: %zu records\n", pa_len(doc->records));
+
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+// Number of diagnostics of ctx logged at level
+size_t
+count_diags(const struct context* ctx, ctx_e_loglevel level)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < ctx->len; i++) {
+        count += ctx->diags[i].level == level;
+    }
+
+    return count;
+}
+
+void
+test_kinship(void)
+{
+    // C is the child of full siblings
+    const char* text = "0 @P1@ INDI\n"
+                       "0 @P2@ INDI\n"
+                       "0 @S1@ INDI\n"
+                       "0 @S2@ INDI\n"
+                       "0 @C@ INDI\n"
+                       "0 @F1@ FAM\n"
+                       "1 HUSB @P1@\n"
+                       "1 WIFE @P2@\n"
+                       "1 CHIL @S1@\n"
+                       "1 CHIL @S2@\n"
+                       "0 @F2@ FAM\n"
+                       "1 HUSB @S1@\n"
+                       "1 WIFE @S2@\n"
+                       "1 CHIL @C@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct fam_graph* g = fg_create(doc, ctx);
+
+    for (size_t nthreads = 1; nthreads <= 2; nthreads++) {
+        struct kinship* k = kin_compute(g, ctx, nthreads);
+        uint32_t s1 = fg_id(g, "@S1@");
+
+        assert(k->inbreeding[fg_id(g, "@C@")] == 0.25);
+        assert(k->inbreeding[s1] == 0);
+        assert(kin_coefficient(k, s1, fg_id(g, "@S2@")) == 0.25);
+        assert(kin_coefficient(k, s1, s1) == 0.5);
+
+        kin_free(k);
+    }
+
+    fg_free(g);
+    ged_document_free(doc);
+
+    // two cycles, I3 below the first and above the second
+    text = "0 @I1@ INDI\n"
+           "0 @I2@ INDI\n"
+           "0 @I3@ INDI\n"
+           "0 @I5@ INDI\n"
+           "0 @I6@ INDI\n"
+           "0 @F1@ FAM\n"
+           "1 HUSB @I1@\n"
+           "1 CHIL @I2@\n"
+           "1 CHIL @I3@\n"
+           "0 @F2@ FAM\n"
+           "1 HUSB @I2@\n"
+           "1 CHIL @I1@\n"
+           "0 @F3@ FAM\n"
+           "1 HUSB @I3@\n"
+           "1 WIFE @I6@\n"
+           "1 CHIL @I5@\n"
+           "0 @F4@ FAM\n"
+           "1 HUSB @I5@\n"
+           "1 CHIL @I6@\n";
+
+    struct context* cycles = ctx_create(WARNING);
+
+    doc = document_from_text(text, cycles, false, false);
+    g = fg_create(doc, cycles);
+
+    struct kinship* k = kin_compute(g, cycles, 0);
+
+    assert(count_diags(cycles, ERROR) == 4);
+    assert(count_diags(cycles, WARNING) == 1);
+    assert(isnan(k->inbreeding[fg_id(g, "@I3@")]));
+
+    printf("Kinship test: %zu individuals\n", g->len);
+
+    kin_free(k);
+    fg_free(g);
+    ged_document_free(doc);
+    ctx_free(cycles);
+    ctx_free(ctx);
+}
+
+void
+test_names(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NAME Ann /Smith/\n"
+                       "0 @I2@ INDI\n"
+                       "1 NAME Bob /Smyth/\n"
+                       "0 @I3@ INDI\n"
+                       "1 NAME Anna Maria /Schmidt/\n"
+                       "0 @I4@ INDI\n"
+                       "1 NAME Dan /Jones/\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct name_index* names = doc->names;
+    size_t count = 0;
+
+    // case does not matter, every given name is a key of its own
+    assert(nm_prefix(names, NM_SURNAME, "sm", count_visit, &count) == 2);
+    assert(nm_prefix(names, NM_GIVEN, "ANN", NULL, NULL) == 2);
+    assert(nm_prefix(names, NM_GIVEN, "maria", NULL, NULL) == 1);
+    assert(nm_prefix(names, NM_SURNAME, "x", NULL, NULL) == 0);
+
+    // each individual once, though all of them have the same code
+    assert(nm_phonetic(names, NM_SOUNDEX, "Smithe", NULL, NULL) == 3);
+    assert(nm_phonetic(names, NM_DAITCH_MOKOTOFF, "Shmit", NULL, NULL) == 3);
+    assert(nm_phonetic(names, NM_SOUNDEX, "Jonas", NULL, NULL) == 1);
+
+    char soundex[5];
+
+    ph_soundex_str(ph_soundex("Rupert"), soundex);
+    assert(ph_soundex("Robert") == ph_soundex("Rupert"));
+    assert(strcmp(soundex, "R163") == 0);
+
+    printf("Names test: %zu matches\n", count);
+
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+// Remembers the last match
+void
+last_match(struct ged_record* match, struct ged_record* root, void* data)
+{
+    (void)root;
+    *(struct ged_record**)data = match;
+}
+
+void
+test_path_query(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NAME Ann /Williams/\n"
+                       "1 BIRT\n"
+                       "2 DATE 1 JAN 1900\n"
+                       "2 NOTE @N1@\n"
+                       "0 @I2@ INDI\n"
+                       "1 NAME Bob /Smith/\n"
+                       "1 BIRT\n"
+                       "2 DATE 2 FEB 1920\n"
+                       "0 @F1@ FAM\n"
+                       "1 HUSB @I2@\n"
+                       "1 CHIL @I1@\n"
+                       "0 @N1@ NOTE\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct {
+        const char* query;
+        size_t matches;
+    } cases[] = {
+        {"INDI.BIRT.DATE", 2},         {"INDI.*.DATE", 2},
+        {"**.DATE", 2},                {"FAM.CHIL->BIRT.DATE", 1},
+        {"FAM.HUSB->", 1},             {"@I2@.NAME", 1},
+        {"INDI.NAME[~/Williams/]", 1}, {"INDI.BIRT.DATE[^2 ]", 1},
+        {"INDI.BIRT.NOTE->", 1},       {"FAM.WIFE->", 0},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; i++) {
+        struct path_query* query = pq_compile(cases[i].query, ctx);
+
+        assert(query);
+
+        // on the calling thread, then on the shared pool
+        assert(pq_run(query, doc, false, NULL, NULL) == cases[i].matches);
+        assert(pq_run(query, doc, true, NULL, NULL) == cases[i].matches);
+
+        pq_free(query);
+    }
+
+    struct path_query* query = pq_compile("FAM.HUSB->", ctx);
+    struct ged_record* husband = NULL;
+
+    pq_run(query, doc, false, last_match, &husband);
+    assert(husband == ged_document_xref(doc, "@I2@"));
+    pq_free(query);
+
+    assert(!pq_compile("INDI..NAME", ctx) && !pq_compile("INDI.@I1@", ctx));
+
+    printf("Path query test: %zu queries\n", sizeof cases / sizeof *cases);
+
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_relation(void)
+{
+    const char* text = "0 @P1@ INDI\n"
+                       "0 @P2@ INDI\n"
+                       "0 @P3@ INDI\n"
+                       "0 @P4@ INDI\n"
+                       "0 @S1@ INDI\n"
+                       "0 @S2@ INDI\n"
+                       "0 @H@ INDI\n"
+                       "0 @U1@ INDI\n"
+                       "0 @U2@ INDI\n"
+                       "0 @C1@ INDI\n"
+                       "0 @C2@ INDI\n"
+                       "0 @C3@ INDI\n"
+                       "0 @F1@ FAM\n"
+                       "1 HUSB @P1@\n"
+                       "1 WIFE @P2@\n"
+                       "1 CHIL @S1@\n"
+                       "1 CHIL @S2@\n"
+                       "0 @F2@ FAM\n"
+                       "1 HUSB @P1@\n"
+                       "1 WIFE @P3@\n"
+                       "1 CHIL @H@\n"
+                       "0 @F3@ FAM\n"
+                       "1 HUSB @P4@\n"
+                       "1 CHIL @U1@\n"
+                       "1 CHIL @U2@\n"
+                       "0 @F4@ FAM\n"
+                       "1 HUSB @S1@\n"
+                       "1 CHIL @C1@\n"
+                       "0 @F5@ FAM\n"
+                       "1 HUSB @H@\n"
+                       "1 CHIL @C2@\n"
+                       "0 @F6@ FAM\n"
+                       "1 WIFE @S2@\n"
+                       "1 CHIL @C3@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct fam_graph* g = fg_create(doc, ctx);
+    struct rel_engine* e = rel_create(g);
+    struct {
+        const char* a;
+        const char* b;
+        rel_e_kind kind;
+        uint32_t degree;
+        uint32_t removal;
+        rel_e_half half;
+    } cases[] = {
+        {"@S1@", "@S2@", REL_COLLATERAL, 0, 0, REL_FULL},
+        {"@S1@", "@H@", REL_COLLATERAL, 0, 0, REL_HALF},
+        {"@U1@", "@U2@", REL_COLLATERAL, 0, 0, REL_HALF_UNKNOWN},
+        {"@C1@", "@C3@", REL_COLLATERAL, 1, 0, REL_FULL},
+        {"@C1@", "@C2@", REL_COLLATERAL, 1, 0, REL_HALF},
+        {"@C1@", "@S2@", REL_COLLATERAL, 0, 1, REL_FULL},
+        {"@C1@", "@P2@", REL_LINEAL, 0, 2, REL_FULL},
+        {"@C1@", "@U1@", REL_NONE, 0, 0, REL_FULL},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; i++) {
+        struct rel_result r;
+
+        assert(rel_find_xref(e, cases[i].a, cases[i].b, &r) == ST_OK);
+        assert(r.kind == cases[i].kind && r.degree == cases[i].degree);
+        assert(r.removal == cases[i].removal && r.half == cases[i].half);
+    }
+
+    printf("Relation test: %zu pairs\n", sizeof cases / sizeof *cases);
+
+    rel_free(e);
+    fg_free(g);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_family_graph(void)
+{
+    // S1 is linked from both sides, C only from its own INDI record
+    const char* text = "0 @P1@ INDI\n"
+                       "0 @P2@ INDI\n"
+                       "0 @S1@ INDI\n"
+                       "1 FAMC @F1@\n"
+                       "0 @S2@ INDI\n"
+                       "0 @C@ INDI\n"
+                       "1 FAMC @F2@\n"
+                       "0 @F1@ FAM\n"
+                       "1 HUSB @P1@\n"
+                       "1 WIFE @P2@\n"
+                       "1 CHIL @S1@\n"
+                       "1 CHIL @S2@\n"
+                       "0 @F2@ FAM\n"
+                       "1 HUSB @S1@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct fam_graph* g = fg_create(doc, ctx);
+    uint32_t c = fg_id(g, "@C@");
+    uint32_t s1 = fg_id(g, "@S1@");
+    size_t count;
+    struct bitset set;
+
+    assert(g->len == 5 && fg_id(g, "@F1@") == FG_NONE);
+    assert(fg_parents(g, s1, &count) && count == 2);
+    assert(*fg_parents(g, c, &count) == s1 && count == 1);
+    assert(*fg_children(g, s1, &count) == c && count == 1);
+
+    assert(bs_init(&set, g->len) == ST_OK);
+
+    assert(fg_ancestors(g, c, FG_GEN_ALL, &set) == ST_OK);
+    assert(bs_count(&set) == 3 && !bs_test(&set, fg_id(g, "@S2@")));
+    assert(fg_ancestors(g, c, 1, &set) == ST_OK);
+    assert(bs_count(&set) == 1 && bs_test(&set, s1));
+
+    assert(fg_descendants(g, fg_id(g, "@P2@"), FG_GEN_ALL, &set) == ST_OK);
+    assert(bs_count(&set) == 3 && bs_test(&set, c));
+
+    printf("Family graph test: %zu individuals\n", g->len);
+
+    bs_destroy(&set);
+    fg_free(g);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+// Appends the xref of the record holding ev
+void
+event_roots(const struct ev_event* ev, void* data)
+{
+    sbuilder_write(data, ev->root->xref);
+}
+
+void
+test_events(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 BIRT\n"
+                       "2 DATE 1900\n"
+                       "1 DEAT\n"
+                       "2 DATE 15 MAR 1950\n"
+                       "0 @I2@ INDI\n"
+                       "1 BIRT\n"
+                       "2 DATE 12 JUN 1920\n"
+                       "0 @I3@ INDI\n"
+                       "1 BIRT\n"
+                       "2 DATE 1 JAN 1700\n"
+                       "1 DEAT\n"
+                       "2 DATE 1760\n"
+                       "0 @F1@ FAM\n"
+                       "1 MARR\n"
+                       "2 DATE BEF 1945\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct ev_index* index = ev_create(doc);
+    struct sbuilder order = sbuilder_new();
+    int32_t y1900 = date_to_day(CAL_GREGORIAN, 1900, 1, 1);
+    int32_t y1940 = date_to_day(CAL_GREGORIAN, 1940, 1, 1);
+    int32_t y2045 = date_to_day(CAL_GREGORIAN, 2045, 1, 1);
+    int32_t y1750 = date_to_day(CAL_GREGORIAN, 1750, 1, 1);
+
+    // a year overlaps every day in it, events come in order of their dates
+    assert(ev_query(index, "BIRT", INT32_MIN, INT32_MAX, event_roots, &order) ==
+           3);
+    assert(strcmp(sbuilder_to_string(&order), "@I3@@I1@@I2@") == 0);
+    assert(ev_query(index, "BIRT", y1900 + 180, y1900 + 180, NULL, NULL) == 1);
+    assert(ev_query(index, "BIRT", y1900 + 366, y1940, NULL, NULL) == 1);
+    assert(ev_query(index, "MARR", y1900, y1900, NULL, NULL) == 1);
+    assert(ev_query(index, "BURI", INT32_MIN, INT32_MAX, NULL, NULL) == 0);
+
+    // I2 has no death, and is bounded by EV_LIFESPAN_MAX
+    assert(ev_alive(index, y1940, y1940, NULL, NULL) == 2);
+    assert(ev_alive(index, y2045, y2045, NULL, NULL) == 0);
+    assert(ev_alive(index, y1750, y1750, NULL, NULL) == 1);
+
+    printf("Events test: %zu event tags\n", index->len);
+
+    sbuilder_destroy(&order);
+    ev_free(index);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+// Number of records matching query, checked to be the same in copy
+size_t
+ft_count(const struct ft_index* index, const struct ft_index* copy,
+         ft_e_op op, const char* query)
+{
+    uint32_t* a;
+    uint32_t* b;
+    size_t len = ft_search(index, op, query, &a);
+
+    assert(ft_search(copy, op, query, &b) == len);
+    assert(!len || memcmp(a, b, len * sizeof *a) == 0);
+
+    free(a);
+    free(b);
+
+    return len;
+}
+
+void
+test_fulltext(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NOTE The quick brown fox\n"
+                       "2 CONC es jump\n"
+                       "0 @I2@ INDI\n"
+                       "1 NOTE brown dog\n"
+                       "2 CONT quick\n"
+                       "0 @F1@ FAM\n"
+                       "1 NOTE Quick, brown!\n"
+                       "1 HUSB @I1@\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct ft_index* index = ft_create(doc, ctx, 0);
+    FILE* fp = tmpfile();
+
+    assert(index && fp && ft_write(index, fp) == ST_OK);
+    rewind(fp);
+
+    struct ft_index* copy = ft_read(fp);
+
+    assert(copy && copy->nterms == index->nterms);
+
+    // CONC joins words, CONT separates them
+    assert(ft_count(index, copy, FT_AND, "QUICK brown") == 3);
+    assert(ft_count(index, copy, FT_PHRASE, "quick brown") == 2);
+    assert(ft_count(index, copy, FT_PHRASE, "dog quick") == 1);
+    assert(ft_count(index, copy, FT_OR, "jump dog") == 2);
+    assert(ft_count(index, copy, FT_AND, "foxes") == 1);
+    assert(ft_count(index, copy, FT_AND, "fox") == 0);
+
+    // pointers are no words
+    assert(ft_count(index, copy, FT_OR, "I1") == 0);
+
+    printf("Full-text test: %zu terms\n", index->nterms);
+
+    fclose(fp);
+    ft_free(copy);
+    ft_free(index);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_places(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 BIRT\n"
+                       "2 PLAC Oslo, Oslo, Norway\n"
+                       "1 RESI\n"
+                       "2 PLAC Bergen ,Vestland,  Norway\n"
+                       "0 @I2@ INDI\n"
+                       "1 BIRT\n"
+                       "2 PLAC Oslo, Oslo, Norway\n"
+                       "1 DEAT\n"
+                       "2 PLAC Norway\n"
+                       "0 @F1@ FAM\n"
+                       "1 MARR\n"
+                       "2 PLAC Stockholm, Sweden\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+    struct place_index* index = pl_create(doc);
+    uint32_t norway = pl_find(index, "Norway");
+    uint32_t oslo = pl_find(index, "Oslo, Oslo, Norway");
+    size_t count;
+    char name[64];
+
+    // components are interned, Oslo once for both levels
+    assert(index->nnames == 6);
+    assert(norway != PL_NONE && oslo != PL_NONE);
+    assert(index->nodes[oslo].depth == 3 && index->nodes[norway].depth == 1);
+    assert(pl_find(index, "Vestland, Norway") != PL_NONE);
+    assert(pl_find(index, "Oslo") == PL_NONE);
+
+    // the subtree of Norway holds every event in it
+    assert(pl_refs(index, norway, false, &count) && count == 1);
+    assert(pl_refs(index, norway, true, &count) && count == 4);
+    assert(pl_refs(index, oslo, false, &count)[1].root ==
+           ged_document_xref(doc, "@I2@"));
+
+    assert(pl_name(index, oslo, name, sizeof name) == 18);
+    assert(strcmp(name, "Oslo, Oslo, Norway") == 0);
+    assert(pl_name(index, oslo, name, 5) == 18 && strcmp(name, "Oslo") == 0);
+
+    printf("Places test: %zu places\n", index->len - 1);
+
+    pl_free(index);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+// Appends the change and key of a differing record
+void
+merkle_change(mk_e_change change, const char* key, struct ged_record* a,
+              struct ged_record* b, void* data)
+{
+    (void)a;
+    (void)b;
+    sbuilder_writef(data, "%c%s ", "ARC"[change], key);
+}
+
+// Adds up the records of each group
+void
+merkle_group(const size_t* records, size_t len, void* data)
+{
+    (void)records;
+    *(size_t*)data += len;
+}
+
+void
+test_merkle(void)
+{
+    const char* before = "0 HEAD\n"
+                         "0 @I1@ INDI\n"
+                         "1 NAME Ann\n"
+                         "1 SEX F\n"
+                         "1 CHAN\n"
+                         "2 DATE 1 JAN 2000\n"
+                         "0 @I2@ INDI\n"
+                         "1 NAME Bob\n"
+                         "0 @I3@ INDI\n"
+                         "1 NAME Ann\n"
+                         "1 SEX F\n";
+    const char* after = "0 HEAD\n"
+                        "0 @I1@ INDI\n"
+                        "1 SEX F\n"
+                        "1 NAME Ann\n"
+                        "1 CHAN\n"
+                        "2 DATE 2 JAN 2001\n"
+                        "0 @I2@ INDI\n"
+                        "1 NAME Bobby\n"
+                        "0 @I4@ INDI\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    struct ged_document* a = document_from_text(before, ctx, false, false);
+    struct ged_document* b = document_from_text(after, ctx, false, false);
+    int flags = MK_UNORDERED | MK_IGNORE_CHAN;
+    struct mk_index* ia = mk_create(a, flags, true);
+    struct mk_index* ib = mk_create(b, flags, false);
+    struct sbuilder changes = sbuilder_new();
+
+    // I1 only differs in the order of its children and its CHAN date
+    assert(mk_diff(ia, ib, merkle_change, &changes) == 3);
+    assert(strcmp(sbuilder_to_string(&changes), "C@I2@ R@I3@ A@I4@ ") == 0);
+    assert(ia->hashes[1] == mk_hash(pa_get(a->records, 1), flags));
+
+    mk_free(ia);
+    mk_free(ib);
+
+    size_t duplicates = 0;
+
+    ia = mk_create(a, 0, false);
+    ib = mk_create(b, 0, true);
+    assert(mk_diff(ia, ib, merkle_change, &changes) == 4);
+    assert(mk_duplicates(ia, merkle_group, &duplicates) == 0);
+    mk_free(ia);
+
+    // I1 and I3 are the same individual
+    ia = mk_create(a, flags | MK_IGNORE_XREF, true);
+    assert(mk_duplicates(ia, merkle_group, &duplicates) == 1);
+    assert(duplicates == 2);
+
+    printf("Merkle test: %zu records\n", ia->len);
+
+    sbuilder_destroy(&changes);
+    mk_free(ia);
+    mk_free(ib);
+    ged_document_free(a);
+    ged_document_free(b);
+    ctx_free(ctx);
+}
+
+struct pool_test {
+    struct tp_pool* pool; // to nest a loop on, NULL in the nested one
+    atomic_int* hits;
+    atomic_size_t tasks;
+};
+
+// Marks every index, and runs a nested loop on the same pool
+void
+pool_range(size_t begin, size_t end, void* data)
+{
+    struct pool_test* t = data;
+
+    for (size_t i = begin; i < end; i++) {
+        atomic_fetch_add(&t->hits[i], 1);
+    }
+
+    // the nested loop has no pool, and nests no further
+    if (begin == 0 && t->pool) {
+        struct pool_test inner = {.pool = NULL, .hits = t->hits + 5000};
+
+        tp_for(t->pool, 1000, 3, pool_range, &inner);
+    }
+}
+
+void
+pool_task(void* arg)
+{
+    atomic_fetch_add(&((struct pool_test*)arg)->tasks, 1);
+}
+
+void
+test_pool(void)
+{
+    for (size_t nthreads = 1; nthreads <= 4; nthreads += 3) {
+        struct tp_pool* pool = tp_create(nthreads);
+        atomic_int* hits = calloc(6000, sizeof *hits);
+        struct pool_test t = {.pool = pool, .hits = hits};
+        struct tp_group group;
+
+        assert(pool && hits && tp_size(pool) == nthreads);
+
+        // every index once, the nested loop adds the second 1000
+        tp_for(pool, 5000, 7, pool_range, &t);
+
+        for (size_t i = 0; i < 6000; i++) {
+            assert(atomic_load(&hits[i]) == 1);
+        }
+
+        atomic_init(&t.tasks, 0);
+        tp_group_init(&group);
+
+        for (int i = 0; i < 100; i++) {
+            tp_spawn(pool, &group, pool_task, &t);
+        }
+
+        tp_wait(pool, &group);
+        assert(atomic_load(&t.tasks) == 100);
+
+        free(hits);
+        tp_free(pool);
+    }
+
+    printf("Pool test: 1 and 4 threads\n");
+}
+
+void
+test_lazy_diagnostics(void)
+{
+    struct context* ctx = ctx_create(WARNING);
+    char xref[16] = "@I1@";
+
+    // filtered out before anything is copied
+    ctx_diag(ctx, DEBUG, CTX_C_XREF_REDEFINED, xref);
+    assert(ctx->len == 0 && ctx->strings_len == 0);
+
+    ctx_push(ctx, posctx_create("lexer"));
+    ctx_diag(ctx, ERROR, CTX_C_XREF_REDEFINED, xref);
+    ctx_diag(ctx, WARNING, CTX_C_LEVEL_JUMP, 1, 2, 4);
+
+    // string arguments are copied, the stack is shared until it changes
+    strcpy(xref, "@I2@");
+    assert(ctx->len == 2 && ctx->diags[0].trace == ctx->diags[1].trace);
+
+    ctx_push(ctx, posctx_create("parser"));
+    ctx_errf(ctx, "%d lines", 3);
+    assert(ctx->diags[2].trace != ctx->diags[1].trace);
+    assert(ctx->diags[2].code == CTX_C_MESSAGE);
+
+    char* messages[3];
+
+    for (size_t i = 0; i < 3; i++) {
+        messages[i] = ctx_diag_message(ctx, &ctx->diags[i]);
+    }
+
+    assert(strcmp(messages[0], "xref @I1@ already defined") == 0);
+    assert(strcmp(messages[1], "invalid line level (should be 1, 2, is 4)") ==
+           0);
+    assert(strcmp(messages[2], "3 lines") == 0);
+
+    printf("Lazy diagnostics test: %zu diagnostics\n", ctx->len);
+
+    for (size_t i = 0; i < 3; i++) {
+        free(messages[i]);
+    }
+
+    ctx_free(ctx);
+}
+
+void
+test_sinks(void)
+{
+    struct context* ctx = ctx_create(WARNING);
+    struct ctx_ring_sink ring;
+
+    ctx_push(ctx, posctx_create("parser"));
+
+    // the ring keeps the last messages, the context none of them
+    assert(ctx_ring_sink_init(&ring, 2) == ST_OK);
+    ctx_set_sink(ctx, ctx_ring_sink, &ring);
+
+    for (int i = 0; i < 5; i++) {
+        ctx_warnf(ctx, "message %d", i);
+    }
+
+    assert(ctx->len == 0 && ring.len == 2 && ring.dropped == 3);
+    assert(strstr(ctx_ring_sink_get(&ring, 0), "message 3"));
+    assert(strstr(ctx_ring_sink_get(&ring, 1), "message 4"));
+
+    // a document built with a sink counts by code
+    struct ctx_count_sink counts;
+    const char* text = "0 @I1@ INDI\n"
+                       "0 @I1@ INDI\n"
+                       "0 @I1@ FAM\n"
+                       "1 HUSB @I9@\n";
+
+    ctx_count_sink_init(&counts);
+    ctx_set_sink(ctx, ctx_count_sink, &counts);
+
+    struct ged_document* doc = document_from_text(text, ctx, false, false);
+
+    assert(counts.counts[CTX_C_XREF_REDEFINED] == 2);
+    assert(counts.counts[CTX_C_XREF_UNDEFINED] == 1);
+    assert(strstr(counts.samples[CTX_C_XREF_UNDEFINED][0], "@I9@"));
+
+    // the stream writes whole lines once its buffer is flushed
+    struct ctx_stream_sink stream;
+    FILE* fp = tmpfile();
+    char line[256];
+    size_t lines = 0;
+
+    assert(fp);
+    ctx_stream_sink_init(&stream, fp);
+    ctx_set_sink(ctx, ctx_stream_sink, &stream);
+    ctx_errf(ctx, "first");
+    ctx_errf(ctx, "second");
+    ctx_stream_sink_flush(&stream);
+    rewind(fp);
+
+    while (fgets(line, sizeof line, fp)) {
+        lines += strstr(line, "first") || strstr(line, "second");
+    }
+
+    assert(lines == 2);
+
+    // and without a sink, diagnostics are kept again
+    ctx_set_sink(ctx, NULL, NULL);
+    ctx_errf(ctx, "kept");
+    assert(ctx->len == 1);
+
+    ctx_pop(ctx);
+    printf("Sinks test: %zu messages dropped\n", ring.dropped);
+
+    fclose(fp);
+    ctx_count_sink_destroy(&counts);
+    ctx_ring_sink_destroy(&ring);
+    ged_document_free(doc);
+    ctx_free(ctx);
+}
+
+void
+test_position_tracking(void)
+{
+    struct context* ctx = ctx_create(WARNING);
+    size_t line = 1;
+    size_t col = 1;
+
+    // a tracked state reads the position when a diagnostic is logged
+    ctx_push(ctx, posctx_create("parser"));
+    ctx_track(ctx, &line, &col);
+    ctx_warnf(ctx, "first");
+    line = 7;
+    col = 3;
+    ctx_warnf(ctx, "second");
+    ctx_pop(ctx);
+
+    assert(ctx->len == 2);
+    assert(ctx->diags[0].line == 1 && ctx->diags[0].col == 1);
+    assert(ctx->diags[1].line == 7 && ctx->diags[1].col == 3);
+
+    // the lexer reports the token an unexpected character is in
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NA\x01ME Ann\n";
+    struct context* lexed = ctx_create(WARNING);
+    struct ged_document* doc = document_from_text(text, lexed, false, false);
+    const struct ctx_diag* diag = NULL;
+
+    for (size_t i = 0; i < lexed->len; i++) {
+        if (lexed->diags[i].code == CTX_C_CHAR_UNEXPECTED) {
+            diag = &lexed->diags[i];
+        }
+    }
+
+    // "NA" starts at the third column of the second line
+    assert(diag && diag->line == 2 && diag->col == 3);
+
+    printf("Position tracking test: line %zu, col %zu\n", diag->line,
+           diag->col);
+
+    ged_document_free(doc);
+    ctx_free(lexed);
+    ctx_free(ctx);
+}
+
+void
+test_small_array(void)
+{
+    struct small_arr sa;
+    int items[10];
+
+    sa_init(&sa);
+    assert(sa_len(&sa) == 0 && !sa_get(&sa, 0) && !sa_back(&sa));
+
+    // the first SA_INLINE items stay in the struct
+    for (int i = 0; i < SA_INLINE; i++) {
+        assert(sa_push(&sa, &items[i]) == ST_OK);
+    }
+
+    assert(sa_is_inline(&sa) && sa_items(&sa) == sa.mem.slots);
+
+    // the next one moves all of them to the heap, in order
+    for (int i = SA_INLINE; i < 10; i++) {
+        assert(sa_push(&sa, &items[i]) == ST_OK);
+    }
+
+    assert(!sa_is_inline(&sa) && sa_len(&sa) == 10);
+
+    for (size_t i = 0; i < 10; i++) {
+        assert(sa_get(&sa, i) == &items[i]);
+    }
+
+    assert(sa_back(&sa) == &items[9] && !sa_get(&sa, 10));
+
+    // reserving on an empty array skips the inline slots
+    struct small_arr reserved;
+
+    sa_init(&reserved);
+    assert(sa_reserve(&reserved, 5) == ST_OK && reserved.cap >= 5);
+    assert(sa_push(&reserved, &items[0]) == ST_OK);
+    assert(sa_get(&reserved, 0) == &items[0]);
+
+    printf("Small array test: %zu items\n", sa_len(&sa));
+
+    sa_destroy(&reserved);
+    sa_destroy(&sa);
+}
+
+void
+test_string_builder(void)
+{
+    struct sbuilder builder;
+    char long_name[300];
+
+    assert(sbuilder_init(&builder, 4) == 0);
+    assert(strcmp(sbuilder_to_string(&builder), "") == 0);
+
+    // formatting past the capacity grows the builder and formats again
+    memset(long_name, 'x', sizeof long_name - 1);
+    long_name[sizeof long_name - 1] = '\0';
+    sbuilder_write(&builder, "0 ");
+    sbuilder_writef(&builder, "@%s@", long_name);
+    sbuilder_write_char(&builder, '!');
+
+    assert(builder.len == 2 + 2 + strlen(long_name) + 1);
+    assert(strlen(sbuilder_to_string(&builder)) == builder.len);
+    assert(strncmp(sbuilder_to_string(&builder), "0 @xxx", 6) == 0);
+    assert(sbuilder_back(&builder) == '!');
+
+    // clear copies the contents out and keeps the memory
+    char* copy = sbuilder_clear(&builder);
+    size_t cap = builder.cap;
+
+    assert(copy && strlen(copy) == 2 + 2 + strlen(long_name) + 1);
+    assert(builder.len == 0 && builder.cap == cap);
+    assert(strcmp(sbuilder_to_string(&builder), "") == 0);
+
+    // after a reset short writes stay terminated
+    sbuilder_writef(&builder, "%d %s", 1, "NAME");
+    sbuilder_reset(&builder);
+    sbuilder_write(&builder, "ab");
+    assert(strcmp(sbuilder_to_string(&builder), "ab") == 0);
+
+    // take hands the buffer over as it is
+    size_t len = 0;
+    const char* mem = builder.mem;
+    char* taken = sbuilder_take(&builder, &len);
+
+    assert(taken == mem && len == 2 && strcmp(taken, "ab") == 0);
+
+    printf("String builder test: %zu characters\n", strlen(copy));
+
+    free(taken);
+    free(copy);
+}
+
+void
+test_short_lexemes(void)
+{
+    const char* text = "0 @I1@ INDI\n"
+                       "1 NOTE Supercalifragilisticexpialidocious\n";
+
+    struct context* ctx = ctx_create(WARNING);
+    ctx_push(ctx, posctx_create("lexer"));
+
+    struct lex_lexer* lexer = lex_create(ctx);
+    size_t inline_count = 0;
+    size_t heap_count = 0;
+    struct lex_token* note = NULL;
+
+    assert(lexer);
+
+    for (const char* c = text; *c; c++) {
+        lex_feed(lexer, *c);
+    }
+    lex_feed(lexer, EOF);
+
+    // lexemes shorter than LEX_SHORT_LEXEME are kept in the token
+    for (struct lex_token* tok = lexer->token_first; tok; tok = tok->next) {
+        if (!tok->lexeme) {
+            continue;
+        }
+
+        bool fits = strlen(tok->lexeme) < LEX_SHORT_LEXEME;
+
+        assert((tok->lexeme == tok->short_lexeme) == fits);
+        inline_count += fits;
+        heap_count += !fits;
+
+        if (!fits) {
+            note = tok;
+        }
+    }
+
+    assert(ctx_continue(ctx) && note && heap_count == 1);
+
+    // a copy points into its own storage
+    struct lex_token* first = lex_token_copy(lexer->token_first);
+    struct lex_token* long_copy = lex_token_copy(note);
+
+    assert(first->lexeme == first->short_lexeme && !first->next);
+    assert(strcmp(first->lexeme, lexer->token_first->lexeme) == 0);
+    assert(long_copy->lexeme != note->lexeme &&
+           long_copy->lexeme != long_copy->short_lexeme);
+    assert(strcmp(long_copy->lexeme, note->lexeme) == 0);
+
+    // exactly LEX_SHORT_LEXEME - 1 characters still fit
+    struct lex_token* edge = lex_token_copy(lexer->token_first);
+
+    edge->lexeme = NULL;
+    assert(lex_token_set_lexeme(edge, note->lexeme, LEX_SHORT_LEXEME - 1) ==
+           ST_OK);
+    assert(edge->lexeme == edge->short_lexeme);
+    assert(strlen(edge->lexeme) == LEX_SHORT_LEXEME - 1);
+
+    printf("Short lexemes test: %zu inline, %zu on the heap\n", inline_count,
+           heap_count);
+
+    lex_token_free(edge);
+    lex_token_free(long_copy);
+    lex_token_free(first);
+    lex_free(lexer);
+    ctx_pop(ctx);
+    ctx_free(ctx);
+}
+
 size_t
 print_errors(struct context* ctx)
 {
@@ -154,6 +1747,30 @@ main(int argc, char** argv)
 {
     test_dynarray();
     test_hashtable();
+    test_incremental();
+    test_dates();
+    test_parallel_builder();
+    test_recovery();
+    test_writer();
+    test_critical_position();
+    test_snapshot();
+    test_backrefs();
+    test_kinship();
+    test_names();
+    test_path_query();
+    test_relation();
+    test_family_graph();
+    test_events();
+    test_fulltext();
+    test_places();
+    test_merkle();
+    test_pool();
+    test_lazy_diagnostics();
+    test_sinks();
+    test_position_tracking();
+    test_small_array();
+    test_string_builder();
+    test_short_lexemes();
 
 #if 1
     from_example("/home/sig/Documents/development/projects/angel-of-death/"
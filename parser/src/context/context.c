@@ -1,11 +1,36 @@
-
 #include "context/context.h"
 #include "utils/stringbuilder.h"
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#define DEFAULT_DIAGS_CAP 16
+#define DEFAULT_STRINGS_CAP 256
+
+static const char* const code_formats[CTX_C_LEN] = {
+    [CTX_C_MESSAGE] = "%s",
+    [CTX_C_XREF_REDEFINED] = "xref %s already defined",
+    [CTX_C_XREF_UNDEFINED] = "xref %s is referenced, but never defined",
+    [CTX_C_LEVEL_LEADING_ZERO] =
+        "gedcom standard disallows leading 0 on level declarations (%s)",
+    [CTX_C_LEVEL_INVALID] = "unable to parse %s as level",
+    [CTX_C_LEVEL_JUMP] = "invalid line level (should be %d, %d, is %d)",
+    [CTX_C_RECORD_SKIPPED] = "skipping record level %d",
+    [CTX_C_RECORD_FAILED] = "unable to create record for line %zu",
+    [CTX_C_DATE_TOO_LONG] = "date value too long",
+    [CTX_C_DATE_INVALID] = "unable to parse date \"%s\"",
+    [CTX_C_MONTH_INVALID] = "%s got invalid month %s",
+    [CTX_C_POINTER_UNKNOWN] = "%s %s does not point to a known %s",
+    [CTX_C_OWN_PARENT] = "individual %s is listed as their own parent",
+    [CTX_C_CHAR_UNEXPECTED] =
+        "unexpected character '%c' encountered (at line %zu, column %zu)",
+    [CTX_C_TOKEN_UNEXPECTED] = "unexpected type %d",
+    [CTX_C_TEXT_SKIPPED] = "invalid text (%zu characters), skipped %zu lines",
+    [CTX_C_LINES_SKIPPED] = "syntax error, skipped %zu lines",
+};
+
 static struct ctx_state*
 stack_get_state(ptr_arr stack, size_t index)
 {
@@ -69,110 +94,338 @@ stack_trace(ptr_arr stack)
     return sbuilder_term(&builder);
 }
 
+// Position of the innermost state that has one
+static void
+stack_position(ptr_arr stack, size_t* line, size_t* col)
+{
+    *line = 0;
+    *col = 0;
+
+    for (size_t i = pa_len(stack); i > 0; i--) {
+        struct ctx_state* state = stack_get_state(stack, i - 1);
+
+        if (state->interface->position) {
+            state->interface->position(state, line, col);
+
+            return;
+        }
+    }
+}
+
+// Moves the tracked state to the position of its stage
+static void
+track_update(struct context* ctx)
+{
+    struct ctx_state* state = stack_get_state(ctx->stack, ctx->track_depth - 1);
+    size_t line, col;
+
+    state->interface->position(state, &line, &col);
+
+    if (line != *ctx->track_line || col != *ctx->track_col) {
+        state->interface->set_position(state, *ctx->track_line,
+                                       *ctx->track_col);
+        ctx_touch(ctx);
+    }
+}
+
+/* === Traces === */
+
+static void
+trace_release(struct ctx_trace* trace)
+{
+    if (trace && !--trace->refs) {
+        stack_free(trace->stack);
+        free(trace);
+    }
+}
+
+// Copy of the stack of ctx, copied again only after the stack changed
+static struct ctx_trace*
+trace_get(struct context* ctx)
+{
+    if (!ctx->trace) {
+        struct ctx_trace* trace = malloc(sizeof *trace);
+
+        if (!trace) {
+            return NULL;
+        }
+
+        trace->refs = 1;
+        trace->stack = stack_copy(ctx->stack);
+        ctx->trace = trace;
+    }
+
+    ctx->trace->refs++;
+
+    return ctx->trace;
+}
+
+/* === Arguments === */
+
+// Kinds of the arguments format takes: 's' for strings, 'd' for ints, 'u' for
+// size_t and 'c' for chars
+static size_t
+format_kinds(const char* format, char* kinds)
+{
+    size_t len = 0;
+
+    for (const char* p = format; *p && len < CTX_DIAG_ARGS; p++) {
+        if (*p != '%' || *++p == '%') {
+            continue;
+        }
+
+        if (*p == 'z') {
+            p++;
+        }
+
+        kinds[len++] = *p == 'u' ? 'u' : *p;
+    }
+
+    return len;
+}
+
+// Reserves size bytes at the end of the strings of ctx
 static e_statuscode
-log_add(struct context* ctx, ctx_e_loglevel level, const char* message)
+strings_reserve(struct context* ctx, size_t size, size_t* offset)
+{
+    if (ctx->strings_len + size > ctx->strings_cap) {
+        size_t cap = ctx->strings_cap ? ctx->strings_cap : DEFAULT_STRINGS_CAP;
+
+        while (cap < ctx->strings_len + size) {
+            cap *= 2;
+        }
+
+        char* grown = realloc(ctx->strings, cap);
+
+        if (!grown) {
+            return ST_MALLOC_ERROR;
+        }
+
+        ctx->strings = grown;
+        ctx->strings_cap = cap;
+    }
+
+    *offset = ctx->strings_len;
+    ctx->strings_len += size;
+
+    return ST_OK;
+}
+
+static e_statuscode
+strings_add(struct context* ctx, const char* string, size_t* offset)
+{
+    size_t len = strlen(string);
+    e_statuscode result = strings_reserve(ctx, len + 1, offset);
+
+    if (result == ST_OK) {
+        memcpy(ctx->strings + *offset, string, len + 1);
+    }
+
+    return result;
+}
+
+static void
+args_read(struct context* ctx, struct ctx_diag* diag, va_list args)
+{
+    char kinds[CTX_DIAG_ARGS];
+    size_t len = format_kinds(code_formats[diag->code], kinds);
+
+    for (size_t i = 0; i < len; i++) {
+        switch (kinds[i]) {
+        case 's': {
+            const char* string = va_arg(args, const char*);
+
+            if (!string) {
+                string = "(null)";
+            }
+
+            if (strings_add(ctx, string, &diag->args[i].str) != ST_OK) {
+                // out of memory, the argument is left out
+                diag->args[i].str = SIZE_MAX;
+            }
+
+            break;
+        }
+        case 'u':
+            diag->args[i].i = (long long)va_arg(args, size_t);
+            break;
+        default:
+            diag->args[i].i = va_arg(args, int);
+        }
+    }
+}
+
+/* === Diagnostics === */
+
+// Appends a diagnostic without arguments at the current position and stack,
+// or returns NULL if it is filtered out
+static struct ctx_diag*
+diag_add(struct context* ctx, ctx_e_loglevel level, ctx_e_code code)
 {
     if (level == CRITICAL) {
-        ctx->can_continue = false;
+        for (struct context* c = ctx; c; c = c->parent) {
+            atomic_store(&c->can_continue, false);
+
+            size_t first = atomic_load(&c->critical_position);
+
+            while (ctx->position < first &&
+                   !atomic_compare_exchange_weak(&c->critical_position, &first,
+                                                 ctx->position)) {
+            }
+        }
     }
 
     if (level < ctx->log_level) {
-        return ST_NOT_OK;
+        return NULL;
     }
 
-    struct ctx_state* state = ctx_state(ctx);
-
-    if (!state) {
+    if (!pa_len(ctx->stack)) {
         assert(false /* attempted to add log before state initialized */);
 
-        return ST_GEN_ERROR;
+        return NULL;
     }
 
-    struct ctx_log_message* msg = malloc(sizeof *msg);
+    if (ctx->len == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : DEFAULT_DIAGS_CAP;
+        struct ctx_diag* grown = realloc(ctx->diags, cap * sizeof *grown);
 
-    if (!msg) {
-        assert(false);
+        if (!grown) {
+            assert(false);
 
-        return ST_MALLOC_ERROR;
+            return NULL;
+        }
+
+        ctx->diags = grown;
+        ctx->cap = cap;
     }
 
-    msg->level = level;
-    msg->message = strdup(message);
-    msg->stack = stack_copy(ctx->stack);
+    if (ctx->track_line) {
+        track_update(ctx);
+    }
 
-    pa_push(ctx->log, msg);
+    struct ctx_diag* diag = &ctx->diags[ctx->len++];
 
-    return ST_OK;
+    diag->code = code;
+    diag->level = level;
+    diag->position = ctx->position;
+    diag->trace = trace_get(ctx);
+    stack_position(ctx->stack, &diag->line, &diag->col);
+
+    return diag;
 }
 
+// Hands the last diagnostic of ctx to its sink, if it has one, and drops it.
+// Its strings start at mark
 static void
-log_destroy(struct ctx_log_message* log)
+diag_emit(struct context* ctx, size_t mark)
 {
-    free(log->message);
-    stack_free(log->stack);
+    if (!ctx->sink) {
+        return;
+    }
+
+    struct ctx_diag* diag = &ctx->diags[ctx->len - 1];
+
+    ctx->sink(ctx, diag, ctx->sink_data);
 
-    free(log);
+    trace_release(diag->trace);
+    ctx->len--;
+    ctx->strings_len = mark;
+}
+
+static e_statuscode
+log_add(struct context* ctx, ctx_e_loglevel level, const char* message)
+{
+    return ctx_diag(ctx, level, CTX_C_MESSAGE, message);
 }
 
 static e_statuscode
 log_vaddf(struct context* ctx, ctx_e_loglevel level, const char* format,
           va_list args)
 {
-    struct sbuilder builder;
+    size_t mark = ctx->strings_len;
+    struct ctx_diag* diag = diag_add(ctx, level, CTX_C_MESSAGE);
 
-    if (sbuilder_init(&builder, 500) != ST_OK) {
-        assert(false /* sbuilder init failed in ctx_verrf */);
-
-        return ST_GEN_ERROR;
+    if (!diag) {
+        return ST_NOT_OK;
     }
 
-    sbuilder_vwritef(&builder, format, args);
-    char* string = sbuilder_term(&builder);
+    // formatted straight into the strings of ctx
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
 
-    e_statuscode result = log_add(ctx, level, string);
+    if (len < 0 ||
+        strings_reserve(ctx, len + 1, &diag->args[0].str) != ST_OK) {
+        ctx->len--;
+        trace_release(diag->trace);
 
-    free(string);
+        return ST_MALLOC_ERROR;
+    }
 
-    return result;
+    vsnprintf(ctx->strings + diag->args[0].str, len + 1, format, args);
+    diag_emit(ctx, mark);
+
+    return ST_OK;
 }
 
-static char*
-log_to_string(struct ctx_log_message* log)
+static const char*
+level_name(ctx_e_loglevel level)
 {
-    struct sbuilder builder = sbuilder_new();
-
-    char* trace = stack_trace(log->stack);
-    sbuilder_write(&builder, trace);
-    free(trace);
-
-    sbuilder_write(&builder, "\t<");
-
-    switch (log->level) {
+    switch (level) {
     case DEBUG:
-        sbuilder_write(&builder, "DEBUG");
-        break;
+        return "DEBUG";
     case INFO:
-        sbuilder_write(&builder, "INFO");
-        break;
+        return "INFO";
     case WARNING:
-        sbuilder_write(&builder, "WARNING");
-        break;
+        return "WARNING";
     case ERROR:
-        sbuilder_write(&builder, "ERROR");
-        break;
+        return "ERROR";
     case CRITICAL:
-        sbuilder_write(&builder, "CRITICAL");
-        break;
+        return "CRITICAL";
     default: {
         assert(false);
 
-        sbuilder_write(&builder, "UNKNOWN");
+        return "UNKNOWN";
     }
     }
+}
 
-    sbuilder_writef(&builder, ">: %s", log->message);
+static void
+diag_write_message(struct sbuilder* builder, const struct context* ctx,
+                   const struct ctx_diag* diag)
+{
+    size_t arg = 0;
 
-    return sbuilder_term(&builder);
+    for (const char* p = code_formats[diag->code]; *p; p++) {
+        if (*p != '%' || arg == CTX_DIAG_ARGS) {
+            sbuilder_write_char(builder, *p);
+            continue;
+        }
+
+        const union ctx_arg* value = &diag->args[arg];
+
+        switch (*++p) {
+        case '%':
+            sbuilder_write_char(builder, '%');
+            continue;
+        case 's':
+            if (value->str != SIZE_MAX) {
+                sbuilder_write(builder, ctx->strings + value->str);
+            }
+            break;
+        case 'c':
+            sbuilder_write_char(builder, (char)value->i);
+            break;
+        case 'z':
+            p++;
+            // fallthrough
+        default:
+            sbuilder_writef(builder, "%lld", value->i);
+        }
+
+        arg++;
+    }
 }
 
 struct ctx_state*
@@ -206,19 +459,19 @@ ctx_state_destroy(struct ctx_state* state)
 struct context*
 ctx_create(ctx_e_loglevel log_level)
 {
-    struct context* ctx = malloc(sizeof *ctx);
+    struct context* ctx = calloc(1, sizeof *ctx);
 
     if (!ctx) {
         assert(false /* context init failed */);
         return NULL;
     }
 
-    ctx->can_continue = true;
+    atomic_init(&ctx->can_continue, true);
+    atomic_init(&ctx->critical_position, SIZE_MAX);
     ctx->log_level = log_level;
     ctx->stack = pa_create(100);
-    ctx->log = pa_create(10);
 
-    if (!(ctx->log && ctx->stack)) {
+    if (!ctx->stack) {
         assert(false /* ctx members initialization failed */);
         ctx_free(ctx);
 
@@ -235,18 +488,14 @@ ctx_free(struct context* ctx)
         return;
     }
 
-    if (ctx->log) {
-        for (size_t i = 0; i < pa_len(ctx->log); i++) {
-            struct ctx_log_message* log = pa_get(ctx->log, i);
-
-            assert(log);
-
-            log_destroy(log);
-        }
-
-        pa_free(ctx->log);
+    for (size_t i = 0; i < ctx->len; i++) {
+        trace_release(ctx->diags[i].trace);
     }
 
+    free(ctx->diags);
+    free(ctx->strings);
+    trace_release(ctx->trace);
+
     if (ctx->stack) {
         stack_free(ctx->stack);
     }
@@ -257,12 +506,182 @@ ctx_free(struct context* ctx)
 bool
 ctx_continue(struct context* ctx)
 {
-    return ctx->can_continue;
+    for (struct context* c = ctx; c; c = c->parent) {
+        if (!atomic_load(&c->can_continue)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+ctx_continue_at(struct context* ctx, size_t position)
+{
+    for (struct context* c = ctx; c; c = c->parent) {
+        if (atomic_load(&c->critical_position) < position) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct context*
+ctx_fork(struct context* parent)
+{
+    struct context* ctx = ctx_create(parent->log_level);
+
+    if (!ctx) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < pa_len(parent->stack); i++) {
+        struct ctx_state* state = stack_get_state(parent->stack, i);
+
+        pa_push(ctx->stack, state->interface->copy(state));
+    }
+
+    ctx->position = parent->position;
+    ctx->parent = parent;
+
+    return ctx;
+}
+
+// qsort is not stable, diagnostics are sorted with their child and index
+struct joined {
+    const struct ctx_diag* diag;
+    size_t child;
+    size_t index;
+};
+
+static int
+joined_cmp(const void* a, const void* b)
+{
+    const struct joined* x = a;
+    const struct joined* y = b;
+
+    if (x->diag->position != y->diag->position) {
+        return x->diag->position > y->diag->position ? 1 : -1;
+    }
+
+    if (x->child != y->child) {
+        return x->child > y->child ? 1 : -1;
+    }
+
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Appends diag of from to ctx, with its strings
+static e_statuscode
+diag_move(struct context* ctx, const struct context* from,
+          const struct ctx_diag* diag)
+{
+    if (ctx->len == ctx->cap) {
+        size_t cap = ctx->cap ? ctx->cap * 2 : DEFAULT_DIAGS_CAP;
+        struct ctx_diag* grown = realloc(ctx->diags, cap * sizeof *grown);
+
+        if (!grown) {
+            return ST_MALLOC_ERROR;
+        }
+
+        ctx->diags = grown;
+        ctx->cap = cap;
+    }
+
+    struct ctx_diag* moved = &ctx->diags[ctx->len++];
+    char kinds[CTX_DIAG_ARGS];
+    size_t len = format_kinds(code_formats[diag->code], kinds);
+
+    *moved = *diag;
+
+    for (size_t i = 0; i < len; i++) {
+        if (kinds[i] != 's' || diag->args[i].str == SIZE_MAX) {
+            continue;
+        }
+
+        if (strings_add(ctx, from->strings + diag->args[i].str,
+                        &moved->args[i].str) != ST_OK) {
+            moved->args[i].str = SIZE_MAX;
+        }
+    }
+
+    return ST_OK;
+}
+
+e_statuscode
+ctx_join(struct context* ctx, struct context** children, size_t len)
+{
+    size_t total = 0;
+    size_t stop = SIZE_MAX; // position of the first critical error
+
+    for (size_t i = 0; i < len; i++) {
+        size_t first = atomic_load(&children[i]->critical_position);
+
+        total += children[i]->len;
+        stop = first < stop ? first : stop;
+    }
+
+    struct joined* diags = malloc((total + 1) * sizeof *diags);
+
+    if (!diags) {
+        return ST_MALLOC_ERROR;
+    }
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        for (size_t d = 0; d < children[i]->len; d++) {
+            diags[count++] = (struct joined){&children[i]->diags[d], i, d};
+        }
+    }
+
+    qsort(diags, count, sizeof *diags, joined_cmp);
+
+    e_statuscode result = ST_OK;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct ctx_diag* diag = diags[i].diag;
+        size_t mark = ctx->strings_len;
+
+        if (diag->position > stop) {
+            trace_release(diag->trace);
+        } else if (diag_move(ctx, children[diags[i].child], diag) != ST_OK) {
+            trace_release(diag->trace);
+            result = ST_MALLOC_ERROR;
+        } else {
+            diag_emit(ctx, mark);
+        }
+    }
+
+    // the traces belong to ctx now
+    for (size_t i = 0; i < len; i++) {
+        children[i]->len = 0;
+    }
+
+    free(diags);
+
+    return result;
+}
+
+void
+ctx_set_sink(struct context* ctx, ctx_sink_fn sink, void* data)
+{
+    ctx->sink = sink;
+    ctx->sink_data = data;
+}
+
+void
+ctx_set_position(struct context* ctx, size_t position)
+{
+    ctx->position = position;
 }
 
 e_statuscode
 ctx_push(struct context* ctx, struct ctx_state* state)
 {
+    ctx_touch(ctx);
+
     return pa_push(ctx->stack, state);
 }
 
@@ -274,10 +693,18 @@ ctx_pop(struct context* ctx)
         return ST_GEN_ERROR;
     }
 
+    ctx_touch(ctx);
+
     struct ctx_state* state = pa_pop(ctx->stack);
 
     ctx_state_destroy(state);
 
+    if (pa_len(ctx->stack) < ctx->track_depth) {
+        ctx->track_line = NULL;
+        ctx->track_col = NULL;
+        ctx->track_depth = 0;
+    }
+
     return ST_OK;
 }
 
@@ -294,10 +721,40 @@ ctx_state(struct context* ctx)
     return state;
 }
 
+void
+ctx_touch(struct context* ctx)
+{
+    if (ctx->trace) {
+        trace_release(ctx->trace);
+        ctx->trace = NULL;
+    }
+}
+
+void
+ctx_track(struct context* ctx, const size_t* line, const size_t* col)
+{
+    // nothing is logged without a state anyway
+    if (!pa_len(ctx->stack)) {
+        return;
+    }
+
+    struct ctx_state* state = ctx_state(ctx);
+
+    if (!state->interface->position || !state->interface->set_position) {
+        assert(false /* state without a position */);
+
+        return;
+    }
+
+    ctx->track_line = line;
+    ctx->track_col = col;
+    ctx->track_depth = pa_len(ctx->stack);
+}
+
 char*
 ctx_log_to_string(struct context* ctx)
 {
-    if (!pa_len(ctx->log)) {
+    if (!ctx->len) {
         return NULL;
     }
 
@@ -309,8 +766,8 @@ ctx_log_to_string(struct context* ctx)
         return NULL;
     }
 
-    for (size_t i = 0; i < pa_len(ctx->log); i++) {
-        char* lstr = log_to_string(pa_get(ctx->log, i));
+    for (size_t i = 0; i < ctx->len; i++) {
+        char* lstr = ctx_diag_to_string(ctx, &ctx->diags[i]);
 
         sbuilder_writef(&builder, "%s\n", lstr);
 
@@ -320,6 +777,69 @@ ctx_log_to_string(struct context* ctx)
     return sbuilder_term(&builder);
 }
 
+e_statuscode
+ctx_diag(struct context* ctx, ctx_e_loglevel level, ctx_e_code code, ...)
+{
+    va_list args;
+    va_start(args, code);
+
+    e_statuscode result = ctx_vdiag(ctx, level, code, args);
+
+    va_end(args);
+
+    return result;
+}
+
+e_statuscode
+ctx_vdiag(struct context* ctx, ctx_e_loglevel level, ctx_e_code code,
+          va_list args)
+{
+    size_t mark = ctx->strings_len;
+    struct ctx_diag* diag = diag_add(ctx, level, code);
+
+    if (!diag) {
+        return ST_NOT_OK;
+    }
+
+    args_read(ctx, diag, args);
+    diag_emit(ctx, mark);
+
+    return ST_OK;
+}
+
+const char*
+ctx_code_format(ctx_e_code code)
+{
+    return code < CTX_C_LEN ? code_formats[code] : NULL;
+}
+
+char*
+ctx_diag_message(const struct context* ctx, const struct ctx_diag* diag)
+{
+    struct sbuilder builder = sbuilder_new();
+
+    diag_write_message(&builder, ctx, diag);
+
+    return sbuilder_term(&builder);
+}
+
+char*
+ctx_diag_to_string(const struct context* ctx, const struct ctx_diag* diag)
+{
+    struct sbuilder builder = sbuilder_new();
+
+    if (diag->trace) {
+        char* trace = stack_trace(diag->trace->stack);
+        sbuilder_write(&builder, trace);
+        free(trace);
+    }
+
+    sbuilder_writef(&builder, "\t<%s>: ", level_name(diag->level));
+    diag_write_message(&builder, ctx, diag);
+
+    return sbuilder_term(&builder);
+}
+
 e_statuscode
 ctx_debug(struct context* ctx, const char* message)
 {
@@ -5,6 +5,7 @@
 #include "utils/ptrarr.h"
 #include "utils/statuscode.h"
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 
 typedef enum { DEBUG = 0, INFO, WARNING, ERROR, CRITICAL, NONE } ctx_e_loglevel;
@@ -15,6 +16,10 @@ struct ctx_state_interface {
     char* (*to_string)(struct ctx_state*);
     void (*free)(struct ctx_state*);
     struct ctx_state* (*copy)(struct ctx_state*);
+
+    // Source position of the state, optional
+    void (*position)(struct ctx_state*, size_t* line, size_t* col);
+    void (*set_position)(struct ctx_state*, size_t line, size_t col);
 };
 
 struct ctx_state {
@@ -22,17 +27,92 @@ struct ctx_state {
     void* const data;
 };
 
-struct ctx_log_message {
-    char* message;
+// Diagnostic codes, each formatted by a printf format of ctx_code_format()
+// taking %s, %d, %zu and %c arguments
+typedef enum {
+    CTX_C_MESSAGE = 0, // formatted by a ctx_*f call
+    CTX_C_XREF_REDEFINED,
+    CTX_C_XREF_UNDEFINED,
+    CTX_C_LEVEL_LEADING_ZERO,
+    CTX_C_LEVEL_INVALID,
+    CTX_C_LEVEL_JUMP,
+    CTX_C_RECORD_SKIPPED,
+    CTX_C_RECORD_FAILED,
+    CTX_C_DATE_TOO_LONG,
+    CTX_C_DATE_INVALID,
+    CTX_C_MONTH_INVALID,
+    CTX_C_POINTER_UNKNOWN,
+    CTX_C_OWN_PARENT,
+    CTX_C_CHAR_UNEXPECTED,
+    CTX_C_TOKEN_UNEXPECTED,
+    CTX_C_TEXT_SKIPPED,
+    CTX_C_LINES_SKIPPED,
+    CTX_C_LEN,
+} ctx_e_code;
+
+#define CTX_DIAG_ARGS 4
+
+// Integer argument, or the offset of a string argument in ctx->strings
+union ctx_arg {
+    long long i;
+    size_t str;
+};
+
+// Copy of the stack of a context, shared by the diagnostics logged while the
+// stack did not change
+struct ctx_trace {
+    size_t refs;
+    ptr_arr stack;
+};
+
+// Diagnostic as logged. The message is only formatted when it is asked for
+struct ctx_diag {
+    ctx_e_code code;
     ctx_e_loglevel level;
-    ptr_arr stack; // copy of the current context stack
+    size_t position; // source position it was logged at
+    size_t line;     // of the innermost state with a position
+    size_t col;
+    struct ctx_trace* trace;
+    union ctx_arg args[CTX_DIAG_ARGS];
 };
 
+struct context;
+
+// Receives each diagnostic of ctx as it is logged. diag is only valid during
+// the call, see ctx_diag_to_string() to keep its message
+typedef void (*ctx_sink_fn)(struct context* ctx, const struct ctx_diag* diag,
+                            void* data);
+
+/*
+A context belongs to one thread. Workers log to contexts forked from the
+caller's, which only they touch, and the caller joins them once they are
+done. Forks share the critical error flag of their parent, so a critical
+error in one worker is seen by the others.
+*/
 struct context {
-    bool can_continue;
+    atomic_bool can_continue;
+    atomic_size_t critical_position; // of the first critical, or SIZE_MAX
     ctx_e_loglevel log_level;
-    ptr_arr stack; // array of ctx_state
-    ptr_arr log;   // array of ctx_log_message
+    size_t position;         // current source position, e.g. the line
+    struct context* parent;  // forked from, NULL for the root
+    ptr_arr stack;           // array of ctx_state
+    struct ctx_trace* trace; // copy of stack, NULL once stack changed
+
+    struct ctx_diag* diags; // logged, in order
+    size_t len;
+    size_t cap;
+
+    char* strings; // string arguments of diags, NUL terminated
+    size_t strings_len;
+    size_t strings_cap;
+
+    ctx_sink_fn sink; // takes the diagnostics instead of diags, if set
+    void* sink_data;
+
+    // position of the state at track_depth - 1, see ctx_track()
+    const size_t* track_line;
+    const size_t* track_col;
+    size_t track_depth;
 };
 
 struct ctx_state* ctx_state_create(const struct ctx_state_interface* interface,
@@ -48,13 +128,62 @@ void ctx_free(struct context* ctx);
 // to parsing
 bool ctx_continue(struct context* ctx);
 
+// Like ctx_continue(), but only counts critical errors logged before position.
+// Workers going through their input in order stop on it, so a critical error
+// in a worker does not cut short those working on earlier input
+bool ctx_continue_at(struct context* ctx, size_t position);
+
+// Context for a worker thread, with a copy of the stack of parent. Called by
+// the thread owning parent, which must outlive the fork
+struct context* ctx_fork(struct context* parent);
+
+// Moves the logs of children to the end of the log of ctx, merged by position.
+// Messages at the same position keep the order of children, so the result
+// does not depend on which worker finished first. Messages after the first
+// critical error are dropped, a serial run would have stopped there
+e_statuscode ctx_join(struct context* ctx, struct context** children,
+                      size_t len);
+
+// Sends the diagnostics logged from now on to sink instead of keeping them, so
+// they take constant memory. Forks keep theirs until they are joined, and
+// reach the sink then. NULL keeps them again, see context/sinks.h for sinks
+void ctx_set_sink(struct context* ctx, ctx_sink_fn sink, void* data);
+
+// Sets the position messages are logged at from now on
+void ctx_set_position(struct context* ctx, size_t position);
+
 e_statuscode ctx_push(struct context* ctx, struct ctx_state* state);
 e_statuscode ctx_pop(struct context* ctx);
 
 struct ctx_state* ctx_state(struct context* ctx);
 
+// Tells ctx that a state on its stack was modified, e.g. its position
+void ctx_touch(struct context* ctx);
+
+// Lets the current state take its position from *line and *col when a
+// diagnostic is logged, until it is popped. A stage then only updates its own
+// fields per token. The state needs the position hooks, e.g. a posctx
+void ctx_track(struct context* ctx, const size_t* line, const size_t* col);
+
 char* ctx_log_to_string(struct context* ctx);
 
+// Logs code with the arguments its format takes. Nothing is formatted or
+// copied if level is filtered out
+e_statuscode ctx_diag(struct context* ctx, ctx_e_loglevel level,
+                      ctx_e_code code, ...);
+e_statuscode ctx_vdiag(struct context* ctx, ctx_e_loglevel level,
+                       ctx_e_code code, va_list args);
+
+const char* ctx_code_format(ctx_e_code code);
+
+// Message of diag, logged to ctx (must be freed)
+char* ctx_diag_message(const struct context* ctx, const struct ctx_diag* diag);
+
+// Message of diag with its level and trace, as in ctx_log_to_string (must be
+// freed)
+char* ctx_diag_to_string(const struct context* ctx,
+                         const struct ctx_diag* diag);
+
 e_statuscode ctx_debug(struct context* ctx, const char* message);
 e_statuscode ctx_debugf(struct context* ctx, const char* format, ...);
 e_statuscode ctx_vdebugf(struct context* ctx, const char* format, va_list args);
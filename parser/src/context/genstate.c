@@ -5,10 +5,13 @@
 #include <stdlib.h>
 #include <string.h>
 
-static const struct ctx_state_interface posctx_i = {.free = posctx_fn_free,
-                                                    .to_string =
-                                                        posctx_fn_to_string,
-                                                    .copy = posctx_fn_copy};
+static const struct ctx_state_interface posctx_i = {
+    .free = posctx_fn_free,
+    .to_string = posctx_fn_to_string,
+    .copy = posctx_fn_copy,
+    .position = posctx_fn_position,
+    .set_position = posctx_fn_set_position,
+};
 
 struct ctx_state*
 posctx_create(const char* origin)
@@ -51,6 +54,7 @@ posctx_update_line(struct context* ctx, size_t line)
         return;
     }
 
+    ctx_touch(ctx);
     data->line = line;
 }
 
@@ -63,6 +67,7 @@ posctx_update_col(struct context* ctx, size_t col)
         return;
     }
 
+    ctx_touch(ctx);
     data->col = col;
 }
 
@@ -75,6 +80,7 @@ posctx_update(struct context* ctx, size_t line, size_t col)
         return;
     }
 
+    ctx_touch(ctx);
     data->line = line;
     data->col = col;
 }
@@ -97,6 +103,24 @@ posctx_fn_to_string(struct ctx_state* state)
     return sbuilder_term(&builder);
 }
 
+void
+posctx_fn_position(struct ctx_state* state, size_t* line, size_t* col)
+{
+    struct posctx_data* data = state->data;
+
+    *line = data->line;
+    *col = data->col;
+}
+
+void
+posctx_fn_set_position(struct ctx_state* state, size_t line, size_t col)
+{
+    struct posctx_data* data = state->data;
+
+    data->line = line;
+    data->col = col;
+}
+
 struct ctx_state*
 posctx_fn_copy(struct ctx_state* state)
 {
@@ -116,9 +140,12 @@ posctx_fn_copy(struct ctx_state* state)
     return copy;
 }
 
-static struct ctx_state_interface tagctx_i = {.free = tagctx_fn_free,
-                                              .to_string = tagctx_fn_to_string,
-                                              .copy = tagctx_fn_copy};
+static struct ctx_state_interface tagctx_i = {
+    .free = tagctx_fn_free,
+    .to_string = tagctx_fn_to_string,
+    .copy = tagctx_fn_copy,
+    .position = tagctx_fn_position,
+};
 
 struct ctx_state*
 tagctx_create(char* name, size_t line, size_t col)
@@ -162,6 +189,15 @@ tagctx_fn_to_string(struct ctx_state* state)
     return sbuilder_term(&builder);
 }
 
+void
+tagctx_fn_position(struct ctx_state* state, size_t* line, size_t* col)
+{
+    struct tagctx_data* data = state->data;
+
+    *line = data->line;
+    *col = data->col;
+}
+
 struct ctx_state*
 tagctx_fn_copy(struct ctx_state* state)
 {
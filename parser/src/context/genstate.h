@@ -19,6 +19,8 @@ struct ctx_state* posctx_create(const char* origin);
 void posctx_fn_free(struct ctx_state* state);
 char* posctx_fn_to_string(struct ctx_state* state);
 struct ctx_state* posctx_fn_copy(struct ctx_state* state);
+void posctx_fn_position(struct ctx_state* state, size_t* line, size_t* col);
+void posctx_fn_set_position(struct ctx_state* state, size_t line, size_t col);
 
 struct ctx_state* posstate_from_ctx(struct context* ctx);
 
@@ -36,5 +38,6 @@ struct ctx_state* tagctx_create(char* name, size_t line, size_t col);
 void tagctx_fn_free(struct ctx_state* state);
 char* tagctx_fn_to_string(struct ctx_state* state);
 struct ctx_state* tagctx_fn_copy(struct ctx_state* state);
+void tagctx_fn_position(struct ctx_state* state, size_t* line, size_t* col);
 
 #endif // GENSTATE_H
\ No newline at end of file
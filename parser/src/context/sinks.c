@@ -0,0 +1,177 @@
+#include "context/sinks.h"
+#include "utils/stringbuilder.h"
+#include <assert.h>
+#include <string.h>
+
+/* === Stream === */
+
+void
+ctx_stream_sink_init(struct ctx_stream_sink* sink, FILE* fp)
+{
+    sink->fp = fp;
+    sink->len = 0;
+}
+
+void
+ctx_stream_sink_flush(struct ctx_stream_sink* sink)
+{
+    if (sink->len) {
+        fwrite(sink->buf, 1, sink->len, sink->fp);
+        fflush(sink->fp);
+        sink->len = 0;
+    }
+}
+
+void
+ctx_stream_sink(struct context* ctx, const struct ctx_diag* diag, void* data)
+{
+    struct ctx_stream_sink* sink = data;
+    char* message = ctx_diag_to_string(ctx, diag);
+
+    if (!message) {
+        return;
+    }
+
+    size_t len = strlen(message);
+
+    if (sink->len + len + 1 > sizeof sink->buf) {
+        ctx_stream_sink_flush(sink);
+    }
+
+    if (len + 1 > sizeof sink->buf) {
+        fprintf(sink->fp, "%s\n", message);
+    } else {
+        memcpy(sink->buf + sink->len, message, len);
+        sink->buf[sink->len + len] = '\n';
+        sink->len += len + 1;
+    }
+
+    free(message);
+
+    if (diag->level == CRITICAL) {
+        ctx_stream_sink_flush(sink);
+    }
+}
+
+/* === Ring === */
+
+e_statuscode
+ctx_ring_sink_init(struct ctx_ring_sink* sink, size_t cap)
+{
+    assert(cap);
+
+    sink->items = calloc(cap, sizeof *sink->items);
+    sink->head = 0;
+    sink->len = 0;
+    sink->cap = cap;
+    sink->dropped = 0;
+
+    return sink->items ? ST_OK : ST_MALLOC_ERROR;
+}
+
+void
+ctx_ring_sink_destroy(struct ctx_ring_sink* sink)
+{
+    for (size_t i = 0; i < sink->len; i++) {
+        free(sink->items[(sink->head + i) % sink->cap]);
+    }
+
+    free(sink->items);
+    sink->items = NULL;
+    sink->len = 0;
+}
+
+const char*
+ctx_ring_sink_get(const struct ctx_ring_sink* sink, size_t i)
+{
+    return i < sink->len ? sink->items[(sink->head + i) % sink->cap] : NULL;
+}
+
+void
+ctx_ring_sink(struct context* ctx, const struct ctx_diag* diag, void* data)
+{
+    struct ctx_ring_sink* sink = data;
+    char* message = ctx_diag_to_string(ctx, diag);
+
+    if (!message) {
+        return;
+    }
+
+    if (sink->len == sink->cap) {
+        free(sink->items[sink->head]);
+        sink->items[sink->head] = message;
+        sink->head = (sink->head + 1) % sink->cap;
+        sink->dropped++;
+
+        return;
+    }
+
+    sink->items[(sink->head + sink->len) % sink->cap] = message;
+    sink->len++;
+}
+
+/* === Counts === */
+
+void
+ctx_count_sink_init(struct ctx_count_sink* sink)
+{
+    memset(sink, 0, sizeof *sink);
+}
+
+void
+ctx_count_sink_destroy(struct ctx_count_sink* sink)
+{
+    for (size_t code = 0; code < CTX_C_LEN; code++) {
+        for (size_t i = 0; i < CTX_COUNT_SAMPLES; i++) {
+            free(sink->samples[code][i]);
+            sink->samples[code][i] = NULL;
+        }
+    }
+}
+
+char*
+ctx_count_sink_to_string(const struct ctx_count_sink* sink)
+{
+    struct sbuilder builder = sbuilder_new();
+    bool any = false;
+
+    for (size_t code = 0; code < CTX_C_LEN; code++) {
+        if (!sink->counts[code]) {
+            continue;
+        }
+
+        // free-form messages share one code
+        const char* format = code == CTX_C_MESSAGE ? "(other messages)"
+                                                   : ctx_code_format(code);
+
+        any = true;
+        sbuilder_writef(&builder, "%zu x %s\n", sink->counts[code], format);
+
+        for (size_t i = 0; i < CTX_COUNT_SAMPLES; i++) {
+            if (sink->samples[code][i]) {
+                sbuilder_writef(&builder, "\te.g. %s\n",
+                                sink->samples[code][i]);
+            }
+        }
+    }
+
+    if (!any) {
+        sbuilder_destroy(&builder);
+
+        return NULL;
+    }
+
+    return sbuilder_term(&builder);
+}
+
+void
+ctx_count_sink(struct context* ctx, const struct ctx_diag* diag, void* data)
+{
+    struct ctx_count_sink* sink = data;
+    size_t count = sink->counts[diag->code]++;
+
+    // only the samples are formatted
+    if (count < CTX_COUNT_SAMPLES) {
+        sink->samples[diag->code][count] = ctx_diag_message(ctx, diag);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+Diagnostic sinks, see ctx_set_sink().
+
+The stream sink writes messages to a file through a buffer, the ring sink
+keeps the last messages, and the count sink counts messages by code and keeps
+the first few of each. All of them take constant memory, however many
+diagnostics are logged.
+*/
+
+#ifndef CONTEXT_SINKS_H
+#define CONTEXT_SINKS_H
+
+#include "context/context.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CTX_STREAM_BUF 4096
+#define CTX_COUNT_SAMPLES 3
+
+/* === Stream === */
+
+struct ctx_stream_sink {
+    FILE* fp;
+    char buf[CTX_STREAM_BUF];
+    size_t len;
+};
+
+void ctx_stream_sink_init(struct ctx_stream_sink* sink, FILE* fp);
+
+// Writes out the buffered messages. Critical ones are written right away
+void ctx_stream_sink_flush(struct ctx_stream_sink* sink);
+
+void ctx_stream_sink(struct context* ctx, const struct ctx_diag* diag,
+                     void* data);
+
+/* === Ring === */
+
+struct ctx_ring_sink {
+    char** items; // formatted messages, the oldest at head
+    size_t head;
+    size_t len;
+    size_t cap;
+    size_t dropped; // overwritten by newer messages
+};
+
+// Keeps the last cap messages
+e_statuscode ctx_ring_sink_init(struct ctx_ring_sink* sink, size_t cap);
+void ctx_ring_sink_destroy(struct ctx_ring_sink* sink);
+
+// i-th message kept, the oldest first
+const char* ctx_ring_sink_get(const struct ctx_ring_sink* sink, size_t i);
+
+void ctx_ring_sink(struct context* ctx, const struct ctx_diag* diag,
+                   void* data);
+
+/* === Counts === */
+
+struct ctx_count_sink {
+    size_t counts[CTX_C_LEN];
+    char* samples[CTX_C_LEN][CTX_COUNT_SAMPLES]; // first messages of a code
+};
+
+void ctx_count_sink_init(struct ctx_count_sink* sink);
+void ctx_count_sink_destroy(struct ctx_count_sink* sink);
+
+// Count and samples of every code logged, NULL if none was (must be freed)
+char* ctx_count_sink_to_string(const struct ctx_count_sink* sink);
+
+void ctx_count_sink(struct context* ctx, const struct ctx_diag* diag,
+                    void* data);
+
+#endif // CONTEXT_SINKS_H
@@ -6,85 +6,116 @@
 #include "context/genstate.h"
 #include "gedcom.h"
 #include "utils/hashmap.h"
+#include "utils/pool.h"
 #include "utils/ptrarr.h"
-
-#define DEFAULT_STACK_CAP 100
-#define DEFAULT_STACK_CAP_MULT 2
+#include "utils/vec.h"
 
 // cap should be prime, and 1.3 * amount of expected items
 // 100 * 1.3, closest prime = 131
 #define DEFAULT_XREFS_CAP 131
 
+// parallel builds split the lines into chunks of about this many lines
+#define BUILD_CHUNK_LINES 4096
+
+VEC_DEFINE(record_vec, struct ged_record*)
+
 struct ged_builder {
     uint8_t cur_level;
 
-    ptr_arr stack;
+    struct record_vec stack; // open records, borrowed
 
     struct hash_table* xrefs;
+    struct backref_index* backrefs; // NULL when not collecting backrefs
+    struct name_index* names;       // NULL when not indexing names
     struct context* ctx;
+    bool owns_tags; // false for workers of a parallel build
 };
 
+// Initializes ged without setting up the tag interfaces
 static e_statuscode
-builder_init(struct ged_builder* ged, struct context* ctx)
+builder_setup(struct ged_builder* ged, struct context* ctx)
 {
-    assert(DEFAULT_STACK_CAP);
-
     ged->cur_level = 0;
-    ged->stack = pa_create(DEFAULT_STACK_CAP);
+    record_vec_init(&ged->stack);
     ged->xrefs = ht_create(DEFAULT_XREFS_CAP);
+    ged->backrefs = NULL;
+    ged->names = NULL;
     ged->ctx = ctx;
+    ged->owns_tags = false;
 
-    tags_init();
+    return ged->xrefs ? ST_OK : ST_MALLOC_ERROR;
+}
 
-    return ST_OK;
+static e_statuscode
+builder_init(struct ged_builder* ged, struct context* ctx)
+{
+    e_statuscode result = builder_setup(ged, ctx);
+
+    if (result == ST_OK) {
+        tags_init();
+        ged->owns_tags = true;
+    }
+
+    return result;
 }
 
 static void
 builder_destroy(struct ged_builder* ged)
 {
-    if (pa_len(ged->stack)) {
+    if (ged->stack.len) {
         ctx_debugf(ged->ctx,
                    "ged_builder destroying with non-empty stack (%zu items)",
-                   pa_len(ged->stack));
+                   ged->stack.len);
 
-        for (size_t i = 0; i < pa_len(ged->stack); i++) {
-            ged_record_free(pa_get(ged->stack, i));
+        for (size_t i = 0; i < ged->stack.len; i++) {
+            ged_record_free(record_vec_get(&ged->stack, i));
         }
     }
 
-    pa_free(ged->stack);
-    ht_free(ged->xrefs);
+    record_vec_destroy(&ged->stack);
+
+    // xrefs and backrefs are set to NULL when handed over to a document
+    if (ged->xrefs) {
+        ht_free(ged->xrefs);
+    }
+
+    br_free(ged->backrefs);
+    nm_free(ged->names);
     ged->ctx = NULL;
 
-    tags_cleanup();
+    if (ged->owns_tags) {
+        tags_cleanup();
+    }
 }
 
+// Creates the backref and name indices of ged
 static e_statuscode
-builder_stack_add(struct ged_builder* ged, struct ged_record* rec)
+builder_indices_create(struct ged_builder* ged)
 {
-    ged->cur_level = rec->level;
+    ged->backrefs = br_create();
+    ged->names = nm_create();
 
-    e_statuscode result = pa_push(ged->stack, rec);
+    return ged->backrefs && ged->names ? ST_OK : ST_MALLOC_ERROR;
+}
 
-    if (result != ST_OK) {
-        return result;
-    }
+static e_statuscode
+builder_stack_add(struct ged_builder* ged, struct ged_record* rec)
+{
+    ged->cur_level = rec->level;
 
-    return ST_OK;
+    return record_vec_push(&ged->stack, rec);
 }
 
 static e_statuscode
 builder_child_add(struct ged_builder* ged, struct ged_record* rec)
 {
-    struct ged_record* back = pa_back(ged->stack);
-
-    if (!back) {
+    if (!ged->stack.len) {
         return ST_GEN_ERROR;
     }
 
-    struct ged_record* last = pa_back(back->children);
+    struct ged_record* back = record_vec_back(&ged->stack);
 
-    pa_push(back->children, rec);
+    sa_push(&back->children, rec);
 
     ged->cur_level++;
 
@@ -94,16 +125,14 @@ builder_child_add(struct ged_builder* ged, struct ged_record* rec)
 static struct ged_record*
 builder_stack_pop(struct ged_builder* ged)
 {
-    if (!pa_len(ged->stack)) {
+    if (!ged->stack.len) {
         return NULL;
     }
 
-    struct ged_record* result = pa_pop(ged->stack);
+    struct ged_record* result = record_vec_pop(&ged->stack);
 
-    if (pa_len(ged->stack)) {
-        struct ged_record* back = pa_back(ged->stack);
-
-        ged->cur_level = back->level;
+    if (ged->stack.len) {
+        ged->cur_level = record_vec_back(&ged->stack)->level;
     } else {
         ged->cur_level = 0;
     }
@@ -111,6 +140,88 @@ builder_stack_pop(struct ged_builder* ged)
     return result;
 }
 
+// Adds an edge for every pointer in the value of rec. Must be called after rec
+// has been added to the stack, so the front of the stack is its level 0 record
+static void
+builder_backrefs_add(struct ged_builder* ged, struct ged_record* rec)
+{
+    if (!ged->backrefs) {
+        return;
+    }
+
+    struct ged_record* root = record_vec_get(&ged->stack, 0);
+
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->type != LT_POINTER) {
+            continue;
+        }
+
+        if (br_add(ged->backrefs, tok->lexeme, rec, root) != ST_OK) {
+            ctx_errf(ged->ctx, "unable to index reference to %s",
+                     tok->lexeme);
+        }
+    }
+}
+
+// Called once all lines of a level 0 record have been read
+static void
+builder_record_done(struct ged_builder* ged, struct ged_record* rec)
+{
+    if (ged->names && strcmp(rec->tag, "INDI") == 0 &&
+        nm_add(ged->names, rec) == NM_NONE) {
+        ctx_errf(ged->ctx, "unable to index names of %s",
+                 rec->xref ? rec->xref : "INDI");
+    }
+}
+
+// Constructs a record for every line from first up to end (NULL for all).
+// Level 0 records are pushed to arr
+static void
+builder_run(struct ged_builder* ged, struct parser_line* first,
+            struct parser_line* end, ptr_arr arr)
+{
+    struct parser_line* line = first;
+    struct ged_record* open = NULL; // level 0 record still taking children
+
+    while (line != end) {
+        // stops after the line of a critical error, and in parallel builds
+        // when a critical error shows up in an earlier chunk
+        if (!ctx_continue_at(ged->ctx, line->level->line)) {
+            break;
+        }
+
+        // orders the diagnostics of parallel builds
+        ctx_set_position(ged->ctx, line->level->line);
+
+        struct ged_record* cur = ged_record_construct(ged, line);
+
+        if (!cur) {
+            ctx_diag(ged->ctx, DEBUG, CTX_C_RECORD_FAILED, line->level->line);
+        } else if (cur->level) {
+            ctx_diag(ged->ctx, DEBUG, CTX_C_RECORD_SKIPPED, cur->level);
+        } else {
+            if (open) {
+                builder_record_done(ged, open);
+            }
+
+            pa_push(arr, cur);
+            open = cur;
+        }
+
+        line = line->next;
+    }
+
+    if (open) {
+        builder_record_done(ged, open);
+    }
+
+    // the stack only borrows records, the last one may still be open
+    while (builder_stack_pop(ged)) {
+    }
+}
+
 struct ged_record*
 ged_record_construct(struct ged_builder* ged, struct parser_line* line)
 {
@@ -118,22 +229,26 @@ ged_record_construct(struct ged_builder* ged, struct parser_line* line)
 
     rec->level = 0;
     rec->tag = NULL;
-    rec->value = pa_create(10);
-    rec->children = pa_create(10);
+    rec->tag_id = 0;
+    rec->xref = NULL;
+    sa_init(&rec->value);
+    sa_init(&rec->children);
     rec->elem.interface = NULL;
     rec->elem.data = NULL;
 
+    // cut short by a critical error of the lexer or parser
+    if (!line->tag) {
+        goto error;
+    }
+
     char* level = line->level->lexeme;
     int level_parsed = atoi(level);
 
     if (strlen(level) > 1 && level[0] == '0') {
-        ctx_warnf(ged->ctx,
-                  "gedcom standard disallows leading 0 on level "
-                  "declarations (%s)",
-                  level);
+        ctx_diag(ged->ctx, WARNING, CTX_C_LEVEL_LEADING_ZERO, level);
 
     } else if (level_parsed == 0 && level[0] != '0') {
-        ctx_critf(ged->ctx, "unable to parse %s as level", level);
+        ctx_diag(ged->ctx, CRITICAL, CTX_C_LEVEL_INVALID, level);
         goto error;
     }
 
@@ -144,13 +259,16 @@ ged_record_construct(struct ged_builder* ged, struct parser_line* line)
 
         // add to symbol table
         if (ht_get(ged->xrefs, xref) != NULL) {
-            ctx_errf(ged->ctx, "xref %s already defined", xref);
+            ctx_diag(ged->ctx, ERROR, CTX_C_XREF_REDEFINED, xref);
         } else {
             ht_set(ged->xrefs, xref, rec);
         }
+
+        rec->xref = strdup(xref);
     }
 
     rec->tag = strdup(line->tag->lexeme);
+    rec->tag_id = ged_tag_id(rec->tag);
 
     if (strlen(rec->tag) > 0 && rec->tag[0] == '_') {
         // TODO: Handle custom tags
@@ -160,25 +278,35 @@ ged_record_construct(struct ged_builder* ged, struct parser_line* line)
 
     if (line->line_value) {
         for (struct lex_token* tok = line->line_value; tok; tok = tok->next) {
+            struct lex_token* copy = lex_token_copy(tok);
 
-            pa_push(rec->value, lex_token_copy(tok));
+            if (!copy || sa_push(&rec->value, copy) != ST_OK) {
+                lex_token_free(copy);
+                ctx_critf(ged->ctx, "out of memory");
+
+                goto error;
+            }
         }
     }
 
+    if (rec->elem.interface && rec->elem.interface->create) {
+        rec->elem.data = rec->elem.interface->create(rec, ged->ctx);
+    }
+
     if (rec->level > ged->cur_level) {
         if (rec->level != ged->cur_level + 1) {
-            ctx_critf(ged->ctx, "invalid line level (should be %d, %d, is %d)",
-                      ged->cur_level, ged->cur_level + 1, rec->level);
+            ctx_diag(ged->ctx, CRITICAL, CTX_C_LEVEL_JUMP, ged->cur_level,
+                     ged->cur_level + 1, rec->level);
 
             goto error;
         }
     } else {
-        while (pa_len(ged->stack) && rec->level <= ged->cur_level) {
+        while (ged->stack.len && rec->level <= ged->cur_level) {
             builder_stack_pop(ged);
         }
     }
 
-    if (pa_len(ged->stack)) {
+    if (ged->stack.len) {
         builder_child_add(ged, rec);
     }
 
@@ -187,14 +315,37 @@ ged_record_construct(struct ged_builder* ged, struct parser_line* line)
         // TODO: error
     }
 
+    builder_backrefs_add(ged, rec);
+
     return rec;
 
 error:
+    // do not leave a dangling symbol behind
+    if (rec->xref && ht_get(ged->xrefs, rec->xref) == rec) {
+        ht_del(ged->xrefs, rec->xref);
+    }
+
     ged_record_free(rec);
 
     return NULL;
 }
 
+// Warns about referenced xrefs that were never declared
+static void
+check_references(const struct backref_index* backrefs,
+                 struct hash_table* xrefs, struct context* ctx)
+{
+    for (size_t i = 0; i < backrefs->len; i++) {
+        const char* target = backrefs->targets[i];
+        size_t count;
+
+        // targets stay known after their last ref is removed
+        if (br_get(backrefs, target, &count) && !ht_get(xrefs, target)) {
+            ctx_diag(ctx, WARNING, CTX_C_XREF_UNDEFINED, target);
+        }
+    }
+}
+
 ptr_arr
 ged_from_parser(struct parser_result result, struct context* ctx)
 {
@@ -206,31 +357,447 @@ ged_from_parser(struct parser_result result, struct context* ctx)
 
     ctx_push(ctx, posctx_create("generator"));
 
-    struct parser_line* line = result.front;
-
     ptr_arr arr = pa_create(100);
 
-    while (line) {
-        struct ged_record* cur = ged_record_construct(&ged, line);
+    builder_run(&ged, result.front, NULL, arr);
 
-        if (!cur) {
-            ctx_debugf(ctx, "unable to create record for line %d",
-                       line->level->line);
-        } else if (cur->level) {
-            ctx_debugf(ctx, "skipping record level %d", cur->level);
+    builder_destroy(&ged);
+    ctx_pop(ctx);
+
+    return arr;
+}
+
+struct ged_document*
+ged_document_from_parser(struct parser_result result, struct context* ctx)
+{
+    struct ged_document* doc = malloc(sizeof *doc);
+
+    if (!doc) {
+        return NULL;
+    }
+
+    struct ged_builder ged;
+
+    if (builder_init(&ged, ctx) != ST_OK) {
+        free(doc);
+
+        return NULL;
+    }
+
+    if (builder_indices_create(&ged) != ST_OK) {
+        builder_destroy(&ged);
+        free(doc);
+
+        return NULL;
+    }
+
+    ctx_push(ctx, posctx_create("generator"));
+
+    doc->records = pa_create(100);
+
+    builder_run(&ged, result.front, NULL, doc->records);
+
+    if (br_finalize(ged.backrefs) != ST_OK) {
+        ctx_critf(ctx, "unable to build backref index");
+    }
+
+    check_references(ged.backrefs, ged.xrefs, ctx);
+
+    // hand the lookup structures over to the document
+    doc->xrefs = ged.xrefs;
+    doc->backrefs = ged.backrefs;
+    doc->names = ged.names;
+    ged.xrefs = NULL;
+    ged.backrefs = NULL;
+    ged.names = NULL;
+
+    builder_destroy(&ged);
+    ctx_pop(ctx);
+
+    return doc;
+}
+
+// Adds rec and its descendants to the lookup structures of ged. xrefs are
+// skipped when ged->xrefs is NULL
+static void
+builder_index(struct ged_builder* ged, struct ged_record* rec,
+              struct ged_record* root)
+{
+    if (rec->xref && ged->xrefs) {
+        if (ht_get(ged->xrefs, rec->xref) != NULL) {
+            ctx_diag(ged->ctx, ERROR, CTX_C_XREF_REDEFINED, rec->xref);
         } else {
-            pa_push(arr, cur);
+            ht_set(ged->xrefs, rec->xref, rec);
         }
+    }
 
-        line = line->next;
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->type == LT_POINTER &&
+            br_add(ged->backrefs, tok->lexeme, rec, root) != ST_OK) {
+            ctx_errf(ged->ctx, "unable to index reference to %s",
+                     tok->lexeme);
+        }
+    }
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        builder_index(ged, sa_get(&rec->children, i), root);
+    }
+}
+
+struct ged_document*
+ged_document_from_records(ptr_arr records, struct context* ctx)
+{
+    struct ged_document* doc = malloc(sizeof *doc);
+
+    if (!doc) {
+        return NULL;
+    }
+
+    struct ged_builder ged;
+
+    if (builder_init(&ged, ctx) != ST_OK) {
+        free(doc);
+
+        return NULL;
     }
 
-    builder_stack_pop(&ged);
+    if (builder_indices_create(&ged) != ST_OK) {
+        builder_destroy(&ged);
+        free(doc);
+
+        return NULL;
+    }
+
+    ctx_push(ctx, posctx_create("generator"));
+
+    for (size_t i = 0; i < pa_len(records); i++) {
+        struct ged_record* rec = pa_get(records, i);
+
+        builder_index(&ged, rec, rec);
+        builder_record_done(&ged, rec);
+    }
+
+    if (br_finalize(ged.backrefs) != ST_OK) {
+        ctx_critf(ctx, "unable to build backref index");
+    }
+
+    doc->records = records;
+    doc->xrefs = ged.xrefs;
+    doc->backrefs = ged.backrefs;
+    doc->names = ged.names;
+    ged.xrefs = NULL;
+    ged.backrefs = NULL;
+    ged.names = NULL;
 
     builder_destroy(&ged);
     ctx_pop(ctx);
 
-    return arr;
+    return doc;
+}
+
+e_statuscode
+ged_document_reindex(struct ged_document* doc, struct context* ctx)
+{
+    struct ged_builder ged;
+
+    if (builder_init(&ged, ctx) != ST_OK) {
+        return ST_INIT_FAIL;
+    }
+
+    ht_free(ged.xrefs);
+    ged.xrefs = NULL;
+
+    if (builder_indices_create(&ged) != ST_OK) {
+        builder_destroy(&ged);
+
+        return ST_MALLOC_ERROR;
+    }
+
+    ctx_push(ctx, posctx_create("generator"));
+
+    for (size_t i = 0; i < pa_len(doc->records); i++) {
+        struct ged_record* rec = pa_get(doc->records, i);
+
+        builder_index(&ged, rec, rec);
+        builder_record_done(&ged, rec);
+    }
+
+    e_statuscode result = br_finalize(ged.backrefs);
+
+    if (result != ST_OK) {
+        ctx_critf(ctx, "unable to build backref index");
+    }
+
+    br_free(doc->backrefs);
+    nm_free(doc->names);
+    doc->backrefs = ged.backrefs;
+    doc->names = ged.names;
+    ged.backrefs = NULL;
+    ged.names = NULL;
+
+    builder_destroy(&ged);
+    ctx_pop(ctx);
+
+    return result;
+}
+
+/* === Parallel building === */
+
+// Lines first up to end, starting at a level 0 line
+struct build_chunk {
+    struct parser_line* first;
+    struct parser_line* end; // first line of the next chunk, NULL if last
+
+    ptr_arr records;
+    struct hash_table* xrefs; // declared in this chunk
+    struct context* ctx;      // forked for the diagnostics of this chunk
+};
+
+static bool
+line_is_record(const struct parser_line* line)
+{
+    const char* level = line->level->lexeme;
+
+    return level[0] == '0' && atoi(level) == 0;
+}
+
+// Splits the lines of result at level 0 lines, into chunks of about
+// BUILD_CHUNK_LINES lines
+static struct build_chunk*
+chunks_split(struct parser_result result, size_t* len)
+{
+    struct build_chunk* chunks = NULL;
+    size_t lines = 0;
+
+    *len = 0;
+
+    for (struct parser_line* line = result.front; line; line = line->next) {
+        if (*len && (lines < BUILD_CHUNK_LINES || !line_is_record(line))) {
+            lines++;
+            continue;
+        }
+
+        // chunks grows in powers of two alongside len
+        if (!(*len & (*len - 1))) {
+            size_t cap = *len ? *len * 2 : 1;
+            struct build_chunk* grown = realloc(chunks, cap * sizeof *grown);
+
+            if (!grown) {
+                free(chunks);
+                *len = 0;
+
+                return NULL;
+            }
+
+            chunks = grown;
+        }
+
+        if (*len) {
+            chunks[*len - 1].end = line;
+        }
+
+        chunks[(*len)++] = (struct build_chunk){.first = line};
+        lines = 1;
+    }
+
+    return chunks;
+}
+
+static void
+chunk_build(struct build_chunk* chunk)
+{
+    struct ged_builder ged;
+
+    chunk->records = pa_create(100);
+
+    // the tag interfaces are set up once, by the calling thread
+    builder_setup(&ged, chunk->ctx);
+    builder_run(&ged, chunk->first, chunk->end, chunk->records);
+
+    chunk->xrefs = ged.xrefs;
+    ged.xrefs = NULL;
+
+    builder_destroy(&ged);
+}
+
+static void
+build_range(size_t begin, size_t end, void* data)
+{
+    struct build_chunk* chunks = data;
+
+    for (size_t i = begin; i < end; i++) {
+        chunk_build(&chunks[i]);
+    }
+}
+
+// Adds the xrefs declared in chunk to xrefs, each at the position of the line
+// declaring it. Duplicates within the chunk were reported by its builder, and
+// are not in its table
+static void
+xrefs_merge(struct hash_table* xrefs, struct build_chunk* chunk)
+{
+    for (struct parser_line* line = chunk->first; line != chunk->end;
+         line = line->next) {
+        struct ged_record* rec;
+
+        if (!line->xref || !(rec = ht_get(chunk->xrefs, line->xref->lexeme))) {
+            continue;
+        }
+
+        // later lines with this xref are the duplicates
+        ht_del(chunk->xrefs, rec->xref);
+        ctx_set_position(chunk->ctx, line->level->line);
+
+        if (ht_get(xrefs, rec->xref) != NULL) {
+            ctx_diag(chunk->ctx, ERROR, CTX_C_XREF_REDEFINED, rec->xref);
+        } else {
+            ht_set(xrefs, rec->xref, rec);
+        }
+    }
+}
+
+// Builds the chunks of result on the shared pool, or on the calling thread
+// unless parallel, and joins their records, xrefs and diagnostics in source
+// order
+static ptr_arr
+build_parallel(struct parser_result result, struct context* ctx,
+               bool parallel, struct hash_table** xrefs)
+{
+    size_t len;
+    struct build_chunk* chunks = chunks_split(result, &len);
+    struct context** forks = malloc((len + 1) * sizeof *forks);
+    ptr_arr records = pa_create(100);
+
+    *xrefs = ht_create(DEFAULT_XREFS_CAP);
+
+    ctx_push(ctx, posctx_create("generator"));
+
+    // each worker only touches the contexts of its chunks
+    for (size_t i = 0; i < len; i++) {
+        chunks[i].ctx = forks[i] = ctx_fork(ctx);
+    }
+
+    // the tag interfaces are only read by the workers
+    tags_init();
+
+    if (parallel) {
+        tp_for(tp_shared(), len, 1, build_range, chunks);
+    } else {
+        build_range(0, len, chunks);
+    }
+
+    tags_cleanup();
+
+    for (size_t i = 0; i < len; i++) {
+        struct build_chunk* chunk = &chunks[i];
+
+        // a serial build stops at the first critical error, before this chunk
+        if (!ctx_continue_at(ctx, chunk->first->level->line)) {
+            for (size_t r = 0; r < pa_len(chunk->records); r++) {
+                ged_record_free(pa_get(chunk->records, r));
+            }
+
+            pa_free(chunk->records);
+            ht_free(chunk->xrefs);
+
+            continue;
+        }
+
+        xrefs_merge(*xrefs, chunk);
+
+        for (size_t r = 0; r < pa_len(chunk->records); r++) {
+            pa_push(records, pa_get(chunk->records, r));
+        }
+
+        pa_free(chunk->records);
+        ht_free(chunk->xrefs);
+    }
+
+    ctx_join(ctx, forks, len);
+    ctx_pop(ctx);
+
+    for (size_t i = 0; i < len; i++) {
+        ctx_free(forks[i]);
+    }
+
+    free(forks);
+    free(chunks);
+
+    return records;
+}
+
+ptr_arr
+ged_from_parser_parallel(struct parser_result result, struct context* ctx,
+                         bool parallel)
+{
+    struct hash_table* xrefs;
+    ptr_arr records = build_parallel(result, ctx, parallel, &xrefs);
+
+    ht_free(xrefs);
+
+    return records;
+}
+
+struct ged_document*
+ged_document_from_parser_parallel(struct parser_result result,
+                                  struct context* ctx, bool parallel)
+{
+    struct ged_document* doc = malloc(sizeof *doc);
+
+    if (!doc) {
+        return NULL;
+    }
+
+    doc->records = build_parallel(result, ctx, parallel, &doc->xrefs);
+    doc->backrefs = NULL;
+    doc->names = NULL;
+
+    // the indices are built serially, in record order
+    if (ged_document_reindex(doc, ctx) != ST_OK) {
+        ged_document_free(doc);
+
+        return NULL;
+    }
+
+    ctx_push(ctx, posctx_create("generator"));
+    check_references(doc->backrefs, doc->xrefs, ctx);
+    ctx_pop(ctx);
+
+    return doc;
+}
+
+void
+ged_document_free(struct ged_document* doc)
+{
+    if (!doc) {
+        return;
+    }
+
+    for (size_t i = 0; i < pa_len(doc->records); i++) {
+        ged_record_free(pa_get(doc->records, i));
+    }
+
+    pa_free(doc->records);
+    ht_free(doc->xrefs);
+    br_free(doc->backrefs);
+    nm_free(doc->names);
+
+    free(doc);
+}
+
+struct ged_record*
+ged_document_xref(struct ged_document* doc, const char* xref)
+{
+    return ht_get(doc->xrefs, xref);
+}
+
+const struct backref*
+ged_document_backrefs(struct ged_document* doc, const char* xref,
+                      size_t* count)
+{
+    return br_get(doc->backrefs, xref, count);
 }
 
 void
@@ -245,46 +812,105 @@ ged_record_free(struct ged_record* rec)
         free(rec->tag);
     }
 
+    if (rec->xref) {
+        free(rec->xref);
+    }
+
     if (rec->elem.interface) {
         rec->elem.interface->free(rec->elem.data);
     }
 
-    if (rec->value) {
-        for (size_t i = 0; i < pa_len(rec->value); i++) {
-            lex_token_free(pa_get(rec->value, i));
-        }
-
-        pa_free(rec->value);
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        lex_token_free(sa_get(&rec->value, i));
     }
 
-    for (size_t i = 0; i < pa_len(rec->children); i++) {
-        struct ged_record* child = pa_get(rec->children, i);
+    sa_destroy(&rec->value);
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        struct ged_record* child = sa_get(&rec->children, i);
 
         ged_record_free(child);
     }
-    pa_free(rec->children);
+    sa_destroy(&rec->children);
 
     free(rec);
 }
 
-char*
-ged_record_to_string(struct ged_record* rec)
+uint32_t
+ged_tag_id(const char* tag)
 {
-    struct sbuilder builder = sbuilder_new();
+    uint32_t id = 0;
+    size_t i = 0;
 
-    for (uint8_t i = 0; i < rec->level; i++) {
-        sbuilder_write(&builder, "\t");
+    for (; tag[i] && i < 4; i++) {
+        id |= (uint32_t)(unsigned char)tag[i] << (8 * i);
     }
 
-    sbuilder_writef(&builder, "%d: <%s> (value)\n", rec->level, rec->tag);
+    if (!tag[i] && !(id & GED_TAG_HASHED)) {
+        return id;
+    }
 
-    for (size_t i = 0; i < pa_len(rec->children); i++) {
-        struct ged_record* child = pa_get(rec->children, i);
+    // FNV-1a
+    id = 2166136261u;
 
-        char* chstr = ged_record_to_string(child);
-        sbuilder_writef(&builder, "%s", chstr);
-        free(chstr);
+    for (i = 0; tag[i]; i++) {
+        id = (id ^ (unsigned char)tag[i]) * 16777619u;
     }
 
+    return id | GED_TAG_HASHED;
+}
+
+size_t
+ged_record_value(const struct ged_record* rec, char* buf, size_t cap)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (!tok->lexeme) {
+            continue;
+        }
+
+        size_t n = strlen(tok->lexeme);
+
+        if (len < cap) {
+            size_t room = cap - len - 1;
+
+            memcpy(buf + len, tok->lexeme, n < room ? n : room);
+        }
+
+        len += n;
+    }
+
+    if (cap) {
+        buf[len < cap ? len : cap - 1] = '\0';
+    }
+
+    return len;
+}
+
+// Writes rec and its children to builder, without a string per child
+static void
+record_to_string(struct sbuilder* builder, const struct ged_record* rec)
+{
+    for (uint8_t i = 0; i < rec->level; i++) {
+        sbuilder_write(builder, "\t");
+    }
+
+    sbuilder_writef(builder, "%d: <%s> (value)\n", rec->level, rec->tag);
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        record_to_string(builder, sa_get(&rec->children, i));
+    }
+}
+
+char*
+ged_record_to_string(struct ged_record* rec)
+{
+    struct sbuilder builder = sbuilder_new();
+
+    record_to_string(&builder, rec);
+
     return sbuilder_term(&builder);
 }
\ No newline at end of file
@@ -2,35 +2,87 @@
 #ifndef GEDCOM_H
 #define GEDCOM_H
 
+#include "index/backref.h"
+#include "index/names.h"
 #include "lexer.h"
 #include "parser.h"
 #include "tags/base.h"
 #include "utils/ptrarr.h"
+#include "utils/smallarr.h"
 #include "utils/stringbuilder.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+// Tags of up to 4 characters are packed into their id, longer ones are hashed
+// with GED_TAG_HASHED set, so equal ids of those still need a strcmp
+#define GED_TAG_HASHED 0x80000000u
+
 struct ged_record {
     uint8_t level;
     char* tag;
+    uint32_t tag_id; // see ged_tag_id
+    char* xref; // NULL if the line declares no xref
 
     struct {
         const struct tag_interface* interface;
         void* data;
     } elem;
 
-    ptr_arr value;
+    struct small_arr value;    // struct lex_token*
+    struct small_arr children; // struct ged_record*
+};
 
-    ptr_arr children;
+// A parsed document, keeping the lookup structures built alongside the records
+struct ged_document {
+    ptr_arr records;          // level 0 records, in source order
+    struct hash_table* xrefs; // xref -> struct ged_record*
+    struct backref_index* backrefs;
+    struct name_index* names; // filled as INDI records are completed
 };
 
 struct ged_builder;
 
 ptr_arr ged_from_parser(struct parser_result result, struct context* ctx);
+struct ged_document* ged_document_from_parser(struct parser_result result,
+                                              struct context* ctx);
+// Document over already built level 0 records, which it takes ownership of.
+// The lookup structures are rebuilt from the records
+struct ged_document* ged_document_from_records(ptr_arr records,
+                                               struct context* ctx);
+// Rebuilds the backref and name indices of doc from its records, after records
+// were replaced. xrefs is left as it is
+e_statuscode ged_document_reindex(struct ged_document* doc,
+                                  struct context* ctx);
+// Like ged_from_parser() and ged_document_from_parser(), building separate
+// level 0 records on the shared pool (see utils/pool.h), or on the calling
+// thread unless parallel. Records keep their order, diagnostics are
+// reported in source order
+ptr_arr ged_from_parser_parallel(struct parser_result result,
+                                 struct context* ctx, bool parallel);
+struct ged_document* ged_document_from_parser_parallel(
+    struct parser_result result, struct context* ctx, bool parallel);
+
+void ged_document_free(struct ged_document* doc);
+
+// Record declaring xref, or NULL
+struct ged_record* ged_document_xref(struct ged_document* doc,
+                                     const char* xref);
+
+// Records whose value points at xref. See index/backref.h
+const struct backref* ged_document_backrefs(struct ged_document* doc,
+                                            const char* xref, size_t* count);
+
 struct ged_record* ged_record_construct(struct ged_builder* ged,
                                         struct parser_line* line);
 
 void ged_record_free(struct ged_record* rec);
 
+uint32_t ged_tag_id(const char* tag);
+
+// Writes the value of rec into buf, truncated to cap - 1 characters.
+// Returns the length of the whole value
+size_t ged_record_value(const struct ged_record* rec, char* buf, size_t cap);
+
 char* ged_record_to_string(struct ged_record* rec);
 
 #endif // GEDCOM_H
\ No newline at end of file
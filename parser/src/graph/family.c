@@ -0,0 +1,409 @@
+#include "graph/family.h"
+#include "utils/vec.h"
+#include <assert.h>
+#include <string.h>
+
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_IDS_CAP 131
+
+enum member_role { ROLE_PARENT = 0, ROLE_CHILD };
+
+// Membership of an individual in a family, from either side of the link
+struct member {
+    uint32_t family;
+    uint32_t role;
+    uint32_t person;
+};
+
+VEC_DEFINE(member_buf, struct member)
+VEC_DEFINE(u64_buf, uint64_t)
+VEC_DEFINE(u32_buf, uint32_t)
+
+static e_statuscode
+member_push(struct member_buf* buf, uint32_t family, uint32_t role,
+            uint32_t person)
+{
+    return member_buf_push(buf, (struct member){family, role, person});
+}
+
+static int
+member_cmp(const void* a, const void* b)
+{
+    const struct member* x = a;
+    const struct member* y = b;
+
+    if (x->family != y->family)
+        return x->family < y->family ? -1 : 1;
+    if (x->role != y->role)
+        return x->role < y->role ? -1 : 1;
+    if (x->person != y->person)
+        return x->person < y->person ? -1 : 1;
+
+    return 0;
+}
+
+static int
+u64_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+// Lexeme of the first pointer in the value of rec, or NULL
+static const char*
+record_pointer(struct ged_record* rec)
+{
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->type == LT_POINTER) {
+            return tok->lexeme;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t
+lookup(struct hash_table* ht, const char* xref)
+{
+    uintptr_t found = xref ? (uintptr_t)ht_get(ht, xref) : 0;
+
+    return found ? (uint32_t)(found - 1) : FG_NONE;
+}
+
+// Collects the family memberships stated under an INDI or FAM record
+static e_statuscode
+collect_members(struct fam_graph* g, struct hash_table* fams,
+                struct ged_record* rec, uint32_t self, uint32_t family,
+                struct member_buf* members, struct context* ctx)
+{
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        struct ged_record* child = sa_get(&rec->children, i);
+        const char* tag = child->tag;
+
+        uint32_t role;
+        bool to_family = self != FG_NONE; // INDI links point to a family
+
+        if (to_family && strcmp(tag, "FAMC") == 0) {
+            role = ROLE_CHILD;
+        } else if (to_family && strcmp(tag, "FAMS") == 0) {
+            role = ROLE_PARENT;
+        } else if (!to_family &&
+                   (strcmp(tag, "HUSB") == 0 || strcmp(tag, "WIFE") == 0)) {
+            role = ROLE_PARENT;
+        } else if (!to_family && strcmp(tag, "CHIL") == 0) {
+            role = ROLE_CHILD;
+        } else {
+            continue;
+        }
+
+        const char* target = record_pointer(child);
+        uint32_t id = lookup(to_family ? fams : g->ids, target);
+
+        if (id == FG_NONE) {
+            ctx_diag(ctx, WARNING, CTX_C_POINTER_UNKNOWN,
+                     rec->xref ? rec->xref : rec->tag, tag,
+                     to_family ? "FAM" : "INDI");
+
+            continue;
+        }
+
+        e_statuscode result =
+            to_family ? member_push(members, id, role, self)
+                      : member_push(members, family, role, id);
+
+        if (result != ST_OK) {
+            return result;
+        }
+    }
+
+    return ST_OK;
+}
+
+// Builds a CSR from edges packed as (row << 32 | column). Sorts edges
+static e_statuscode
+csr_build(struct u64_buf* edges, size_t len, uint32_t** off, uint32_t** adj)
+{
+    qsort(edges->mem, edges->len, sizeof *edges->mem, u64_cmp);
+
+    *off = calloc(len + 1, sizeof **off);
+    *adj = malloc((edges->len ? edges->len : 1) * sizeof **adj);
+
+    if (!*off || !*adj) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < edges->len; i++) {
+        (*off)[(edges->mem[i] >> 32) + 1]++;
+        (*adj)[i] = (uint32_t)edges->mem[i];
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        (*off)[i + 1] += (*off)[i];
+    }
+
+    return ST_OK;
+}
+
+static e_statuscode
+closure(const uint32_t* off, const uint32_t* adj, uint32_t id,
+        uint32_t max_gen, struct bitset* out)
+{
+    struct u32_buf cur = {0};
+    struct u32_buf next = {0};
+    e_statuscode result = ST_OK;
+
+    bs_clear_all(out);
+
+    if (u32_buf_push(&cur, id) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (uint32_t gen = 0; gen < max_gen && cur.len; gen++) {
+        next.len = 0;
+
+        for (size_t i = 0; i < cur.len; i++) {
+            uint32_t u = cur.mem[i];
+
+            for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+                uint32_t v = adj[e];
+
+                if (bs_test(out, v)) {
+                    continue;
+                }
+
+                bs_set(out, v);
+
+                if ((result = u32_buf_push(&next, v)) != ST_OK) {
+                    goto cleanup;
+                }
+            }
+        }
+
+        struct u32_buf tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+
+cleanup:
+    u32_buf_destroy(&cur);
+    u32_buf_destroy(&next);
+
+    return result;
+}
+
+struct fam_graph*
+fg_create(struct ged_document* doc, struct context* ctx)
+{
+    struct fam_graph* g = malloc(sizeof *g);
+
+    if (!g) {
+        return NULL;
+    }
+
+    g->len = 0;
+    g->indis = NULL;
+    g->parent_off = NULL;
+    g->parents = NULL;
+    g->child_off = NULL;
+    g->children = NULL;
+    g->ids = ht_create(DEFAULT_IDS_CAP);
+
+    struct hash_table* fams = ht_create(DEFAULT_IDS_CAP);
+    struct member_buf members = {0};
+    struct u64_buf edges = {0};
+    size_t nrecords = pa_len(doc->records);
+    uint32_t nfams = 0;
+
+    ctx_push(ctx, posctx_create("family graph"));
+
+    if (!g->ids || !fams) {
+        goto error;
+    }
+
+    for (size_t i = 0; i < nrecords; i++) {
+        struct ged_record* rec = pa_get(doc->records, i);
+
+        g->len += strcmp(rec->tag, "INDI") == 0;
+    }
+
+    if (g->len >= FG_NONE) {
+        ctx_critf(ctx, "too many individuals for the family graph (%zu)",
+                  g->len);
+        goto error;
+    }
+
+    g->indis = malloc((g->len ? g->len : 1) * sizeof *g->indis);
+
+    if (!g->indis) {
+        goto error;
+    }
+
+    // number individuals and families
+    for (size_t i = 0, id = 0; i < nrecords; i++) {
+        struct ged_record* rec = pa_get(doc->records, i);
+
+        if (strcmp(rec->tag, "INDI") == 0) {
+            g->indis[id] = rec;
+
+            if (rec->xref) {
+                ht_set(g->ids, rec->xref, (void*)(uintptr_t)(id + 1));
+            }
+
+            id++;
+        } else if (strcmp(rec->tag, "FAM") == 0 && rec->xref) {
+            ht_set(fams, rec->xref, (void*)(uintptr_t)(++nfams));
+        }
+    }
+
+    for (size_t i = 0; i < nrecords; i++) {
+        struct ged_record* rec = pa_get(doc->records, i);
+        e_statuscode result = ST_OK;
+
+        if (strcmp(rec->tag, "INDI") == 0 && rec->xref) {
+            result = collect_members(g, fams, rec, fg_id(g, rec->xref),
+                                     FG_NONE, &members, ctx);
+        } else if (strcmp(rec->tag, "FAM") == 0 && rec->xref) {
+            result = collect_members(g, fams, rec, FG_NONE,
+                                     lookup(fams, rec->xref), &members, ctx);
+        }
+
+        if (result != ST_OK) {
+            goto error;
+        }
+    }
+
+    // members sorted by family, parents before children. A link stated on
+    // both sides shows up twice, and is skipped the second time
+    qsort(members.mem, members.len, sizeof *members.mem, member_cmp);
+
+    for (size_t start = 0, end = 0; start < members.len; start = end) {
+        size_t first_child = start;
+        uint32_t family = members.mem[start].family;
+
+        for (end = start;
+             end < members.len && members.mem[end].family == family; end++) {
+            if (members.mem[end].role == ROLE_PARENT) {
+                first_child = end + 1;
+            }
+        }
+
+        for (size_t p = start; p < first_child; p++) {
+            if (p > start && members.mem[p].person == members.mem[p - 1].person)
+                continue;
+
+            for (size_t c = first_child; c < end; c++) {
+                uint32_t parent = members.mem[p].person;
+                uint32_t child = members.mem[c].person;
+
+                if (c > first_child && child == members.mem[c - 1].person)
+                    continue;
+
+                if (parent == child) {
+                    ctx_diag(ctx, WARNING, CTX_C_OWN_PARENT,
+                             g->indis[child]->xref);
+                    continue;
+                }
+
+                uint64_t edge = (uint64_t)child << 32 | parent;
+
+                if (u64_buf_push(&edges, edge) != ST_OK)
+                    goto error;
+            }
+        }
+    }
+
+    // the same parent and child can meet in more than one family
+    qsort(edges.mem, edges.len, sizeof *edges.mem, u64_cmp);
+
+    size_t unique = 0;
+
+    for (size_t i = 0; i < edges.len; i++) {
+        if (!unique || edges.mem[i] != edges.mem[unique - 1]) {
+            edges.mem[unique++] = edges.mem[i];
+        }
+    }
+
+    edges.len = unique;
+
+    if (csr_build(&edges, g->len, &g->parent_off, &g->parents) != ST_OK) {
+        goto error;
+    }
+
+    for (size_t i = 0; i < edges.len; i++) {
+        edges.mem[i] = edges.mem[i] << 32 | edges.mem[i] >> 32;
+    }
+
+    if (csr_build(&edges, g->len, &g->child_off, &g->children) != ST_OK) {
+        goto error;
+    }
+
+    member_buf_destroy(&members);
+    u64_buf_destroy(&edges);
+    ht_free(fams);
+    ctx_pop(ctx);
+
+    return g;
+
+error:
+    ctx_critf(ctx, "unable to build family graph");
+
+    member_buf_destroy(&members);
+    u64_buf_destroy(&edges);
+
+    if (fams) {
+        ht_free(fams);
+    }
+
+    fg_free(g);
+    ctx_pop(ctx);
+
+    return NULL;
+}
+
+void
+fg_free(struct fam_graph* g)
+{
+    if (!g) {
+        return;
+    }
+
+    if (g->ids) {
+        ht_free(g->ids);
+    }
+
+    free(g->indis);
+    free(g->parent_off);
+    free(g->parents);
+    free(g->child_off);
+    free(g->children);
+
+    free(g);
+}
+
+uint32_t
+fg_id(const struct fam_graph* g, const char* xref)
+{
+    return lookup(g->ids, xref);
+}
+
+e_statuscode
+fg_ancestors(const struct fam_graph* g, uint32_t id, uint32_t max_gen,
+             struct bitset* out)
+{
+    assert(id < g->len && out->len >= g->len);
+
+    return closure(g->parent_off, g->parents, id, max_gen, out);
+}
+
+e_statuscode
+fg_descendants(const struct fam_graph* g, uint32_t id, uint32_t max_gen,
+               struct bitset* out)
+{
+    assert(id < g->len && out->len >= g->len);
+
+    return closure(g->child_off, g->children, id, max_gen, out);
+}
@@ -0,0 +1,69 @@
+/*
+Genealogy graph over the INDI and FAM records of a document.
+
+Individuals are numbered densely (0 .. len - 1) in the order their INDI
+records appear. Parent and child adjacency is stored as compressed sparse
+rows: the parents of id are parents[parent_off[id]] .. parents[parent_off[id
++ 1] - 1], and likewise for children.
+
+Links are taken from both sides of the family records: HUSB/WIFE/CHIL under
+FAM, and FAMC/FAMS under INDI, so a link stated on only one side is still
+present in the graph.
+*/
+
+#ifndef GRAPH_FAMILY_H
+#define GRAPH_FAMILY_H
+
+#include "context/context.h"
+#include "gedcom.h"
+#include "utils/bitset.h"
+#include "utils/hashmap.h"
+#include <stdint.h>
+
+#define FG_NONE UINT32_MAX
+#define FG_GEN_ALL UINT32_MAX
+
+struct fam_graph {
+    size_t len;                // number of individuals
+    struct ged_record** indis; // id -> INDI record
+    struct hash_table* ids;    // xref -> id + 1
+
+    uint32_t* parent_off; // len + 1 entries
+    uint32_t* parents;
+    uint32_t* child_off; // len + 1 entries
+    uint32_t* children;
+};
+
+struct fam_graph* fg_create(struct ged_document* doc, struct context* ctx);
+void fg_free(struct fam_graph* g);
+
+// Id of the individual declared as xref, or FG_NONE
+uint32_t fg_id(const struct fam_graph* g, const char* xref);
+
+static inline const uint32_t*
+fg_parents(const struct fam_graph* g, uint32_t id, size_t* count)
+{
+    *count = g->parent_off[id + 1] - g->parent_off[id];
+
+    return g->parents + g->parent_off[id];
+}
+
+static inline const uint32_t*
+fg_children(const struct fam_graph* g, uint32_t id, size_t* count)
+{
+    *count = g->child_off[id + 1] - g->child_off[id];
+
+    return g->children + g->child_off[id];
+}
+
+// Sets the bit of every ancestor of id up to max_gen generations back (1 =
+// parents only, FG_GEN_ALL = no limit). out must hold g->len bits, and is
+// cleared first. id itself is only included if the pedigree loops back to it.
+e_statuscode fg_ancestors(const struct fam_graph* g, uint32_t id,
+                          uint32_t max_gen, struct bitset* out);
+
+// Same as fg_ancestors, following children instead
+e_statuscode fg_descendants(const struct fam_graph* g, uint32_t id,
+                            uint32_t max_gen, struct bitset* out);
+
+#endif // GRAPH_FAMILY_H
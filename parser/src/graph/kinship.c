@@ -0,0 +1,666 @@
+#include "graph/kinship.h"
+#include "context/genstate.h"
+#include "utils/pool.h"
+#include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define MEMO_EMPTY UINT64_MAX
+#define MEMO_MIN_CAP 1024
+
+// Slots of all tables in use at once, 1 GiB. Half of them go to the shared
+// table, the other half is split among the local tables of the workers
+#define MEMO_BUDGET (1 << 26)
+
+#define SCHEDULE_CHUNK 64
+
+// Key and value share a slot, so a probe that hits costs one cache line
+struct kin_slot {
+    uint64_t key;
+    double value;
+};
+
+/*
+Open addressing with linear probing, grown at half load. A table that cannot
+double without passing max_cap (or cannot grow) keeps taking values up to 3/4
+load, and then stops remembering new ones. Results stay exact, only slower.
+*/
+struct kin_memo {
+    struct kin_slot* slots;
+    size_t mask;
+    size_t len;
+    size_t max_cap;
+};
+
+// values computed during the current generation by one tp_for slot
+struct kin_worker {
+    struct kin_memo local;
+};
+
+/*
+Every worker memoizes into its own table while a generation runs, and reads
+the shared table, which is frozen until the generation is done. Between
+generations the calling thread merges the local tables into the shared one,
+so no table is ever written while another thread reads it.
+*/
+struct kin_job {
+    struct kinship* k;
+    const uint32_t* order; // individuals sorted by generation
+    size_t end;            // of the current generation in order
+    atomic_size_t cursor;  // next unscheduled position in order
+
+    struct kin_worker* workers;
+    size_t nworkers;
+};
+
+static size_t
+memo_index(const struct kin_memo* memo, uint64_t key)
+{
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & memo->mask;
+}
+
+static e_statuscode
+memo_init(struct kin_memo* memo, size_t cap, size_t max_cap)
+{
+    size_t pow2 = MEMO_MIN_CAP;
+
+    while (pow2 < cap) {
+        pow2 *= 2;
+    }
+
+    memo->slots = malloc(pow2 * sizeof *memo->slots);
+
+    if (!memo->slots) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < pow2; i++) {
+        memo->slots[i].key = MEMO_EMPTY;
+    }
+
+    memo->mask = pow2 - 1;
+    memo->len = 0;
+    memo->max_cap = max_cap;
+
+    return ST_OK;
+}
+
+static void
+memo_destroy(struct kin_memo* memo)
+{
+    free(memo->slots);
+    memo->slots = NULL;
+}
+
+static void
+memo_clear(struct kin_memo* memo)
+{
+    if (!memo->len) {
+        return;
+    }
+
+    for (size_t i = 0; i <= memo->mask; i++) {
+        memo->slots[i].key = MEMO_EMPTY;
+    }
+
+    memo->len = 0;
+}
+
+static bool
+memo_get(const struct kin_memo* memo, uint64_t key, double* out)
+{
+    for (size_t i = memo_index(memo, key);; i = (i + 1) & memo->mask) {
+        if (memo->slots[i].key == key) {
+            *out = memo->slots[i].value;
+
+            return true;
+        }
+
+        if (memo->slots[i].key == MEMO_EMPTY) {
+            return false;
+        }
+    }
+}
+
+static void memo_put(struct kin_memo* memo, uint64_t key, double value);
+
+static void
+memo_grow(struct kin_memo* memo)
+{
+    struct kin_memo grown;
+
+    if (memo_init(&grown, (memo->mask + 1) * 2, memo->max_cap) != ST_OK) {
+        return;
+    }
+
+    for (size_t i = 0; i <= memo->mask; i++) {
+        if (memo->slots[i].key != MEMO_EMPTY) {
+            memo_put(&grown, memo->slots[i].key, memo->slots[i].value);
+        }
+    }
+
+    memo_destroy(memo);
+    *memo = grown;
+}
+
+static void
+memo_put(struct kin_memo* memo, uint64_t key, double value)
+{
+    size_t cap = memo->mask + 1;
+
+    // doubling must not pass max_cap, which need not be a power of two
+    if ((memo->len + 1) * 2 > cap && cap * 2 <= memo->max_cap) {
+        memo_grow(memo);
+        cap = memo->mask + 1;
+    }
+
+    if ((memo->len + 1) * 4 > cap * 3) {
+        return;
+    }
+
+    size_t i = memo_index(memo, key);
+
+    for (; memo->slots[i].key != MEMO_EMPTY; i = (i + 1) & memo->mask) {
+        if (memo->slots[i].key == key) {
+            return;
+        }
+    }
+
+    memo->slots[i].key = key;
+    memo->slots[i].value = value;
+    memo->len++;
+}
+
+// x may only be an ancestor of y if it is of an earlier generation. Ties
+// are broken by id, so a pair always maps to the same memo key
+static bool
+is_younger(const struct kinship* k, uint32_t x, uint32_t y)
+{
+    uint32_t gx = k->generation[x];
+    uint32_t gy = k->generation[y];
+
+    return gx > gy || (gx == gy && x > y);
+}
+
+// Both x and y must be of a generation whose inbreeding is computed. New
+// values are memoized in local
+static double
+phi(struct kinship* k, struct kin_memo* local, uint32_t x, uint32_t y)
+{
+    if (x == y) {
+        return 0.5 * (1.0 + k->inbreeding[x]);
+    }
+
+    if (!is_younger(k, x, y)) {
+        uint32_t tmp = x;
+        x = y;
+        y = tmp;
+    }
+
+    size_t nparents;
+    const uint32_t* parents = fg_parents(k->g, x, &nparents);
+
+    // a founder is unrelated to anyone of the same or an earlier generation
+    if (!nparents) {
+        return 0.0;
+    }
+
+    uint64_t key = (uint64_t)x << 32 | y;
+    double value;
+
+    if (memo_get(k->memo, key, &value) || memo_get(local, key, &value)) {
+        return value;
+    }
+
+    value = phi(k, local, parents[0], y);
+
+    if (nparents > 1) {
+        value += phi(k, local, parents[1], y);
+    }
+
+    value *= 0.5;
+
+    memo_put(local, key, value);
+
+    return value;
+}
+
+static void
+compute_inbreeding(struct kinship* k, struct kin_memo* local, uint32_t id)
+{
+    size_t nparents;
+    const uint32_t* parents = fg_parents(k->g, id, &nparents);
+
+    k->inbreeding[id] =
+        nparents > 1 ? phi(k, local, parents[0], parents[1]) : 0.0;
+}
+
+// Runs between generations, while no worker runs
+static void
+merge_local(struct kin_job* job)
+{
+    for (size_t w = 0; w < job->nworkers; w++) {
+        struct kin_memo* local = &job->workers[w].local;
+
+        for (size_t i = 0; local->len && i <= local->mask; i++) {
+            if (local->slots[i].key != MEMO_EMPTY) {
+                memo_put(job->k->memo, local->slots[i].key,
+                         local->slots[i].value);
+            }
+        }
+
+        memo_clear(local);
+    }
+}
+
+// Computes the current generation. Slots take chunks of it as they go, so
+// they stay busy if some individuals take longer
+static void
+workers_run(size_t begin, size_t end, void* data)
+{
+    struct kin_job* job = data;
+
+    for (size_t w = begin; w < end; w++) {
+        struct kin_memo* local = &job->workers[w].local;
+
+        for (;;) {
+            size_t start = atomic_fetch_add(&job->cursor, SCHEDULE_CHUNK);
+
+            if (start >= job->end) {
+                break;
+            }
+
+            size_t stop = start + SCHEDULE_CHUNK < job->end
+                              ? start + SCHEDULE_CHUNK
+                              : job->end;
+
+            for (size_t i = start; i < stop; i++) {
+                compute_inbreeding(job->k, local, job->order[i]);
+            }
+        }
+    }
+}
+
+// Assigns generations with Kahn's algorithm. Individuals left over are on or
+// below a pedigree cycle, and keep FG_NONE
+static size_t
+assign_generations(struct kinship* k, uint32_t* indegree, uint32_t* queue)
+{
+    const struct fam_graph* g = k->g;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t ngen = 0;
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        indegree[i] = g->parent_off[i + 1] - g->parent_off[i];
+        k->generation[i] = 0;
+
+        if (!indegree[i]) {
+            queue[tail++] = i;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t u = queue[head++];
+        size_t nchildren;
+        const uint32_t* children = fg_children(g, u, &nchildren);
+
+        if (k->generation[u] + 1 > ngen) {
+            ngen = k->generation[u] + 1;
+        }
+
+        for (size_t i = 0; i < nchildren; i++) {
+            uint32_t c = children[i];
+
+            if (k->generation[c] < k->generation[u] + 1) {
+                k->generation[c] = k->generation[u] + 1;
+            }
+
+            if (!--indegree[c]) {
+                queue[tail++] = c;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        if (indegree[i]) {
+            k->generation[i] = FG_NONE;
+        }
+    }
+
+    return ngen;
+}
+
+/*
+Reports the individuals Kahn's algorithm could not order. Those in a strongly
+connected component of more than one individual, or their own child, are on a
+cycle; the rest only descend from one. The components are found with Tarjan's
+algorithm, walking the children of unordered individuals without recursion.
+*/
+static void
+report_cycles(struct kinship* k, uint32_t* index, uint32_t* stack,
+              struct context* ctx)
+{
+    const struct fam_graph* g = k->g;
+    size_t unordered = 0;
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        unordered += k->generation[i] == FG_NONE;
+        index[i] = FG_NONE;
+    }
+
+    if (!unordered) {
+        return;
+    }
+
+    // low[v] is FG_NONE once v left the stack with its component
+    uint32_t* low = malloc(g->len * sizeof *low);
+    uint32_t* frame_node = malloc(g->len * sizeof *frame_node);
+    uint32_t* frame_child = malloc(g->len * sizeof *frame_child);
+    bool* cyclic = calloc(g->len, sizeof *cyclic);
+
+    if (!low || !frame_node || !frame_child || !cyclic) {
+        ctx_warnf(ctx,
+                  "%zu individuals are on or descend from a pedigree cycle, "
+                  "their coefficients are not computed",
+                  unordered);
+        goto done;
+    }
+
+    uint32_t next = 0;
+    size_t top = 0;
+    size_t ncyclic = 0;
+
+    for (uint32_t r = 0; r < g->len; r++) {
+        if (k->generation[r] != FG_NONE || index[r] != FG_NONE) {
+            continue;
+        }
+
+        size_t depth = 1;
+
+        frame_node[0] = r;
+        frame_child[0] = 0;
+        index[r] = low[r] = next++;
+        stack[top++] = r;
+
+        while (depth) {
+            uint32_t v = frame_node[depth - 1];
+            size_t nchildren;
+            const uint32_t* children = fg_children(g, v, &nchildren);
+
+            if (frame_child[depth - 1] < nchildren) {
+                uint32_t w = children[frame_child[depth - 1]++];
+
+                if (k->generation[w] != FG_NONE) {
+                    continue;
+                }
+
+                if (index[w] == FG_NONE) {
+                    frame_node[depth] = w;
+                    frame_child[depth] = 0;
+                    depth++;
+                    index[w] = low[w] = next++;
+                    stack[top++] = w;
+                } else if (low[w] != FG_NONE && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+
+                continue;
+            }
+
+            depth--;
+
+            if (depth && low[v] < low[frame_node[depth - 1]]) {
+                low[frame_node[depth - 1]] = low[v];
+            }
+
+            if (low[v] != index[v]) {
+                continue;
+            }
+
+            // v is the root of a component, made of v and what is above it
+            bool cycle = stack[top - 1] != v;
+
+            for (size_t c = 0; c < nchildren && !cycle; c++) {
+                cycle = children[c] == v;
+            }
+
+            uint32_t w;
+
+            do {
+                w = stack[--top];
+                low[w] = FG_NONE;
+                cyclic[w] = cycle;
+                ncyclic += cycle;
+            } while (w != v);
+        }
+    }
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        if (cyclic[i]) {
+            const char* xref = g->indis[i]->xref;
+
+            ctx_errf(ctx, "pedigree cycle: %s is their own ancestor",
+                     xref ? xref : "(no xref)");
+        }
+    }
+
+    if (unordered > ncyclic) {
+        ctx_warnf(ctx,
+                  "%zu individuals descend from a pedigree cycle, their "
+                  "coefficients are not computed",
+                  unordered - ncyclic);
+    }
+
+done:
+    free(low);
+    free(frame_node);
+    free(frame_child);
+    free(cyclic);
+}
+
+static struct kin_memo*
+memo_create(size_t max_cap)
+{
+    struct kin_memo* memo = malloc(sizeof *memo);
+
+    if (!memo) {
+        return NULL;
+    }
+
+    if (memo_init(memo, MEMO_MIN_CAP, max_cap) != ST_OK) {
+        free(memo);
+
+        return NULL;
+    }
+
+    return memo;
+}
+
+static void
+memo_free(struct kin_memo* memo)
+{
+    if (!memo) {
+        return;
+    }
+
+    memo_destroy(memo);
+    free(memo);
+}
+
+// Runs the generations after the founders, one tp_for over the worker slots
+// each
+static e_statuscode
+run_generations(struct kin_job* job, const size_t* gen_off,
+                struct tp_pool* pool)
+{
+    e_statuscode result = ST_OK;
+    size_t initialized = 0;
+    size_t local_cap = MEMO_BUDGET / 2 / job->nworkers;
+
+    job->workers = malloc(job->nworkers * sizeof *job->workers);
+
+    if (!job->workers) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (; initialized < job->nworkers; initialized++) {
+        if (memo_init(&job->workers[initialized].local, MEMO_MIN_CAP,
+                      local_cap) != ST_OK) {
+            result = ST_MALLOC_ERROR;
+            goto cleanup;
+        }
+    }
+
+    for (size_t gen = 1; gen < job->k->ngen; gen++) {
+        size_t len = gen_off[gen + 1] - gen_off[gen];
+        size_t slots = (len + SCHEDULE_CHUNK - 1) / SCHEDULE_CHUNK;
+
+        atomic_store(&job->cursor, gen_off[gen]);
+        job->end = gen_off[gen + 1];
+
+        if (slots > job->nworkers) {
+            slots = job->nworkers;
+        }
+
+        if (pool && slots > 1) {
+            tp_for(pool, slots, 1, workers_run, job);
+        } else {
+            workers_run(0, 1, job);
+        }
+
+        merge_local(job);
+    }
+
+cleanup:
+    for (size_t i = 0; i < initialized; i++) {
+        memo_destroy(&job->workers[i].local);
+    }
+
+    free(job->workers);
+
+    return result;
+}
+
+struct kinship*
+kin_compute(const struct fam_graph* g, struct context* ctx, size_t nthreads)
+{
+    struct kinship* k = malloc(sizeof *k);
+
+    if (!k) {
+        return NULL;
+    }
+
+    size_t len = g->len ? g->len : 1;
+
+    k->g = g;
+    k->ngen = 0;
+    k->inbreeding = malloc(len * sizeof *k->inbreeding);
+    k->generation = malloc(len * sizeof *k->generation);
+    // the local tables are gone by the time queries run
+    k->memo = memo_create(MEMO_BUDGET / 2);
+    k->query = memo_create(MEMO_BUDGET / 2);
+
+    uint32_t* scratch = malloc(len * sizeof *scratch);
+    uint32_t* order = malloc(len * sizeof *order);
+    size_t* gen_off = NULL;
+
+    ctx_push(ctx, posctx_create("kinship"));
+
+    if (!k->inbreeding || !k->generation || !k->memo || !k->query ||
+        !scratch || !order) {
+        goto error;
+    }
+
+    k->ngen = assign_generations(k, scratch, order);
+    report_cycles(k, scratch, order, ctx);
+
+    // counting sort on generation
+    gen_off = calloc(k->ngen + 2, sizeof *gen_off);
+
+    if (!gen_off) {
+        goto error;
+    }
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        k->inbreeding[i] = NAN;
+
+        if (k->generation[i] != FG_NONE) {
+            gen_off[k->generation[i] + 2]++;
+        }
+    }
+
+    for (size_t gen = 0; gen < k->ngen; gen++) {
+        gen_off[gen + 2] += gen_off[gen + 1];
+    }
+
+    for (uint32_t i = 0; i < g->len; i++) {
+        if (k->generation[i] != FG_NONE) {
+            order[gen_off[k->generation[i] + 1]++] = i;
+        }
+    }
+
+    for (size_t i = 0; i < gen_off[1]; i++) {
+        k->inbreeding[order[i]] = 0.0;
+    }
+
+    struct tp_pool* pool = nthreads == 1 ? NULL : tp_shared();
+
+    if (!nthreads) {
+        nthreads = pool ? tp_size(pool) : 1;
+    }
+
+    struct kin_job job = {.k = k, .order = order, .nworkers = nthreads};
+
+    if (run_generations(&job, gen_off, pool) != ST_OK) {
+        goto error;
+    }
+
+    free(scratch);
+    free(order);
+    free(gen_off);
+    ctx_pop(ctx);
+
+    return k;
+
+error:
+    ctx_critf(ctx, "unable to compute kinship coefficients");
+
+    free(scratch);
+    free(order);
+    free(gen_off);
+    kin_free(k);
+    ctx_pop(ctx);
+
+    return NULL;
+}
+
+void
+kin_free(struct kinship* k)
+{
+    if (!k) {
+        return;
+    }
+
+    free(k->inbreeding);
+    free(k->generation);
+    memo_free(k->memo);
+    memo_free(k->query);
+
+    free(k);
+}
+
+double
+kin_coefficient(struct kinship* k, uint32_t a, uint32_t b)
+{
+    if (a >= k->g->len || b >= k->g->len) {
+        return NAN;
+    }
+
+    if (k->generation[a] == FG_NONE || k->generation[b] == FG_NONE) {
+        return NAN;
+    }
+
+    return phi(k, k->query, a, b);
+}
@@ -0,0 +1,54 @@
+/*
+Kinship and inbreeding coefficients for every individual of a family graph.
+
+Individuals are scheduled by generation (one past their oldest parent), so
+everyone in a generation only depends on earlier generations and a generation
+can be computed in parallel. Pairwise kinship values met on the way are
+memoized in open addressing tables: one per worker while a generation runs,
+merged into a shared one between generations. All tables together stay within
+1 GiB, values that do not fit are computed again when needed.
+
+Pedigree cycles (someone being their own ancestor) are data errors. They are
+reported through the context, and the individuals on or below a cycle get NAN
+coefficients.
+*/
+
+#ifndef GRAPH_KINSHIP_H
+#define GRAPH_KINSHIP_H
+
+#include "context/context.h"
+#include "graph/family.h"
+#include <stdint.h>
+
+struct kin_memo;
+
+struct kinship {
+    const struct fam_graph* g;
+
+    // inbreeding coefficient of each individual, which is the kinship
+    // coefficient of its parents. NAN if it could not be computed
+    double* inbreeding;
+
+    // generation of each individual, FG_NONE on or below a pedigree cycle
+    uint32_t* generation;
+    size_t ngen;
+
+    struct kin_memo* memo;  // filled by kin_compute, read only afterwards
+    struct kin_memo* query; // values computed by kin_coefficient
+};
+
+// Computes the inbreeding coefficient of every individual in g. Generations
+// are split among nthreads workers on the shared pool (see utils/pool.h), 0
+// being one per pool thread. With nthreads 1 everything runs on the calling
+// thread
+struct kinship* kin_compute(const struct fam_graph* g, struct context* ctx,
+                            size_t nthreads);
+void kin_free(struct kinship* k);
+
+// Kinship coefficient of a and b: the probability that alleles drawn at
+// random from each are identical by descent. Individuals with more than two
+// parents (adoptive families) use the first two. NAN if either is on or below
+// a pedigree cycle. Not thread safe, as it memoizes into k.
+double kin_coefficient(struct kinship* k, uint32_t a, uint32_t b);
+
+#endif // GRAPH_KINSHIP_H
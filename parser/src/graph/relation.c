@@ -0,0 +1,298 @@
+#include "graph/relation.h"
+#include <assert.h>
+#include <string.h>
+
+// Visited state of an individual for both sides of the search, kept together
+// so the meeting check touches one cache line
+struct rel_mark {
+    uint32_t stamp_a;
+    uint32_t dist_a;
+    uint32_t stamp_b;
+    uint32_t dist_b;
+};
+
+// BFS queue of one side. queue[head, tail) is the frontier at depth, the next
+// frontier is appended after tail
+struct side {
+    uint32_t* queue;
+    size_t head;
+    size_t tail;
+    size_t len;
+    uint32_t depth;
+};
+
+static uint32_t
+spread(uint32_t x, uint32_t y)
+{
+    return x > y ? x - y : y - x;
+}
+
+// Records node as a common ancestor, if it is at least as close as the ones
+// found so far
+static void
+candidate(struct rel_result* out, uint32_t* best, uint32_t node, uint32_t da,
+          uint32_t db)
+{
+    uint32_t total = da + db;
+
+    // prefer the closest ancestors, then the most even split between sides
+    if (total < *best ||
+        (total == *best && spread(da, db) < spread(out->up_a, out->up_b))) {
+        *best = total;
+        out->up_a = da;
+        out->up_b = db;
+        out->ncommon = 0;
+    } else if (total != *best || da != out->up_a) {
+        return;
+    }
+
+    if (out->ncommon < REL_MAX_COMMON) {
+        out->common[out->ncommon] = node;
+    }
+
+    out->ncommon++;
+}
+
+static void
+expand(struct rel_engine* e, struct side* s, bool is_a,
+       struct rel_result* out, uint32_t* best)
+{
+    const struct fam_graph* g = e->g;
+    uint32_t stamp = e->stamp;
+    uint32_t depth = s->depth + 1;
+
+    for (size_t i = s->head; i < s->tail; i++) {
+        uint32_t u = s->queue[i];
+
+        for (uint32_t k = g->parent_off[u]; k < g->parent_off[u + 1]; k++) {
+            uint32_t v = g->parents[k];
+            struct rel_mark* m = &e->marks[v];
+
+            if (is_a) {
+                if (m->stamp_a == stamp)
+                    continue;
+
+                m->stamp_a = stamp;
+                m->dist_a = depth;
+
+                if (m->stamp_b == stamp)
+                    candidate(out, best, v, depth, m->dist_b);
+            } else {
+                if (m->stamp_b == stamp)
+                    continue;
+
+                m->stamp_b = stamp;
+                m->dist_b = depth;
+
+                if (m->stamp_a == stamp)
+                    candidate(out, best, v, m->dist_a, depth);
+            }
+
+            s->queue[s->len++] = v;
+        }
+    }
+
+    s->head = s->tail;
+    s->tail = s->len;
+    s->depth = depth;
+}
+
+static bool
+can_expand(struct rel_engine* e, struct side* s)
+{
+    return s->head < s->tail && s->depth < e->max_gen;
+}
+
+struct rel_engine*
+rel_create(const struct fam_graph* g)
+{
+    struct rel_engine* e = malloc(sizeof *e);
+
+    if (!e) {
+        return NULL;
+    }
+
+    size_t len = g->len ? g->len : 1;
+
+    e->g = g;
+    e->max_gen = FG_GEN_ALL;
+    e->stamp = 0;
+    e->marks = calloc(len, sizeof *e->marks);
+    e->queue_a = malloc(len * sizeof *e->queue_a);
+    e->queue_b = malloc(len * sizeof *e->queue_b);
+
+    if (!e->marks || !e->queue_a || !e->queue_b) {
+        rel_free(e);
+
+        return NULL;
+    }
+
+    return e;
+}
+
+void
+rel_free(struct rel_engine* e)
+{
+    if (!e) {
+        return;
+    }
+
+    free(e->marks);
+    free(e->queue_a);
+    free(e->queue_b);
+
+    free(e);
+}
+
+// A child of common ancestor p that the search from a (or b) reached at up - 1
+// generations, on a shortest line up to p. FG_NONE if there is none
+static uint32_t
+line_child(const struct rel_engine* e, uint32_t p, bool is_a, uint32_t up)
+{
+    size_t nchildren;
+    const uint32_t* children = fg_children(e->g, p, &nchildren);
+
+    for (size_t i = 0; i < nchildren; i++) {
+        const struct rel_mark* m = &e->marks[children[i]];
+
+        if (is_a ? m->stamp_a == e->stamp && m->dist_a == up - 1
+                 : m->stamp_b == e->stamp && m->dist_b == up - 1) {
+            return children[i];
+        }
+    }
+
+    return FG_NONE;
+}
+
+// Half or full, from the parents of the two children of the common ancestors
+// the lines of a collateral relationship go through
+static rel_e_half
+half_of(const struct rel_engine* e, const struct rel_result* out)
+{
+    // both parents are nearest common ancestors
+    if (out->ncommon > 1) {
+        return REL_FULL;
+    }
+
+    uint32_t x = line_child(e, out->common[0], true, out->up_a);
+    uint32_t y = line_child(e, out->common[0], false, out->up_b);
+
+    if (x == FG_NONE || y == FG_NONE) {
+        return REL_HALF_UNKNOWN;
+    }
+
+    size_t nx;
+    size_t ny;
+
+    fg_parents(e->g, x, &nx);
+    fg_parents(e->g, y, &ny);
+
+    // their other parents differ, or those would be common ancestors too
+    return nx > 1 && ny > 1 ? REL_HALF : REL_HALF_UNKNOWN;
+}
+
+e_statuscode
+rel_find(struct rel_engine* e, uint32_t a, uint32_t b, struct rel_result* out)
+{
+    memset(out, 0, sizeof *out);
+
+    if (a >= e->g->len || b >= e->g->len) {
+        return ST_GEN_ERROR;
+    }
+
+    if (a == b) {
+        out->kind = REL_SELF;
+        out->ncommon = 1;
+        out->common[0] = a;
+
+        return ST_OK;
+    }
+
+    // a stamp is never reused without clearing the marks
+    if (++e->stamp == 0) {
+        memset(e->marks, 0, e->g->len * sizeof *e->marks);
+        e->stamp = 1;
+    }
+
+    struct side sa = {.queue = e->queue_a, .head = 0, .tail = 1, .len = 1};
+    struct side sb = {.queue = e->queue_b, .head = 0, .tail = 1, .len = 1};
+
+    sa.queue[0] = a;
+    sb.queue[0] = b;
+
+    e->marks[a].stamp_a = e->stamp;
+    e->marks[a].dist_a = 0;
+    e->marks[b].stamp_b = e->stamp;
+    e->marks[b].dist_b = 0;
+
+    uint32_t best = UINT32_MAX;
+
+    for (;;) {
+        bool can_a = can_expand(e, &sa);
+        bool can_b = can_expand(e, &sb);
+
+        if (!can_a && !can_b) {
+            break;
+        }
+
+        // A common ancestor not yet seen by a side is at least one generation
+        // beyond that side's depth. b may be an ancestor of a (or the other
+        // way around), so that is the only bound
+        uint32_t bound = UINT32_MAX;
+
+        if (can_a)
+            bound = sa.depth + 1;
+        if (can_b && sb.depth + 1 < bound)
+            bound = sb.depth + 1;
+
+        if (best <= bound) {
+            break;
+        }
+
+        bool pick_a = can_a;
+
+        if (can_a && can_b) {
+            size_t front_a = sa.tail - sa.head;
+            size_t front_b = sb.tail - sb.head;
+
+            pick_a = sa.depth < sb.depth ||
+                     (sa.depth == sb.depth && front_a <= front_b);
+        }
+
+        if (pick_a) {
+            expand(e, &sa, true, out, &best);
+        } else {
+            expand(e, &sb, false, out, &best);
+        }
+    }
+
+    if (!out->ncommon) {
+        out->kind = REL_NONE;
+    } else if (!out->up_a || !out->up_b) {
+        out->kind = REL_LINEAL;
+        out->removal = spread(out->up_a, out->up_b);
+    } else {
+        out->kind = REL_COLLATERAL;
+        out->degree = (out->up_a < out->up_b ? out->up_a : out->up_b) - 1;
+        out->removal = spread(out->up_a, out->up_b);
+        out->half = half_of(e, out);
+    }
+
+    return ST_OK;
+}
+
+e_statuscode
+rel_find_xref(struct rel_engine* e, const char* a, const char* b,
+              struct rel_result* out)
+{
+    uint32_t ida = fg_id(e->g, a);
+    uint32_t idb = fg_id(e->g, b);
+
+    if (ida == FG_NONE || idb == FG_NONE) {
+        memset(out, 0, sizeof *out);
+
+        return ST_NOT_OK;
+    }
+
+    return rel_find(e, ida, idb, out);
+}
@@ -0,0 +1,84 @@
+/*
+Relationship and common ancestor search over a family graph.
+
+rel_find() runs a breadth first search up the parent graph from both
+individuals at once, and stops as soon as no undiscovered common ancestor can
+be closer than the best one found. Visited marks are stamped with a query
+number rather than cleared, so an engine can be reused for any number of
+queries without touching memory proportional to the graph.
+
+An engine is not thread safe, create one per thread. The graph can be shared.
+*/
+
+#ifndef GRAPH_RELATION_H
+#define GRAPH_RELATION_H
+
+#include "graph/family.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REL_MAX_COMMON 8
+
+typedef enum {
+    REL_NONE = 0,  // no common ancestor
+    REL_SELF,      // a and b are the same individual
+    REL_LINEAL,    // one is an ancestor of the other
+    REL_COLLATERAL // related through a common ancestor
+} rel_e_kind;
+
+typedef enum {
+    REL_FULL = 0,    // through both parents
+    REL_HALF,        // through one parent, the other ones are known to differ
+    REL_HALF_UNKNOWN // through one parent, the other one is missing
+} rel_e_half;
+
+/*
+Distances are counted in generations from each individual up to the common
+ancestors. For collateral relationships:
+        degree 0, removal 0: siblings
+        degree 0, removal 1: aunt/uncle and niece/nephew
+        degree 1, removal 0: first cousins
+        degree 2, removal 1: second cousins once removed
+*/
+struct rel_result {
+    rel_e_kind kind;
+
+    uint32_t up_a;
+    uint32_t up_b;
+    uint32_t degree;  // min(up_a, up_b) - 1, collateral only
+    uint32_t removal; // |up_a - up_b|
+
+    // whether both parents at the top of the two lines are shared. Only
+    // meaningful for collateral relationships
+    rel_e_half half;
+
+    // nearest common ancestors, up to REL_MAX_COMMON of them (ncommon can be
+    // larger, if there were more)
+    size_t ncommon;
+    uint32_t common[REL_MAX_COMMON];
+};
+
+struct rel_mark;
+
+struct rel_engine {
+    const struct fam_graph* g;
+    uint32_t max_gen; // generations searched on each side
+
+    uint32_t stamp;
+    struct rel_mark* marks;
+
+    uint32_t* queue_a;
+    uint32_t* queue_b;
+};
+
+struct rel_engine* rel_create(const struct fam_graph* g);
+void rel_free(struct rel_engine* e);
+
+e_statuscode rel_find(struct rel_engine* e, uint32_t a, uint32_t b,
+                      struct rel_result* out);
+
+// Same as rel_find, resolving the individuals by xref
+e_statuscode rel_find_xref(struct rel_engine* e, const char* a,
+                           const char* b, struct rel_result* out);
+
+#endif // GRAPH_RELATION_H
@@ -0,0 +1,597 @@
+#include "incremental.h"
+#include "context/genstate.h"
+#include "lexer.h"
+#include "parser.h"
+#include "utils/hash64.h"
+#include "utils/hashmap.h"
+#include <assert.h>
+#include <string.h>
+
+#define DEFAULT_RANGES_CAP 64
+
+/* === Ranges === */
+
+// Whether the line at p declares a level 0 record
+static bool
+is_record_start(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+
+    return end - p > 1 && p[0] == '0' && (p[1] == ' ' || p[1] == '\t');
+}
+
+static e_statuscode
+ranges_push(struct inc_range** ranges, size_t* len, size_t* cap,
+            size_t offset, size_t line)
+{
+    if (*len == *cap) {
+        size_t grown_cap = *cap ? *cap * 2 : DEFAULT_RANGES_CAP;
+        struct inc_range* grown =
+            realloc(*ranges, grown_cap * sizeof *grown);
+
+        if (!grown) {
+            return ST_MALLOC_ERROR;
+        }
+
+        *ranges = grown;
+        *cap = grown_cap;
+    }
+
+    (*ranges)[(*len)++] = (struct inc_range){
+        .offset = offset,
+        .line = line,
+        .name_id = NM_NONE,
+    };
+
+    return ST_OK;
+}
+
+// Splits text into the ranges of its level 0 records and hashes them. Lines
+// are counted like the lexer does, by '\n'
+static e_statuscode
+ranges_split(const char* text, size_t len, struct inc_range** ranges,
+             size_t* count)
+{
+    const char* end = text + len;
+    size_t cap = 0;
+    size_t line = 1;
+    e_statuscode result = ST_OK;
+
+    *ranges = NULL;
+    *count = 0;
+
+    for (const char* p = text; p < end && result == ST_OK;) {
+        if (!*count || is_record_start(p, end)) {
+            result = ranges_push(ranges, count, &cap, p - text, line);
+        }
+
+        while (p < end && *p != '\n' && *p != '\r') {
+            p++;
+        }
+
+        while (p < end && (*p == '\n' || *p == '\r')) {
+            line += *p++ == '\n';
+        }
+    }
+
+    for (size_t i = 0; i < *count && result == ST_OK; i++) {
+        struct inc_range* r = &(*ranges)[i];
+        size_t next = i + 1 < *count ? (*ranges)[i + 1].offset : len;
+
+        r->len = next - r->offset;
+        r->hash = hash64(text + r->offset, r->len, 0);
+    }
+
+    return result;
+}
+
+// Lexes, parses and builds a single range. Returns its level 0 record
+static struct ged_record*
+range_parse(const char* text, const struct inc_range* range,
+            struct context* ctx)
+{
+    ctx_push(ctx, posctx_create("lexer"));
+
+    struct lex_lexer* lexer = lex_create(ctx);
+
+    if (!lexer) {
+        ctx_pop(ctx);
+
+        return NULL;
+    }
+
+    // diagnostics and tokens carry their line in the whole text
+    lexer->curline = range->line;
+    lexer->tokline = range->line;
+
+    for (size_t i = 0; i < range->len; i++) {
+        lex_feed(lexer, text[range->offset + i]);
+    }
+
+    lex_feed(lexer, EOF);
+    ctx_pop(ctx);
+
+    struct parser_result parsed = parser_parse(lexer->token_first, ctx);
+    ptr_arr records = ged_from_parser(parsed, ctx);
+    struct ged_record* rec = NULL;
+
+    // a range declares one level 0 record at most
+    for (size_t i = 0; records && i < pa_len(records); i++) {
+        if (!rec) {
+            rec = pa_get(records, i);
+        } else {
+            ged_record_free(pa_get(records, i));
+        }
+    }
+
+    pa_free(records);
+    parser_result_destroy(&parsed);
+    lex_free(lexer);
+
+    return rec;
+}
+
+/* === Records === */
+
+// Open addressing table of level 0 records by address, giving the index of
+// their range. Probed linearly
+struct position_slot {
+    const struct ged_record* rec;
+    size_t range;
+};
+
+struct position_table {
+    struct position_slot* slots;
+    size_t mask;
+};
+
+static size_t
+position_index(const struct position_table* table,
+               const struct ged_record* rec)
+{
+    return (size_t)(((uintptr_t)rec >> 4) * 0x9E3779B97F4A7C15ull >> 32) &
+           table->mask;
+}
+
+static e_statuscode
+position_table_init(struct position_table* table,
+                    const struct inc_range* ranges, size_t len)
+{
+    size_t cap = 16;
+
+    while (cap < len * 2) {
+        cap *= 2;
+    }
+
+    table->slots = calloc(cap, sizeof *table->slots);
+    table->mask = cap - 1;
+
+    if (!table->slots) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (!ranges[i].rec) {
+            continue;
+        }
+
+        size_t slot = position_index(table, ranges[i].rec);
+
+        while (table->slots[slot].rec) {
+            slot = (slot + 1) & table->mask;
+        }
+
+        table->slots[slot] = (struct position_slot){ranges[i].rec, i};
+    }
+
+    return ST_OK;
+}
+
+// Range of rec, or SIZE_MAX if rec is no level 0 record of the text
+static size_t
+position_of(const struct position_table* table, const struct ged_record* rec)
+{
+    for (size_t slot = position_index(table, rec); table->slots[slot].rec;
+         slot = (slot + 1) & table->mask) {
+        if (table->slots[slot].rec == rec) {
+            return table->slots[slot].range;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+static bool
+record_before(const struct ged_record* a, const struct ged_record* b,
+              void* data)
+{
+    return position_of(data, a) < position_of(data, b);
+}
+
+// The indices of a document while a reload updates them
+struct inc_update {
+    struct inc_document* inc;
+    struct position_table positions;
+    struct context* ctx;
+};
+
+static void
+unindex_node(struct inc_update* up, struct ged_record* node,
+             struct ged_record* root)
+{
+    struct ged_document* doc = up->inc->doc;
+
+    if (node->xref && ht_get(doc->xrefs, node->xref) == node) {
+        ht_del(doc->xrefs, node->xref);
+    }
+
+    for (size_t i = 0; i < sa_len(&node->value); i++) {
+        struct lex_token* tok = sa_get(&node->value, i);
+
+        if (tok->type == LT_POINTER &&
+            br_remove(doc->backrefs, tok->lexeme, root) != ST_OK) {
+            ctx_errf(up->ctx, "unable to unindex reference to %s",
+                     tok->lexeme);
+        }
+    }
+
+    for (size_t i = 0; i < sa_len(&node->children); i++) {
+        unindex_node(up, sa_get(&node->children, i), root);
+    }
+}
+
+// Takes the record of range out of the indices
+static void
+unindex_range(struct inc_update* up, struct inc_range* range)
+{
+    struct inc_clash_vec* clashes = &up->inc->clashes;
+    size_t kept = 0;
+
+    unindex_node(up, range->rec, range->rec);
+
+    if (range->name_id != NM_NONE) {
+        nm_remove(up->inc->doc->names, range->name_id);
+        range->name_id = NM_NONE;
+    }
+
+    for (size_t i = 0; i < clashes->len; i++) {
+        if (clashes->mem[i].root != range->rec) {
+            clashes->mem[kept++] = clashes->mem[i];
+        }
+    }
+
+    clashes->len = kept;
+}
+
+// Gives xref to node, unless an earlier declaration holds it. xrefs are only
+// valid on level 0 records, so a holder below one keeps its xref
+static void
+claim_xref(struct inc_update* up, struct ged_record* node,
+           struct ged_record* root)
+{
+    struct hash_table* xrefs = up->inc->doc->xrefs;
+    struct ged_record* holder = ht_get(xrefs, node->xref);
+    struct inc_clash lost = {node, root};
+
+    if (!holder) {
+        ht_set(xrefs, node->xref, node);
+
+        return;
+    }
+
+    size_t held_at = position_of(&up->positions, holder);
+
+    if (held_at != SIZE_MAX && position_of(&up->positions, root) < held_at) {
+        ht_set(xrefs, node->xref, node);
+        lost = (struct inc_clash){holder, holder};
+    }
+
+    if (inc_clash_vec_push(&up->inc->clashes, lost) != ST_OK) {
+        ctx_errf(up->ctx, "unable to remember redefined xref %s", node->xref);
+    }
+}
+
+static void
+index_node(struct inc_update* up, struct ged_record* node,
+           struct ged_record* root)
+{
+    struct ged_document* doc = up->inc->doc;
+
+    if (node->xref) {
+        if (ht_get(doc->xrefs, node->xref) != NULL) {
+            ctx_diag(up->ctx, ERROR, CTX_C_XREF_REDEFINED, node->xref);
+        }
+
+        claim_xref(up, node, root);
+    }
+
+    for (size_t i = 0; i < sa_len(&node->value); i++) {
+        struct lex_token* tok = sa_get(&node->value, i);
+
+        if (tok->type == LT_POINTER &&
+            br_insert(doc->backrefs, tok->lexeme, node, root, record_before,
+                      &up->positions) != ST_OK) {
+            ctx_errf(up->ctx, "unable to index reference to %s", tok->lexeme);
+        }
+    }
+
+    for (size_t i = 0; i < sa_len(&node->children); i++) {
+        index_node(up, sa_get(&node->children, i), root);
+    }
+}
+
+// Puts the record of range into the indices
+static void
+index_range(struct inc_update* up, struct inc_range* range)
+{
+    struct ged_record* rec = range->rec;
+
+    index_node(up, rec, rec);
+
+    if (strcmp(rec->tag, "INDI") != 0) {
+        return;
+    }
+
+    range->name_id = nm_add(up->inc->doc->names, rec);
+
+    if (range->name_id == NM_NONE) {
+        ctx_errf(up->ctx, "unable to index names of %s",
+                 rec->xref ? rec->xref : "INDI");
+    }
+}
+
+// Hands xrefs freed by removed records to the declarations that lost them,
+// the earliest first
+static void
+reclaim_xrefs(struct inc_update* up)
+{
+    struct inc_clash_vec* clashes = &up->inc->clashes;
+
+    // insertion sort on source position, there are few clashes
+    for (size_t i = 1; i < clashes->len; i++) {
+        struct inc_clash clash = clashes->mem[i];
+        size_t at = position_of(&up->positions, clash.root);
+        size_t j = i;
+
+        for (; j && position_of(&up->positions, clashes->mem[j - 1].root) > at;
+             j--) {
+            clashes->mem[j] = clashes->mem[j - 1];
+        }
+
+        clashes->mem[j] = clash;
+    }
+
+    struct inc_clash_vec pending = *clashes;
+
+    // claim_xref pushes the declarations that still lose
+    inc_clash_vec_init(clashes);
+
+    for (size_t i = 0; i < pending.len; i++) {
+        claim_xref(up, pending.mem[i].node, pending.mem[i].root);
+    }
+
+    inc_clash_vec_destroy(&pending);
+}
+
+/* === Matching === */
+
+// Open addressing table of old ranges by hash, probed linearly
+struct range_table {
+    uint32_t* slots; // index + 1, 0 if empty
+    size_t mask;
+};
+
+static e_statuscode
+range_table_init(struct range_table* table, const struct inc_range* ranges,
+                 size_t len)
+{
+    size_t cap = 16;
+
+    while (cap < len * 2) {
+        cap *= 2;
+    }
+
+    table->slots = calloc(cap, sizeof *table->slots);
+    table->mask = cap - 1;
+
+    if (!table->slots) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        size_t slot = ranges[i].hash & table->mask;
+
+        while (table->slots[slot]) {
+            slot = (slot + 1) & table->mask;
+        }
+
+        table->slots[slot] = (uint32_t)(i + 1);
+    }
+
+    return ST_OK;
+}
+
+// First old range equal to range that was not matched yet, or SIZE_MAX
+static size_t
+range_table_take(const struct range_table* table, struct inc_range* old,
+                 bool* used, const struct inc_range* range)
+{
+    for (size_t slot = range->hash & table->mask; table->slots[slot];
+         slot = (slot + 1) & table->mask) {
+        size_t i = table->slots[slot] - 1;
+
+        if (!used[i] && old[i].hash == range->hash &&
+            old[i].len == range->len) {
+            used[i] = true;
+
+            return i;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+/* === API === */
+
+struct inc_document*
+inc_parse(const char* text, size_t len, struct context* ctx)
+{
+    struct inc_document* inc = calloc(1, sizeof *inc);
+
+    if (!inc) {
+        return NULL;
+    }
+
+    inc->doc = ged_document_from_records(pa_create(100), ctx);
+
+    if (!inc->doc || inc_reload(inc, text, len, ctx, NULL) != ST_OK) {
+        inc_free(inc);
+
+        return NULL;
+    }
+
+    return inc;
+}
+
+void
+inc_free(struct inc_document* inc)
+{
+    if (!inc) {
+        return;
+    }
+
+    ged_document_free(inc->doc);
+    free(inc->ranges);
+    inc_clash_vec_destroy(&inc->clashes);
+    free(inc);
+}
+
+e_statuscode
+inc_reload(struct inc_document* inc, const char* text, size_t len,
+           struct context* ctx, struct inc_stats* stats)
+{
+    struct inc_stats counts = {0};
+    struct inc_range* ranges;
+    size_t count;
+    struct range_table table;
+    struct inc_update up = {.inc = inc, .ctx = ctx};
+
+    e_statuscode result = ranges_split(text, len, &ranges, &count);
+
+    if (result != ST_OK) {
+        free(ranges);
+
+        return result;
+    }
+
+    bool* used = calloc(inc->len + 1, sizeof *used);
+    bool* changed = calloc(count + 1, sizeof *changed);
+    bool* moved = calloc(count + 1, sizeof *moved);
+    ptr_arr records = pa_create(count ? count : 1);
+
+    if (!used || !changed || !moved || !records ||
+        range_table_init(&table, inc->ranges, inc->len) != ST_OK) {
+        free(used);
+        free(changed);
+        free(moved);
+        pa_free(records);
+        free(ranges);
+
+        return ST_MALLOC_ERROR;
+    }
+
+    // unchanged ranges keep their record, so only edits are parsed. Records
+    // that moved before ones they followed are indexed again, so that
+    // xrefs and backrefs follow source order
+    for (size_t i = 0, next_old = 0; i < count; i++) {
+        struct inc_range* r = &ranges[i];
+        size_t old = range_table_take(&table, inc->ranges, used, r);
+
+        if (old == SIZE_MAX) {
+            r->rec = range_parse(text, r, ctx);
+            changed[i] = true;
+            counts.parsed++;
+            continue;
+        }
+
+        r->rec = inc->ranges[old].rec;
+        r->name_id = inc->ranges[old].name_id;
+        r->shift = inc->ranges[old].shift +
+                   ((long)r->line - (long)inc->ranges[old].line);
+
+        if (r->rec && old < next_old) {
+            changed[i] = true;
+            moved[i] = true;
+        } else if (r->rec) {
+            next_old = old + 1;
+        }
+
+        counts.reused += r->rec != NULL;
+    }
+
+    if (position_table_init(&up.positions, ranges, count) != ST_OK) {
+        result = ST_MALLOC_ERROR;
+    }
+
+    ctx_push(ctx, posctx_create("incremental"));
+
+    for (size_t i = 0; i < count; i++) {
+        if (moved[i]) {
+            unindex_range(&up, &ranges[i]);
+        }
+    }
+
+    // drop old records first, so edited records can declare their xrefs
+    // again
+    for (size_t i = 0; i < inc->len; i++) {
+        if (!used[i] && inc->ranges[i].rec) {
+            unindex_range(&up, &inc->ranges[i]);
+            ged_record_free(inc->ranges[i].rec);
+            counts.removed++;
+        }
+    }
+
+    if (result == ST_OK) {
+        reclaim_xrefs(&up);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!ranges[i].rec) {
+            continue;
+        }
+
+        if (changed[i] && result == ST_OK) {
+            index_range(&up, &ranges[i]);
+        }
+
+        pa_push(records, ranges[i].rec);
+    }
+
+    ctx_pop(ctx);
+
+    pa_free(inc->doc->records);
+    inc->doc->records = records;
+    free(inc->ranges);
+    inc->ranges = ranges;
+    inc->len = count;
+
+    free(up.positions.slots);
+    free(table.slots);
+    free(used);
+    free(changed);
+    free(moved);
+
+    if (stats) {
+        *stats = counts;
+    }
+
+    return result;
+}
+
+size_t
+inc_line(const struct inc_range* range, const struct lex_token* tok)
+{
+    return (size_t)((long)tok->line + range->shift);
+}
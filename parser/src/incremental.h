@@ -0,0 +1,82 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "context/context.h"
+#include "gedcom.h"
+#include "utils/statuscode.h"
+#include "utils/vec.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+Incremental reparsing.
+
+The source is split into the byte ranges of its level 0 records: a range
+starts at every line beginning with "0 " and runs up to the next one. Text
+before the first such line belongs to the first range. Each range is
+fingerprinted with hash64().
+
+On reload the new text is split and hashed again, and ranges are matched to
+the old ones by hash. Only unmatched ranges are lexed, parsed and built, the
+records of matched ranges are moved over as they are. Only the changed
+records, and those moved past others, are taken out of and put into the xref,
+backref and name indices, so a reload costs the split plus the edit.
+
+The indices match those of a fresh parse of the text: an xref declared twice
+belongs to its first declaration, which takes it over again once an earlier
+one is removed, and backrefs stay in source order. Name ids follow the order
+individuals were added in.
+*/
+
+struct inc_range {
+    uint64_t hash;
+    size_t offset;
+    size_t len;
+    size_t line; // of the first byte, from 1
+
+    // added to the token lines of rec, which were lexed at line - shift.
+    // See inc_line
+    long shift;
+
+    struct ged_record* rec; // NULL if the range holds no valid record
+    uint32_t name_id;       // of rec in the name index, or NM_NONE
+};
+
+// A declaration of an xref that is already declared earlier in the source
+struct inc_clash {
+    struct ged_record* node;
+    struct ged_record* root;
+};
+
+VEC_DEFINE(inc_clash_vec, struct inc_clash)
+
+struct inc_document {
+    struct ged_document* doc;
+
+    struct inc_range* ranges; // in source order
+    size_t len;
+
+    struct inc_clash_vec clashes;
+};
+
+struct inc_stats {
+    size_t reused;  // records moved over from the previous text
+    size_t parsed;  // ranges parsed again
+    size_t removed; // records of the previous text that were dropped
+};
+
+// Parses text into a document that can be reloaded
+struct inc_document* inc_parse(const char* text, size_t len,
+                               struct context* ctx);
+void inc_free(struct inc_document* inc);
+
+// Updates inc->doc to the new text. Records in inc->doc stay valid if their
+// range did not change, all others are freed. stats may be NULL
+e_statuscode inc_reload(struct inc_document* inc, const char* text,
+                        size_t len, struct context* ctx,
+                        struct inc_stats* stats);
+
+// Line of tok in the current text. tok must belong to the record of range
+size_t inc_line(const struct inc_range* range, const struct lex_token* tok);
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,391 @@
+#include "index/backref.h"
+#include <assert.h>
+#include <string.h>
+
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_TARGETS_CAP 131
+#define DEFAULT_PENDING_CAP 64
+#define DEFAULT_EDITED_CAP 16
+
+static e_statuscode
+pending_reserve(struct backref_index* index)
+{
+    if (index->pending.len < index->pending.cap) {
+        return ST_OK;
+    }
+
+    size_t cap = index->pending.cap ? index->pending.cap * 2
+                                    : DEFAULT_PENDING_CAP;
+
+    uint32_t* target =
+        realloc(index->pending.target, cap * sizeof *index->pending.target);
+
+    if (!target) {
+        return ST_MALLOC_ERROR;
+    }
+
+    index->pending.target = target;
+
+    struct backref* refs =
+        realloc(index->pending.refs, cap * sizeof *index->pending.refs);
+
+    if (!refs) {
+        return ST_MALLOC_ERROR;
+    }
+
+    index->pending.refs = refs;
+    index->pending.cap = cap;
+
+    return ST_OK;
+}
+
+// Returns the id of target, assigning a new one if it has not been seen
+static e_statuscode
+target_id(struct backref_index* index, const char* target, uint32_t* id)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->ids, target);
+
+    if (found) {
+        *id = (uint32_t)(found - 1);
+
+        return ST_OK;
+    }
+
+    // targets grows in powers of two alongside len
+    if (!(index->len & (index->len - 1))) {
+        size_t cap = index->len ? index->len * 2 : 1;
+        char** targets = realloc(index->targets, cap * sizeof *targets);
+
+        if (!targets) {
+            return ST_MALLOC_ERROR;
+        }
+
+        index->targets = targets;
+    }
+
+    char* copy = strdup(target);
+
+    if (!copy) {
+        return ST_MALLOC_ERROR;
+    }
+
+    *id = (uint32_t)index->len;
+    index->targets[index->len++] = copy;
+    ht_set(index->ids, target, (void*)(uintptr_t)(*id + 1));
+
+    return ST_OK;
+}
+
+// The list of target id, copied out of the laid out refs on first use
+static struct backref_list*
+edited_list(struct backref_index* index, uint32_t id)
+{
+    if (id >= index->edited_cap) {
+        size_t cap = index->edited_cap ? index->edited_cap : DEFAULT_EDITED_CAP;
+
+        while (cap <= id) {
+            cap *= 2;
+        }
+
+        struct backref_list** edited =
+            realloc(index->edited, cap * sizeof *edited);
+
+        if (!edited) {
+            return NULL;
+        }
+
+        for (size_t i = index->edited_cap; i < cap; i++) {
+            edited[i] = NULL;
+        }
+
+        index->edited = edited;
+        index->edited_cap = cap;
+    }
+
+    if (index->edited[id]) {
+        return index->edited[id];
+    }
+
+    struct backref_list* list = malloc(sizeof *list);
+
+    if (!list) {
+        return NULL;
+    }
+
+    size_t first = id < index->laid_out ? index->offsets[id] : 0;
+    size_t len = id < index->laid_out ? index->offsets[id + 1] - first : 0;
+
+    list->len = len;
+    list->cap = len ? len : 1;
+    list->refs = malloc(list->cap * sizeof *list->refs);
+
+    if (!list->refs) {
+        free(list);
+
+        return NULL;
+    }
+
+    memcpy(list->refs, index->refs + first, len * sizeof *list->refs);
+    index->edited[id] = list;
+
+    return list;
+}
+
+struct backref_index*
+br_create(void)
+{
+    struct backref_index* index = malloc(sizeof *index);
+
+    if (!index) {
+        return NULL;
+    }
+
+    index->len = 0;
+    index->targets = NULL;
+    index->offsets = NULL;
+    index->refs = NULL;
+    index->laid_out = 0;
+    index->edited = NULL;
+    index->edited_cap = 0;
+    index->pending.target = NULL;
+    index->pending.refs = NULL;
+    index->pending.len = 0;
+    index->pending.cap = 0;
+    index->finalized = false;
+    index->ids = ht_create(DEFAULT_TARGETS_CAP);
+
+    if (!index->ids) {
+        free(index);
+
+        return NULL;
+    }
+
+    return index;
+}
+
+void
+br_free(struct backref_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->len; i++) {
+        free(index->targets[i]);
+    }
+
+    for (size_t i = 0; i < index->edited_cap; i++) {
+        if (index->edited[i]) {
+            free(index->edited[i]->refs);
+            free(index->edited[i]);
+        }
+    }
+
+    free(index->targets);
+    free(index->edited);
+    free(index->offsets);
+    free(index->refs);
+    free(index->pending.target);
+    free(index->pending.refs);
+    ht_free(index->ids);
+
+    free(index);
+}
+
+e_statuscode
+br_add(struct backref_index* index, const char* target,
+       struct ged_record* node, struct ged_record* root)
+{
+    if (index->finalized) {
+        assert(false /* br_add called on finalized index, see br_insert */);
+
+        return ST_GEN_ERROR;
+    }
+
+    uint32_t id;
+    e_statuscode result = target_id(index, target, &id);
+
+    if (result != ST_OK) {
+        return result;
+    }
+
+    if ((result = pending_reserve(index)) != ST_OK) {
+        return result;
+    }
+
+    size_t i = index->pending.len++;
+
+    index->pending.target[i] = id;
+    index->pending.refs[i].node = node;
+    index->pending.refs[i].root = root;
+
+    return ST_OK;
+}
+
+e_statuscode
+br_finalize(struct backref_index* index)
+{
+    if (index->finalized) {
+        return ST_OK;
+    }
+
+    size_t nedges = index->pending.len;
+
+    index->offsets = calloc(index->len + 1, sizeof *index->offsets);
+    index->refs = malloc((nedges ? nedges : 1) * sizeof *index->refs);
+
+    if (!index->offsets || !index->refs) {
+        return ST_MALLOC_ERROR;
+    }
+
+    // counting sort on target id. Stable, so refs of a target keep source
+    // order
+    for (size_t i = 0; i < nedges; i++) {
+        index->offsets[index->pending.target[i] + 1]++;
+    }
+
+    for (size_t i = 0; i < index->len; i++) {
+        index->offsets[i + 1] += index->offsets[i];
+    }
+
+    for (size_t i = 0; i < nedges; i++) {
+        size_t slot = index->offsets[index->pending.target[i]]++;
+
+        index->refs[slot] = index->pending.refs[i];
+    }
+
+    // the fill pass advanced every offset to the start of the next target
+    for (size_t i = index->len; i > 0; i--) {
+        index->offsets[i] = index->offsets[i - 1];
+    }
+
+    index->offsets[0] = 0;
+    index->laid_out = index->len;
+
+    free(index->pending.target);
+    free(index->pending.refs);
+    index->pending.target = NULL;
+    index->pending.refs = NULL;
+    index->pending.len = 0;
+    index->pending.cap = 0;
+
+    index->finalized = true;
+
+    return ST_OK;
+}
+
+e_statuscode
+br_insert(struct backref_index* index, const char* target,
+          struct ged_record* node, struct ged_record* root, br_before before,
+          void* data)
+{
+    if (!index->finalized) {
+        assert(false /* br_insert called before br_finalize */);
+
+        return ST_GEN_ERROR;
+    }
+
+    uint32_t id;
+    e_statuscode result = target_id(index, target, &id);
+
+    if (result != ST_OK) {
+        return result;
+    }
+
+    struct backref_list* list = edited_list(index, id);
+
+    if (!list) {
+        return ST_MALLOC_ERROR;
+    }
+
+    if (list->len == list->cap) {
+        struct backref* refs =
+            realloc(list->refs, list->cap * 2 * sizeof *refs);
+
+        if (!refs) {
+            return ST_MALLOC_ERROR;
+        }
+
+        list->refs = refs;
+        list->cap *= 2;
+    }
+
+    // after the edges of records before root, and of root itself
+    size_t i = list->len;
+
+    while (i && list->refs[i - 1].root != root &&
+           before(root, list->refs[i - 1].root, data)) {
+        i--;
+    }
+
+    memmove(list->refs + i + 1, list->refs + i,
+            (list->len - i) * sizeof *list->refs);
+    list->refs[i].node = node;
+    list->refs[i].root = root;
+    list->len++;
+
+    return ST_OK;
+}
+
+e_statuscode
+br_remove(struct backref_index* index, const char* target,
+          const struct ged_record* root)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->ids, target);
+
+    if (!index->finalized || !found) {
+        return ST_OK;
+    }
+
+    struct backref_list* list = edited_list(index, (uint32_t)(found - 1));
+
+    if (!list) {
+        return ST_MALLOC_ERROR;
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < list->len; i++) {
+        if (list->refs[i].root != root) {
+            list->refs[kept++] = list->refs[i];
+        }
+    }
+
+    list->len = kept;
+
+    return ST_OK;
+}
+
+const struct backref*
+br_get(const struct backref_index* index, const char* xref, size_t* count)
+{
+    *count = 0;
+
+    if (!index->finalized) {
+        assert(false /* br_get called before br_finalize */);
+
+        return NULL;
+    }
+
+    uintptr_t found = (uintptr_t)ht_get(index->ids, xref);
+
+    if (!found) {
+        return NULL;
+    }
+
+    size_t id = found - 1;
+
+    if (id < index->edited_cap && index->edited[id]) {
+        *count = index->edited[id]->len;
+
+        return *count ? index->edited[id]->refs : NULL;
+    }
+
+    if (id >= index->laid_out) {
+        return NULL;
+    }
+
+    *count = index->offsets[id + 1] - index->offsets[id];
+
+    return index->refs + index->offsets[id];
+}
@@ -0,0 +1,88 @@
+/*
+Reverse reference (backlink) index.
+
+Every pointer value (e.g. `1 CHIL @I3@`) is an edge from the record holding it
+to the record the xref names. The index stores, for each target xref, all
+records pointing at it in compressed sparse row form: refs of target id i are
+refs[offsets[i]] .. refs[offsets[i + 1] - 1].
+
+Edges are collected with br_add() while the document is built, and laid out
+once by br_finalize(). A finalized index is edited with br_insert() and
+br_remove(), which move the refs of the targets they touch out into lists of
+their own, so an edit costs as much as the refs of its target.
+*/
+
+#ifndef INDEX_BACKREF_H
+#define INDEX_BACKREF_H
+
+#include "utils/hashmap.h"
+#include "utils/statuscode.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct ged_record;
+
+struct backref {
+    struct ged_record* node; // record holding the pointer value
+    struct ged_record* root; // level 0 record node belongs to
+};
+
+struct backref_list {
+    struct backref* refs;
+    size_t len;
+    size_t cap;
+};
+
+struct backref_index {
+    size_t len;      // number of distinct targets
+    char** targets;  // xref of each target id
+    size_t* offsets; // laid_out + 1 entries, only valid once finalized
+    struct backref* refs;
+    size_t laid_out; // targets laid out by br_finalize
+
+    // refs of targets edited after finalization, NULL for the others
+    struct backref_list** edited;
+    size_t edited_cap;
+
+    struct hash_table* ids; // xref -> target id + 1
+
+    // edges collected before finalization, in the order they were added
+    struct {
+        uint32_t* target;
+        struct backref* refs;
+        size_t len;
+        size_t cap;
+    } pending;
+
+    bool finalized;
+};
+
+struct backref_index* br_create(void);
+void br_free(struct backref_index* index);
+
+e_statuscode br_add(struct backref_index* index, const char* target,
+                    struct ged_record* node, struct ged_record* root);
+
+// Lays out the collected edges. Edges are added with br_insert afterwards.
+e_statuscode br_finalize(struct backref_index* index);
+
+// Whether level 0 record a comes before b in the source
+typedef bool (*br_before)(const struct ged_record* a,
+                          const struct ged_record* b, void* data);
+
+// Adds an edge to a finalized index, in source order as told by before
+e_statuscode br_insert(struct backref_index* index, const char* target,
+                       struct ged_record* node, struct ged_record* root,
+                       br_before before, void* data);
+
+// Drops the edges of target held by root or its children
+e_statuscode br_remove(struct backref_index* index, const char* target,
+                       const struct ged_record* root);
+
+// Records referencing xref, in source order. Sets count to 0 and returns NULL
+// if nothing references xref.
+const struct backref* br_get(const struct backref_index* index,
+                             const char* xref, size_t* count);
+
+#endif // INDEX_BACKREF_H
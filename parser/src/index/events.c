@@ -0,0 +1,367 @@
+#include "index/events.h"
+#include "tags/date.h"
+#include <assert.h>
+#include <string.h>
+
+// cap should be prime, see DEFAULT_TARGETS_CAP
+#define DEFAULT_TAGS_CAP 31
+#define DEFAULT_TREE_CAP 64
+
+static const char* birth_tags[] = {"BIRT", "CHR", "BAPM"};
+static const char* death_tags[] = {"DEAT", "BURI", "CREM"};
+
+static bool
+tag_in(const char* tag, const char** tags, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (strcmp(tag, tags[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static e_statuscode
+tree_push(struct ev_tree* tree, const struct ev_event* ev)
+{
+    if (tree->len == tree->cap) {
+        size_t cap = tree->cap ? tree->cap * 2 : DEFAULT_TREE_CAP;
+        struct ev_event* events = realloc(tree->events, cap * sizeof *events);
+
+        if (!events) {
+            return ST_MALLOC_ERROR;
+        }
+
+        tree->events = events;
+        tree->cap = cap;
+    }
+
+    tree->events[tree->len++] = *ev;
+
+    return ST_OK;
+}
+
+static int
+event_cmp(const void* a, const void* b)
+{
+    const struct ev_event* x = a;
+    const struct ev_event* y = b;
+
+    if (x->lo != y->lo) {
+        return x->lo < y->lo ? -1 : 1;
+    }
+
+    return (x->hi > y->hi) - (x->hi < y->hi);
+}
+
+static int32_t
+tree_build_max(struct ev_tree* tree, size_t l, size_t r)
+{
+    if (l >= r) {
+        return INT32_MIN;
+    }
+
+    size_t mid = l + (r - l) / 2;
+    int32_t max = tree->events[mid].hi;
+    int32_t left = tree_build_max(tree, l, mid);
+    int32_t right = tree_build_max(tree, mid + 1, r);
+
+    if (left > max) {
+        max = left;
+    }
+
+    if (right > max) {
+        max = right;
+    }
+
+    tree->max_hi[mid] = max;
+
+    return max;
+}
+
+static e_statuscode
+tree_finalize(struct ev_tree* tree)
+{
+    if (!tree->len) {
+        return ST_OK;
+    }
+
+    qsort(tree->events, tree->len, sizeof *tree->events, event_cmp);
+
+    tree->max_hi = malloc(tree->len * sizeof *tree->max_hi);
+
+    if (!tree->max_hi) {
+        return ST_MALLOC_ERROR;
+    }
+
+    tree_build_max(tree, 0, tree->len);
+
+    return ST_OK;
+}
+
+static size_t
+tree_query(const struct ev_tree* tree, size_t l, size_t r, int32_t lo,
+           int32_t hi, ev_visit visit, void* data)
+{
+    size_t count = 0;
+
+    // recurse into the left subtree and loop into the right one
+    while (l < r) {
+        size_t mid = l + (r - l) / 2;
+
+        // nothing in this subtree ends at or after lo
+        if (tree->max_hi[mid] < lo) {
+            break;
+        }
+
+        count += tree_query(tree, l, mid, lo, hi, visit, data);
+
+        const struct ev_event* ev = &tree->events[mid];
+
+        // everything from mid on starts after hi
+        if (ev->lo > hi) {
+            break;
+        }
+
+        if (ev->hi >= lo) {
+            if (visit) {
+                visit(ev, data);
+            }
+
+            count++;
+        }
+
+        l = mid + 1;
+    }
+
+    return count;
+}
+
+static void
+tree_destroy(struct ev_tree* tree)
+{
+    free(tree->events);
+    free(tree->max_hi);
+}
+
+static struct ev_tree*
+tree_of(struct ev_index* index, const char* tag)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->tags, tag);
+
+    if (found) {
+        return index->trees[found - 1];
+    }
+
+    // trees grows in powers of two alongside len
+    if (!(index->len & (index->len - 1))) {
+        size_t cap = index->len ? index->len * 2 : 1;
+        struct ev_tree** trees = realloc(index->trees, cap * sizeof *trees);
+
+        if (!trees) {
+            return NULL;
+        }
+
+        index->trees = trees;
+    }
+
+    struct ev_tree* tree = calloc(1, sizeof *tree);
+
+    if (!tree) {
+        return NULL;
+    }
+
+    index->trees[index->len++] = tree;
+    ht_set(index->tags, tag, (void*)(uintptr_t)index->len);
+
+    return tree;
+}
+
+// Date of an event, taken from its first DATE child that could be parsed
+static const struct ged_date*
+event_date(struct ged_record* event)
+{
+    for (size_t i = 0; i < sa_len(&event->children); i++) {
+        struct ged_record* child = sa_get(&event->children, i);
+        const struct ged_date* date = ged_record_date(child);
+
+        if (date) {
+            return date;
+        }
+    }
+
+    return NULL;
+}
+
+static e_statuscode
+add_lifespan(struct ev_index* index, struct ged_record* indi, int64_t born_lo,
+             int64_t born_hi, int64_t died_lo, int64_t died_hi)
+{
+    bool born = born_lo <= born_hi;
+    bool died = died_lo <= died_hi;
+
+    if (!born && !died) {
+        return ST_OK;
+    }
+
+    int64_t lo = born ? born_lo : died_lo - EV_LIFESPAN_MAX;
+    int64_t hi = died ? died_hi : born_hi + EV_LIFESPAN_MAX;
+
+    if (born && died) {
+        // BEF and AFT leave one side open, the other event still bounds it
+        if (died_lo - EV_LIFESPAN_MAX > lo) {
+            lo = died_lo - EV_LIFESPAN_MAX;
+        }
+
+        if (born_hi + EV_LIFESPAN_MAX < hi) {
+            hi = born_hi + EV_LIFESPAN_MAX;
+        }
+    }
+
+    struct ev_event ev = {
+        .lo = (int32_t)(lo < DATE_MIN ? DATE_MIN : lo),
+        .hi = (int32_t)(hi > DATE_MAX ? DATE_MAX : hi),
+        .event = indi,
+        .root = indi,
+    };
+
+    if (ev.lo > ev.hi) {
+        return ST_OK;
+    }
+
+    return tree_push(&index->lifespans, &ev);
+}
+
+static e_statuscode
+add_record(struct ev_index* index, struct ged_record* root)
+{
+    bool indi = strcmp(root->tag, "INDI") == 0;
+
+    if (!indi && strcmp(root->tag, "FAM") != 0) {
+        return ST_OK;
+    }
+
+    // empty ranges until an event is found
+    int64_t born_lo = DATE_MAX, born_hi = DATE_MIN;
+    int64_t died_lo = DATE_MAX, died_hi = DATE_MIN;
+
+    for (size_t i = 0; i < sa_len(&root->children); i++) {
+        struct ged_record* event = sa_get(&root->children, i);
+        const struct ged_date* date = event_date(event);
+
+        if (!date) {
+            continue;
+        }
+
+        struct ev_tree* tree = tree_of(index, event->tag);
+        struct ev_event ev = {date->lo, date->hi, event, root};
+
+        if (!tree || tree_push(tree, &ev) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+
+        if (!indi) {
+            continue;
+        }
+
+        if (tag_in(event->tag, birth_tags,
+                   sizeof birth_tags / sizeof *birth_tags)) {
+            born_lo = date->lo < born_lo ? date->lo : born_lo;
+            born_hi = date->hi > born_hi ? date->hi : born_hi;
+        } else if (tag_in(event->tag, death_tags,
+                          sizeof death_tags / sizeof *death_tags)) {
+            died_lo = date->lo < died_lo ? date->lo : died_lo;
+            died_hi = date->hi > died_hi ? date->hi : died_hi;
+        }
+    }
+
+    if (!indi) {
+        return ST_OK;
+    }
+
+    return add_lifespan(index, root, born_lo, born_hi, died_lo, died_hi);
+}
+
+struct ev_index*
+ev_create(struct ged_document* doc)
+{
+    struct ev_index* index = calloc(1, sizeof *index);
+
+    if (!index) {
+        return NULL;
+    }
+
+    index->tags = ht_create(DEFAULT_TAGS_CAP);
+
+    if (!index->tags) {
+        free(index);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < pa_len(doc->records); i++) {
+        if (add_record(index, pa_get(doc->records, i)) != ST_OK) {
+            goto error;
+        }
+    }
+
+    for (size_t i = 0; i < index->len; i++) {
+        if (tree_finalize(index->trees[i]) != ST_OK) {
+            goto error;
+        }
+    }
+
+    if (tree_finalize(&index->lifespans) != ST_OK) {
+        goto error;
+    }
+
+    return index;
+
+error:
+    ev_free(index);
+
+    return NULL;
+}
+
+void
+ev_free(struct ev_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->len; i++) {
+        tree_destroy(index->trees[i]);
+        free(index->trees[i]);
+    }
+
+    tree_destroy(&index->lifespans);
+    free(index->trees);
+    ht_free(index->tags);
+    free(index);
+}
+
+size_t
+ev_query(const struct ev_index* index, const char* tag, int32_t lo,
+         int32_t hi, ev_visit visit, void* data)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->tags, tag);
+
+    if (!found) {
+        return 0;
+    }
+
+    const struct ev_tree* tree = index->trees[found - 1];
+
+    return tree_query(tree, 0, tree->len, lo, hi, visit, data);
+}
+
+size_t
+ev_alive(const struct ev_index* index, int32_t lo, int32_t hi,
+         ev_visit visit, void* data)
+{
+    const struct ev_tree* tree = &index->lifespans;
+
+    return tree_query(tree, 0, tree->len, lo, hi, visit, data);
+}
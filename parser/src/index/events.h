@@ -0,0 +1,67 @@
+/*
+Event date index.
+
+Events are the level 1 records of INDI and FAM records holding a parsed DATE
+(BIRT, DEAT, MARR, ...). Each event is stored as the interval of days its date
+can denote, in one tree per event tag.
+
+A tree is a sorted interval array: events sorted by first day, with the
+largest last day of every subtree kept alongside. The subtree of index mid
+over [l, r) is mid = (l + r) / 2, with [l, mid) left and [mid + 1, r) right.
+Overlap queries take O(log n + k) for k results.
+
+The index also keeps the span each individual may have lived in, from the
+first possible day of birth (BIRT, CHR, BAPM) to the last possible day of
+death (DEAT, BURI, CREM). A missing end is bounded by EV_LIFESPAN_MAX.
+*/
+
+#ifndef INDEX_EVENTS_H
+#define INDEX_EVENTS_H
+
+#include "gedcom.h"
+#include "utils/hashmap.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// 120 years, in days
+#define EV_LIFESPAN_MAX 43830
+
+struct ev_event {
+    int32_t lo; // first possible day
+    int32_t hi; // last possible day
+    struct ged_record* event; // BIRT, DEAT, ... or the INDI for lifespans
+    struct ged_record* root;  // INDI or FAM holding the event
+};
+
+struct ev_tree {
+    size_t len;
+    size_t cap;
+    struct ev_event* events; // sorted by lo, then hi
+    int32_t* max_hi;         // largest hi of the subtree at each index
+};
+
+struct ev_index {
+    size_t len; // number of trees
+    struct ev_tree** trees;
+    struct hash_table* tags; // event tag -> tree id + 1
+
+    struct ev_tree lifespans;
+};
+
+// Called for every matching event, in ascending order of lo
+typedef void (*ev_visit)(const struct ev_event* ev, void* data);
+
+struct ev_index* ev_create(struct ged_document* doc);
+void ev_free(struct ev_index* index);
+
+// Visits every tag event whose date may lie within [lo, hi] (day numbers, see
+// date_to_day). visit may be NULL to only count. Returns the number of events
+// visited
+size_t ev_query(const struct ev_index* index, const char* tag, int32_t lo,
+                int32_t hi, ev_visit visit, void* data);
+
+// Visits every individual that may have been alive at some day of [lo, hi]
+size_t ev_alive(const struct ev_index* index, int32_t lo, int32_t hi,
+                ev_visit visit, void* data);
+
+#endif // INDEX_EVENTS_H
@@ -0,0 +1,1121 @@
+#include "index/fulltext.h"
+#include "utils/pool.h"
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define FT_MAGIC "GEDFTX01"
+#define FT_MAGIC_LEN 8
+
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_TERMS_CAP 1021
+#define DEFAULT_BUF_CAP 16
+
+// A range takes at least this many records
+#define MIN_RECORDS_PER_THREAD 256
+
+struct buf {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+};
+
+// Postings of one term, written in record order
+struct posting {
+    char* term;
+    struct buf data;
+    uint32_t df;
+    uint32_t last; // last record id written, 0 before the first
+};
+
+struct term_table {
+    struct hash_table* ids; // term -> index in items + 1
+    struct posting* items;
+    size_t len;
+    size_t cap;
+};
+
+// Word at position pos of the record being indexed
+struct hit {
+    uint32_t term;
+    uint32_t pos;
+};
+
+struct worker {
+    struct ged_document* doc;
+    size_t begin; // records [begin, end)
+    size_t end;
+
+    struct term_table terms;
+
+    struct hit* hits;
+    size_t nhits;
+    size_t hits_cap;
+
+    struct buf text; // value being split into words
+    uint32_t pos;
+    e_statuscode result;
+};
+
+/*
+=================================================
+Buffers and varints
+=================================================
+*/
+
+static e_statuscode
+buf_reserve(struct buf* buf, size_t extra)
+{
+    if (buf->len + extra <= buf->cap) {
+        return ST_OK;
+    }
+
+    size_t cap = buf->cap ? buf->cap : DEFAULT_BUF_CAP;
+
+    while (cap < buf->len + extra) {
+        cap *= 2;
+    }
+
+    uint8_t* data = realloc(buf->data, cap);
+
+    if (!data) {
+        return ST_MALLOC_ERROR;
+    }
+
+    buf->data = data;
+    buf->cap = cap;
+
+    return ST_OK;
+}
+
+static e_statuscode
+buf_append(struct buf* buf, const void* mem, size_t len)
+{
+    if (buf_reserve(buf, len) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    memcpy(buf->data + buf->len, mem, len);
+    buf->len += len;
+
+    return ST_OK;
+}
+
+static e_statuscode
+buf_varint(struct buf* buf, uint64_t value)
+{
+    if (buf_reserve(buf, 10) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    do {
+        uint8_t byte = value & 0x7F;
+
+        value >>= 7;
+        buf->data[buf->len++] = byte | (value ? 0x80 : 0);
+    } while (value);
+
+    return ST_OK;
+}
+
+// Returns the byte after the varint, or NULL if it runs past end
+static const uint8_t*
+read_varint(const uint8_t* p, const uint8_t* end, uint64_t* out)
+{
+    uint64_t value = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            *out = value;
+
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================================================
+Term tables
+=================================================
+*/
+
+static e_statuscode
+table_init(struct term_table* table)
+{
+    table->items = NULL;
+    table->len = 0;
+    table->cap = 0;
+    table->ids = ht_create(DEFAULT_TERMS_CAP);
+
+    return table->ids ? ST_OK : ST_MALLOC_ERROR;
+}
+
+static void
+table_destroy(struct term_table* table)
+{
+    for (size_t i = 0; i < table->len; i++) {
+        free(table->items[i].term);
+        free(table->items[i].data.data);
+    }
+
+    free(table->items);
+
+    if (table->ids) {
+        ht_free(table->ids);
+    }
+}
+
+// Index of the postings of term, added if it is new. -1 on allocation failure
+static long
+table_get(struct term_table* table, const char* term)
+{
+    uintptr_t found = (uintptr_t)ht_get(table->ids, term);
+
+    if (found) {
+        return (long)found - 1;
+    }
+
+    if (table->len == table->cap) {
+        size_t cap = table->cap ? table->cap * 2 : DEFAULT_BUF_CAP;
+        struct posting* items = realloc(table->items, cap * sizeof *items);
+
+        if (!items) {
+            return -1;
+        }
+
+        table->items = items;
+        table->cap = cap;
+    }
+
+    char* copy = strdup(term);
+
+    if (!copy) {
+        return -1;
+    }
+
+    table->items[table->len] =
+        (struct posting){.term = copy, .data = {0}, .df = 0, .last = 0};
+    ht_set(table->ids, term, (void*)(uintptr_t)(table->len + 1));
+
+    return (long)table->len++;
+}
+
+/*
+=================================================
+Building
+=================================================
+*/
+
+static bool
+is_word_byte(unsigned char c)
+{
+    return isalnum(c) || c >= 0x80;
+}
+
+static e_statuscode
+add_hit(struct worker* w, uint32_t term)
+{
+    if (w->nhits == w->hits_cap) {
+        size_t cap = w->hits_cap ? w->hits_cap * 2 : DEFAULT_BUF_CAP;
+        struct hit* hits = realloc(w->hits, cap * sizeof *hits);
+
+        if (!hits) {
+            return ST_MALLOC_ERROR;
+        }
+
+        w->hits = hits;
+        w->hits_cap = cap;
+    }
+
+    w->hits[w->nhits++] = (struct hit){term, w->pos++};
+
+    return ST_OK;
+}
+
+// Splits text into words, calling fn for each
+static e_statuscode
+split_words(const char* text, size_t len,
+            e_statuscode (*fn)(const char* word, void* data), void* data)
+{
+    char word[FT_TERM_MAX + 1];
+    size_t wlen = 0;
+
+    for (size_t i = 0; i <= len; i++) {
+        unsigned char c = i < len ? (unsigned char)text[i] : ' ';
+
+        if (is_word_byte(c)) {
+            if (wlen < FT_TERM_MAX) {
+                word[wlen++] = (char)tolower(c);
+            }
+
+            continue;
+        }
+
+        if (!wlen) {
+            continue;
+        }
+
+        word[wlen] = '\0';
+        wlen = 0;
+
+        e_statuscode result = fn(word, data);
+
+        if (result != ST_OK) {
+            return result;
+        }
+    }
+
+    return ST_OK;
+}
+
+static e_statuscode
+worker_word(const char* word, void* data)
+{
+    struct worker* w = data;
+    long term = table_get(&w->terms, word);
+
+    if (term < 0) {
+        return ST_MALLOC_ERROR;
+    }
+
+    return add_hit(w, (uint32_t)term);
+}
+
+static e_statuscode
+append_value(struct buf* text, const struct ged_record* rec)
+{
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->type == LT_POINTER || !tok->lexeme) {
+            continue;
+        }
+
+        if (buf_append(text, tok->lexeme, strlen(tok->lexeme)) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    return ST_OK;
+}
+
+static bool
+is_continuation(const struct ged_record* rec)
+{
+    return strcmp(rec->tag, "CONC") == 0 || strcmp(rec->tag, "CONT") == 0;
+}
+
+// Indexes the value of rec, continued by its CONC and CONT children, then the
+// other children
+static e_statuscode
+index_value(struct worker* w, const struct ged_record* rec)
+{
+    w->text.len = 0;
+
+    if (append_value(&w->text, rec) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        const struct ged_record* child = sa_get(&rec->children, i);
+
+        if (!is_continuation(child)) {
+            continue;
+        }
+
+        // CONC continues the word, CONT starts a new line
+        if ((child->tag[3] == 'T' && buf_append(&w->text, "\n", 1) != ST_OK) ||
+            append_value(&w->text, child) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    if (w->text.len) {
+        e_statuscode result =
+            split_words((const char*)w->text.data, w->text.len, worker_word, w);
+
+        if (result != ST_OK) {
+            return result;
+        }
+
+        // no phrase spans two values
+        w->pos++;
+    }
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        const struct ged_record* child = sa_get(&rec->children, i);
+
+        if (is_continuation(child)) {
+            continue;
+        }
+
+        e_statuscode result = index_value(w, child);
+
+        if (result != ST_OK) {
+            return result;
+        }
+    }
+
+    return ST_OK;
+}
+
+static int
+hit_cmp(const void* a, const void* b)
+{
+    const struct hit* x = a;
+    const struct hit* y = b;
+
+    if (x->term != y->term) {
+        return x->term < y->term ? -1 : 1;
+    }
+
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+// Appends the words of record id to their postings
+static e_statuscode
+index_record(struct worker* w, uint32_t id)
+{
+    w->nhits = 0;
+    w->pos = 0;
+
+    e_statuscode result = index_value(w, pa_get(w->doc->records, id));
+
+    if (result != ST_OK) {
+        return result;
+    }
+
+    if (w->nhits > 1) {
+        qsort(w->hits, w->nhits, sizeof *w->hits, hit_cmp);
+    }
+
+    for (size_t i = 0; i < w->nhits;) {
+        struct posting* p = &w->terms.items[w->hits[i].term];
+        size_t n = 1;
+
+        while (i + n < w->nhits && w->hits[i + n].term == w->hits[i].term) {
+            n++;
+        }
+
+        if (buf_varint(&p->data, id - p->last) != ST_OK ||
+            buf_varint(&p->data, n) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+
+        uint32_t prev = 0;
+
+        for (size_t j = i; j < i + n; j++) {
+            if (buf_varint(&p->data, w->hits[j].pos - prev) != ST_OK) {
+                return ST_MALLOC_ERROR;
+            }
+
+            prev = w->hits[j].pos;
+        }
+
+        p->last = id;
+        p->df++;
+        i += n;
+    }
+
+    return ST_OK;
+}
+
+static void
+worker_run(struct worker* w)
+{
+    w->result = table_init(&w->terms);
+
+    for (size_t i = w->begin; i < w->end && w->result == ST_OK; i++) {
+        w->result = index_record(w, (uint32_t)i);
+    }
+}
+
+// Runs the workers of a range of ranges
+static void
+workers_run(size_t begin, size_t end, void* data)
+{
+    struct worker* workers = data;
+
+    for (size_t i = begin; i < end; i++) {
+        worker_run(&workers[i]);
+    }
+}
+
+// Appends the postings of a later range of records to dst. The first record
+// of src is stored as a delta from 0, and is rewritten relative to dst
+static e_statuscode
+posting_merge(struct posting* dst, const struct posting* src)
+{
+    const uint8_t* p = src->data.data;
+    const uint8_t* end = p + src->data.len;
+    uint64_t first;
+
+    p = read_varint(p, end, &first);
+    assert(p);
+
+    if (buf_varint(&dst->data, first - dst->last) != ST_OK ||
+        buf_append(&dst->data, p, end - p) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    dst->last = src->last;
+    dst->df += src->df;
+
+    return ST_OK;
+}
+
+static int
+posting_cmp(const void* a, const void* b)
+{
+    return strcmp(((const struct posting*)a)->term,
+                  ((const struct posting*)b)->term);
+}
+
+// Moves the merged postings into index, sorted by term
+static e_statuscode
+index_take(struct ft_index* index, struct term_table* table)
+{
+    qsort(table->items, table->len, sizeof *table->items, posting_cmp);
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < table->len; i++) {
+        total += table->items[i].data.len;
+    }
+
+    index->terms = malloc((table->len ? table->len : 1) * sizeof *index->terms);
+    index->postings = malloc(total ? total : 1);
+
+    if (!index->terms || !index->postings) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < table->len; i++) {
+        struct posting* p = &table->items[i];
+
+        index->terms[i] = (struct ft_term){.term = p->term,
+                                           .df = p->df,
+                                           .offset = index->postings_len,
+                                           .len = p->data.len};
+        memcpy(index->postings + index->postings_len, p->data.data,
+               p->data.len);
+        index->postings_len += p->data.len;
+        index->nterms++;
+
+        // the term string now belongs to index
+        p->term = NULL;
+    }
+
+    return ST_OK;
+}
+
+static struct ft_index*
+index_alloc(void)
+{
+    return calloc(1, sizeof(struct ft_index));
+}
+
+struct ft_index*
+ft_create(struct ged_document* doc, struct context* ctx, size_t nthreads)
+{
+    size_t nrecords = pa_len(doc->records);
+    struct tp_pool* pool = nthreads == 1 ? NULL : tp_shared();
+
+    if (!nthreads) {
+        nthreads = tp_size(pool);
+    }
+
+    if (nthreads > nrecords / MIN_RECORDS_PER_THREAD) {
+        nthreads = nrecords / MIN_RECORDS_PER_THREAD;
+    }
+
+    if (!nthreads) {
+        nthreads = 1;
+    }
+
+    struct ft_index* index = index_alloc();
+    struct worker* workers = calloc(nthreads, sizeof *workers);
+    struct term_table merged = {0};
+
+    ctx_push(ctx, posctx_create("fulltext"));
+
+    if (!index || !workers || table_init(&merged) != ST_OK) {
+        goto error;
+    }
+
+    index->nrecords = nrecords;
+
+    for (size_t i = 0; i < nthreads; i++) {
+        workers[i].doc = doc;
+        workers[i].begin = nrecords * i / nthreads;
+        workers[i].end = nrecords * (i + 1) / nthreads;
+    }
+
+    if (pool) {
+        tp_for(pool, nthreads, 1, workers_run, workers);
+    } else {
+        workers_run(0, nthreads, workers);
+    }
+
+    for (size_t i = 0; i < nthreads; i++) {
+        struct worker* w = &workers[i];
+
+        if (w->result != ST_OK) {
+            goto error;
+        }
+
+        for (size_t j = 0; j < w->terms.len; j++) {
+            long term = table_get(&merged, w->terms.items[j].term);
+
+            if (term < 0 ||
+                posting_merge(&merged.items[term], &w->terms.items[j]) !=
+                    ST_OK) {
+                goto error;
+            }
+        }
+
+        // the postings are copied, release them as early as possible
+        table_destroy(&w->terms);
+        w->terms = (struct term_table){0};
+    }
+
+    if (index_take(index, &merged) != ST_OK) {
+        goto error;
+    }
+
+    ctx_debugf(ctx, "indexed %zu terms of %zu records in %zu ranges",
+               index->nterms, nrecords, nthreads);
+
+    goto cleanup;
+
+error:
+    ctx_critf(ctx, "unable to build full-text index");
+    ft_free(index);
+    index = NULL;
+
+cleanup:
+    for (size_t i = 0; workers && i < nthreads; i++) {
+        table_destroy(&workers[i].terms);
+        free(workers[i].hits);
+        free(workers[i].text.data);
+    }
+
+    table_destroy(&merged);
+    free(workers);
+    ctx_pop(ctx);
+
+    return index;
+}
+
+void
+ft_free(struct ft_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->nterms; i++) {
+        free(index->terms[i].term);
+    }
+
+    free(index->terms);
+    free(index->postings);
+    free(index);
+}
+
+/*
+=================================================
+Queries
+=================================================
+*/
+
+struct cursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t doc;
+    uint32_t npos;
+    const uint8_t* pos; // position deltas of doc
+    bool done;
+};
+
+static void
+cursor_next(struct cursor* c)
+{
+    uint64_t delta;
+    uint64_t npos;
+
+    if (c->p >= c->end || !(c->p = read_varint(c->p, c->end, &delta)) ||
+        !(c->p = read_varint(c->p, c->end, &npos))) {
+        c->done = true;
+
+        return;
+    }
+
+    c->doc += (uint32_t)delta;
+    c->npos = (uint32_t)npos;
+    c->pos = c->p;
+
+    // skip the positions
+    for (uint32_t i = 0; i < c->npos && c->p; i++) {
+        c->p = read_varint(c->p, c->end, &delta);
+    }
+
+    if (!c->p) {
+        c->done = true;
+    }
+}
+
+static void
+cursor_init(struct cursor* c, const struct ft_index* index,
+            const struct ft_term* term)
+{
+    c->p = index->postings + term->offset;
+    c->end = c->p + term->len;
+    c->doc = 0;
+    c->done = false;
+    cursor_next(c);
+}
+
+static void
+cursor_seek(struct cursor* c, uint32_t doc)
+{
+    while (!c->done && c->doc < doc) {
+        cursor_next(c);
+    }
+}
+
+// Decodes the positions of the current record into buf
+static e_statuscode
+cursor_positions(const struct cursor* c, struct buf* buf)
+{
+    buf->len = 0;
+
+    if (buf_reserve(buf, c->npos * sizeof(uint32_t)) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    uint32_t* out = (uint32_t*)buf->data;
+    const uint8_t* p = c->pos;
+    uint32_t pos = 0;
+
+    for (uint32_t i = 0; i < c->npos; i++) {
+        uint64_t delta;
+
+        p = read_varint(p, c->end, &delta);
+        pos += (uint32_t)delta;
+        out[i] = pos;
+    }
+
+    buf->len = c->npos;
+
+    return ST_OK;
+}
+
+static const struct ft_term*
+term_find(const struct ft_index* index, const char* term)
+{
+    size_t lo = 0;
+    size_t hi = index->nterms;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(index->terms[mid].term, term);
+
+        if (!cmp) {
+            return &index->terms[mid];
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+struct query {
+    const struct ft_index* index;
+    const struct ft_term** terms; // in query order, NULL if not indexed
+    size_t len;
+    size_t cap;
+};
+
+static e_statuscode
+query_word(const char* word, void* data)
+{
+    struct query* q = data;
+
+    if (q->len == q->cap) {
+        size_t cap = q->cap ? q->cap * 2 : DEFAULT_BUF_CAP;
+        const struct ft_term** terms = realloc(q->terms, cap * sizeof *terms);
+
+        if (!terms) {
+            return ST_MALLOC_ERROR;
+        }
+
+        q->terms = terms;
+        q->cap = cap;
+    }
+
+    q->terms[q->len++] = term_find(q->index, word);
+
+    return ST_OK;
+}
+
+struct results {
+    uint32_t* ids;
+    size_t len;
+    size_t cap;
+};
+
+static e_statuscode
+results_push(struct results* r, uint32_t id)
+{
+    if (r->len == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : DEFAULT_BUF_CAP;
+        uint32_t* ids = realloc(r->ids, cap * sizeof *ids);
+
+        if (!ids) {
+            return ST_MALLOC_ERROR;
+        }
+
+        r->ids = ids;
+        r->cap = cap;
+    }
+
+    r->ids[r->len++] = id;
+
+    return ST_OK;
+}
+
+// Whether the words of the cursors follow each other in the current record
+static bool
+phrase_match(const struct cursor* cursors, size_t len, struct buf* scratch)
+{
+    struct buf* first = &scratch[0];
+
+    if (cursor_positions(&cursors[0], first) != ST_OK) {
+        return false;
+    }
+
+    uint32_t* candidates = (uint32_t*)first->data;
+    size_t ncandidates = first->len;
+
+    for (size_t i = 1; i < len && ncandidates; i++) {
+        if (cursor_positions(&cursors[i], &scratch[1]) != ST_OK) {
+            return false;
+        }
+
+        const uint32_t* pos = (const uint32_t*)scratch[1].data;
+        size_t npos = scratch[1].len;
+        size_t kept = 0;
+
+        // both lists ascend, keep starts whose word i is at start + i
+        for (size_t a = 0, b = 0; a < ncandidates && b < npos;) {
+            uint32_t want = candidates[a] + (uint32_t)i;
+
+            if (pos[b] < want) {
+                b++;
+            } else {
+                if (pos[b] == want) {
+                    candidates[kept++] = candidates[a];
+                }
+
+                a++;
+            }
+        }
+
+        ncandidates = kept;
+    }
+
+    return ncandidates > 0;
+}
+
+static e_statuscode
+search_and(const struct ft_index* index, const struct query* q, bool phrase,
+           struct results* r)
+{
+    struct cursor* cursors = malloc(q->len * sizeof *cursors);
+    struct buf scratch[2] = {{0}, {0}};
+    e_statuscode result = ST_OK;
+
+    if (!cursors) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < q->len; i++) {
+        cursor_init(&cursors[i], index, q->terms[i]);
+    }
+
+    // the cursor of the rarest word leads, phrases keep query order
+    size_t lead = 0;
+
+    for (size_t i = 1; i < q->len; i++) {
+        if (q->terms[i]->df < q->terms[lead]->df) {
+            lead = i;
+        }
+    }
+
+    while (!cursors[lead].done && result == ST_OK) {
+        uint32_t target = cursors[lead].doc;
+        bool all = true;
+
+        for (size_t i = 0; i < q->len && all; i++) {
+            cursor_seek(&cursors[i], target);
+
+            if (cursors[i].done) {
+                goto done;
+            }
+
+            if (cursors[i].doc != target) {
+                // skip the leader ahead
+                cursor_seek(&cursors[lead], cursors[i].doc);
+                all = false;
+            }
+        }
+
+        if (!all) {
+            continue;
+        }
+
+        if (!phrase || phrase_match(cursors, q->len, scratch)) {
+            result = results_push(r, target);
+        }
+
+        cursor_next(&cursors[lead]);
+    }
+
+done:
+    free(scratch[0].data);
+    free(scratch[1].data);
+    free(cursors);
+
+    return result;
+}
+
+static e_statuscode
+search_or(const struct ft_index* index, const struct query* q,
+          struct results* r)
+{
+    struct cursor* cursors = malloc((q->len ? q->len : 1) * sizeof *cursors);
+    size_t len = 0;
+    e_statuscode result = ST_OK;
+
+    if (!cursors) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < q->len; i++) {
+        if (q->terms[i]) {
+            cursor_init(&cursors[len++], index, q->terms[i]);
+        }
+    }
+
+    while (result == ST_OK) {
+        uint32_t min = UINT32_MAX;
+        bool any = false;
+
+        for (size_t i = 0; i < len; i++) {
+            if (!cursors[i].done && (!any || cursors[i].doc < min)) {
+                min = cursors[i].doc;
+                any = true;
+            }
+        }
+
+        if (!any) {
+            break;
+        }
+
+        result = results_push(r, min);
+
+        for (size_t i = 0; i < len; i++) {
+            if (!cursors[i].done && cursors[i].doc == min) {
+                cursor_next(&cursors[i]);
+            }
+        }
+    }
+
+    free(cursors);
+
+    return result;
+}
+
+size_t
+ft_search(const struct ft_index* index, ft_e_op op, const char* query,
+          uint32_t** out)
+{
+    struct query q = {.index = index};
+    struct results r = {0};
+    e_statuscode result =
+        split_words(query, strlen(query), query_word, &q);
+
+    *out = NULL;
+
+    if (result == ST_OK && op == FT_OR) {
+        result = search_or(index, &q, &r);
+    } else if (result == ST_OK && q.len) {
+        bool missing = false;
+
+        for (size_t i = 0; i < q.len; i++) {
+            missing |= !q.terms[i];
+        }
+
+        if (!missing) {
+            result = search_and(index, &q, op == FT_PHRASE, &r);
+        }
+    }
+
+    free(q.terms);
+
+    if (result != ST_OK) {
+        free(r.ids);
+
+        return 0;
+    }
+
+    *out = r.ids;
+
+    return r.len;
+}
+
+/*
+=================================================
+Files
+=================================================
+
+All integers are little endian:
+        magic           8 bytes
+        nrecords        u64
+        nterms          u64
+        postings_len    u64
+        nterms times:   u32 length, term, u32 df, u64 offset, u64 len
+        postings
+*/
+
+static bool
+write_uint(FILE* fp, uint64_t value, int bytes)
+{
+    uint8_t buf[8];
+
+    for (int i = 0; i < bytes; i++) {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    return fwrite(buf, 1, bytes, fp) == (size_t)bytes;
+}
+
+static bool
+read_uint(FILE* fp, uint64_t* value, int bytes)
+{
+    uint8_t buf[8];
+
+    if (fread(buf, 1, bytes, fp) != (size_t)bytes) {
+        return false;
+    }
+
+    *value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        *value |= (uint64_t)buf[i] << (8 * i);
+    }
+
+    return true;
+}
+
+e_statuscode
+ft_write(const struct ft_index* index, FILE* fp)
+{
+    bool ok = fwrite(FT_MAGIC, 1, FT_MAGIC_LEN, fp) == FT_MAGIC_LEN &&
+              write_uint(fp, index->nrecords, 8) &&
+              write_uint(fp, index->nterms, 8) &&
+              write_uint(fp, index->postings_len, 8);
+
+    for (size_t i = 0; i < index->nterms && ok; i++) {
+        const struct ft_term* t = &index->terms[i];
+        size_t len = strlen(t->term);
+
+        ok = write_uint(fp, len, 4) && fwrite(t->term, 1, len, fp) == len &&
+             write_uint(fp, t->df, 4) && write_uint(fp, t->offset, 8) &&
+             write_uint(fp, t->len, 8);
+    }
+
+    ok = ok && fwrite(index->postings, 1, index->postings_len, fp) ==
+                   index->postings_len;
+
+    return ok ? ST_OK : ST_FILE_ERROR;
+}
+
+struct ft_index*
+ft_read(FILE* fp)
+{
+    char magic[FT_MAGIC_LEN];
+    uint64_t nrecords;
+    uint64_t nterms;
+    uint64_t postings_len;
+
+    if (fread(magic, 1, FT_MAGIC_LEN, fp) != FT_MAGIC_LEN ||
+        memcmp(magic, FT_MAGIC, FT_MAGIC_LEN) != 0 ||
+        !read_uint(fp, &nrecords, 8) || !read_uint(fp, &nterms, 8) ||
+        !read_uint(fp, &postings_len, 8) || nrecords > UINT32_MAX ||
+        nterms > postings_len || postings_len > SIZE_MAX) {
+        return NULL;
+    }
+
+    struct ft_index* index = index_alloc();
+
+    if (!index) {
+        return NULL;
+    }
+
+    index->nrecords = nrecords;
+    index->terms = malloc((nterms ? nterms : 1) * sizeof *index->terms);
+    index->postings = malloc(postings_len ? postings_len : 1);
+
+    if (!index->terms || !index->postings) {
+        goto error;
+    }
+
+    for (uint64_t i = 0; i < nterms; i++) {
+        struct ft_term* t = &index->terms[i];
+        uint64_t len;
+        uint64_t df;
+
+        if (!read_uint(fp, &len, 4) || len > FT_TERM_MAX ||
+            !(t->term = malloc(len + 1))) {
+            goto error;
+        }
+
+        index->nterms++;
+        t->term[len] = '\0';
+
+        if (fread(t->term, 1, len, fp) != len || !read_uint(fp, &df, 4) ||
+            !read_uint(fp, &t->offset, 8) || !read_uint(fp, &t->len, 8) ||
+            t->offset > postings_len || t->len > postings_len - t->offset) {
+            goto error;
+        }
+
+        t->df = (uint32_t)df;
+    }
+
+    if (fread(index->postings, 1, postings_len, fp) != postings_len) {
+        goto error;
+    }
+
+    index->postings_len = postings_len;
+
+    return index;
+
+error:
+    ft_free(index);
+
+    return NULL;
+}
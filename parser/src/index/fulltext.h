@@ -0,0 +1,69 @@
+/*
+Full-text index over record values.
+
+Every value below a level 0 record (NOTE, PLAC, TEXT, ...) is split into
+words: runs of ASCII letters and digits, lower cased, and bytes >= 0x80, so
+UTF-8 text stays whole. CONC and CONT lines continue the value of their
+parent. Pointer values are not indexed.
+
+Each word maps to a posting list over level 0 record ids (their index in
+doc->records), stored as LEB128 varints:
+        doc delta, position count, position deltas...
+Positions count words within the record. Separate values are one position
+apart, so phrases do not match across values.
+
+The index is built in parallel, one contiguous range of records per task,
+and merged in record order. It can be written to and read from a file.
+*/
+
+#ifndef INDEX_FULLTEXT_H
+#define INDEX_FULLTEXT_H
+
+#include "context/context.h"
+#include "gedcom.h"
+#include "utils/statuscode.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Longer words are cut to this many bytes
+#define FT_TERM_MAX 64
+
+typedef enum {
+    FT_AND = 0, // records holding every word
+    FT_OR,      // records holding any word
+    FT_PHRASE,  // records holding the words in order, next to each other
+} ft_e_op;
+
+struct ft_term {
+    char* term;
+    uint32_t df;     // number of records holding the term
+    uint64_t offset; // postings of the term are postings[offset, offset + len)
+    uint64_t len;
+};
+
+struct ft_index {
+    size_t nrecords;
+    size_t nterms;
+    struct ft_term* terms; // sorted by term
+    uint8_t* postings;
+    size_t postings_len;
+};
+
+// Records are split into nthreads ranges, indexed on the shared pool (see
+// utils/pool.h). 0 is one range per pool thread, 1 indexes on the calling
+// thread
+struct ft_index* ft_create(struct ged_document* doc, struct context* ctx,
+                           size_t nthreads);
+void ft_free(struct ft_index* index);
+
+// Searches for the words of query. Writes the matching record ids, in
+// ascending order, to a new array in *out (NULL if there are none), which
+// the caller frees. Returns the number of matches
+size_t ft_search(const struct ft_index* index, ft_e_op op, const char* query,
+                 uint32_t** out);
+
+e_statuscode ft_write(const struct ft_index* index, FILE* fp);
+struct ft_index* ft_read(FILE* fp);
+
+#endif // INDEX_FULLTEXT_H
@@ -0,0 +1,303 @@
+#include "index/merkle.h"
+#include "utils/hash64.h"
+#include "utils/pool.h"
+#include <stdio.h>
+#include <string.h>
+
+// Level 0 records a task takes at most
+#define SCHEDULE_CHUNK 64
+
+// values and child lists up to these sizes are hashed without allocating
+#define VALUE_BUF 256
+#define CHILD_BUF 32
+
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_KEYS_CAP 131
+
+/* === Hashing === */
+
+static int
+u64_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t
+hash_record(const struct ged_record* rec, int flags, uint32_t chan)
+{
+    char buf[VALUE_BUF];
+    char* value = buf;
+    size_t len = ged_record_value(rec, buf, sizeof buf);
+
+    if (len >= sizeof buf) {
+        value = malloc(len + 1);
+
+        if (value) {
+            ged_record_value(rec, value, len + 1);
+        } else {
+            // out of memory, hash what fits
+            value = buf;
+            len = sizeof buf - 1;
+        }
+    }
+
+    // strings are hashed with their terminator, so fields cannot run into
+    // each other
+    uint64_t h = hash64(rec->tag, strlen(rec->tag) + 1, 0);
+
+    if (!(flags & MK_IGNORE_XREF)) {
+        const char* xref = rec->xref ? rec->xref : "";
+
+        h = hash64(xref, strlen(xref) + 1, h);
+    }
+
+    h = hash64(value, len, h);
+
+    if (value != buf) {
+        free(value);
+    }
+
+    uint64_t children_buf[CHILD_BUF];
+    uint64_t* children = children_buf;
+    size_t nchildren = sa_len(&rec->children);
+    size_t count = 0;
+
+    if (nchildren > CHILD_BUF &&
+        !(children = malloc(nchildren * sizeof *children))) {
+        return h;
+    }
+
+    for (size_t i = 0; i < nchildren; i++) {
+        const struct ged_record* child = sa_get(&rec->children, i);
+
+        if ((flags & MK_IGNORE_CHAN) && child->tag_id == chan) {
+            continue;
+        }
+
+        children[count++] = hash_record(child, flags, chan);
+    }
+
+    if (flags & MK_UNORDERED) {
+        qsort(children, count, sizeof *children, u64_cmp);
+    }
+
+    h = hash64(children, count * sizeof *children, h);
+
+    if (children != children_buf) {
+        free(children);
+    }
+
+    return h;
+}
+
+uint64_t
+mk_hash(const struct ged_record* rec, int flags)
+{
+    return hash_record(rec, flags, ged_tag_id("CHAN"));
+}
+
+static void
+hash_range(size_t begin, size_t end, void* data)
+{
+    struct mk_index* index = data;
+    uint32_t chan = ged_tag_id("CHAN");
+
+    for (size_t i = begin; i < end; i++) {
+        index->hashes[i] = hash_record(pa_get(index->doc->records, i),
+                                       index->flags, chan);
+    }
+}
+
+/* === Keys === */
+
+// Keys records by xref, or by tag for records without one. Later records with
+// a key already taken get "#n" appended, n counting from 1
+static bool
+keys_build(struct mk_index* index)
+{
+    struct hash_table* seen = ht_create(DEFAULT_KEYS_CAP); // base -> count
+
+    if (!seen) {
+        return false;
+    }
+
+    bool ok = true;
+
+    for (size_t i = 0; i < index->len && ok; i++) {
+        const struct ged_record* rec = pa_get(index->doc->records, i);
+        const char* base = rec->xref ? rec->xref : rec->tag;
+        uintptr_t n = (uintptr_t)ht_get(seen, base);
+
+        ht_set(seen, base, (void*)(n + 1));
+
+        int len = snprintf(NULL, 0, n ? "%s#%zu" : "%s", base, (size_t)n);
+
+        index->keys[i] = malloc(len + 1);
+
+        if (!index->keys[i]) {
+            ok = false;
+            break;
+        }
+
+        snprintf(index->keys[i], len + 1, n ? "%s#%zu" : "%s", base,
+                 (size_t)n);
+        ht_set(index->ids, index->keys[i], (void*)(uintptr_t)(i + 1));
+    }
+
+    ht_free(seen);
+
+    return ok;
+}
+
+/* === Index === */
+
+struct mk_index*
+mk_create(struct ged_document* doc, int flags, bool parallel)
+{
+    struct mk_index* index = calloc(1, sizeof *index);
+
+    if (!index) {
+        return NULL;
+    }
+
+    index->doc = doc;
+    index->flags = flags;
+    index->len = pa_len(doc->records);
+    index->hashes = malloc((index->len + 1) * sizeof *index->hashes);
+    index->keys = calloc(index->len + 1, sizeof *index->keys);
+    index->ids = ht_create(DEFAULT_KEYS_CAP);
+
+    if (!index->hashes || !index->keys || !index->ids ||
+        !keys_build(index)) {
+        mk_free(index);
+
+        return NULL;
+    }
+
+    if (parallel) {
+        tp_for(tp_shared(), index->len, SCHEDULE_CHUNK, hash_range, index);
+    } else {
+        hash_range(0, index->len, index);
+    }
+
+    return index;
+}
+
+void
+mk_free(struct mk_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; index->keys && i < index->len; i++) {
+        free(index->keys[i]);
+    }
+
+    free(index->keys);
+    free(index->hashes);
+    ht_free(index->ids);
+    free(index);
+}
+
+// Index of the record with key in index, or SIZE_MAX
+static size_t
+record_of(const struct mk_index* index, const char* key)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->ids, key);
+
+    return found ? found - 1 : SIZE_MAX;
+}
+
+size_t
+mk_diff(const struct mk_index* a, const struct mk_index* b, mk_visit visit,
+        void* data)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < a->len; i++) {
+        size_t j = record_of(b, a->keys[i]);
+        struct ged_record* rec = pa_get(a->doc->records, i);
+
+        if (j == SIZE_MAX) {
+            visit(MK_REMOVED, a->keys[i], rec, NULL, data);
+            count++;
+        } else if (a->hashes[i] != b->hashes[j]) {
+            visit(MK_CHANGED, a->keys[i], rec, pa_get(b->doc->records, j),
+                  data);
+            count++;
+        }
+    }
+
+    for (size_t j = 0; j < b->len; j++) {
+        if (record_of(a, b->keys[j]) == SIZE_MAX) {
+            visit(MK_ADDED, b->keys[j], NULL, pa_get(b->doc->records, j),
+                  data);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// qsort has no context argument, records are sorted as (hash, index) pairs
+struct hashed {
+    uint64_t hash;
+    size_t record;
+};
+
+static int
+hashed_cmp(const void* a, const void* b)
+{
+    const struct hashed* x = a;
+    const struct hashed* y = b;
+
+    if (x->hash != y->hash) {
+        return x->hash > y->hash ? 1 : -1;
+    }
+
+    return (x->record > y->record) - (x->record < y->record);
+}
+
+size_t
+mk_duplicates(const struct mk_index* index, mk_group_visit visit, void* data)
+{
+    struct hashed* sorted = malloc((index->len + 1) * sizeof *sorted);
+    size_t* group = malloc((index->len + 1) * sizeof *group);
+    size_t count = 0;
+
+    if (!sorted || !group) {
+        free(sorted);
+        free(group);
+
+        return 0;
+    }
+
+    for (size_t i = 0; i < index->len; i++) {
+        sorted[i] = (struct hashed){index->hashes[i], i};
+    }
+
+    qsort(sorted, index->len, sizeof *sorted, hashed_cmp);
+
+    for (size_t i = 0; i < index->len;) {
+        size_t len = 0;
+        uint64_t hash = sorted[i].hash;
+
+        while (i < index->len && sorted[i].hash == hash) {
+            group[len++] = sorted[i++].record;
+        }
+
+        if (len > 1) {
+            visit(group, len, data);
+            count++;
+        }
+    }
+
+    free(sorted);
+    free(group);
+
+    return count;
+}
@@ -0,0 +1,77 @@
+/*
+Content hashes of record subtrees.
+
+The hash of a record covers its tag, xref and value, and the hashes of its
+children, so equal hashes mean equal subtrees (up to 64-bit collisions) and
+a changed line changes the hash of every record above it. Flags make hashes
+canonical over differences that do not matter for a comparison, e.g. the
+order of children or CHAN change dates.
+
+An index keeps the hash of every level 0 record of a document, computed in
+parallel, and a key per record: its xref, or for records without one (HEAD,
+TRLR, ...) the tag and how many records of that tag came before. Two indices
+are diffed by key with one hash comparison per record.
+*/
+
+#ifndef INDEX_MERKLE_H
+#define INDEX_MERKLE_H
+
+#include "gedcom.h"
+#include "utils/hashmap.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MK_UNORDERED 1 // children hash the same in any order
+#define MK_IGNORE_CHAN 2 // CHAN records, the last change, are skipped
+#define MK_IGNORE_XREF 4 // the xref a record declares is skipped
+
+typedef enum {
+    MK_ADDED = 0, // only in the second document
+    MK_REMOVED,   // only in the first document
+    MK_CHANGED,   // in both, with different hashes
+} mk_e_change;
+
+struct mk_index {
+    struct ged_document* doc;
+    int flags;
+
+    uint64_t* hashes; // of each level 0 record, in document order
+    char** keys;      // of each level 0 record
+    size_t len;
+
+    struct hash_table* ids; // key -> record index + 1
+};
+
+// Called for each differing record. a or b is NULL for added and removed
+// records
+typedef void (*mk_visit)(mk_e_change change, const char* key,
+                         struct ged_record* a, struct ged_record* b,
+                         void* data);
+
+// Called for each group of level 0 records with equal hashes, given by their
+// index in doc->records
+typedef void (*mk_group_visit)(const size_t* records, size_t len,
+                               void* data);
+
+// Hash of the subtree below rec
+uint64_t mk_hash(const struct ged_record* rec, int flags);
+
+// Hashes every level 0 record of doc, on the shared pool (see utils/pool.h)
+// if parallel
+struct mk_index* mk_create(struct ged_document* doc, int flags,
+                           bool parallel);
+void mk_free(struct mk_index* index);
+
+// Visits the records added, removed and changed from a to b: first those of
+// a in document order, then those only in b. Both indices should be built
+// with the same flags. Returns the number of visits
+size_t mk_diff(const struct mk_index* a, const struct mk_index* b,
+               mk_visit visit, void* data);
+
+// Visits every group of identical records, e.g. with MK_IGNORE_XREF to find
+// duplicates under different xrefs. Returns the number of groups
+size_t mk_duplicates(const struct mk_index* index, mk_group_visit visit,
+                     void* data);
+
+#endif // INDEX_MERKLE_H
@@ -0,0 +1,631 @@
+#include "index/names.h"
+#include "gedcom.h"
+#include "utils/phonetic.h"
+#include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+// GEDCOM lines are at most 255 characters
+#define NAME_VALUE_MAX 256
+#define DEFAULT_INDIS_CAP 64
+#define DEFAULT_ENTRIES_CAP 64
+
+// ASCII forms of U+00C0 .. U+00DF, the lower case letters U+00E0 .. U+00FF
+// are 0x20 after them
+static const char* latin1_fold[32] = {
+    "A", "A", "A", "A", "A", "A", "AE", "C", "E", "E",  "E",
+    "I", "I", "I", "I", "I", "D", "N",  "O", "O", "O",  "O",
+    "O", "",  "O", "U", "U", "U", "U",  "Y", "TH", "SS"};
+
+/*
+=================================================
+Sorted arrays
+=================================================
+*/
+
+static e_statuscode
+reserve(void** items, size_t* cap, size_t len, size_t size)
+{
+    if (len < *cap) {
+        return ST_OK;
+    }
+
+    size_t new_cap = *cap ? *cap * 2 : DEFAULT_ENTRIES_CAP;
+    void* mem = realloc(*items, new_cap * size);
+
+    if (!mem) {
+        return ST_MALLOC_ERROR;
+    }
+
+    *items = mem;
+    *cap = new_cap;
+
+    return ST_OK;
+}
+
+// Sorts the entries after *sorted and merges them into the sorted ones
+static e_statuscode
+merge_pending(void* items, size_t len, size_t* sorted, size_t size,
+              int (*cmp)(const void*, const void*))
+{
+    size_t pending = len - *sorted;
+
+    if (!pending) {
+        return ST_OK;
+    }
+
+    char* base = items;
+
+    char* tail = base + *sorted * size;
+
+    qsort(tail, pending, size, cmp);
+
+    if (*sorted && cmp(tail - size, tail) > 0) {
+        char* tmp = malloc(pending * size);
+
+        if (!tmp) {
+            return ST_MALLOC_ERROR;
+        }
+
+        memcpy(tmp, tail, pending * size);
+
+        // merge from the back, the sorted entries move up by pending
+        size_t i = *sorted;
+        size_t j = pending;
+        size_t k = len;
+
+        while (j) {
+            if (i && cmp(base + (i - 1) * size, tmp + (j - 1) * size) > 0) {
+                memcpy(base + --k * size, base + --i * size, size);
+            } else {
+                memcpy(base + --k * size, tmp + --j * size, size);
+            }
+        }
+
+        free(tmp);
+    }
+
+    *sorted = len;
+
+    return ST_OK;
+}
+
+static int
+key_cmp(const void* a, const void* b)
+{
+    const struct nm_key* x = a;
+    const struct nm_key* y = b;
+    int result = strcmp(x->key, y->key);
+
+    return result ? result : (x->id > y->id) - (x->id < y->id);
+}
+
+static int
+code_cmp(const void* a, const void* b)
+{
+    const struct nm_code* x = a;
+    const struct nm_code* y = b;
+
+    if (x->code != y->code) {
+        return x->code < y->code ? -1 : 1;
+    }
+
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// Drops the entries of removed ids. Entries keep their order
+static void
+purge_keys(const struct name_index* index, struct nm_keys* keys)
+{
+    size_t kept = 0;
+    size_t sorted = 0;
+
+    for (size_t i = 0; i < keys->len; i++) {
+        if (!index->indis[keys->items[i].id]) {
+            free(keys->items[i].key);
+            continue;
+        }
+
+        sorted += i < keys->sorted;
+        keys->items[kept++] = keys->items[i];
+    }
+
+    keys->len = kept;
+    keys->sorted = sorted;
+}
+
+static void
+purge_codes(const struct name_index* index, struct nm_codes* codes)
+{
+    size_t kept = 0;
+    size_t sorted = 0;
+
+    for (size_t i = 0; i < codes->len; i++) {
+        if (index->indis[codes->items[i].id]) {
+            sorted += i < codes->sorted;
+            codes->items[kept++] = codes->items[i];
+        }
+    }
+
+    codes->len = kept;
+    codes->sorted = sorted;
+}
+
+static e_statuscode
+flush(struct name_index* index)
+{
+    if (index->removed) {
+        for (int i = 0; i < NM_KIND_COUNT; i++) {
+            purge_keys(index, &index->keys[i]);
+        }
+
+        for (int i = 0; i < NM_CODE_COUNT; i++) {
+            purge_codes(index, &index->codes[i]);
+        }
+
+        index->removed = 0;
+    }
+
+    for (int i = 0; i < NM_KIND_COUNT; i++) {
+        struct nm_keys* keys = &index->keys[i];
+
+        if (merge_pending(keys->items, keys->len, &keys->sorted,
+                          sizeof *keys->items, key_cmp) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    for (int i = 0; i < NM_CODE_COUNT; i++) {
+        struct nm_codes* codes = &index->codes[i];
+
+        if (merge_pending(codes->items, codes->len, &codes->sorted,
+                          sizeof *codes->items, code_cmp) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    return ST_OK;
+}
+
+/*
+=================================================
+Building
+=================================================
+*/
+
+size_t
+nm_normalize(const char* name, char* out, size_t cap)
+{
+    size_t len = 0;
+    bool space = false;
+
+    // writes c, unless out is full. len keeps counting
+#define PUT(c)                                                                 \
+    do {                                                                       \
+        if (len + 1 < cap) {                                                   \
+            out[len] = (c);                                                    \
+        }                                                                      \
+        len++;                                                                 \
+    } while (0)
+
+    for (const unsigned char* s = (const unsigned char*)name; *s; s++) {
+        const char* fold = NULL;
+        char single[2] = {0};
+
+        if (isalnum(*s)) {
+            single[0] = (char)toupper(*s);
+            fold = single;
+        } else if (*s == 0xC3 && s[1] >= 0x80 && s[1] <= 0xBF) {
+            s++;
+            fold = *s == 0xBF ? "Y" : latin1_fold[*s & 0x1F];
+        } else if (*s == '\'' || *s >= 0x80) {
+            // O'Brien is OBRIEN, other characters are dropped
+            continue;
+        } else {
+            space = len > 0;
+
+            continue;
+        }
+
+        if (!*fold) {
+            continue;
+        }
+
+        if (space) {
+            PUT(' ');
+            space = false;
+        }
+
+        for (; *fold; fold++) {
+            PUT(*fold);
+        }
+    }
+
+#undef PUT
+
+    if (cap) {
+        out[len < cap ? len : cap - 1] = '\0';
+    }
+
+    return len;
+}
+
+// Adds key for id, unless id already has it. Entries of id start at first
+static e_statuscode
+add_key(struct nm_keys* keys, size_t first, const char* key, uint32_t id)
+{
+    if (!*key) {
+        return ST_OK;
+    }
+
+    for (size_t i = first; i < keys->len; i++) {
+        if (strcmp(keys->items[i].key, key) == 0) {
+            return ST_OK;
+        }
+    }
+
+    if (reserve((void**)&keys->items, &keys->cap, keys->len,
+                sizeof *keys->items) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    char* copy = strdup(key);
+
+    if (!copy) {
+        return ST_MALLOC_ERROR;
+    }
+
+    keys->items[keys->len++] = (struct nm_key){copy, id};
+
+    return ST_OK;
+}
+
+static e_statuscode
+add_code(struct nm_codes* codes, size_t first, uint32_t code, uint32_t id)
+{
+    for (size_t i = first; i < codes->len; i++) {
+        if (codes->items[i].code == code) {
+            return ST_OK;
+        }
+    }
+
+    if (reserve((void**)&codes->items, &codes->cap, codes->len,
+                sizeof *codes->items) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    codes->items[codes->len++] = (struct nm_code){code, id};
+
+    return ST_OK;
+}
+
+// Where the entries of the individual being added start
+struct batch {
+    uint32_t id;
+    size_t keys[NM_KIND_COUNT];
+    size_t codes[NM_CODE_COUNT];
+};
+
+static e_statuscode
+add_surname(struct name_index* index, const struct batch* batch,
+            const char* raw)
+{
+    char surname[NAME_VALUE_MAX];
+
+    nm_normalize(raw, surname, sizeof surname);
+
+    if (!*surname) {
+        return ST_OK;
+    }
+
+    e_statuscode result = add_key(&index->keys[NM_SURNAME],
+                                  batch->keys[NM_SURNAME], surname, batch->id);
+
+    uint32_t soundex = ph_soundex(surname);
+
+    if (soundex && result == ST_OK) {
+        result = add_code(&index->codes[NM_SOUNDEX], batch->codes[NM_SOUNDEX],
+                          soundex, batch->id);
+    }
+
+    uint32_t dm[PH_DM_MAX_CODES];
+    size_t ndm = ph_daitch_mokotoff(surname, dm);
+
+    for (size_t i = 0; i < ndm && result == ST_OK; i++) {
+        result = add_code(&index->codes[NM_DAITCH_MOKOTOFF],
+                          batch->codes[NM_DAITCH_MOKOTOFF], dm[i], batch->id);
+    }
+
+    return result;
+}
+
+// Every word of raw is a given name
+static e_statuscode
+add_given(struct name_index* index, const struct batch* batch, const char* raw)
+{
+    char given[NAME_VALUE_MAX];
+
+    char* save;
+
+    nm_normalize(raw, given, sizeof given);
+
+    for (char* word = strtok_r(given, " ", &save); word;
+         word = strtok_r(NULL, " ", &save)) {
+        if (add_key(&index->keys[NM_GIVEN], batch->keys[NM_GIVEN], word,
+                    batch->id) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    return ST_OK;
+}
+
+// NAME is "Given /Surname/ Suffix", SURN lists surnames separated by commas
+// and GIVN given names
+static e_statuscode
+add_name(struct name_index* index, const struct batch* batch,
+         struct ged_record* name)
+{
+    char value[NAME_VALUE_MAX];
+    e_statuscode result = ST_OK;
+
+    ged_record_value(name, value, sizeof value);
+
+    char* slash = strchr(value, '/');
+
+    if (slash) {
+        char* end = strchr(slash + 1, '/');
+
+        *slash = '\0';
+
+        if (end) {
+            *end = '\0';
+        }
+
+        result = add_surname(index, batch, slash + 1);
+    }
+
+    if (result == ST_OK) {
+        result = add_given(index, batch, value);
+    }
+
+    for (size_t i = 0; i < sa_len(&name->children) && result == ST_OK; i++) {
+        struct ged_record* part = sa_get(&name->children, i);
+
+        ged_record_value(part, value, sizeof value);
+
+        if (strcmp(part->tag, "SURN") == 0) {
+            char* save;
+
+            for (char* s = strtok_r(value, ",", &save); s && result == ST_OK;
+                 s = strtok_r(NULL, ",", &save)) {
+                result = add_surname(index, batch, s);
+            }
+        } else if (strcmp(part->tag, "GIVN") == 0) {
+            result = add_given(index, batch, value);
+        }
+    }
+
+    return result;
+}
+
+struct name_index*
+nm_create(void)
+{
+    return calloc(1, sizeof(struct name_index));
+}
+
+void
+nm_free(struct name_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (int i = 0; i < NM_KIND_COUNT; i++) {
+        for (size_t j = 0; j < index->keys[i].len; j++) {
+            free(index->keys[i].items[j].key);
+        }
+
+        free(index->keys[i].items);
+    }
+
+    for (int i = 0; i < NM_CODE_COUNT; i++) {
+        free(index->codes[i].items);
+    }
+
+    free(index->indis);
+    free(index);
+}
+
+uint32_t
+nm_add(struct name_index* index, struct ged_record* rec)
+{
+    if (strcmp(rec->tag, "INDI") != 0 || index->len >= NM_NONE) {
+        return NM_NONE;
+    }
+
+    if (index->len == index->cap) {
+        size_t cap = index->cap ? index->cap * 2 : DEFAULT_INDIS_CAP;
+        struct ged_record** indis = realloc(index->indis, cap * sizeof *indis);
+
+        if (!indis) {
+            return NM_NONE;
+        }
+
+        index->indis = indis;
+        index->cap = cap;
+    }
+
+    struct batch batch = {.id = (uint32_t)index->len};
+
+    for (int i = 0; i < NM_KIND_COUNT; i++) {
+        batch.keys[i] = index->keys[i].len;
+    }
+
+    for (int i = 0; i < NM_CODE_COUNT; i++) {
+        batch.codes[i] = index->codes[i].len;
+    }
+
+    // the id is taken even if a name can not be indexed, so ids stay dense
+    index->indis[index->len++] = rec;
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        struct ged_record* child = sa_get(&rec->children, i);
+
+        if (strcmp(child->tag, "NAME") != 0) {
+            continue;
+        }
+
+        if (add_name(index, &batch, child) != ST_OK) {
+            break;
+        }
+    }
+
+    return batch.id;
+}
+
+void
+nm_remove(struct name_index* index, uint32_t id)
+{
+    if (id < index->len && index->indis[id]) {
+        index->indis[id] = NULL;
+        index->removed++;
+    }
+}
+
+/*
+=================================================
+Queries
+=================================================
+*/
+
+size_t
+nm_prefix(struct name_index* index, nm_e_kind kind, const char* prefix,
+          nm_visit visit, void* data)
+{
+    char key[NAME_VALUE_MAX];
+    size_t len = nm_normalize(prefix, key, sizeof key);
+
+    if (len >= sizeof key || flush(index) != ST_OK) {
+        return 0;
+    }
+
+    const struct nm_keys* keys = &index->keys[kind];
+    size_t lo = 0;
+    size_t hi = keys->len;
+
+    // first key not less than the prefix
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(keys->items[mid].key, key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    size_t count = 0;
+
+    for (size_t i = lo; i < keys->len; i++) {
+        const struct nm_key* entry = &keys->items[i];
+
+        if (strncmp(entry->key, key, len) != 0) {
+            break;
+        }
+
+        if (visit) {
+            visit(entry->id, index->indis[entry->id], data);
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+static int
+id_cmp(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+size_t
+nm_phonetic(struct name_index* index, nm_e_code code, const char* name,
+            nm_visit visit, void* data)
+{
+    char normalized[NAME_VALUE_MAX];
+    uint32_t query[PH_DM_MAX_CODES];
+    size_t nquery = 0;
+
+    nm_normalize(name, normalized, sizeof normalized);
+
+    if (code == NM_SOUNDEX) {
+        query[0] = ph_soundex(normalized);
+        nquery = query[0] != 0;
+    } else {
+        nquery = ph_daitch_mokotoff(normalized, query);
+    }
+
+    if (!nquery || flush(index) != ST_OK) {
+        return 0;
+    }
+
+    const struct nm_codes* codes = &index->codes[code];
+    uint32_t* ids = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+
+    for (size_t q = 0; q < nquery; q++) {
+        size_t lo = 0;
+        size_t hi = codes->len;
+
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (codes->items[mid].code < query[q]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        for (; lo < codes->len && codes->items[lo].code == query[q]; lo++) {
+            if (reserve((void**)&ids, &cap, len, sizeof *ids) != ST_OK) {
+                free(ids);
+
+                return 0;
+            }
+
+            ids[len++] = codes->items[lo].id;
+        }
+    }
+
+    // a name can match through several of its codes
+    if (nquery > 1) {
+        qsort(ids, len, sizeof *ids, id_cmp);
+    }
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (i && ids[i] == ids[i - 1]) {
+            continue;
+        }
+
+        if (visit) {
+            visit(ids[i], index->indis[ids[i]], data);
+        }
+
+        count++;
+    }
+
+    free(ids);
+
+    return count;
+}
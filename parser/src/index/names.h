@@ -0,0 +1,97 @@
+/*
+Name index.
+
+Individuals get dense ids in the order they are added, which for a whole
+document is the order of its INDI records (the same ids as struct fam_graph).
+
+NAME values ("Given /Surname/") are normalized to upper case ASCII, with
+Latin-1 accents folded. Surnames and every given name word are kept as sorted
+(key, id) arrays for prefix search, surnames additionally as sorted
+(code, id) arrays of their Soundex and Daitch-Mokotoff codes.
+
+Records can be added and removed at any time: new entries are appended
+unsorted and merged into the sorted arrays by the next query, which also drops
+the entries of removed individuals. Queries may thus modify the index and must
+not run concurrently with each other, nm_add() or nm_remove(). Ids of removed
+individuals are not reused, so after a removal ids no longer match struct
+fam_graph.
+*/
+
+#ifndef INDEX_NAMES_H
+#define INDEX_NAMES_H
+
+#include "utils/statuscode.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NM_NONE UINT32_MAX
+
+struct ged_record;
+
+typedef enum { NM_SURNAME = 0, NM_GIVEN, NM_KIND_COUNT } nm_e_kind;
+
+typedef enum { NM_SOUNDEX = 0, NM_DAITCH_MOKOTOFF, NM_CODE_COUNT } nm_e_code;
+
+struct nm_key {
+    char* key;
+    uint32_t id;
+};
+
+struct nm_code {
+    uint32_t code;
+    uint32_t id;
+};
+
+// Entries up to sorted are in order, the ones after it still need merging
+struct nm_keys {
+    struct nm_key* items;
+    size_t len;
+    size_t cap;
+    size_t sorted;
+};
+
+struct nm_codes {
+    struct nm_code* items;
+    size_t len;
+    size_t cap;
+    size_t sorted;
+};
+
+struct name_index {
+    size_t len; // individuals
+    size_t cap;
+    struct ged_record** indis; // NULL for removed ids
+    size_t removed;            // ids removed since the last query
+
+    struct nm_keys keys[NM_KIND_COUNT];
+    struct nm_codes codes[NM_CODE_COUNT];
+};
+
+// Called once per matching name. An individual is visited once per distinct
+// name of theirs that matches
+typedef void (*nm_visit)(uint32_t id, struct ged_record* indi, void* data);
+
+struct name_index* nm_create(void);
+void nm_free(struct name_index* index);
+
+// Indexes the names of an INDI record. Returns its id, or NM_NONE if rec is
+// no INDI or could not be added
+uint32_t nm_add(struct name_index* index, struct ged_record* rec);
+
+// Removes the individual id returned by nm_add
+void nm_remove(struct name_index* index, uint32_t id);
+
+// Upper case ASCII form of a name, see above. Returns the length of the
+// normalized name, which is truncated to cap - 1 characters
+size_t nm_normalize(const char* name, char* out, size_t cap);
+
+// Visits every individual with a name of kind starting with prefix. Returns
+// the number of visits
+size_t nm_prefix(struct name_index* index, nm_e_kind kind, const char* prefix,
+                 nm_visit visit, void* data);
+
+// Visits every individual, once, whose surname sounds like name
+size_t nm_phonetic(struct name_index* index, nm_e_code code, const char* name,
+                   nm_visit visit, void* data);
+
+#endif // INDEX_NAMES_H
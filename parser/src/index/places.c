@@ -0,0 +1,636 @@
+#include "index/places.h"
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+// GEDCOM lines are at most 255 characters
+#define PLACE_VALUE_MAX 256
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_NAMES_CAP 1021
+#define DEFAULT_NODES_CAP 64
+#define DEFAULT_CHILDREN_CAP 128 // power of two
+
+// A PLAC value found while walking the document
+struct pending_ref {
+    uint32_t node;
+    struct pl_ref ref;
+};
+
+struct builder {
+    struct place_index* index;
+    size_t nodes_cap;
+
+    // children in insertion order, only used to number the nodes
+    uint32_t* first_child;
+    uint32_t* last_child;
+    uint32_t* next_sibling;
+
+    struct pending_ref* pending;
+    size_t npending;
+    size_t pending_cap;
+};
+
+/*
+=================================================
+Child table
+=================================================
+*/
+
+static size_t
+child_slot(const struct pl_children* children, uint64_t key)
+{
+    // Fibonacci hashing
+    size_t mask = children->cap - 1;
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+
+    while (children->keys[slot] && children->keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static uint64_t
+child_key(uint32_t parent, uint32_t name)
+{
+    return ((uint64_t)parent << 32 | name) + 1;
+}
+
+static e_statuscode
+children_init(struct pl_children* children, size_t cap)
+{
+    children->cap = cap;
+    children->len = 0;
+    children->keys = calloc(cap, sizeof *children->keys);
+    children->nodes = malloc(cap * sizeof *children->nodes);
+
+    if (!children->keys || !children->nodes) {
+        free(children->keys);
+        free(children->nodes);
+        children->keys = NULL;
+        children->nodes = NULL;
+
+        return ST_MALLOC_ERROR;
+    }
+
+    return ST_OK;
+}
+
+static void
+children_destroy(struct pl_children* children)
+{
+    free(children->keys);
+    free(children->nodes);
+}
+
+static e_statuscode
+children_set(struct pl_children* children, uint32_t parent, uint32_t name,
+             uint32_t node)
+{
+    // kept at most half full
+    if ((children->len + 1) * 2 > children->cap) {
+        struct pl_children grown;
+
+        if (children_init(&grown, children->cap * 2) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+
+        for (size_t i = 0; i < children->cap; i++) {
+            if (children->keys[i]) {
+                size_t slot = child_slot(&grown, children->keys[i]);
+
+                grown.keys[slot] = children->keys[i];
+                grown.nodes[slot] = children->nodes[i];
+            }
+        }
+
+        grown.len = children->len;
+        children_destroy(children);
+        *children = grown;
+    }
+
+    uint64_t key = child_key(parent, name);
+    size_t slot = child_slot(children, key);
+
+    children->len += !children->keys[slot];
+    children->keys[slot] = key;
+    children->nodes[slot] = node;
+
+    return ST_OK;
+}
+
+static uint32_t
+children_get(const struct pl_children* children, uint32_t parent,
+             uint32_t name)
+{
+    size_t slot = child_slot(children, child_key(parent, name));
+
+    return children->keys[slot] ? children->nodes[slot] : PL_NONE;
+}
+
+/*
+=================================================
+Building
+=================================================
+*/
+
+// Trims the jurisdiction [begin, end) in place, returning its start
+static char*
+trim(char* begin, char* end)
+{
+    while (begin < end && isspace((unsigned char)*begin)) {
+        begin++;
+    }
+
+    while (end > begin && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+
+    *end = '\0';
+
+    return begin;
+}
+
+// Cuts the last jurisdiction off value, whose first len characters are left.
+// len is set to SIZE_MAX once no jurisdiction is left
+static const char*
+pop_component(char* value, size_t* len)
+{
+    char* end = value + *len;
+    char* begin = end;
+
+    while (begin > value && begin[-1] != ',') {
+        begin--;
+    }
+
+    *len = begin > value ? (size_t)(begin - value - 1) : SIZE_MAX;
+
+    return trim(begin, end);
+}
+
+// Index of name in names, added if it is new. PL_NONE on allocation failure
+static uint32_t
+intern(struct place_index* index, const char* name)
+{
+    uintptr_t found = (uintptr_t)ht_get(index->name_ids, name);
+
+    if (found) {
+        return (uint32_t)(found - 1);
+    }
+
+    // names grows in powers of two alongside nnames
+    if (!(index->nnames & (index->nnames - 1))) {
+        size_t cap = index->nnames ? index->nnames * 2 : 1;
+        char** names = realloc(index->names, cap * sizeof *names);
+
+        if (!names) {
+            return PL_NONE;
+        }
+
+        index->names = names;
+    }
+
+    char* copy = strdup(name);
+
+    if (!copy) {
+        return PL_NONE;
+    }
+
+    index->names[index->nnames++] = copy;
+
+    // the empty name can not be a hashtable key, it is looked up by hand
+    if (*name) {
+        ht_set(index->name_ids, name, (void*)(uintptr_t)index->nnames);
+    }
+
+    return (uint32_t)(index->nnames - 1);
+}
+
+static uint32_t
+node_add(struct builder* b, uint32_t parent, uint32_t name)
+{
+    struct place_index* index = b->index;
+
+    if (index->len == b->nodes_cap) {
+        size_t cap = b->nodes_cap * 2;
+        struct pl_node* nodes = realloc(index->nodes, cap * sizeof *nodes);
+
+        if (nodes) {
+            index->nodes = nodes;
+        }
+
+        // each array keeps its old block if growing it fails
+        uint32_t** arrays[] = {&b->first_child, &b->last_child,
+                               &b->next_sibling};
+        bool grown = nodes != NULL;
+
+        for (size_t i = 0; i < sizeof arrays / sizeof *arrays; i++) {
+            uint32_t* array = realloc(*arrays[i], cap * sizeof *array);
+
+            if (array) {
+                *arrays[i] = array;
+            }
+
+            grown = grown && array;
+        }
+
+        if (!grown) {
+            return PL_NONE;
+        }
+
+        b->nodes_cap = cap;
+    }
+
+    uint32_t node = (uint32_t)index->len;
+
+    if (children_set(&index->children, parent, name, node) != ST_OK) {
+        return PL_NONE;
+    }
+
+    index->len++;
+    index->nodes[node] = (struct pl_node){
+        .name = name,
+        .parent = parent,
+        .size = 1,
+        .depth = parent == PL_NONE ? 0 : index->nodes[parent].depth + 1};
+    b->first_child[node] = PL_NONE;
+    b->last_child[node] = PL_NONE;
+    b->next_sibling[node] = PL_NONE;
+
+    if (parent != PL_NONE) {
+        if (b->last_child[parent] == PL_NONE) {
+            b->first_child[parent] = node;
+        } else {
+            b->next_sibling[b->last_child[parent]] = node;
+        }
+
+        b->last_child[parent] = node;
+    }
+
+    return node;
+}
+
+static uint32_t
+name_lookup(const struct place_index* index, const char* name)
+{
+    if (!*name) {
+        // the empty name is interned at most once, search for it
+        for (size_t i = 0; i < index->nnames; i++) {
+            if (!*index->names[i]) {
+                return (uint32_t)i;
+            }
+        }
+
+        return PL_NONE;
+    }
+
+    uintptr_t found = (uintptr_t)ht_get(index->name_ids, name);
+
+    return found ? (uint32_t)(found - 1) : PL_NONE;
+}
+
+// Node of value, from its last jurisdiction down, added if it is new
+static uint32_t
+place_add(struct builder* b, char* value)
+{
+    struct place_index* index = b->index;
+    uint32_t node = PL_ROOT;
+
+    for (size_t len = strlen(value); len != SIZE_MAX;) {
+        const char* component = pop_component(value, &len);
+        uint32_t name = name_lookup(index, component);
+
+        if (name == PL_NONE) {
+            name = intern(index, component);
+        }
+
+        uint32_t child = name == PL_NONE
+                             ? PL_NONE
+                             : children_get(&index->children, node, name);
+
+        if (child == PL_NONE && name != PL_NONE) {
+            child = node_add(b, node, name);
+        }
+
+        if (child == PL_NONE) {
+            return PL_NONE;
+        }
+
+        node = child;
+    }
+
+    return node;
+}
+
+static e_statuscode
+pending_add(struct builder* b, uint32_t node, struct ged_record* event,
+            struct ged_record* root)
+{
+    if (b->npending == b->pending_cap) {
+        size_t cap = b->pending_cap ? b->pending_cap * 2 : DEFAULT_NODES_CAP;
+        struct pending_ref* pending =
+            realloc(b->pending, cap * sizeof *pending);
+
+        if (!pending) {
+            return ST_MALLOC_ERROR;
+        }
+
+        b->pending = pending;
+        b->pending_cap = cap;
+    }
+
+    b->pending[b->npending++] = (struct pending_ref){node, {event, root}};
+
+    return ST_OK;
+}
+
+static e_statuscode
+collect(struct builder* b, struct ged_record* rec, struct ged_record* root)
+{
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        struct ged_record* child = sa_get(&rec->children, i);
+
+        if (strcmp(child->tag, "PLAC") == 0) {
+            char value[PLACE_VALUE_MAX];
+
+            ged_record_value(child, value, sizeof value);
+
+            uint32_t node = *value ? place_add(b, value) : PL_ROOT;
+
+            if (node == PL_NONE) {
+                return ST_MALLOC_ERROR;
+            }
+
+            // events without a place are not indexed
+            if (node != PL_ROOT && pending_add(b, node, rec, root) != ST_OK) {
+                return ST_MALLOC_ERROR;
+            }
+        }
+
+        if (collect(b, child, root) != ST_OK) {
+            return ST_MALLOC_ERROR;
+        }
+    }
+
+    return ST_OK;
+}
+
+// Renumbers the nodes in preorder and lays out their refs
+static e_statuscode
+finalize(struct builder* b)
+{
+    struct place_index* index = b->index;
+    size_t len = index->len;
+    uint32_t* order = malloc(len * sizeof *order); // preorder -> old
+    uint32_t* renamed = malloc(len * sizeof *renamed); // old -> preorder
+    struct pl_node* nodes = malloc(len * sizeof *nodes);
+    struct pl_children children;
+    e_statuscode result = ST_MALLOC_ERROR;
+
+    index->ref_off = calloc(len + 1, sizeof *index->ref_off);
+    index->refs = malloc((b->npending ? b->npending : 1) * sizeof *index->refs);
+
+    if (!order || !renamed || !nodes || !index->ref_off || !index->refs ||
+        children_init(&children, index->children.cap) != ST_OK) {
+        goto cleanup;
+    }
+
+    // preorder: the stack reuses order, which is filled from the front
+    size_t top = len;
+    size_t next = 0;
+
+    order[--top] = PL_ROOT;
+
+    while (top < len) {
+        uint32_t node = order[top++];
+
+        renamed[node] = (uint32_t)next;
+        order[next++] = node;
+
+        // push the children last to first, so the first is visited next
+        size_t first = top;
+
+        for (uint32_t c = b->first_child[node]; c != PL_NONE;
+             c = b->next_sibling[c]) {
+            order[--top] = c;
+        }
+
+        for (size_t i = top, j = first - 1; i < j; i++, j--) {
+            uint32_t tmp = order[i];
+
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    assert(next == len);
+
+    for (size_t i = 0; i < len; i++) {
+        struct pl_node old = index->nodes[order[i]];
+
+        nodes[i] = old;
+        nodes[i].parent = old.parent == PL_NONE ? PL_NONE : renamed[old.parent];
+        nodes[i].size = 1;
+
+        if (nodes[i].parent != PL_NONE) {
+            children_set(&children, nodes[i].parent, old.name, (uint32_t)i);
+        }
+    }
+
+    // sizes, children come after their parent
+    for (size_t i = len; i-- > 1;) {
+        nodes[nodes[i].parent].size += nodes[i].size;
+    }
+
+    // counting sort of the refs on their node
+    for (size_t i = 0; i < b->npending; i++) {
+        index->ref_off[renamed[b->pending[i].node] + 1]++;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        index->ref_off[i + 1] += index->ref_off[i];
+    }
+
+    for (size_t i = 0; i < b->npending; i++) {
+        size_t* slot = &index->ref_off[renamed[b->pending[i].node]];
+
+        index->refs[(*slot)++] = b->pending[i].ref;
+    }
+
+    // the offsets moved up by one node while filling
+    memmove(index->ref_off + 1, index->ref_off, len * sizeof *index->ref_off);
+    index->ref_off[0] = 0;
+
+    free(index->nodes);
+    children_destroy(&index->children);
+    index->nodes = nodes;
+    index->children = children;
+    nodes = NULL;
+    result = ST_OK;
+
+cleanup:
+    free(order);
+    free(renamed);
+    free(nodes);
+
+    return result;
+}
+
+struct place_index*
+pl_create(struct ged_document* doc)
+{
+    struct place_index* index = calloc(1, sizeof *index);
+
+    if (!index) {
+        return NULL;
+    }
+
+    struct builder b = {.index = index, .nodes_cap = DEFAULT_NODES_CAP};
+
+    index->name_ids = ht_create(DEFAULT_NAMES_CAP);
+    index->nodes = malloc(b.nodes_cap * sizeof *index->nodes);
+    b.first_child = malloc(b.nodes_cap * sizeof *b.first_child);
+    b.last_child = malloc(b.nodes_cap * sizeof *b.last_child);
+    b.next_sibling = malloc(b.nodes_cap * sizeof *b.next_sibling);
+
+    e_statuscode result = ST_MALLOC_ERROR;
+
+    if (!index->name_ids || !index->nodes || !b.first_child || !b.last_child ||
+        !b.next_sibling ||
+        children_init(&index->children, DEFAULT_CHILDREN_CAP) != ST_OK) {
+        goto cleanup;
+    }
+
+    // the root
+    index->len = 1;
+    index->nodes[PL_ROOT] =
+        (struct pl_node){.name = PL_NONE, .parent = PL_NONE, .size = 1};
+    b.first_child[PL_ROOT] = PL_NONE;
+    b.last_child[PL_ROOT] = PL_NONE;
+    b.next_sibling[PL_ROOT] = PL_NONE;
+
+    result = ST_OK;
+
+    for (size_t i = 0; i < pa_len(doc->records) && result == ST_OK; i++) {
+        struct ged_record* root = pa_get(doc->records, i);
+
+        result = collect(&b, root, root);
+    }
+
+    if (result == ST_OK) {
+        result = finalize(&b);
+    }
+
+cleanup:
+    free(b.first_child);
+    free(b.last_child);
+    free(b.next_sibling);
+    free(b.pending);
+
+    if (result != ST_OK) {
+        pl_free(index);
+
+        return NULL;
+    }
+
+    return index;
+}
+
+void
+pl_free(struct place_index* index)
+{
+    if (!index) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->nnames; i++) {
+        free(index->names[i]);
+    }
+
+    free(index->names);
+
+    if (index->name_ids) {
+        ht_free(index->name_ids);
+    }
+
+    free(index->nodes);
+    children_destroy(&index->children);
+    free(index->ref_off);
+    free(index->refs);
+    free(index);
+}
+
+uint32_t
+pl_find(const struct place_index* index, const char* place)
+{
+    char value[PLACE_VALUE_MAX];
+    size_t len = strlen(place);
+
+    if (len >= sizeof value) {
+        return PL_NONE;
+    }
+
+    memcpy(value, place, len + 1);
+
+    uint32_t node = PL_ROOT;
+
+    while (len != SIZE_MAX && node != PL_NONE) {
+        uint32_t name = name_lookup(index, pop_component(value, &len));
+
+        node = name == PL_NONE ? PL_NONE
+                               : children_get(&index->children, node, name);
+    }
+
+    return node;
+}
+
+const struct pl_ref*
+pl_refs(const struct place_index* index, uint32_t node, bool subtree,
+        size_t* count)
+{
+    size_t last = subtree ? node + index->nodes[node].size : node + 1;
+    size_t begin = index->ref_off[node];
+
+    *count = index->ref_off[last] - begin;
+
+    return *count ? &index->refs[begin] : NULL;
+}
+
+// Copies what fits of mem to buf + len, leaving room for the terminator
+static void
+put(char* buf, size_t cap, size_t len, const char* mem, size_t n)
+{
+    if (len + 1 >= cap) {
+        return;
+    }
+
+    size_t room = cap - len - 1;
+
+    memcpy(buf + len, mem, n < room ? n : room);
+}
+
+size_t
+pl_name(const struct place_index* index, uint32_t node, char* buf, size_t cap)
+{
+    size_t len = 0;
+
+    for (; node != PL_ROOT && node != PL_NONE;
+         node = index->nodes[node].parent) {
+        const char* component = pl_component(index, node);
+        size_t n = strlen(component);
+
+        if (len) {
+            put(buf, cap, len, ", ", 2);
+            len += 2;
+        }
+
+        put(buf, cap, len, component, n);
+        len += n;
+    }
+
+    if (cap) {
+        buf[len < cap ? len : cap - 1] = '\0';
+    }
+
+    return len;
+}
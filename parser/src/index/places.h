@@ -0,0 +1,83 @@
+/*
+Place hierarchy index.
+
+PLAC values list jurisdictions from the smallest to the largest
+("Oslo, Oslo, Norway"). Every component is interned once, and places form a
+tree from the largest jurisdiction down, below a root node 0 without a name:
+        root -> Norway -> Oslo -> Oslo
+Components are compared as written, with surrounding spaces trimmed.
+
+Nodes are numbered in preorder, so the subtree of node n is the nodes
+[n, n + nodes[n].size), and the events of a subtree are one contiguous run of
+refs. Children of n are n + 1, then each next sibling follows the subtree of
+the one before it.
+*/
+
+#ifndef INDEX_PLACES_H
+#define INDEX_PLACES_H
+
+#include "gedcom.h"
+#include "utils/hashmap.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PL_NONE UINT32_MAX
+#define PL_ROOT 0
+
+struct pl_node {
+    uint32_t name;   // index in names, PL_NONE for the root
+    uint32_t parent; // PL_NONE for the root
+    uint32_t size;   // nodes in the subtree, including this one
+    uint32_t depth;  // 0 for the root, 1 for countries, ...
+};
+
+struct pl_ref {
+    struct ged_record* event; // record holding the PLAC (BIRT, RESI, ...)
+    struct ged_record* root;  // level 0 record event belongs to
+};
+
+struct pl_children {
+    uint64_t* keys; // (parent << 32 | name) + 1, 0 if free
+    uint32_t* nodes;
+    size_t cap; // power of two
+    size_t len;
+};
+
+struct place_index {
+    size_t nnames;
+    char** names;
+    struct hash_table* name_ids; // name -> index in names + 1
+
+    size_t len;
+    struct pl_node* nodes;
+    struct pl_children children; // (parent, name) -> node
+
+    size_t* ref_off; // refs of node n are refs[ref_off[n], ref_off[n + 1])
+    struct pl_ref* refs;
+};
+
+struct place_index* pl_create(struct ged_document* doc);
+void pl_free(struct place_index* index);
+
+// Node of a place ("Norway", "Oslo, Norway"), PL_NONE if no event is there
+uint32_t pl_find(const struct place_index* index, const char* place);
+
+// Events placed at node, or anywhere below it with subtree
+const struct pl_ref* pl_refs(const struct place_index* index, uint32_t node,
+                             bool subtree, size_t* count);
+
+// Writes the full place of node ("Oslo, Oslo, Norway") to buf, truncated to
+// cap - 1 characters. Returns the length of the whole place
+size_t pl_name(const struct place_index* index, uint32_t node, char* buf,
+               size_t cap);
+
+static inline const char*
+pl_component(const struct place_index* index, uint32_t node)
+{
+    uint32_t name = index->nodes[node].name;
+
+    return name == PL_NONE ? "" : index->names[name];
+}
+
+#endif // INDEX_PLACES_H
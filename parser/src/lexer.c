@@ -100,13 +100,26 @@ num_at_back(struct sbuilder* builder)
     return n;
 }
 
-static struct lex_token*
-lex_add_token(struct lex_lexer* lexer, lex_token_type type, char* lexeme)
+// Adds a token with the text collected so far, and clears it
+static e_statuscode
+lex_add_token(struct lex_lexer* lexer, lex_token_type type)
 {
+    struct sbuilder* builder = &lexer->state.builder;
     struct lex_token* newtok = malloc(sizeof *newtok);
 
     if (!newtok)
-        return NULL;
+        return ST_MALLOC_ERROR;
+
+    newtok->lexeme = NULL;
+
+    if (builder->mem &&
+        lex_token_set_lexeme(newtok, builder->mem, builder->len) != ST_OK) {
+        free(newtok);
+
+        return ST_MALLOC_ERROR;
+    }
+
+    sbuilder_reset(builder);
 
     if (lexer->token_last)
         lexer->token_last->next = newtok;
@@ -117,12 +130,11 @@ lex_add_token(struct lex_lexer* lexer, lex_token_type type, char* lexeme)
     lexer->token_last = newtok;
 
     newtok->type = type;
-    newtok->lexeme = lexeme;
     newtok->line = lexer->tokline;
     newtok->col = lexer->tokcol;
     newtok->next = NULL;
 
-    return newtok;
+    return ST_OK;
 }
 
 static void
@@ -134,13 +146,17 @@ lex_reset_state(struct lex_lexer* lexer)
     }
 
     lexer->state.possible_length = (int)LT_INVALID;
+    lexer->state.skipping = false;
 }
 
-static void
+static e_statuscode
 lex_tok_complete(struct lex_lexer* lexer, lex_token_type type)
 {
-    lex_add_token(lexer, type, sbuilder_clear(&lexer->state.builder));
+    e_statuscode result = lex_add_token(lexer, type);
+
     lex_reset_state(lexer);
+
+    return result;
 }
 
 static lex_e_valid
@@ -247,6 +263,39 @@ lex_validate(struct lex_lexer* lexer, lex_token_type type, char c)
     }
 }
 
+static bool
+is_line_end(char c)
+{
+    return is_car_ret(c) || is_line_feed(c) || is_eof(c);
+}
+
+// Adds the skipped text as one token, the next one starts at the current
+// character. The parser reports it with the lines it skips along with it
+static e_statuscode
+lex_skip_end(struct lex_lexer* lexer)
+{
+    e_statuscode result = lex_tok_complete(lexer, LT_INVALID);
+
+    lexer->tokline = lexer->curline;
+    lexer->tokcol = lexer->curcol;
+
+    return result;
+}
+
+// Skips c without validating it, until the line ends. Returns ST_NOT_OK if c
+// was skipped, ST_OK if it ends the skipped text
+static e_statuscode
+lex_skip(struct lex_lexer* lexer, char c)
+{
+    if (!is_line_end(c)) {
+        sbuilder_write_char(&lexer->state.builder, c);
+
+        return ST_NOT_OK;
+    }
+
+    return lex_skip_end(lexer);
+}
+
 // does not currently process current character if done by not
 static e_statuscode
 lex_advance(struct lex_lexer* lexer)
@@ -267,7 +316,12 @@ lex_advance(struct lex_lexer* lexer)
             if ((*status_cache == LV_DONE_WHEN_NOT) ||
                 (*status_cache == LV_DONE_WHEN_DELIM && is_terminator(c))) {
 
-                lex_tok_complete(lexer, type);
+                e_statuscode result = lex_tok_complete(lexer, type);
+
+                if (result != ST_OK) {
+                    return result;
+                }
+
                 e_statuscode nxt_status = lex_advance(lexer);
 
                 if (!(nxt_status == ST_OK || nxt_status == ST_NOT_OK)) {
@@ -287,9 +341,8 @@ lex_advance(struct lex_lexer* lexer)
         }
         case LV_DONE: {
             sbuilder_write_char(&lexer->state.builder, c);
-            lex_tok_complete(lexer, type);
 
-            return ST_OK;
+            return lex_tok_complete(lexer, type);
         }
         case LV_DONE_WHEN_NOT: {
             *status_cache = LV_DONE_WHEN_NOT;
@@ -308,18 +361,28 @@ lex_advance(struct lex_lexer* lexer)
         }
     }
 
-    if (!lexer->state.possible_length) {
-        ctx_critf(
-            lexer->ctx,
-            "unexpected character '%c' encountered (at line %zu, column %zu)",
-            c, lexer->curline, lexer->curcol);
+    if (!lexer->state.possible_length && lexer->recover) {
+        if (is_line_end(c)) {
+            e_statuscode result = lex_skip_end(lexer);
+
+            return result == ST_OK ? lex_advance(lexer) : result;
+        }
 
         sbuilder_write_char(&lexer->state.builder, c);
+        lexer->state.skipping = true;
+
+        return ST_NOT_OK;
+    }
 
-        lex_add_token(lexer, LT_INVALID, sbuilder_clear(&lexer->state.builder));
-        lex_reset_state(lexer);
+    if (!lexer->state.possible_length) {
+        // the builder stops at the position of the first critical error
+        ctx_set_position(lexer->ctx, lexer->curline);
+        ctx_diag(lexer->ctx, CRITICAL, CTX_C_CHAR_UNEXPECTED, c,
+                 lexer->curline, lexer->curcol);
 
-        return ST_OK;
+        sbuilder_write_char(&lexer->state.builder, c);
+
+        return lex_tok_complete(lexer, LT_INVALID);
     }
 
     sbuilder_write_char(&lexer->state.builder, c);
@@ -327,6 +390,21 @@ lex_advance(struct lex_lexer* lexer)
     return ST_NOT_OK;
 }
 
+// Advances over the current character, or skips it
+static e_statuscode
+lex_step(struct lex_lexer* lexer)
+{
+    if (lexer->state.skipping) {
+        e_statuscode result = lex_skip(lexer, lexer->current);
+
+        if (result != ST_OK) {
+            return result;
+        }
+    }
+
+    return lex_advance(lexer);
+}
+
 /*
 =================================================
 END INTERNAL
@@ -341,13 +419,26 @@ lex_token_copy(struct lex_token* token)
     }
 
     struct lex_token* copy = malloc(sizeof *copy);
+
+    if (!copy) {
+        return NULL;
+    }
+
     copy->type = token->type;
-    copy->lexeme = strdup(token->lexeme);
+    copy->lexeme = NULL;
     copy->line = token->line;
     copy->col = token->col;
 
     copy->next = NULL;
 
+    if (token->lexeme &&
+        lex_token_set_lexeme(copy, token->lexeme, strlen(token->lexeme)) !=
+            ST_OK) {
+        free(copy);
+
+        return NULL;
+    }
+
     return copy;
 }
 
@@ -357,15 +448,31 @@ lex_token_free(struct lex_token* token)
     if (!token)
         return;
 
-    // lexeme has been made by stringbuilder and must be free after use
-    if (token->lexeme) {
+    if (token->lexeme != token->short_lexeme) {
         free(token->lexeme);
-        token->lexeme = NULL;
     }
 
     free(token);
 }
 
+e_statuscode
+lex_token_set_lexeme(struct lex_token* token, const char* lexeme, size_t len)
+{
+    assert(!token->lexeme);
+
+    char* mem = token->short_lexeme;
+
+    if (len >= sizeof token->short_lexeme && !(mem = malloc(len + 1))) {
+        return ST_MALLOC_ERROR;
+    }
+
+    memcpy(mem, lexeme, len);
+    mem[len] = '\0';
+    token->lexeme = mem;
+
+    return ST_OK;
+}
+
 struct lex_lexer*
 lex_create(struct context* ctx)
 {
@@ -400,6 +507,10 @@ lex_init(struct lex_lexer* lexer, struct context* ctx)
     lexer->curcol = 1;
     lexer->token_first = NULL;
     lexer->token_last = NULL;
+    lexer->recover = false;
+
+    // diagnostics are placed at the start of the current token
+    ctx_track(ctx, &lexer->tokline, &lexer->tokcol);
 
     lex_reset_state(lexer);
 
@@ -457,14 +568,14 @@ lex_feed(struct lex_lexer* lexer, char c)
         return ST_NOT_INIT;
     }
 
-    e_statuscode result = lex_advance(lexer);
+    e_statuscode result = lex_step(lexer);
 
     // final call
     if (lexer->eof_reached) {
         lexer->current = lexer->lookahead;
         lexer->lookahead = EOF;
 
-        e_statuscode nxtresult = lex_advance(lexer);
+        e_statuscode nxtresult = lex_step(lexer);
 
         result = (nxtresult > result) ? nxtresult : result;
     }
@@ -480,8 +591,6 @@ lex_feed(struct lex_lexer* lexer, char c)
         if (result == ST_OK) {
             lexer->tokline = lexer->curline;
             lexer->tokcol = lexer->curcol;
-
-            posctx_update(lexer->ctx, lexer->tokline, lexer->tokcol);
         }
     }
 
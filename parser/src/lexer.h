@@ -33,14 +33,23 @@ typedef enum lex_e_valid {
     LV_DONE_WHEN_DELIM // done when a delim is encountered (space)
 } lex_e_valid;
 
+// Lexemes shorter than this are kept inside their token, which covers levels,
+// tags, delimiters and most xrefs
+#define LEX_SHORT_LEXEME 16
+
 struct lex_token {
     lex_token_type type;
 
     size_t line;
     size_t col;
 
+    // NULL, short_lexeme, or a heap string for longer lexemes. Since it may
+    // point into the token, tokens are copied with lex_token_copy() and never
+    // by value
     char* lexeme;
     struct lex_token* next;
+
+    char short_lexeme[LEX_SHORT_LEXEME];
 };
 
 struct lex_lexer {
@@ -51,6 +60,7 @@ struct lex_lexer {
         lex_e_valid status[(int)LT_INVALID]; // contains status for each type
 
         int possible_length;
+        bool skipping; // invalid text, until the line ends
     } state;
 
     bool eof_reached;
@@ -66,6 +76,11 @@ struct lex_lexer {
 
     struct context* ctx;
     struct sbuilder buf;
+
+    // Skip invalid text up to the end of its line as a single LT_INVALID
+    // token instead of logging a critical error. The token is reported by
+    // the parser, see parser_parse_recover(). Off by default
+    bool recover;
 };
 
 // API functions
@@ -74,6 +89,11 @@ struct lex_lexer {
 struct lex_token* lex_token_copy(struct lex_token* token);
 void lex_token_free(struct lex_token* token);
 
+// Sets the lexeme of token to a copy of the len characters at lexeme, inside
+// the token if they fit. The token must not have a lexeme yet
+e_statuscode lex_token_set_lexeme(struct lex_token* token, const char* lexeme,
+                                  size_t len);
+
 // used when lexer is heap allocated
 struct lex_lexer* lex_create(struct context* ctx);
 void lex_free(struct lex_lexer* lexer);
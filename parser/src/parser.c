@@ -23,6 +23,7 @@ parser_curline_reset(struct parser* parser)
     cur_line->next = NULL;
 
     parser->state.cur_line = cur_line;
+    parser->state.value_back = NULL;
     parser->state.index = 0;
 
     return old;
@@ -38,6 +39,10 @@ parser_init(struct parser* parser, struct context* ctx)
     parser->result.front = NULL;
     parser->result.back = NULL;
     parser->ctx = ctx;
+    parser->line = 0;
+    parser->col = 0;
+    parser->recovery.enabled = false;
+    parser->recovery.active = false;
 
     parser_curline_reset(parser);
 
@@ -94,12 +99,16 @@ parser_curline_terminate(struct parser* parser)
     return line;
 }
 
-static void
+static e_statuscode
 parser_update_at(struct parser* parser, struct lex_token* token, int index)
 {
     struct parser_line* cur_line = parser->state.cur_line;
     struct lex_token* token_copy = lex_token_copy(token);
 
+    if (!token_copy) {
+        return ST_MALLOC_ERROR;
+    }
+
     switch (index) {
     case 0: {
         cur_line->level = token_copy;
@@ -115,18 +124,89 @@ parser_update_at(struct parser* parser, struct lex_token* token, int index)
     }
     default: {
         // The optional line_value can contain multiple values
-        struct lex_token* back = cur_line->line_value;
+        struct lex_token* back = parser->state.value_back;
 
         if (back) {
-            for (; back->next != NULL; back = back->next) {
-            }
-
             back->next = token_copy;
         } else {
             cur_line->line_value = token_copy;
         }
+
+        parser->state.value_back = token_copy;
+    }
+    }
+
+    return ST_OK;
+}
+
+static bool
+is_blank(struct lex_token* token)
+{
+    return token->type == LT_WHITESPACE || token->type == LT_DELIM ||
+           is_terminator(token);
+}
+
+// Drops the current line, which broke at token
+static e_statuscode
+parser_recover(struct parser* parser, struct lex_token* token)
+{
+    struct parser_line* broken = parser_curline_reset(parser);
+
+    parser->recovery.active = true;
+    parser->recovery.in_line = !is_terminator(token);
+    parser->recovery.level = broken->level ? atoi(broken->level->lexeme) : 0;
+    parser->recovery.lines = 1;
+    parser->recovery.text = 0;
+
+    // the lexer leaves skipped text for the parser to report
+    if (token->type == LT_INVALID && token->lexeme) {
+        parser->recovery.text = strlen(token->lexeme);
+    }
+
+    parser_line_free(broken);
+
+    return ST_NOT_OK;
+}
+
+static void
+parser_recover_end(struct parser* parser)
+{
+    if (parser->recovery.text) {
+        ctx_diag(parser->ctx, ERROR, CTX_C_TEXT_SKIPPED, parser->recovery.text,
+                 parser->recovery.lines);
+    } else {
+        ctx_diag(parser->ctx, ERROR, CTX_C_LINES_SKIPPED,
+                 parser->recovery.lines);
+    }
+
+    parser->recovery.active = false;
+}
+
+// Skips tokens up to the next line that is not below the broken one
+static e_statuscode
+parser_skip(struct parser* parser, struct lex_token* token)
+{
+    if (parser->recovery.in_line) {
+        parser->recovery.in_line = !is_terminator(token);
+
+        return ST_NOT_OK;
     }
+
+    if (is_blank(token)) {
+        return ST_NOT_OK;
     }
+
+    if (token->type == LT_NUMBER &&
+        atoi(token->lexeme) <= parser->recovery.level) {
+        parser_recover_end(parser);
+
+        return parser_parse_token(parser, token);
+    }
+
+    parser->recovery.lines++;
+    parser->recovery.in_line = !is_terminator(token);
+
+    return ST_NOT_OK;
 }
 
 /*
@@ -215,9 +295,12 @@ parser_parse_token(struct parser* parser, struct lex_token* token)
 {
     int index = parser->state.index;
 
+    if (parser->recovery.active) {
+        return parser_skip(parser, token);
+    }
+
     // leading whitespace
-    if (!index && (token->type == LT_WHITESPACE || token->type == LT_DELIM ||
-                   is_terminator(token))) {
+    if (!index && is_blank(token)) {
         return ST_NOT_OK;
     }
 
@@ -225,17 +308,21 @@ parser_parse_token(struct parser* parser, struct lex_token* token)
 
     // yes i know i can use !index u cunt
     if (index == 0) {
-        posctx_update_line(parser->ctx, token->line);
+        parser->line = token->line;
     }
 
-    posctx_update_col(parser->ctx, token->col);
+    parser->col = token->col;
 
     if (index < 6 && (index & 1)) {
         if (token->type == LT_DELIM) {
             return ST_NOT_OK;
         } else if (!(index == 5 && is_terminator(token))) {
             // If index 5 is not a delimeter, it must be a terminator or eof.
+            if (parser->recovery.enabled) {
+                return parser_recover(parser, token);
+            }
 
+            ctx_set_position(parser->ctx, parser->line);
             ctx_critf(
                 parser->ctx,
                 "optional value must start with a delimeter, or be omitted "
@@ -253,9 +340,17 @@ parser_parse_token(struct parser* parser, struct lex_token* token)
         return ST_OK;
     }
 
+    if (parser->recovery.enabled && token->type == LT_INVALID) {
+        return parser_recover(parser, token);
+    }
+
     if (!parser_valid_at_idx(parser, token, index)) {
-        if (index != 2) {
-            ctx_critf(parser->ctx, "unexpected type %d", (int)token->type);
+        if (index != 2 && parser->recovery.enabled) {
+            return parser_recover(parser, token);
+        } else if (index != 2) {
+            ctx_set_position(parser->ctx, parser->line);
+            ctx_diag(parser->ctx, CRITICAL, CTX_C_TOKEN_UNEXPECTED,
+                     (int)token->type);
             return ST_GEN_ERROR;
         }
 
@@ -267,13 +362,13 @@ parser_parse_token(struct parser* parser, struct lex_token* token)
         return parser_parse_token(parser, token);
     }
 
-    parser_update_at(parser, token, index);
+    e_statuscode result = parser_update_at(parser, token, index);
 
-    return ST_NOT_OK;
+    return result == ST_OK ? ST_NOT_OK : result;
 }
 
-struct parser_result
-parser_parse(struct lex_token* tokens, struct context* ctx)
+static struct parser_result
+parser_parse_all(struct lex_token* tokens, struct context* ctx, bool recover)
 {
     ctx_push(ctx, posctx_create("parser"));
     struct parser_result empty = {.front = NULL, .back = NULL};
@@ -289,8 +384,20 @@ parser_parse(struct lex_token* tokens, struct context* ctx)
         return empty;
     }
 
+    parser.recovery.enabled = recover;
+    ctx_track(ctx, &parser.line, &parser.col);
+
     for (struct lex_token* tok = tokens; tok; tok = tok->next) {
-        parser_parse_token(&parser, tok);
+        if (parser_parse_token(&parser, tok) == ST_MALLOC_ERROR) {
+            ctx_set_position(ctx, parser.line);
+            ctx_critf(ctx, "out of memory");
+            break;
+        }
+    }
+
+    // the input ended in a skipped span
+    if (parser.recovery.active) {
+        parser_recover_end(&parser);
     }
 
     parser_destroy(&parser);
@@ -298,3 +405,15 @@ parser_parse(struct lex_token* tokens, struct context* ctx)
 
     return parser.result;
 }
+
+struct parser_result
+parser_parse(struct lex_token* tokens, struct context* ctx)
+{
+    return parser_parse_all(tokens, ctx, false);
+}
+
+struct parser_result
+parser_parse_recover(struct lex_token* tokens, struct context* ctx)
+{
+    return parser_parse_all(tokens, ctx, true);
+}
@@ -33,8 +33,24 @@ struct parser {
     struct {
         int index;
         struct parser_line* cur_line;
+        struct lex_token* value_back; // last token of line_value
     } state;
 
+    // line of the current line, column of the current token
+    size_t line;
+    size_t col;
+
+    // Broken lines are skipped with the lines below them, see
+    // parser_parse_recover()
+    struct {
+        bool enabled;
+        bool active;
+        bool in_line; // the broken line did not end yet
+        int level;    // of the broken line, 0 if it has none
+        size_t lines;
+        size_t text; // length of the invalid text it broke at, or 0
+    } recovery;
+
     struct context* ctx;
     struct parser_result result;
 };
@@ -48,4 +64,12 @@ e_statuscode parser_parse_token(struct parser* parser, struct lex_token* token);
 struct parser_result parser_parse(struct lex_token* tokens,
                                   struct context* ctx);
 
+// Like parser_parse(), but a line with a syntax error is dropped with the
+// lines below it, and parsing goes on at the next line of the same or a lower
+// level. Each skipped span gets one error instead of a critical error, which
+// also covers the invalid text of a recovering lexer (see lex_lexer.recover)
+// the span starts at
+struct parser_result parser_parse_recover(struct lex_token* tokens,
+                                          struct context* ctx);
+
 #endif // PARSER_H
\ No newline at end of file
@@ -0,0 +1,490 @@
+#include "query/path.h"
+#include "context/genstate.h"
+#include "utils/pool.h"
+#include <assert.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// GEDCOM lines are at most 255 characters
+#define VALUE_MAX 256
+#define DEFAULT_STEPS_CAP 4
+// Level 0 records a task takes at most
+#define SCHEDULE_CHUNK 64
+
+struct compiler {
+    const char* text;
+    const char* p;
+    struct context* ctx;
+    struct path_query* query;
+};
+
+struct eval {
+    const struct path_query* query;
+    struct ged_document* doc;
+    struct ged_record* root;
+    pq_visit visit;
+    void* data;
+    size_t count;
+};
+
+struct job {
+    const struct path_query* query;
+    struct ged_document* doc;
+    pq_visit visit;
+    void* data;
+    atomic_size_t count;
+};
+
+/*
+=================================================
+Compiling
+=================================================
+*/
+
+static bool
+compile_error(struct compiler* c, const char* message)
+{
+    ctx_errf(c->ctx, "query \"%s\", column %zu: %s", c->text,
+             (size_t)(c->p - c->text) + 1, message);
+
+    return false;
+}
+
+static bool
+is_tag_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static char*
+copy_range(const char* begin, const char* end)
+{
+    size_t len = end - begin;
+    char* copy = malloc(len + 1);
+
+    if (copy) {
+        memcpy(copy, begin, len);
+        copy[len] = '\0';
+    }
+
+    return copy;
+}
+
+static bool
+compile_pred(struct compiler* c, struct pq_step* step)
+{
+    struct pq_pred pred;
+
+    // skip '['
+    c->p++;
+
+    switch (*c->p) {
+    case '=':
+        pred.op = PQ_EQUALS;
+        break;
+    case '~':
+        pred.op = PQ_CONTAINS;
+        break;
+    case '^':
+        pred.op = PQ_PREFIX;
+        break;
+    default:
+        return compile_error(c, "expected '=', '~' or '^'");
+    }
+
+    const char* begin = ++c->p;
+    const char* end;
+
+    if (*begin == '"') {
+        end = strchr(++begin, '"');
+
+        if (!end) {
+            return compile_error(c, "unterminated string");
+        }
+
+        c->p = end + 1;
+    } else {
+        end = begin;
+
+        while (*end && *end != ']') {
+            end++;
+        }
+
+        c->p = end;
+    }
+
+    if (*c->p != ']') {
+        return compile_error(c, "expected ']'");
+    }
+
+    c->p++;
+
+    struct pq_pred* preds =
+        realloc(step->preds, (step->npreds + 1) * sizeof *preds);
+
+    if (!preds) {
+        return compile_error(c, "out of memory");
+    }
+
+    step->preds = preds;
+    pred.len = end - begin;
+    pred.text = copy_range(begin, end);
+
+    if (!pred.text) {
+        return compile_error(c, "out of memory");
+    }
+
+    step->preds[step->npreds++] = pred;
+
+    return true;
+}
+
+static bool
+compile_step(struct compiler* c, struct pq_step* step, bool first)
+{
+    const char* begin = c->p;
+
+    if (*c->p == '@' && first) {
+        const char* end = strchr(c->p + 1, '@');
+
+        if (!end) {
+            return compile_error(c, "unterminated xref");
+        }
+
+        step->kind = PQ_XREF;
+        c->p = end + 1;
+    } else if (c->p[0] == '*' && c->p[1] == '*') {
+        step->kind = PQ_DESCENDANTS;
+        c->p += 2;
+    } else if (*c->p == '*') {
+        step->kind = PQ_ANY;
+        c->p++;
+    } else if (is_tag_char(*c->p)) {
+        step->kind = PQ_TAG;
+
+        while (is_tag_char(*c->p)) {
+            c->p++;
+        }
+    } else {
+        return compile_error(c, "expected a tag, '*' or '**'");
+    }
+
+    step->name = copy_range(begin, c->p);
+
+    if (!step->name) {
+        return compile_error(c, "out of memory");
+    }
+
+    if (step->kind == PQ_TAG) {
+        step->tag_id = ged_tag_id(step->name);
+    }
+
+    while (*c->p == '[') {
+        if (step->kind == PQ_DESCENDANTS) {
+            return compile_error(c, "'**' takes no predicates");
+        }
+
+        if (!compile_pred(c, step)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct path_query*
+pq_compile(const char* text, struct context* ctx)
+{
+    struct path_query* query = calloc(1, sizeof *query);
+
+    if (!query) {
+        return NULL;
+    }
+
+    struct compiler c = {.text = text, .p = text, .ctx = ctx, .query = query};
+    size_t cap = 0;
+    bool deref = false;
+
+    ctx_push(ctx, posctx_create("query"));
+
+    for (;;) {
+        if (query->len == cap) {
+            cap = cap ? cap * 2 : DEFAULT_STEPS_CAP;
+
+            struct pq_step* steps = realloc(query->steps, cap * sizeof *steps);
+
+            if (!steps) {
+                compile_error(&c, "out of memory");
+                goto error;
+            }
+
+            query->steps = steps;
+        }
+
+        struct pq_step* step = &query->steps[query->len++];
+
+        *step = (struct pq_step){.deref = deref};
+
+        if (!compile_step(&c, step, query->len == 1)) {
+            goto error;
+        }
+
+        if (!*c.p) {
+            break;
+        }
+
+        if (*c.p == '.') {
+            c.p++;
+            deref = false;
+        } else if (c.p[0] == '-' && c.p[1] == '>') {
+            if (step->kind == PQ_DESCENDANTS) {
+                compile_error(&c, "'->' can not follow '**'");
+                goto error;
+            }
+
+            c.p += 2;
+            deref = true;
+
+            if (!*c.p) {
+                query->deref_result = true;
+                break;
+            }
+        } else {
+            compile_error(&c, "expected '.' or '->'");
+            goto error;
+        }
+    }
+
+    ctx_pop(ctx);
+
+    return query;
+
+error:
+    ctx_pop(ctx);
+    pq_free(query);
+
+    return NULL;
+}
+
+void
+pq_free(struct path_query* query)
+{
+    if (!query) {
+        return;
+    }
+
+    for (size_t i = 0; i < query->len; i++) {
+        struct pq_step* step = &query->steps[i];
+
+        for (size_t j = 0; j < step->npreds; j++) {
+            free(step->preds[j].text);
+        }
+
+        free(step->preds);
+        free(step->name);
+    }
+
+    free(query->steps);
+    free(query);
+}
+
+/*
+=================================================
+Evaluation
+=================================================
+*/
+
+// Record the first pointer in the value of rec points at
+static struct ged_record*
+deref(struct ged_document* doc, const struct ged_record* rec)
+{
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->type == LT_POINTER) {
+            return ged_document_xref(doc, tok->lexeme);
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+preds_hold(const struct pq_step* step, const struct ged_record* rec)
+{
+    if (!step->npreds) {
+        return true;
+    }
+
+    char value[VALUE_MAX];
+    size_t len = ged_record_value(rec, value, sizeof value);
+
+    for (size_t i = 0; i < step->npreds; i++) {
+        const struct pq_pred* pred = &step->preds[i];
+        bool holds;
+
+        switch (pred->op) {
+        case PQ_EQUALS:
+            holds = len == pred->len && strcmp(value, pred->text) == 0;
+            break;
+        case PQ_CONTAINS:
+            holds = strstr(value, pred->text) != NULL;
+            break;
+        case PQ_PREFIX:
+            holds = strncmp(value, pred->text, pred->len) == 0;
+            break;
+        default:
+            assert(false);
+            holds = false;
+        }
+
+        if (!holds) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+step_matches(const struct pq_step* step, const struct ged_record* rec)
+{
+    switch (step->kind) {
+    case PQ_TAG:
+        if (rec->tag_id != step->tag_id ||
+            ((step->tag_id & GED_TAG_HASHED) &&
+             strcmp(rec->tag, step->name) != 0)) {
+            return false;
+        }
+        break;
+    case PQ_XREF:
+        if (!rec->xref || strcmp(rec->xref, step->name) != 0) {
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return preds_hold(step, rec);
+}
+
+static void
+emit(struct eval* e, struct ged_record* rec)
+{
+    if (e->query->deref_result && !(rec = deref(e->doc, rec))) {
+        return;
+    }
+
+    e->count++;
+
+    if (e->visit) {
+        e->visit(rec, e->root, e->data);
+    }
+}
+
+static void visit_child(struct eval* e, size_t i, struct ged_record* child);
+
+// rec matched the steps before i, continues with the children of rec
+static void
+eval_from(struct eval* e, size_t i, struct ged_record* rec)
+{
+    if (i == e->query->len) {
+        emit(e, rec);
+
+        return;
+    }
+
+    if (e->query->steps[i].deref && !(rec = deref(e->doc, rec))) {
+        return;
+    }
+
+    for (size_t j = 0; j < sa_len(&rec->children); j++) {
+        visit_child(e, i, sa_get(&rec->children, j));
+    }
+}
+
+// Matches step i against child
+static void
+visit_child(struct eval* e, size_t i, struct ged_record* child)
+{
+    const struct pq_step* step = &e->query->steps[i];
+
+    if (step->kind != PQ_DESCENDANTS) {
+        if (step_matches(step, child)) {
+            eval_from(e, i + 1, child);
+        }
+
+        return;
+    }
+
+    // ** as no level, then as one more level for every child
+    if (i + 1 == e->query->len) {
+        emit(e, child);
+    } else {
+        visit_child(e, i + 1, child);
+    }
+
+    for (size_t j = 0; j < sa_len(&child->children); j++) {
+        visit_child(e, i, sa_get(&child->children, j));
+    }
+}
+
+size_t
+pq_run_record(const struct path_query* query, struct ged_document* doc,
+              struct ged_record* root, pq_visit visit, void* data)
+{
+    struct eval e = {.query = query,
+                     .doc = doc,
+                     .root = root,
+                     .visit = visit,
+                     .data = data,
+                     .count = 0};
+
+    // level 0 records are the children of the document
+    visit_child(&e, 0, root);
+
+    return e.count;
+}
+
+static void
+run_range(size_t begin, size_t end, void* data)
+{
+    struct job* job = data;
+    size_t count = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        count += pq_run_record(job->query, job->doc,
+                               pa_get(job->doc->records, i), job->visit,
+                               job->data);
+    }
+
+    atomic_fetch_add(&job->count, count);
+}
+
+size_t
+pq_run(const struct path_query* query, struct ged_document* doc,
+       bool parallel, pq_visit visit, void* data)
+{
+    // an xref names its record, nothing else can match
+    if (query->steps[0].kind == PQ_XREF) {
+        struct ged_record* root = ged_document_xref(doc, query->steps[0].name);
+
+        return root ? pq_run_record(query, doc, root, visit, data) : 0;
+    }
+
+    struct job job = {
+        .query = query, .doc = doc, .visit = visit, .data = data};
+    size_t len = pa_len(doc->records);
+
+    atomic_init(&job.count, 0);
+
+    if (parallel) {
+        tp_for(tp_shared(), len, SCHEDULE_CHUNK, run_range, &job);
+    } else {
+        run_range(0, len, &job);
+    }
+
+    return atomic_load(&job.count);
+}
@@ -0,0 +1,91 @@
+/*
+Path queries over records.
+
+A query is a path of steps from level 0 records down to their descendants:
+        INDI.BIRT.DATE          DATE of every BIRT of every INDI
+        INDI.*.PLAC             PLAC of any event of an INDI
+        **.NOTE                 NOTE at any level of any record
+        FAM.CHIL->BIRT.DATE     birth dates of children, CHIL points at INDI
+        FAM.HUSB->              the INDI records HUSB points at
+        @I1@.NAME               NAME of the record with xref @I1@
+        INDI.NAME[~/Williams/]  names containing /Williams/
+
+A step is a tag, * (any tag) or ** (any number of levels, including none).
+Steps are separated by '.' for children, or by '->' to first follow the
+pointer value of the record matched so far. A trailing '->' yields the
+record pointed at. Only the first step can be an xref.
+
+Steps may be followed by value predicates, which all have to hold:
+        [=text]   value is text
+        [~text]   value contains text
+        [^text]   value starts with text
+text can be quoted ("...") to include ']'.
+
+Tags are compiled to tag ids, and evaluation walks the records without
+allocating.
+*/
+
+#ifndef QUERY_PATH_H
+#define QUERY_PATH_H
+
+#include "context/context.h"
+#include "gedcom.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum {
+    PQ_TAG = 0,
+    PQ_ANY,         // *
+    PQ_DESCENDANTS, // **
+    PQ_XREF,        // @I1@, first step only
+} pq_e_step;
+
+typedef enum {
+    PQ_EQUALS = 0, // [=text]
+    PQ_CONTAINS,   // [~text]
+    PQ_PREFIX,     // [^text]
+} pq_e_pred;
+
+struct pq_pred {
+    pq_e_pred op;
+    char* text;
+    size_t len;
+};
+
+struct pq_step {
+    pq_e_step kind;
+    bool deref;      // follow the pointer of the previous match first
+    uint32_t tag_id; // PQ_TAG only
+    char* name;      // tag or xref
+    struct pq_pred* preds;
+    size_t npreds;
+};
+
+struct path_query {
+    struct pq_step* steps;
+    size_t len;
+    bool deref_result; // trailing '->'
+};
+
+// Called for every match, with the level 0 record the walk started from.
+// Matches of one level 0 record are visited in document order
+typedef void (*pq_visit)(struct ged_record* match, struct ged_record* root,
+                         void* data);
+
+// Returns NULL, and logs the position of the error to ctx, if text is no
+// valid query
+struct path_query* pq_compile(const char* text, struct context* ctx);
+void pq_free(struct path_query* query);
+
+// Visits every match in doc. If parallel, level 0 records are spread over the
+// shared pool (see utils/pool.h) and visit is called concurrently. Returns the
+// number of matches
+size_t pq_run(const struct path_query* query, struct ged_document* doc,
+              bool parallel, pq_visit visit, void* data);
+
+// Visits the matches below a single level 0 record
+size_t pq_run_record(const struct path_query* query, struct ged_document* doc,
+                     struct ged_record* root, pq_visit visit, void* data);
+
+#endif // QUERY_PATH_H
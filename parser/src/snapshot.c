@@ -0,0 +1,878 @@
+#include "snapshot.h"
+#include "context/genstate.h"
+#include "tags/base.h"
+#include "utils/hash64.h"
+#include "utils/hashmap.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// cap should be prime, see DEFAULT_XREFS_CAP
+#define DEFAULT_STRINGS_CAP 4099
+#define DEFAULT_POOL_CAP 4096
+
+#define SNAP_ALIGN 8
+
+/* === Writing === */
+
+struct snap_builder {
+    const struct ged_document* doc;
+
+    struct ged_record** recs; // record of each node
+    struct snap_node* nodes;
+    struct snap_token* tokens;
+    uint32_t nnodes;
+    uint32_t ntokens;
+
+    struct {
+        char* mem;
+        size_t len;
+        size_t cap;
+        struct hash_table* offsets; // string -> offset + 1
+    } pool;
+
+    struct snap_xref* xrefs;
+    uint32_t nxrefs;
+
+    uint32_t* targets;
+    uint32_t* offsets;
+    struct snap_backref* refs;
+    uint32_t ntargets;
+    uint32_t nrefs;
+};
+
+static void
+count_nodes(const struct ged_record* rec, size_t* nnodes, size_t* ntokens)
+{
+    (*nnodes)++;
+    *ntokens += sa_len(&rec->value);
+
+    for (size_t i = 0; i < sa_len(&rec->children); i++) {
+        count_nodes(sa_get(&rec->children, i), nnodes, ntokens);
+    }
+}
+
+static e_statuscode
+pool_append(struct snap_builder* b, const char* mem, size_t len,
+            uint32_t* offset)
+{
+    if (b->pool.len + len + 1 > UINT32_MAX) {
+        return ST_NOT_OK;
+    }
+
+    if (b->pool.len + len + 1 > b->pool.cap) {
+        size_t cap = b->pool.cap ? b->pool.cap : DEFAULT_POOL_CAP;
+
+        while (cap < b->pool.len + len + 1) {
+            cap *= 2;
+        }
+
+        char* grown = realloc(b->pool.mem, cap);
+
+        if (!grown) {
+            return ST_MALLOC_ERROR;
+        }
+
+        b->pool.mem = grown;
+        b->pool.cap = cap;
+    }
+
+    *offset = (uint32_t)b->pool.len;
+
+    memcpy(b->pool.mem + b->pool.len, mem, len);
+    b->pool.mem[b->pool.len + len] = '\0';
+    b->pool.len += len + 1;
+
+    return ST_OK;
+}
+
+// Offset of str in the pool, adding it if it has not been seen
+static e_statuscode
+pool_intern(struct snap_builder* b, const char* str, size_t len,
+            uint32_t* offset)
+{
+    // hash table keys cannot be empty, "" is always at offset 0
+    if (!len) {
+        *offset = 0;
+
+        return ST_OK;
+    }
+
+    uintptr_t found = (uintptr_t)ht_get(b->pool.offsets, str);
+
+    if (found) {
+        *offset = (uint32_t)(found - 1);
+
+        return ST_OK;
+    }
+
+    e_statuscode result = pool_append(b, str, len, offset);
+
+    if (result == ST_OK) {
+        ht_set(b->pool.offsets, str, (void*)((uintptr_t)*offset + 1));
+    }
+
+    return result;
+}
+
+static e_statuscode
+node_fill(struct snap_builder* b, uint32_t index, uint32_t parent,
+          struct sbuilder* value)
+{
+    const struct ged_record* rec = b->recs[index];
+    struct snap_node* node = &b->nodes[index];
+    e_statuscode result;
+
+    node->tag_id = rec->tag_id;
+    node->parent = parent;
+    node->level = rec->level;
+    node->xref = SNAP_NONE;
+    node->first_token = b->ntokens;
+    node->ntokens = (uint32_t)sa_len(&rec->value);
+    node->nchildren = (uint32_t)sa_len(&rec->children);
+
+    result = pool_intern(b, rec->tag, strlen(rec->tag), &node->tag);
+
+    if (result == ST_OK && rec->xref) {
+        result = pool_intern(b, rec->xref, strlen(rec->xref), &node->xref);
+    }
+
+    sbuilder_reset(value);
+
+    for (size_t i = 0; i < sa_len(&rec->value) && result == ST_OK; i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+        struct snap_token* out = &b->tokens[b->ntokens++];
+
+        out->type = tok->type;
+        out->line = (uint32_t)tok->line;
+        out->col = (uint32_t)tok->col;
+        out->len = tok->lexeme ? (uint32_t)strlen(tok->lexeme) : SNAP_NONE;
+
+        if (tok->lexeme && sbuilder_write(value, tok->lexeme)) {
+            result = ST_MALLOC_ERROR;
+        }
+    }
+
+    node->value_len = (uint32_t)value->len;
+
+    if (result == ST_OK) {
+        result = pool_intern(b, value->mem, value->len, &node->value);
+    }
+
+    return result;
+}
+
+// Lays out the nodes breadth first, so the children of a node are contiguous
+static e_statuscode
+builder_nodes(struct snap_builder* b)
+{
+    struct sbuilder value;
+    e_statuscode result = ST_OK;
+
+    if (sbuilder_init(&value, SBUILDER_DEFAULT_CAP)) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < pa_len(b->doc->records); i++) {
+        b->recs[b->nnodes++] = pa_get(b->doc->records, i);
+    }
+
+    for (uint32_t i = 0; i < b->nnodes && result == ST_OK; i++) {
+        const struct ged_record* rec = b->recs[i];
+
+        b->nodes[i].first_child = b->nnodes;
+
+        for (size_t c = 0; c < sa_len(&rec->children); c++) {
+            b->recs[b->nnodes] = sa_get(&rec->children, c);
+            b->nodes[b->nnodes].parent = i;
+            b->nnodes++;
+        }
+
+        result = node_fill(b, i, i < pa_len(b->doc->records)
+                                     ? SNAP_NONE
+                                     : b->nodes[i].parent,
+                           &value);
+    }
+
+    sbuilder_destroy(&value);
+
+    return result;
+}
+
+struct record_slot {
+    const struct ged_record* rec;
+    uint32_t node;
+};
+
+static int
+record_slot_cmp(const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t)((const struct record_slot*)a)->rec;
+    uintptr_t y = (uintptr_t)((const struct record_slot*)b)->rec;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t
+record_node(const struct record_slot* slots, uint32_t len,
+            const struct ged_record* rec)
+{
+    struct record_slot key = {rec, 0};
+    const struct record_slot* found =
+        bsearch(&key, slots, len, sizeof *slots, record_slot_cmp);
+
+    return found ? found->node : SNAP_NONE;
+}
+
+struct string_slot {
+    const char* str;
+    uint32_t index;
+};
+
+static int
+string_slot_cmp(const void* a, const void* b)
+{
+    return strcmp(((const struct string_slot*)a)->str,
+                  ((const struct string_slot*)b)->str);
+}
+
+static e_statuscode
+builder_xrefs(struct snap_builder* b)
+{
+    struct string_slot* slots = malloc((b->nnodes + 1) * sizeof *slots);
+
+    if (!slots) {
+        return ST_MALLOC_ERROR;
+    }
+
+    for (uint32_t i = 0; i < b->nnodes; i++) {
+        const char* xref = b->recs[i]->xref;
+
+        // duplicates were reported and dropped by the builder
+        if (xref && ht_get(b->doc->xrefs, xref) == b->recs[i]) {
+            slots[b->nxrefs++] = (struct string_slot){xref, i};
+        }
+    }
+
+    qsort(slots, b->nxrefs, sizeof *slots, string_slot_cmp);
+
+    b->xrefs = malloc((b->nxrefs + 1) * sizeof *b->xrefs);
+
+    if (!b->xrefs) {
+        free(slots);
+
+        return ST_MALLOC_ERROR;
+    }
+
+    for (uint32_t i = 0; i < b->nxrefs; i++) {
+        b->xrefs[i].xref = b->nodes[slots[i].index].xref;
+        b->xrefs[i].node = slots[i].index;
+    }
+
+    free(slots);
+
+    return ST_OK;
+}
+
+static e_statuscode
+builder_backrefs(struct snap_builder* b)
+{
+    const struct backref_index* br = b->doc->backrefs;
+    size_t ntargets = br && br->finalized ? br->len : 0;
+    size_t nrefs = 0;
+    e_statuscode result = ST_OK;
+
+    for (size_t i = 0; i < ntargets; i++) {
+        size_t count;
+
+        br_get(br, br->targets[i], &count);
+        nrefs += count;
+    }
+
+    struct string_slot* targets = malloc((ntargets + 1) * sizeof *targets);
+    struct record_slot* recs = malloc((b->nnodes + 1) * sizeof *recs);
+
+    b->targets = malloc((ntargets + 1) * sizeof *b->targets);
+    b->offsets = malloc((ntargets + 1) * sizeof *b->offsets);
+    b->refs = malloc((nrefs + 1) * sizeof *b->refs);
+
+    if (!targets || !recs || !b->targets || !b->offsets || !b->refs) {
+        result = ST_MALLOC_ERROR;
+        goto done;
+    }
+
+    for (uint32_t i = 0; i < b->nnodes; i++) {
+        recs[i] = (struct record_slot){b->recs[i], i};
+    }
+
+    qsort(recs, b->nnodes, sizeof *recs, record_slot_cmp);
+
+    for (size_t i = 0; i < ntargets; i++) {
+        targets[i] = (struct string_slot){br->targets[i], (uint32_t)i};
+    }
+
+    qsort(targets, ntargets, sizeof *targets, string_slot_cmp);
+
+    b->offsets[0] = 0;
+
+    for (size_t i = 0; i < ntargets && result == ST_OK; i++) {
+        const char* xref = targets[i].str;
+        size_t count;
+        const struct backref* refs = br_get(br, xref, &count);
+
+        result = pool_intern(b, xref, strlen(xref), &b->targets[i]);
+
+        for (size_t r = 0; r < count; r++) {
+            struct snap_backref* out = &b->refs[b->nrefs++];
+
+            out->node = record_node(recs, b->nnodes, refs[r].node);
+            out->root = record_node(recs, b->nnodes, refs[r].root);
+        }
+
+        b->offsets[i + 1] = b->nrefs;
+        b->ntargets++;
+    }
+
+done:
+    free(targets);
+    free(recs);
+
+    return result;
+}
+
+static void
+builder_destroy(struct snap_builder* b)
+{
+    free(b->recs);
+    free(b->nodes);
+    free(b->tokens);
+    free(b->pool.mem);
+    ht_free(b->pool.offsets);
+    free(b->xrefs);
+    free(b->targets);
+    free(b->offsets);
+    free(b->refs);
+}
+
+e_statuscode
+snap_write(const struct ged_document* doc, uint64_t source_hash,
+           uint64_t source_size, FILE* fp)
+{
+    size_t nnodes = 0;
+    size_t ntokens = 0;
+
+    for (size_t i = 0; i < pa_len(doc->records); i++) {
+        count_nodes(pa_get(doc->records, i), &nnodes, &ntokens);
+    }
+
+    if (nnodes >= SNAP_NONE || ntokens >= SNAP_NONE) {
+        return ST_NOT_OK;
+    }
+
+    struct snap_builder b = {.doc = doc};
+
+    b.recs = malloc((nnodes + 1) * sizeof *b.recs);
+    b.nodes = malloc((nnodes + 1) * sizeof *b.nodes);
+    b.tokens = malloc((ntokens + 1) * sizeof *b.tokens);
+    b.pool.offsets = ht_create(DEFAULT_STRINGS_CAP);
+
+    uint32_t empty;
+    e_statuscode result = ST_MALLOC_ERROR;
+
+    if (b.recs && b.nodes && b.tokens && b.pool.offsets) {
+        result = pool_append(&b, "", 0, &empty);
+    }
+
+    if (result == ST_OK) {
+        result = builder_nodes(&b);
+    }
+
+    if (result == ST_OK) {
+        result = builder_xrefs(&b);
+    }
+
+    if (result == ST_OK) {
+        result = builder_backrefs(&b);
+    }
+
+    if (result != ST_OK) {
+        builder_destroy(&b);
+
+        return result;
+    }
+
+    const void* data[SNAP_SECTIONS] = {
+        [SNAP_NODES] = b.nodes,     [SNAP_TOKENS] = b.tokens,
+        [SNAP_STRINGS] = b.pool.mem, [SNAP_XREFS] = b.xrefs,
+        [SNAP_TARGETS] = b.targets, [SNAP_OFFSETS] = b.offsets,
+        [SNAP_REFS] = b.refs,
+    };
+
+    size_t sizes[SNAP_SECTIONS] = {
+        [SNAP_NODES] = b.nnodes * sizeof *b.nodes,
+        [SNAP_TOKENS] = b.ntokens * sizeof *b.tokens,
+        [SNAP_STRINGS] = b.pool.len,
+        [SNAP_XREFS] = b.nxrefs * sizeof *b.xrefs,
+        [SNAP_TARGETS] = b.ntargets * sizeof *b.targets,
+        [SNAP_OFFSETS] = (b.ntargets + 1) * sizeof *b.offsets,
+        [SNAP_REFS] = b.nrefs * sizeof *b.refs,
+    };
+
+    struct snap_header header;
+
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, SNAP_MAGIC, SNAP_MAGIC_LEN);
+    header.version = SNAP_VERSION;
+    header.byte_order = SNAP_BYTE_ORDER;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.nroots = (uint32_t)pa_len(doc->records);
+
+    uint64_t offset = sizeof header;
+
+    for (int i = 0; i < SNAP_SECTIONS; i++) {
+        offset = (offset + SNAP_ALIGN - 1) & ~(uint64_t)(SNAP_ALIGN - 1);
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        header.data_hash = hash64(data[i], sizes[i], header.data_hash);
+        offset += sizes[i];
+    }
+
+    header.size = offset;
+    header.header_hash =
+        hash64(&header, offsetof(struct snap_header, header_hash), 0);
+
+    static const char padding[SNAP_ALIGN];
+    bool ok = fwrite(&header, sizeof header, 1, fp) == 1;
+
+    offset = sizeof header;
+
+    for (int i = 0; i < SNAP_SECTIONS && ok; i++) {
+        size_t pad = header.sections[i].offset - offset;
+
+        ok = fwrite(padding, 1, pad, fp) == pad &&
+             fwrite(data[i], 1, sizes[i], fp) == sizes[i];
+        offset = header.sections[i].offset + sizes[i];
+    }
+
+    builder_destroy(&b);
+
+    return ok ? ST_OK : ST_FILE_ERROR;
+}
+
+/* === Reading === */
+
+static const size_t section_elem[SNAP_SECTIONS] = {
+    [SNAP_NODES] = sizeof(struct snap_node),
+    [SNAP_TOKENS] = sizeof(struct snap_token),
+    [SNAP_STRINGS] = 1,
+    [SNAP_XREFS] = sizeof(struct snap_xref),
+    [SNAP_TARGETS] = sizeof(uint32_t),
+    [SNAP_OFFSETS] = sizeof(uint32_t),
+    [SNAP_REFS] = sizeof(struct snap_backref),
+};
+
+// Checks the header and points the sections of snap into the file
+static bool
+snapshot_layout(struct snapshot* snap)
+{
+    const struct snap_header* h = (const struct snap_header*)snap->base;
+
+    if (snap->size < sizeof *h ||
+        memcmp(h->magic, SNAP_MAGIC, SNAP_MAGIC_LEN) ||
+        h->version != SNAP_VERSION || h->byte_order != SNAP_BYTE_ORDER ||
+        h->size != snap->size ||
+        h->header_hash !=
+            hash64(h, offsetof(struct snap_header, header_hash), 0)) {
+        return false;
+    }
+
+    const void* sections[SNAP_SECTIONS];
+
+    for (int i = 0; i < SNAP_SECTIONS; i++) {
+        const struct snap_section* s = &h->sections[i];
+
+        if (s->offset % SNAP_ALIGN || s->offset < sizeof *h ||
+            s->offset > snap->size || s->size > snap->size - s->offset ||
+            s->size % section_elem[i] ||
+            s->size / section_elem[i] >= SNAP_NONE) {
+            return false;
+        }
+
+        sections[i] = snap->base + s->offset;
+    }
+
+    snap->header = h;
+    snap->nodes = sections[SNAP_NODES];
+    snap->tokens = sections[SNAP_TOKENS];
+    snap->strings = sections[SNAP_STRINGS];
+    snap->xrefs = sections[SNAP_XREFS];
+    snap->targets = sections[SNAP_TARGETS];
+    snap->offsets = sections[SNAP_OFFSETS];
+    snap->refs = sections[SNAP_REFS];
+
+    snap->nnodes = h->sections[SNAP_NODES].size / sizeof *snap->nodes;
+    snap->ntokens = h->sections[SNAP_TOKENS].size / sizeof *snap->tokens;
+    snap->nxrefs = h->sections[SNAP_XREFS].size / sizeof *snap->xrefs;
+    snap->ntargets = h->sections[SNAP_TARGETS].size / sizeof *snap->targets;
+
+    size_t nstrings = h->sections[SNAP_STRINGS].size;
+    size_t noffsets = h->sections[SNAP_OFFSETS].size / sizeof *snap->offsets;
+
+    return h->nroots <= snap->nnodes && nstrings &&
+           snap->strings[nstrings - 1] == '\0' &&
+           noffsets == (size_t)snap->ntargets + 1;
+}
+
+static bool
+verify_string(const struct snapshot* snap, uint32_t offset, bool optional)
+{
+    if (offset == SNAP_NONE) {
+        return optional;
+    }
+
+    return offset < snap->header->sections[SNAP_STRINGS].size;
+}
+
+static bool
+verify_node(const struct snapshot* snap, uint32_t index)
+{
+    if (index == SNAP_NONE) {
+        return false;
+    }
+
+    return index < snap->nnodes;
+}
+
+// Checks every offset and index, so that no accessor leaves the file, and the
+// shape of the tree, so that no walk of it loops
+static bool
+snapshot_verify(const struct snapshot* snap)
+{
+    const struct snap_header* h = snap->header;
+    uint64_t hash = 0;
+
+    for (int i = 0; i < SNAP_SECTIONS; i++) {
+        hash = hash64(snap->base + h->sections[i].offset, h->sections[i].size,
+                      hash);
+    }
+
+    if (hash != h->data_hash) {
+        return false;
+    }
+
+    size_t nstrings = h->sections[SNAP_STRINGS].size;
+
+    for (uint32_t i = 0; i < snap->nnodes; i++) {
+        const struct snap_node* n = &snap->nodes[i];
+
+        if (!verify_string(snap, n->tag, false) ||
+            !verify_string(snap, n->xref, true) ||
+            !verify_string(snap, n->value, false) ||
+            n->value_len > nstrings - n->value - 1 ||
+            n->first_token > snap->ntokens ||
+            n->ntokens > snap->ntokens - n->first_token ||
+            n->first_child > snap->nnodes ||
+            n->nchildren > snap->nnodes - n->first_child ||
+            (i < h->nroots) != (n->parent == SNAP_NONE) ||
+            (n->parent != SNAP_NONE && !verify_node(snap, n->parent))) {
+            return false;
+        }
+
+        uint64_t len = 0;
+
+        for (uint32_t t = 0; t < n->ntokens; t++) {
+            uint32_t tlen = snap->tokens[n->first_token + t].len;
+
+            len += tlen == SNAP_NONE ? 0 : tlen;
+        }
+
+        if (len != n->value_len) {
+            return false;
+        }
+
+        // nodes are laid out breadth first, so children come after their
+        // parent and no walk down the tree can return to a node
+        if (n->first_child <= i) {
+            return false;
+        }
+
+        for (uint32_t c = 0; c < n->nchildren; c++) {
+            if (snap->nodes[n->first_child + c].parent != i) {
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < snap->nxrefs; i++) {
+        if (!verify_string(snap, snap->xrefs[i].xref, false) ||
+            !verify_node(snap, snap->xrefs[i].node)) {
+            return false;
+        }
+    }
+
+    uint32_t nrefs = h->sections[SNAP_REFS].size / sizeof *snap->refs;
+
+    for (uint32_t i = 0; i < snap->ntargets; i++) {
+        if (!verify_string(snap, snap->targets[i], false) ||
+            snap->offsets[i] > snap->offsets[i + 1]) {
+            return false;
+        }
+    }
+
+    if (snap->offsets[0] != 0 || snap->offsets[snap->ntargets] != nrefs) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nrefs; i++) {
+        if (!verify_node(snap, snap->refs[i].node) ||
+            !verify_node(snap, snap->refs[i].root)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct snapshot*
+snap_open(const char* path, int flags)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    struct snapshot* snap = NULL;
+    void* base = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    // the mapping stays valid without the descriptor
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    snap = calloc(1, sizeof *snap);
+
+    if (snap) {
+        snap->base = base;
+        snap->size = (size_t)st.st_size;
+    }
+
+    if (!snap || !snapshot_layout(snap) ||
+        ((flags & SNAP_VERIFY) && !snapshot_verify(snap))) {
+        munmap(base, (size_t)st.st_size);
+        free(snap);
+
+        return NULL;
+    }
+
+    return snap;
+}
+
+void
+snap_close(struct snapshot* snap)
+{
+    if (!snap) {
+        return;
+    }
+
+    munmap((void*)snap->base, snap->size);
+    free(snap);
+}
+
+bool
+snap_matches(const struct snapshot* snap, uint64_t source_hash,
+             uint64_t source_size)
+{
+    return snap->header->source_hash == source_hash &&
+           snap->header->source_size == source_size;
+}
+
+uint32_t
+snap_xref(const struct snapshot* snap, const char* xref)
+{
+    uint32_t lo = 0;
+    uint32_t hi = snap->nxrefs;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(snap->strings + snap->xrefs[mid].xref, xref);
+
+        if (!cmp) {
+            return snap->xrefs[mid].node;
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return SNAP_NONE;
+}
+
+const struct snap_backref*
+snap_backrefs(const struct snapshot* snap, const char* xref, size_t* count)
+{
+    uint32_t lo = 0;
+    uint32_t hi = snap->ntargets;
+
+    *count = 0;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(snap->strings + snap->targets[mid], xref);
+
+        if (!cmp) {
+            *count = snap->offsets[mid + 1] - snap->offsets[mid];
+
+            return *count ? &snap->refs[snap->offsets[mid]] : NULL;
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/* === Conversion === */
+
+static struct ged_record*
+node_to_record(const struct snapshot* snap, uint32_t index,
+               struct context* ctx)
+{
+    const struct snap_node* node = &snap->nodes[index];
+    struct ged_record* rec = malloc(sizeof *rec);
+
+    if (!rec) {
+        return NULL;
+    }
+
+    rec->level = (uint8_t)node->level;
+    rec->tag = strdup(snap->strings + node->tag);
+    rec->tag_id = node->tag_id;
+    rec->xref = node->xref == SNAP_NONE ? NULL
+                                        : strdup(snap->strings + node->xref);
+    rec->elem.interface = NULL;
+    rec->elem.data = NULL;
+    sa_init(&rec->value);
+    sa_init(&rec->children);
+
+    if (!rec->tag || (node->xref != SNAP_NONE && !rec->xref) ||
+        sa_reserve(&rec->value, node->ntokens) != ST_OK ||
+        sa_reserve(&rec->children, node->nchildren) != ST_OK) {
+        goto error;
+    }
+
+    const char* value = snap->strings + node->value;
+
+    for (uint32_t i = 0; i < node->ntokens; i++) {
+        const struct snap_token* t = &snap->tokens[node->first_token + i];
+        struct lex_token* tok = malloc(sizeof *tok);
+
+        if (!tok) {
+            goto error;
+        }
+
+        tok->type = (lex_token_type)t->type;
+        tok->line = t->line;
+        tok->col = t->col;
+        tok->next = NULL;
+        tok->lexeme = NULL;
+
+        // pushed first, so it is freed with the record on failure
+        if (sa_push(&rec->value, tok) != ST_OK) {
+            free(tok);
+            goto error;
+        }
+
+        if (t->len != SNAP_NONE) {
+            if (lex_token_set_lexeme(tok, value, t->len) != ST_OK) {
+                goto error;
+            }
+
+            value += t->len;
+        }
+    }
+
+    if (rec->tag[0] != '_') {
+        rec->elem.interface = tag_i_get(rec->tag);
+    }
+
+    if (rec->elem.interface && rec->elem.interface->create) {
+        rec->elem.data = rec->elem.interface->create(rec, ctx);
+    }
+
+    for (uint32_t i = 0; i < node->nchildren; i++) {
+        struct ged_record* child =
+            node_to_record(snap, node->first_child + i, ctx);
+
+        if (!child) {
+            goto error;
+        }
+
+        if (sa_push(&rec->children, child) != ST_OK) {
+            ged_record_free(child);
+            goto error;
+        }
+    }
+
+    return rec;
+
+error:
+    ged_record_free(rec);
+
+    return NULL;
+}
+
+struct ged_document*
+snap_to_document(const struct snapshot* snap, struct context* ctx)
+{
+    uint32_t nroots = snap_nroots(snap);
+    ptr_arr records = pa_create(nroots ? nroots : 1);
+
+    tags_init();
+    ctx_push(ctx, posctx_create("snapshot"));
+
+    for (uint32_t i = 0; i < nroots; i++) {
+        struct ged_record* rec = node_to_record(snap, i, ctx);
+
+        if (!rec) {
+            ctx_critf(ctx, "unable to rebuild record %u", i);
+            break;
+        }
+
+        pa_push(records, rec);
+    }
+
+    ctx_pop(ctx);
+    tags_cleanup();
+
+    if (pa_len(records) != nroots) {
+        for (size_t i = 0; i < pa_len(records); i++) {
+            ged_record_free(pa_get(records, i));
+        }
+
+        pa_free(records);
+
+        return NULL;
+    }
+
+    return ged_document_from_records(records, ctx);
+}
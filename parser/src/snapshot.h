@@ -0,0 +1,180 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "context/context.h"
+#include "gedcom.h"
+#include "utils/statuscode.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SNAP_MAGIC "GEDSNAP\0"
+#define SNAP_MAGIC_LEN 8
+#define SNAP_VERSION 1
+#define SNAP_BYTE_ORDER 0x01020304u
+
+// Missing string or node
+#define SNAP_NONE UINT32_MAX
+
+// Also check the data hash and every offset in the file, so accessors can be
+// used on untrusted files. Reads the whole file
+#define SNAP_VERIFY 1
+
+/*
+Binary snapshot of a parsed document.
+
+A snapshot is mapped into memory and used in place, nothing is deserialized on
+load. All references inside the file are offsets or indices, so it can be
+mapped at any address:
+
+    header
+    nodes    struct snap_node, level 0 records first. Children of a node are
+             contiguous, at first_child .. first_child + nchildren - 1
+    tokens   struct snap_token, the value of a node split into its tokens
+    strings  NUL terminated strings, deduplicated. Offset 0 is ""
+    xrefs    struct snap_xref, sorted by xref
+    targets  string offset of each referenced xref, sorted
+    offsets  ntargets + 1 entries, refs of target i are
+             refs[offsets[i]] .. refs[offsets[i + 1] - 1]
+    refs     struct snap_backref
+
+The header is covered by its own hash, the sections by data_hash. Files are
+written in host byte order and rejected by hosts of another order.
+*/
+
+typedef enum {
+    SNAP_NODES = 0,
+    SNAP_TOKENS,
+    SNAP_STRINGS,
+    SNAP_XREFS,
+    SNAP_TARGETS,
+    SNAP_OFFSETS,
+    SNAP_REFS,
+    SNAP_SECTIONS // should always be last
+} snap_e_section;
+
+struct snap_section {
+    uint64_t offset; // from the start of the file, 8 byte aligned
+    uint64_t size;   // in bytes
+};
+
+struct snap_header {
+    char magic[SNAP_MAGIC_LEN];
+    uint32_t version;
+    uint32_t byte_order; // SNAP_BYTE_ORDER, as stored by the writing host
+    uint64_t size;       // of the whole file
+    uint64_t source_hash; // hash64 of the source GEDCOM file
+    uint64_t source_size;
+    uint64_t data_hash; // sections hashed in order, see hash64()
+    uint32_t nroots;
+    uint32_t reserved;
+    struct snap_section sections[SNAP_SECTIONS];
+    uint64_t header_hash; // of every field above
+};
+
+struct snap_node {
+    uint32_t tag;  // string offset
+    uint32_t tag_id;
+    uint32_t xref; // string offset, SNAP_NONE if the line declares no xref
+    uint32_t value; // string offset of the whole value
+    uint32_t value_len;
+    uint32_t first_token;
+    uint32_t ntokens;
+    uint32_t parent; // SNAP_NONE for level 0 records
+    uint32_t first_child;
+    uint32_t nchildren;
+    uint32_t level;
+};
+
+// Tokens of a node follow each other in its value
+struct snap_token {
+    uint32_t type; // lex_token_type
+    uint32_t len;  // SNAP_NONE if the token had no lexeme
+    uint32_t line;
+    uint32_t col;
+};
+
+struct snap_xref {
+    uint32_t xref; // string offset
+    uint32_t node;
+};
+
+struct snap_backref {
+    uint32_t node; // node holding the pointer value
+    uint32_t root; // level 0 record node belongs to
+};
+
+struct snapshot {
+    const uint8_t* base;
+    size_t size;
+
+    const struct snap_header* header;
+    const struct snap_node* nodes;
+    const struct snap_token* tokens;
+    const char* strings;
+    const struct snap_xref* xrefs;
+    const uint32_t* targets;
+    const uint32_t* offsets;
+    const struct snap_backref* refs;
+
+    uint32_t nnodes;
+    uint32_t ntokens;
+    uint32_t nxrefs;
+    uint32_t ntargets;
+};
+
+// Writes doc as a snapshot. source_hash and source_size identify the file doc
+// was parsed from, see hash64_file()
+e_statuscode snap_write(const struct ged_document* doc, uint64_t source_hash,
+                        uint64_t source_size, FILE* fp);
+
+// Maps the snapshot at path. Returns NULL if it cannot be mapped, or is not a
+// valid snapshot. flags is 0 or SNAP_VERIFY
+struct snapshot* snap_open(const char* path, int flags);
+void snap_close(struct snapshot* snap);
+
+// Whether snap was written from a source file of the given hash and size
+bool snap_matches(const struct snapshot* snap, uint64_t source_hash,
+                  uint64_t source_size);
+
+// Node declaring xref, SNAP_NONE if there is none
+uint32_t snap_xref(const struct snapshot* snap, const char* xref);
+
+// Nodes referencing xref, in source order. Sets count to 0 and returns NULL
+// if nothing references xref
+const struct snap_backref* snap_backrefs(const struct snapshot* snap,
+                                         const char* xref, size_t* count);
+
+// Rebuilds the records of snap as a document. Returns NULL, with a critical
+// error in ctx, if a record cannot be rebuilt
+struct ged_document* snap_to_document(const struct snapshot* snap,
+                                      struct context* ctx);
+
+static inline const char*
+snap_string(const struct snapshot* snap, uint32_t offset)
+{
+    return offset == SNAP_NONE ? NULL : snap->strings + offset;
+}
+
+static inline uint32_t
+snap_nroots(const struct snapshot* snap)
+{
+    return snap->header->nroots;
+}
+
+// Level 0 records are nodes 0 .. snap_nroots() - 1
+static inline const struct snap_node*
+snap_node(const struct snapshot* snap, uint32_t index)
+{
+    return &snap->nodes[index];
+}
+
+static inline const struct snap_node*
+snap_child(const struct snapshot* snap, const struct snap_node* node,
+           uint32_t i)
+{
+    return &snap->nodes[node->first_child + i];
+}
+
+#endif // SNAPSHOT_H
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "tags/base.h"
+#include "tags/date.h"
 #include "tags/month.h"
 
 // Hashtable of tag interfaces
@@ -41,6 +42,7 @@ tags_init(void)
     */
     void (*init_modules[])(struct hash_table*) = {
         init_months,
+        init_dates,
     };
 
     assert(sizeof init_modules /* No tag modules to initialize */);
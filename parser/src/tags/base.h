@@ -8,7 +8,8 @@
 #include "utils/ptrarr.h"
 
 struct tag_interface {
-    void* const (*create)(struct ged_record*);
+    // Called once the record's value is read, the result is kept as its data
+    void* (*create)(struct ged_record* rec, struct context* ctx);
     void (*free)(void* data);
 };
 
@@ -0,0 +1,636 @@
+#include "tags/date.h"
+#include "gedcom.h"
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GEDCOM lines are at most 255 characters
+#define DATE_VALUE_MAX 256
+
+// Month names and keywords are at most 4 characters, and are compared packed
+// into an integer
+#define CODE(a, b, c, d)                                                       \
+    ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 |               \
+     (uint32_t)(d) << 24)
+
+#define KW_ABT CODE('A', 'B', 'T', 0)
+#define KW_CAL CODE('C', 'A', 'L', 0)
+#define KW_EST CODE('E', 'S', 'T', 0)
+#define KW_BEF CODE('B', 'E', 'F', 0)
+#define KW_AFT CODE('A', 'F', 'T', 0)
+#define KW_BET CODE('B', 'E', 'T', 0)
+#define KW_AND CODE('A', 'N', 'D', 0)
+#define KW_FROM CODE('F', 'R', 'O', 'M')
+#define KW_TO CODE('T', 'O', 0, 0)
+#define KW_INT CODE('I', 'N', 'T', 0)
+#define KW_BC CODE('B', '.', 'C', '.')
+
+// Days between the Julian day number epoch and the Hebrew one (1 Tishri AM 1)
+#define HEBREW_EPOCH 347998
+// 1 Vendemiaire I is day FRENCH_EPOCH + 366
+#define FRENCH_EPOCH 2375474
+
+static const uint32_t months_gregorian[] = {
+    CODE('J', 'A', 'N', 0), CODE('F', 'E', 'B', 0), CODE('M', 'A', 'R', 0),
+    CODE('A', 'P', 'R', 0), CODE('M', 'A', 'Y', 0), CODE('J', 'U', 'N', 0),
+    CODE('J', 'U', 'L', 0), CODE('A', 'U', 'G', 0), CODE('S', 'E', 'P', 0),
+    CODE('O', 'C', 'T', 0), CODE('N', 'O', 'V', 0), CODE('D', 'E', 'C', 0)};
+
+static const uint32_t months_french[] = {
+    CODE('V', 'E', 'N', 'D'), CODE('B', 'R', 'U', 'M'),
+    CODE('F', 'R', 'I', 'M'), CODE('N', 'I', 'V', 'O'),
+    CODE('P', 'L', 'U', 'V'), CODE('V', 'E', 'N', 'T'),
+    CODE('G', 'E', 'R', 'M'), CODE('F', 'L', 'O', 'R'),
+    CODE('P', 'R', 'A', 'I'), CODE('M', 'E', 'S', 'S'),
+    CODE('T', 'H', 'E', 'R'), CODE('F', 'R', 'U', 'C'),
+    CODE('C', 'O', 'M', 'P')};
+
+static const uint32_t months_hebrew[] = {
+    CODE('T', 'S', 'H', 0), CODE('C', 'S', 'H', 0), CODE('K', 'S', 'L', 0),
+    CODE('T', 'V', 'T', 0), CODE('S', 'H', 'V', 0), CODE('A', 'D', 'R', 0),
+    CODE('A', 'D', 'S', 0), CODE('N', 'S', 'N', 0), CODE('I', 'Y', 'R', 0),
+    CODE('S', 'V', 'N', 0), CODE('T', 'M', 'Z', 0), CODE('A', 'A', 'V', 0),
+    CODE('E', 'L', 'L', 0)};
+
+enum hebrew_month { TSH = 1, CSH, KSL, TVT, SHV, ADR, ADS, NSN };
+
+struct calendar {
+    const char* escape; // as in @#DGREGORIAN@
+    const uint32_t* months;
+    int nmonths;
+};
+
+static const struct calendar calendars[CAL_COUNT] = {
+    [CAL_GREGORIAN] = {"GREGORIAN", months_gregorian, 12},
+    [CAL_JULIAN] = {"JULIAN", months_gregorian, 12},
+    [CAL_FRENCH] = {"FRENCH R", months_french, 13},
+    [CAL_HEBREW] = {"HEBREW", months_hebrew, 13},
+};
+
+struct word {
+    const char* mem;
+    size_t len;
+    uint32_t code; // packed upper case word, 0 if longer than 4 characters
+};
+
+/*
+=================================================
+Calendars
+=================================================
+*/
+
+static int64_t
+floor_div(int64_t a, int64_t b)
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static bool
+gregorian_leap(int64_t year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static bool
+julian_leap(int64_t year)
+{
+    return floor_div(year, 4) * 4 == year;
+}
+
+// Days from the Hebrew epoch to the molad of Tishri of year, postponed to a
+// permitted weekday
+static int64_t
+hebrew_elapsed(int64_t year)
+{
+    int64_t months = floor_div(235 * year - 234, 19);
+    int64_t parts = 12084 + 13753 * months;
+    int64_t day = months * 29 + floor_div(parts, 25920);
+
+    if ((3 * (day + 1)) % 7 < 3) {
+        day++;
+    }
+
+    return day;
+}
+
+static int64_t
+hebrew_new_year(int64_t year)
+{
+    int64_t prev = hebrew_elapsed(year - 1);
+    int64_t cur = hebrew_elapsed(year);
+    int64_t next = hebrew_elapsed(year + 1);
+    int64_t delay = 0;
+
+    if (next - cur == 356) {
+        delay = 2;
+    } else if (cur - prev == 382) {
+        delay = 1;
+    }
+
+    return HEBREW_EPOCH + cur + delay;
+}
+
+static bool
+hebrew_leap(int64_t year)
+{
+    int64_t r = (7 * year + 1) % 19;
+
+    return (r < 0 ? r + 19 : r) < 7;
+}
+
+static int
+hebrew_month_length(int64_t year, int month)
+{
+    int64_t year_length = hebrew_new_year(year + 1) - hebrew_new_year(year);
+    bool leap = hebrew_leap(year);
+
+    switch (month) {
+    case CSH:
+        return year_length % 10 == 5 ? 30 : 29;
+    case KSL:
+        return year_length % 10 == 3 ? 29 : 30;
+    case ADR:
+        return leap ? 30 : 29;
+    case ADS:
+        return leap ? 29 : 0;
+    default:
+        // the remaining months alternate, starting with 30 days in Tishri
+        return month < ADR ? (month & 1 ? 30 : 29) : (month & 1 ? 29 : 30);
+    }
+}
+
+static int
+month_length(date_e_calendar cal, int64_t year, int month)
+{
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    switch (cal) {
+    case CAL_GREGORIAN:
+    case CAL_JULIAN: {
+        bool leap =
+            cal == CAL_GREGORIAN ? gregorian_leap(year) : julian_leap(year);
+
+        return days[month - 1] + (month == 2 && leap);
+    }
+    case CAL_FRENCH:
+        // sansculottides: 5 days, 6 in every fourth year (3, 7, 11, ...)
+        return month < 13 ? 30 : (year % 4 == 3 ? 6 : 5);
+    case CAL_HEBREW:
+        return hebrew_month_length(year, month);
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+int32_t
+date_to_day(date_e_calendar cal, int32_t year, int month, int day)
+{
+    int64_t y = year;
+
+    switch (cal) {
+    case CAL_GREGORIAN:
+    case CAL_JULIAN: {
+        // years start in March, so the leap day is last
+        int64_t a = (14 - month) / 12;
+        int64_t y2 = y + 4800 - a;
+        int64_t m2 = month + 12 * a - 3;
+        int64_t jdn = day + (153 * m2 + 2) / 5 + 365 * y2 + floor_div(y2, 4);
+
+        if (cal == CAL_GREGORIAN) {
+            return jdn - floor_div(y2, 100) + floor_div(y2, 400) - 32045;
+        }
+
+        return jdn - 32083;
+    }
+    case CAL_FRENCH:
+        return floor_div(y * 1461, 4) + (month - 1) * 30 + day + FRENCH_EPOCH;
+    case CAL_HEBREW: {
+        int64_t jdn = hebrew_new_year(y) + day - 1;
+
+        for (int m = TSH; m < month; m++) {
+            jdn += hebrew_month_length(y, m);
+        }
+
+        return jdn;
+    }
+    default:
+        assert(false);
+        return DATE_MIN;
+    }
+}
+
+/*
+=================================================
+Parsing
+=================================================
+*/
+
+static uint32_t
+pack_word(const char* mem, size_t len)
+{
+    if (len > 4) {
+        return 0;
+    }
+
+    uint32_t code = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        code |= (uint32_t)toupper((unsigned char)mem[i]) << (8 * i);
+    }
+
+    return code;
+}
+
+static int
+month_lookup(date_e_calendar cal, uint32_t code)
+{
+    const struct calendar* c = &calendars[cal];
+
+    for (int i = 0; code && i < c->nmonths; i++) {
+        if (c->months[i] == code) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// Reads the next space separated word of *str. Calendar escapes contain
+// spaces (@#DFRENCH R@), and are read up to their closing @
+static bool
+next_word(const char** str, struct word* out)
+{
+    const char* s = *str;
+
+    while (*s == ' ') {
+        s++;
+    }
+
+    if (!*s) {
+        *str = s;
+
+        return false;
+    }
+
+    const char* end = s;
+
+    if (s[0] == '@' && s[1] == '#') {
+        end = strchr(s + 2, '@');
+        end = end ? end + 1 : s + strlen(s);
+    } else {
+        while (*end && *end != ' ') {
+            end++;
+        }
+    }
+
+    out->mem = s;
+    out->len = end - s;
+    out->code = pack_word(s, out->len);
+    *str = end;
+
+    return true;
+}
+
+static bool
+peek_word(const char* str, struct word* out)
+{
+    return next_word(&str, out);
+}
+
+// Parses a number of at most 6 digits. Years may be followed by a dual year
+// (1750/51)
+static bool
+parse_number(const struct word* w, int32_t* out, bool* dual)
+{
+    size_t i = 0;
+    int32_t value = 0;
+
+    for (; i < w->len && isdigit((unsigned char)w->mem[i]); i++) {
+        value = value * 10 + (w->mem[i] - '0');
+    }
+
+    if (!i || i > 6) {
+        return false;
+    }
+
+    *dual = false;
+
+    if (i < w->len) {
+        if (w->mem[i] != '/' || i + 1 == w->len) {
+            return false;
+        }
+
+        for (i++; i < w->len; i++) {
+            if (!isdigit((unsigned char)w->mem[i])) {
+                return false;
+            }
+        }
+
+        *dual = true;
+    }
+
+    *out = value;
+
+    return true;
+}
+
+static bool
+parse_escape(const struct word* w, date_e_calendar* cal)
+{
+    // @#D<name>@
+    if (w->len < 5 || w->mem[2] != 'D' || w->mem[w->len - 1] != '@') {
+        return false;
+    }
+
+    const char* name = w->mem + 3;
+    size_t len = w->len - 4;
+
+    for (int i = 0; i < CAL_COUNT; i++) {
+        if (strlen(calendars[i].escape) == len &&
+            strncmp(calendars[i].escape, name, len) == 0) {
+            *cal = (date_e_calendar)i;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+is_date_end(const struct word* w)
+{
+    return w->code == KW_AND || w->code == KW_TO || w->code == KW_BC ||
+           w->mem[0] == '(';
+}
+
+// Parses [calendar escape] [[day] month] year [B.C.] into the range of days
+// it covers
+static e_statuscode
+parse_single(const char** str, struct ged_date* out)
+{
+    struct word words[3];
+    int nwords = 0;
+    date_e_calendar cal = CAL_GREGORIAN;
+    struct word w;
+
+    if (peek_word(*str, &w) && w.mem[0] == '@') {
+        if (!parse_escape(&w, &cal)) {
+            return ST_NOT_OK;
+        }
+
+        next_word(str, &w);
+    }
+
+    while (peek_word(*str, &w) && !is_date_end(&w)) {
+        if (nwords == 3) {
+            return ST_NOT_OK;
+        }
+
+        next_word(str, &words[nwords++]);
+    }
+
+    int32_t year;
+    int32_t day = 0;
+    int month = 0;
+    bool dual;
+
+    if (!nwords || !parse_number(&words[nwords - 1], &year, &dual)) {
+        return ST_NOT_OK;
+    }
+
+    if (nwords > 1 && !(month = month_lookup(cal, words[nwords - 2].code))) {
+        return ST_NOT_OK;
+    }
+
+    if (nwords > 2) {
+        bool day_dual;
+
+        if (!parse_number(&words[0], &day, &day_dual) || day_dual || !day) {
+            return ST_NOT_OK;
+        }
+    }
+
+    // 1750/51 is 1751 new style, dual years are only used for January to
+    // March
+    if (dual) {
+        year++;
+    }
+
+    if (peek_word(*str, &w) && w.code == KW_BC) {
+        next_word(str, &w);
+        year = 1 - year;
+    }
+
+    // the French and Hebrew calendars have no years before their epoch
+    if ((cal == CAL_FRENCH || cal == CAL_HEBREW) && year < 1) {
+        return ST_NOT_OK;
+    }
+
+    if (month) {
+        int length = month_length(cal, year, month);
+
+        if (!length || day > length) {
+            return ST_NOT_OK;
+        }
+
+        if (day) {
+            out->lo = out->hi = date_to_day(cal, year, month, day);
+        } else {
+            out->lo = date_to_day(cal, year, month, 1);
+            out->hi = out->lo + length - 1;
+        }
+    } else {
+        out->lo = date_to_day(cal, year, 1, 1);
+        out->hi = date_to_day(cal, year + 1, 1, 1) - 1;
+    }
+
+    if (out->lo < DATE_MIN) {
+        return ST_NOT_OK;
+    }
+
+    out->calendar = (uint8_t)cal;
+    out->qualifier = DQ_EXACT;
+
+    return ST_OK;
+}
+
+static date_e_qualifier
+qualifier_lookup(uint32_t code)
+{
+    switch (code) {
+    case KW_ABT:
+        return DQ_ABOUT;
+    case KW_CAL:
+        return DQ_CALCULATED;
+    case KW_EST:
+        return DQ_ESTIMATED;
+    case KW_BEF:
+        return DQ_BEFORE;
+    case KW_AFT:
+        return DQ_AFTER;
+    case KW_BET:
+        return DQ_BETWEEN;
+    case KW_FROM:
+    case KW_TO:
+        return DQ_PERIOD;
+    case KW_INT:
+        return DQ_INTERPRETED;
+    default:
+        return DQ_EXACT;
+    }
+}
+
+e_statuscode
+date_parse(const char* str, struct ged_date* out)
+{
+    struct word w;
+    struct ged_date second;
+
+    if (!next_word(&str, &w)) {
+        return ST_NOT_OK;
+    }
+
+    date_e_qualifier qualifier = qualifier_lookup(w.code);
+
+    if (qualifier == DQ_EXACT) {
+        // not a keyword, read it again as part of the date
+        str = w.mem;
+    }
+
+    if (w.code == KW_TO) {
+        // TO <date> is a period with an open start
+        if (parse_single(&str, &second) != ST_OK) {
+            return ST_NOT_OK;
+        }
+
+        *out = second;
+        out->lo = DATE_MIN;
+    } else if (parse_single(&str, out) != ST_OK) {
+        return ST_NOT_OK;
+    }
+
+    out->qualifier = (uint8_t)qualifier;
+
+    switch (qualifier) {
+    case DQ_BEFORE:
+        out->hi = out->lo > DATE_MIN ? out->lo - 1 : DATE_MIN;
+        out->lo = DATE_MIN;
+        break;
+    case DQ_AFTER:
+        out->lo = out->hi < DATE_MAX ? out->hi + 1 : DATE_MAX;
+        out->hi = DATE_MAX;
+        break;
+    case DQ_BETWEEN:
+        if (!next_word(&str, &w) || w.code != KW_AND ||
+            parse_single(&str, &second) != ST_OK || second.hi < out->lo) {
+            return ST_NOT_OK;
+        }
+
+        out->hi = second.hi;
+        break;
+    case DQ_PERIOD:
+        if (w.code == KW_TO) {
+            break;
+        }
+
+        // FROM <date> without TO has an open end
+        out->hi = DATE_MAX;
+
+        if (peek_word(str, &w) && w.code == KW_TO) {
+            next_word(&str, &w);
+
+            if (parse_single(&str, &second) != ST_OK ||
+                second.hi < out->lo) {
+                return ST_NOT_OK;
+            }
+
+            out->hi = second.hi;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // only a trailing (phrase) may follow
+    if (next_word(&str, &w) && w.mem[0] != '(') {
+        return ST_NOT_OK;
+    }
+
+    return ST_OK;
+}
+
+int
+date_month_index(date_e_calendar cal, const char* name)
+{
+    return month_lookup(cal, pack_word(name, strlen(name)));
+}
+
+int
+date_cmp(const struct ged_date* a, const struct ged_date* b)
+{
+    uint64_t ka = date_key(a);
+    uint64_t kb = date_key(b);
+
+    return (ka > kb) - (ka < kb);
+}
+
+/*
+=================================================
+Tag interface
+=================================================
+*/
+
+static void*
+date_create(struct ged_record* rec, struct context* ctx)
+{
+    char value[DATE_VALUE_MAX];
+
+    if (ged_record_value(rec, value, sizeof value) >= sizeof value) {
+        ctx_diag(ctx, WARNING, CTX_C_DATE_TOO_LONG);
+
+        return NULL;
+    }
+
+    struct ged_date date;
+
+    if (date_parse(value, &date) != ST_OK) {
+        // dates are often free text, keep the record without a date
+        ctx_diag(ctx, WARNING, CTX_C_DATE_INVALID, value);
+
+        return NULL;
+    }
+
+    struct ged_date* result = malloc(sizeof *result);
+
+    if (!result) {
+        assert(false);
+
+        return NULL;
+    }
+
+    *result = date;
+
+    return result;
+}
+
+static const struct tag_interface tag_i_date = {.create = date_create,
+                                                .free = free};
+
+const struct ged_date*
+ged_record_date(const struct ged_record* rec)
+{
+    if (rec->elem.interface != &tag_i_date) {
+        return NULL;
+    }
+
+    return rec->elem.data;
+}
+
+void
+init_dates(struct hash_table* ht)
+{
+    ht_set(ht, DATE_TAG, (void*)&tag_i_date);
+}
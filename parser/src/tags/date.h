@@ -0,0 +1,79 @@
+/*
+DATE values
+
+Dates are converted to Julian day numbers, so dates of every calendar compare
+as plain integers. A date value is the range of days it can denote:
+        2 Oct 1822            [2 Oct 1822, 2 Oct 1822]
+        Dec 1859              [1 Dec 1859, 31 Dec 1859]
+        BEF 1828              [DATE_MIN, 31 Dec 1827]
+        BET 1820 AND 1825     [1 Jan 1820, 31 Dec 1825]
+        FROM 1900 TO 1905     [1 Jan 1900, 31 Dec 1905]
+Approximations (ABT, CAL, EST) keep the range of the date they qualify, the
+qualifier tells how far to trust it.
+*/
+
+#ifndef TAGS_DATE_H
+#define TAGS_DATE_H
+
+#include "tags/base.h"
+#include <stdint.h>
+
+#define DATE_TAG "DATE"
+
+#define DATE_MIN 0 // 1 Jan 4713 BC (Julian)
+#define DATE_MAX INT32_MAX
+
+typedef enum {
+    CAL_GREGORIAN = 0,
+    CAL_JULIAN,
+    CAL_FRENCH,
+    CAL_HEBREW,
+    CAL_COUNT
+} date_e_calendar;
+
+typedef enum {
+    DQ_EXACT = 0,
+    DQ_ABOUT,       // ABT
+    DQ_CALCULATED,  // CAL
+    DQ_ESTIMATED,   // EST
+    DQ_BEFORE,      // BEF
+    DQ_AFTER,       // AFT
+    DQ_BETWEEN,     // BET .. AND ..
+    DQ_PERIOD,      // FROM .. TO .., or either of them alone
+    DQ_INTERPRETED, // INT .. (phrase)
+} date_e_qualifier;
+
+struct ged_date {
+    int32_t lo; // first possible day
+    int32_t hi; // last possible day
+    uint8_t calendar;
+    uint8_t qualifier;
+};
+
+// Parses a DATE value. Returns ST_NOT_OK if str is not a date
+e_statuscode date_parse(const char* str, struct ged_date* out);
+
+// Day number of a calendar date. month and day are 1 based, month in the
+// order of the calendar's GEDCOM month names. Years before 1 are B.C.
+// astronomically (0 = 1 B.C.)
+int32_t date_to_day(date_e_calendar cal, int32_t year, int month, int day);
+
+// 1 based index of a month name in the calendar (case insensitive), 0 if it
+// is not a month of that calendar
+int date_month_index(date_e_calendar cal, const char* name);
+
+// Sorts dates by first possible day, then last possible day
+static inline uint64_t
+date_key(const struct ged_date* date)
+{
+    return (uint64_t)(uint32_t)date->lo << 32 | (uint32_t)date->hi;
+}
+
+int date_cmp(const struct ged_date* a, const struct ged_date* b);
+
+// Parsed date of a DATE record, NULL if rec is no DATE or could not be parsed
+const struct ged_date* ged_record_date(const struct ged_record* rec);
+
+void init_dates(struct hash_table* ht);
+
+#endif // TAGS_DATE_H
@@ -1,7 +1,9 @@
 
 #include "tags/month.h"
+#include "tags/date.h"
 #include "utils/ptrarr.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 struct month {
@@ -10,55 +12,45 @@ struct month {
 };
 
 static struct month*
-month_base_create(struct ged_record* rec, const char** possible_months,
-                  const char* name)
+month_base_create(struct ged_record* rec, struct context* ctx,
+                  date_e_calendar cal, const char* name)
 {
-    size_t len = pa_len(rec->value);
+    size_t len = sa_len(&rec->value);
 
     if (len != 1) {
-#if 0
-        ctx_critf(tag->ctx, "%s expects exactly one argument (got %d)", name,
-                  count);
-#endif
+        ctx_errf(ctx, "%s expects exactly one argument (got %zu)", name, len);
 
         return NULL;
     }
 
-    struct lex_token* tok = pa_front(rec->value);
+    struct lex_token* tok = sa_get(&rec->value, 0);
 
     if (!tok->lexeme) {
-#if 0
-        ctx_critf(tag->ctx, "%s empty argument", name);
-#endif
+        ctx_errf(ctx, "%s empty argument", name);
+
         return NULL;
     }
 
     const char* entry = tok->lexeme;
 
-    size_t size = sizeof possible_months / sizeof *possible_months;
-
-    for (size_t i = 0; i < size; i++) {
-        if (strcmp(possible_months[i], entry) == 0) {
-            struct month* m = malloc(sizeof *m);
+    if (!date_month_index(cal, entry)) {
+        ctx_diag(ctx, ERROR, CTX_C_MONTH_INVALID, name, entry);
 
-            if (!m) {
-                assert(false);
+        return NULL;
+    }
 
-                return NULL;
-            }
+    struct month* m = malloc(sizeof *m);
 
-            m->name = strdup(name);
-            m->value = strdup(entry);
+    if (!m) {
+        assert(false);
 
-            return m;
-        }
+        return NULL;
     }
 
-#if 0
-    ctx_errf(tag->ctx, "%s got invalid month %s", name, entry);
-#endif
+    m->name = strdup(name);
+    m->value = strdup(entry);
 
-    return NULL;
+    return m;
 }
 
 static void
@@ -81,32 +73,22 @@ month_base_free(void* data)
     free(m);
 }
 
-static struct month*
-month_eng_create(struct ged_record* rec)
+static void*
+month_eng_create(struct ged_record* rec, struct context* ctx)
 {
-    const char* months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN",
-                            "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
-
-    return month_base_create(rec, months, MONTH_ENG);
+    return month_base_create(rec, ctx, CAL_GREGORIAN, MONTH_ENG);
 }
 
-static struct month*
-month_fren_create(struct ged_record* rec)
+static void*
+month_fren_create(struct ged_record* rec, struct context* ctx)
 {
-    const char* months[] = {"VEND", "BRUM", "FRIM", "NIVO", "PLUV",
-                            "VENT", "GERM", "FLOR", "PRAI", "MESS",
-                            "THER", "FRUC", "COMP"};
-
-    return month_base_create(rec, months, MONTH_FREN);
+    return month_base_create(rec, ctx, CAL_FRENCH, MONTH_FREN);
 }
 
-static struct month*
-month_hebr_create(struct ged_record* rec)
+static void*
+month_hebr_create(struct ged_record* rec, struct context* ctx)
 {
-    const char* months[] = {"TSH", "CSH", "KSL", "TVT", "SHV", "ADR", "ADS",
-                            "NSN", "IYR", "SVN", "TMZ", "AAV", "ELL"};
-
-    return month_base_create(rec, months, MONTH_HEBR);
+    return month_base_create(rec, ctx, CAL_HEBREW, MONTH_HEBR);
 }
 
 static const struct tag_interface tag_i_month_eng = {.create = month_eng_create,
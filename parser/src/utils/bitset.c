@@ -0,0 +1,73 @@
+#include "utils/bitset.h"
+#include <string.h>
+
+static size_t
+num_words(size_t len)
+{
+    return (len + 63) / 64;
+}
+
+e_statuscode
+bs_init(struct bitset* bs, size_t len)
+{
+    bs->len = len;
+    bs->words = calloc(num_words(len) ? num_words(len) : 1, sizeof *bs->words);
+
+    if (!bs->words) {
+        bs->len = 0;
+
+        return ST_MALLOC_ERROR;
+    }
+
+    return ST_OK;
+}
+
+void
+bs_destroy(struct bitset* bs)
+{
+    free(bs->words);
+
+    bs->words = NULL;
+    bs->len = 0;
+}
+
+void
+bs_clear_all(struct bitset* bs)
+{
+    memset(bs->words, 0, num_words(bs->len) * sizeof *bs->words);
+}
+
+size_t
+bs_count(const struct bitset* bs)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < num_words(bs->len); i++) {
+        count += __builtin_popcountll(bs->words[i]);
+    }
+
+    return count;
+}
+
+size_t
+bs_next(const struct bitset* bs, size_t from)
+{
+    if (from >= bs->len) {
+        return bs->len;
+    }
+
+    size_t w = from >> 6;
+    uint64_t word = bs->words[w] & (~(uint64_t)0 << (from & 63));
+
+    while (!word) {
+        if (++w >= num_words(bs->len)) {
+            return bs->len;
+        }
+
+        word = bs->words[w];
+    }
+
+    size_t i = (w << 6) + __builtin_ctzll(word);
+
+    return i < bs->len ? i : bs->len;
+}
@@ -0,0 +1,45 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include "utils/statuscode.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct bitset {
+    uint64_t* words;
+    size_t len; // in bits
+};
+
+e_statuscode bs_init(struct bitset* bs, size_t len);
+void bs_destroy(struct bitset* bs);
+
+void bs_clear_all(struct bitset* bs);
+size_t bs_count(const struct bitset* bs);
+
+// Index of the first set bit at or after from, or bs->len if there is none.
+// Iterate with:
+// for (i = bs_next(bs, 0); i < bs->len; i = bs_next(bs, i + 1))
+size_t bs_next(const struct bitset* bs, size_t from);
+
+// test and set are on every traversal's hot path, so they are kept inline
+
+static inline bool
+bs_test(const struct bitset* bs, size_t i)
+{
+    return (bs->words[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void
+bs_set(struct bitset* bs, size_t i)
+{
+    bs->words[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static inline void
+bs_unset(struct bitset* bs, size_t i)
+{
+    bs->words[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+#endif // BITSET_H
@@ -0,0 +1,90 @@
+#include "utils/hash64.h"
+#include <string.h>
+
+#define HASH64_FILE_CHUNK (1 << 20)
+
+// odd constants with well spread bits
+#define P0 0xa0761d6478bd642full
+#define P1 0xe7037ed1a0b428dbull
+#define P2 0x8ebc6af09c88c6e3ull
+#define P3 0x589965cc75374cc3ull
+
+static inline uint64_t
+mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t
+read64(const uint8_t* p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof v);
+
+    return v;
+}
+
+// Up to 8 trailing bytes, zero padded
+static inline uint64_t
+read_tail(const uint8_t* p, size_t len)
+{
+    uint64_t v = 0;
+
+    memcpy(&v, p, len);
+
+    return v;
+}
+
+uint64_t
+hash64(const void* data, size_t len, uint64_t seed)
+{
+    const uint8_t* p = data;
+    uint64_t h = seed ^ mix(len ^ P0, P1);
+
+    for (; len >= 16; p += 16, len -= 16) {
+        h = mix(read64(p) ^ P1, read64(p + 8) ^ h);
+    }
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (len > 8) {
+        a = read64(p);
+        b = read_tail(p + 8, len - 8);
+    } else if (len) {
+        a = read_tail(p, len);
+    }
+
+    h = mix(a ^ P2, b ^ h ^ P3);
+
+    return mix(h ^ P0, h ^ P1);
+}
+
+bool
+hash64_file(FILE* fp, uint64_t* hash, uint64_t* size)
+{
+    char* buf = malloc(HASH64_FILE_CHUNK);
+
+    if (!buf) {
+        return false;
+    }
+
+    *hash = 0;
+    *size = 0;
+
+    size_t n;
+
+    while ((n = fread(buf, 1, HASH64_FILE_CHUNK, fp)) > 0) {
+        *hash = hash64(buf, n, *hash);
+        *size += n;
+    }
+
+    bool ok = !ferror(fp);
+
+    free(buf);
+
+    return ok;
+}
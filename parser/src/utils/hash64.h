@@ -0,0 +1,26 @@
+/*
+Fast 64-bit hash for fingerprints and checksums.
+
+Not cryptographic. Input is read 16 bytes at a time and folded with 64x64 ->
+128 bit multiplies, so hashing runs close to memory speed. Words are read in
+host byte order, hashes are only comparable between hosts of equal order.
+*/
+
+#ifndef HASH64_H
+#define HASH64_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Hash of len bytes at data. Hashing data in pieces, passing the previous
+// result as seed, gives a hash of the pieces (not equal to the hash of the
+// whole)
+uint64_t hash64(const void* data, size_t len, uint64_t seed);
+
+// Hash and size of everything left in fp, read in large pieces. Returns false
+// on read errors
+bool hash64_file(FILE* fp, uint64_t* hash, uint64_t* size);
+
+#endif // HASH64_H
@@ -14,8 +14,8 @@ hash_fnv1a(const char* key)
 {
     size_t hash = FNV1A_OFFSET;
 
-    for (size_t i = 0; i < strlen(key); i++) {
-        hash = (hash ^ key[i]) * FNV1A_PRIME;
+    for (; *key; key++) {
+        hash = (hash ^ (unsigned char)*key) * FNV1A_PRIME;
     }
 
     return hash;
@@ -27,6 +27,72 @@ get_index(struct hash_table* ht, const char* key)
     return hash_fnv1a(key) % ht->cap;
 }
 
+// Moves every entry into a table of 2 * cap + 1 buckets. Entries are relinked,
+// not copied, so values and keys keep their addresses.
+static void
+ht_grow(struct hash_table* ht)
+{
+    size_t cap = ht->cap * 2 + 1;
+    struct ht_bucket** buckets = calloc(cap, sizeof *buckets);
+
+    if (!buckets) {
+        // keep the old (slower, but valid) table
+        return;
+    }
+
+    // every bucket is allocated before an entry moves, so a failure leaves
+    // the old table as it was
+    for (size_t i = 0; i < ht->cap; i++) {
+        struct ht_bucket* bucket = ht->buckets[i];
+
+        for (struct ht_entry* entry = bucket ? bucket->front : NULL; entry;
+             entry = entry->next) {
+            size_t index = hash_fnv1a(entry->key) % cap;
+
+            if (buckets[index]) {
+                continue;
+            }
+
+            if (!(buckets[index] = malloc(sizeof *buckets[index]))) {
+                for (size_t j = 0; j < cap; j++) {
+                    free(buckets[j]);
+                }
+
+                free(buckets);
+
+                return;
+            }
+
+            buckets[index]->front = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < ht->cap; i++) {
+        struct ht_bucket* bucket = ht->buckets[i];
+
+        if (!bucket)
+            continue;
+
+        struct ht_entry* entry = bucket->front;
+
+        while (entry) {
+            struct ht_entry* next = entry->next;
+            size_t index = hash_fnv1a(entry->key) % cap;
+
+            entry->next = buckets[index]->front;
+            buckets[index]->front = entry;
+
+            entry = next;
+        }
+
+        free(bucket);
+    }
+
+    free(ht->buckets);
+    ht->cap = cap;
+    ht->buckets = buckets;
+}
+
 static void
 bucket_free(struct ht_bucket* bucket)
 {
@@ -58,6 +124,7 @@ ht_create(size_t cap)
         return NULL;
 
     ht->cap = cap;
+    ht->len = 0;
     ht->buckets = calloc(cap, sizeof *ht->buckets);
 
     if (!ht->buckets) {
@@ -161,6 +228,10 @@ ht_set(struct hash_table* ht, const char* key, void* value)
     } else {
         bucket->front = entry;
     }
+
+    if (++ht->len > ht->cap * HT_MAX_LOAD) {
+        ht_grow(ht);
+    }
 }
 
 void*
@@ -188,6 +259,10 @@ ht_del(struct hash_table* ht, const char* key)
                 bucket->front = entry->next;
             }
 
+            free(entry->key);
+            free(entry);
+            ht->len--;
+
             return value;
         }
 
@@ -196,4 +271,10 @@ ht_del(struct hash_table* ht, const char* key)
     }
 
     return NULL;
-}
\ No newline at end of file
+}
+
+size_t
+ht_len(struct hash_table* ht)
+{
+    return ht->len;
+}
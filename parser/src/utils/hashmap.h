@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#define HT_MAX_LOAD 2
+
 struct ht_entry {
     char* key;
     void* value;
@@ -18,9 +20,12 @@ struct ht_bucket {
 struct hash_table {
     struct ht_bucket** buckets;
     size_t cap;
+    size_t len;
 };
 
-// cap should be 1.3 * expected num of items, and should be a prime number
+// cap should be 1.3 * expected num of items, and should be a prime number.
+// The table grows by itself once it holds more than HT_MAX_LOAD entries per
+// bucket, so cap is only a starting point.
 struct hash_table* ht_create(size_t cap);
 void ht_free(struct hash_table* ht);
 
@@ -29,4 +34,6 @@ void* ht_get(struct hash_table* ht, const char* key);
 void ht_set(struct hash_table* ht, const char* key, void* value);
 void* ht_del(struct hash_table* ht, const char* key);
 
+size_t ht_len(struct hash_table* ht);
+
 #endif // HASHMAP_H
\ No newline at end of file
@@ -0,0 +1,342 @@
+#include "utils/phonetic.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Longer names are cut, neither code looks that far
+#define NAME_MAX_LEN 64
+#define DM_CODE_LEN 6
+
+/*
+=================================================
+Soundex
+=================================================
+*/
+
+// Digit of every letter A-Z. 0 for vowels, '-' for H and W, which do not
+// separate equal consonants
+static const char soundex_digits[] = "0123012-02245501262301-202";
+
+uint32_t
+ph_soundex(const char* name)
+{
+    char code[4] = {'0', '0', '0', '0'};
+    size_t len = 0;
+    char last = 0;
+
+    for (; *name && len < 4; name++) {
+        int c = toupper((unsigned char)*name);
+
+        if (c < 'A' || c > 'Z') {
+            continue;
+        }
+
+        char digit = soundex_digits[c - 'A'];
+
+        if (!len) {
+            code[len++] = (char)c;
+        } else if (digit == '-') {
+            continue;
+        } else if (digit != '0' && digit != last) {
+            code[len++] = digit;
+        }
+
+        last = digit;
+    }
+
+    if (!len) {
+        return 0;
+    }
+
+    return (uint32_t)code[0] | (uint32_t)code[1] << 8 |
+           (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24;
+}
+
+void
+ph_soundex_str(uint32_t code, char out[5])
+{
+    for (int i = 0; i < 4; i++) {
+        out[i] = (char)(code >> (8 * i));
+    }
+
+    out[4] = '\0';
+}
+
+/*
+=================================================
+Daitch-Mokotoff
+=================================================
+*/
+
+// Codes of a pattern at the start of a name, before a vowel, and anywhere
+// else. "" is not coded. Letters that sound two ways have alternative codes
+struct dm_rule {
+    const char* pattern;
+    const char* code[3];
+    const char* alt[3];
+};
+
+enum { DM_START, DM_VOWEL, DM_OTHER };
+
+// Longer patterns come before their prefixes
+static const struct dm_rule dm_rules[] = {
+    {"AI", {"0", "1", ""}, {0}},
+    {"AJ", {"0", "1", ""}, {0}},
+    {"AY", {"0", "1", ""}, {0}},
+    {"AU", {"0", "7", ""}, {0}},
+    {"A", {"0", "", ""}, {0}},
+    {"B", {"7", "7", "7"}, {0}},
+    {"CHS", {"5", "54", "54"}, {0}},
+    {"CH", {"5", "5", "5"}, {"4", "4", "4"}},
+    {"CK", {"5", "5", "5"}, {"45", "45", "45"}},
+    {"CSZ", {"4", "4", "4"}, {0}},
+    {"CZS", {"4", "4", "4"}, {0}},
+    {"CS", {"4", "4", "4"}, {0}},
+    {"CZ", {"4", "4", "4"}, {0}},
+    {"C", {"5", "5", "5"}, {"4", "4", "4"}},
+    {"DRZ", {"4", "4", "4"}, {0}},
+    {"DRS", {"4", "4", "4"}, {0}},
+    {"DSH", {"4", "4", "4"}, {0}},
+    {"DSZ", {"4", "4", "4"}, {0}},
+    {"DS", {"4", "4", "4"}, {0}},
+    {"DZH", {"4", "4", "4"}, {0}},
+    {"DZS", {"4", "4", "4"}, {0}},
+    {"DZ", {"4", "4", "4"}, {0}},
+    {"DT", {"3", "3", "3"}, {0}},
+    {"D", {"3", "3", "3"}, {0}},
+    {"EI", {"0", "1", ""}, {0}},
+    {"EJ", {"0", "1", ""}, {0}},
+    {"EY", {"0", "1", ""}, {0}},
+    {"EU", {"1", "1", ""}, {0}},
+    {"E", {"0", "", ""}, {0}},
+    {"FB", {"7", "7", "7"}, {0}},
+    {"F", {"7", "7", "7"}, {0}},
+    {"G", {"5", "5", "5"}, {0}},
+    {"H", {"5", "5", ""}, {0}},
+    {"IA", {"1", "", ""}, {0}},
+    {"IE", {"1", "", ""}, {0}},
+    {"IO", {"1", "", ""}, {0}},
+    {"IU", {"1", "", ""}, {0}},
+    {"I", {"0", "", ""}, {0}},
+    {"J", {"1", "1", "1"}, {"4", "4", "4"}},
+    {"KS", {"5", "54", "54"}, {0}},
+    {"KH", {"5", "5", "5"}, {0}},
+    {"K", {"5", "5", "5"}, {0}},
+    {"L", {"8", "8", "8"}, {0}},
+    {"MN", {"66", "66", "66"}, {0}},
+    {"M", {"6", "6", "6"}, {0}},
+    {"NM", {"66", "66", "66"}, {0}},
+    {"N", {"6", "6", "6"}, {0}},
+    {"OI", {"0", "1", ""}, {0}},
+    {"OJ", {"0", "1", ""}, {0}},
+    {"OY", {"0", "1", ""}, {0}},
+    {"O", {"0", "", ""}, {0}},
+    {"PF", {"7", "7", "7"}, {0}},
+    {"PH", {"7", "7", "7"}, {0}},
+    {"P", {"7", "7", "7"}, {0}},
+    {"Q", {"5", "5", "5"}, {0}},
+    {"RS", {"94", "94", "94"}, {"4", "4", "4"}},
+    {"RZ", {"94", "94", "94"}, {"4", "4", "4"}},
+    {"R", {"9", "9", "9"}, {0}},
+    {"SCHTSCH", {"2", "4", "4"}, {0}},
+    {"SCHTSH", {"2", "4", "4"}, {0}},
+    {"SCHTCH", {"2", "4", "4"}, {0}},
+    {"SCHT", {"2", "43", "43"}, {0}},
+    {"SCHD", {"2", "43", "43"}, {0}},
+    {"SCH", {"4", "4", "4"}, {0}},
+    {"SHTCH", {"2", "4", "4"}, {0}},
+    {"SHTSH", {"2", "4", "4"}, {0}},
+    {"SHCH", {"2", "4", "4"}, {0}},
+    {"SHT", {"2", "43", "43"}, {0}},
+    {"SHD", {"2", "43", "43"}, {0}},
+    {"SH", {"4", "4", "4"}, {0}},
+    {"STSCH", {"2", "4", "4"}, {0}},
+    {"STCH", {"2", "4", "4"}, {0}},
+    {"STRZ", {"2", "4", "4"}, {0}},
+    {"STRS", {"2", "4", "4"}, {0}},
+    {"STSH", {"2", "4", "4"}, {0}},
+    {"ST", {"2", "43", "43"}, {0}},
+    {"SZCZ", {"2", "4", "4"}, {0}},
+    {"SZCS", {"2", "4", "4"}, {0}},
+    {"SZT", {"2", "43", "43"}, {0}},
+    {"SZD", {"2", "43", "43"}, {0}},
+    {"SZ", {"4", "4", "4"}, {0}},
+    {"SC", {"2", "4", "4"}, {0}},
+    {"SD", {"2", "43", "43"}, {0}},
+    {"S", {"4", "4", "4"}, {0}},
+    {"TTSCH", {"4", "4", "4"}, {0}},
+    {"TTSZ", {"4", "4", "4"}, {0}},
+    {"TTCH", {"4", "4", "4"}, {0}},
+    {"TTS", {"4", "4", "4"}, {0}},
+    {"TTZ", {"4", "4", "4"}, {0}},
+    {"TSCH", {"4", "4", "4"}, {0}},
+    {"TCH", {"4", "4", "4"}, {0}},
+    {"TRZ", {"4", "4", "4"}, {0}},
+    {"TRS", {"4", "4", "4"}, {0}},
+    {"TSH", {"4", "4", "4"}, {0}},
+    {"TSZ", {"4", "4", "4"}, {0}},
+    {"TZS", {"4", "4", "4"}, {0}},
+    {"TH", {"3", "3", "3"}, {0}},
+    {"TS", {"4", "4", "4"}, {0}},
+    {"TC", {"4", "4", "4"}, {0}},
+    {"TZ", {"4", "4", "4"}, {0}},
+    {"T", {"3", "3", "3"}, {0}},
+    {"UI", {"0", "1", ""}, {0}},
+    {"UJ", {"0", "1", ""}, {0}},
+    {"UY", {"0", "1", ""}, {0}},
+    {"UE", {"0", "", ""}, {0}},
+    {"U", {"0", "", ""}, {0}},
+    {"V", {"7", "7", "7"}, {0}},
+    {"W", {"7", "7", "7"}, {0}},
+    {"X", {"5", "54", "54"}, {0}},
+    {"Y", {"1", "", ""}, {0}},
+    {"ZHDZH", {"2", "4", "4"}, {0}},
+    {"ZDZH", {"2", "4", "4"}, {0}},
+    {"ZSCH", {"4", "4", "4"}, {0}},
+    {"ZDZ", {"2", "4", "4"}, {0}},
+    {"ZHD", {"2", "43", "43"}, {0}},
+    {"ZSH", {"4", "4", "4"}, {0}},
+    {"ZD", {"2", "43", "43"}, {0}},
+    {"ZH", {"4", "4", "4"}, {0}},
+    {"ZS", {"4", "4", "4"}, {0}},
+    {"Z", {"4", "4", "4"}, {0}},
+};
+
+// First rule of every letter A-Z in dm_rules, filled once on first use, by
+// whichever thread codes a name first
+static size_t dm_first[27];
+static pthread_once_t dm_first_once = PTHREAD_ONCE_INIT;
+
+struct dm_branch {
+    char digits[DM_CODE_LEN];
+    size_t len;
+    const char* last; // last code, "" after a letter that is not coded
+};
+
+static void
+dm_index_rules(void)
+{
+    size_t len = sizeof dm_rules / sizeof *dm_rules;
+    size_t rule = 0;
+
+    for (int c = 0; c < 26; c++) {
+        while (rule < len && dm_rules[rule].pattern[0] - 'A' < c) {
+            rule++;
+        }
+
+        dm_first[c] = rule;
+    }
+
+    dm_first[26] = len;
+}
+
+static const struct dm_rule*
+dm_match(const char* name)
+{
+    int c = name[0] - 'A';
+
+    for (size_t i = dm_first[c]; i < dm_first[c + 1]; i++) {
+        const char* pattern = dm_rules[i].pattern;
+        size_t len = strlen(pattern);
+
+        if (strncmp(name, pattern, len) == 0) {
+            return &dm_rules[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+dm_append(struct dm_branch* branch, const char* code)
+{
+    if (!*code) {
+        branch->last = code;
+
+        return;
+    }
+
+    // equal codes of adjacent letters are coded once
+    if (strcmp(code, branch->last) == 0) {
+        return;
+    }
+
+    branch->last = code;
+
+    for (; *code && branch->len < DM_CODE_LEN; code++) {
+        branch->digits[branch->len++] = *code;
+    }
+}
+
+size_t
+ph_daitch_mokotoff(const char* name, uint32_t codes[PH_DM_MAX_CODES])
+{
+    char letters[NAME_MAX_LEN + 1];
+    size_t len = 0;
+
+    pthread_once(&dm_first_once, dm_index_rules);
+
+    for (; *name && len < NAME_MAX_LEN; name++) {
+        int c = toupper((unsigned char)*name);
+
+        if (c >= 'A' && c <= 'Z') {
+            letters[len++] = (char)c;
+        }
+    }
+
+    letters[len] = '\0';
+
+    if (!len) {
+        return 0;
+    }
+
+    struct dm_branch branches[PH_DM_MAX_CODES] = {{.len = 0, .last = ""}};
+    size_t nbranches = 1;
+
+    for (size_t i = 0; i < len;) {
+        const struct dm_rule* rule = dm_match(&letters[i]);
+        size_t plen = strlen(rule->pattern);
+        char next = letters[i + plen];
+        int pos = !i ? DM_START
+                     : (next && strchr("AEIOUY", next) ? DM_VOWEL : DM_OTHER);
+
+        size_t n = nbranches;
+
+        for (size_t b = 0; b < n; b++) {
+            // the alternative goes into a copy, as long as there is room
+            if (rule->alt[pos] && nbranches < PH_DM_MAX_CODES) {
+                branches[nbranches] = branches[b];
+                dm_append(&branches[nbranches++], rule->alt[pos]);
+            }
+
+            dm_append(&branches[b], rule->code[pos]);
+        }
+
+        i += plen;
+    }
+
+    size_t ncodes = 0;
+
+    for (size_t b = 0; b < nbranches; b++) {
+        uint32_t code = 0;
+
+        for (size_t i = 0; i < DM_CODE_LEN; i++) {
+            char digit = i < branches[b].len ? branches[b].digits[i] : '0';
+
+            code = code * 10 + (uint32_t)(digit - '0');
+        }
+
+        bool seen = false;
+
+        for (size_t i = 0; i < ncodes && !seen; i++) {
+            seen = codes[i] == code;
+        }
+
+        if (!seen) {
+            codes[ncodes++] = code;
+        }
+    }
+
+    return ncodes;
+}
@@ -0,0 +1,30 @@
+/*
+Phonetic name codes.
+
+Both encoders skip everything but the letters A-Z (case insensitive), so
+names should be normalized to ASCII first.
+*/
+
+#ifndef PHONETIC_H
+#define PHONETIC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Daitch-Mokotoff codes of names with ambiguous letters branch, a name has at
+// most this many codes
+#define PH_DM_MAX_CODES 16
+
+// American Soundex code of name, packed like "W452" (first letter in the low
+// byte). 0 if name has no letters
+uint32_t ph_soundex(const char* name);
+
+// Writes the 4 character code and a terminator to out
+void ph_soundex_str(uint32_t code, char out[5]);
+
+// Daitch-Mokotoff Soundex codes of name, as 6 digit numbers (print with
+// %06u). Returns the number of distinct codes written, 0 if name has no
+// letters
+size_t ph_daitch_mokotoff(const char* name, uint32_t codes[PH_DM_MAX_CODES]);
+
+#endif // PHONETIC_H
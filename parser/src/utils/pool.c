@@ -0,0 +1,442 @@
+#include "utils/pool.h"
+#include <sched.h>
+#include <unistd.h>
+
+#define DEFAULT_DEQUE_CAP 64
+
+// worker running on this thread, NULL outside of pools
+static _Thread_local struct tp_worker* current = NULL;
+
+static struct tp_pool* shared = NULL;
+static size_t shared_threads = 0;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* === Deques === */
+
+static void
+deque_init(struct tp_deque* d)
+{
+    pthread_mutex_init(&d->lock, NULL);
+    d->items = NULL;
+    d->head = 0;
+    d->len = 0;
+    d->cap = 0;
+}
+
+static void
+deque_destroy(struct tp_deque* d)
+{
+    pthread_mutex_destroy(&d->lock);
+    free(d->items);
+}
+
+static e_statuscode
+deque_push(struct tp_deque* d, struct tp_task task)
+{
+    pthread_mutex_lock(&d->lock);
+
+    if (d->len == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : DEFAULT_DEQUE_CAP;
+        struct tp_task* items = malloc(cap * sizeof *items);
+
+        if (!items) {
+            pthread_mutex_unlock(&d->lock);
+
+            return ST_MALLOC_ERROR;
+        }
+
+        // unwrap the ring into the front of the new buffer
+        for (size_t i = 0; i < d->len; i++) {
+            items[i] = d->items[(d->head + i) % d->cap];
+        }
+
+        free(d->items);
+        d->items = items;
+        d->head = 0;
+        d->cap = cap;
+    }
+
+    d->items[(d->head + d->len) % d->cap] = task;
+    d->len++;
+
+    pthread_mutex_unlock(&d->lock);
+
+    return ST_OK;
+}
+
+static bool
+deque_pop_back(struct tp_deque* d, struct tp_task* task)
+{
+    pthread_mutex_lock(&d->lock);
+
+    bool found = d->len > 0;
+
+    if (found) {
+        d->len--;
+        *task = d->items[(d->head + d->len) % d->cap];
+    }
+
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+static bool
+deque_pop_front(struct tp_deque* d, struct tp_task* task)
+{
+    pthread_mutex_lock(&d->lock);
+
+    bool found = d->len > 0;
+
+    if (found) {
+        *task = d->items[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->len--;
+    }
+
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+/* === Scheduling === */
+
+// Own tasks newest first, then shared ones, then the oldest task of another
+// worker
+static bool
+find_task(struct tp_pool* pool, struct tp_worker* self, struct tp_task* task)
+{
+    if (!atomic_load(&pool->queued)) {
+        return false;
+    }
+
+    bool found = (self && deque_pop_back(&self->deque, task)) ||
+                 deque_pop_front(&pool->shared, task);
+
+    size_t first = self ? self->index + 1 : 0;
+
+    for (size_t i = 0; i < pool->nworkers && !found; i++) {
+        struct tp_worker* victim = &pool->workers[(first + i) % pool->nworkers];
+
+        found = victim != self && deque_pop_front(&victim->deque, task);
+    }
+
+    if (found) {
+        atomic_fetch_sub(&pool->queued, 1);
+    }
+
+    return found;
+}
+
+static void
+run_task(struct tp_task* task)
+{
+    task->fn(task->arg);
+    atomic_fetch_sub(&task->group->pending, 1);
+}
+
+static void*
+worker_main(void* arg)
+{
+    struct tp_worker* self = arg;
+    struct tp_pool* pool = self->pool;
+
+    current = self;
+
+    for (;;) {
+        struct tp_task task;
+
+        if (find_task(pool, self, &task)) {
+            run_task(&task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleeping, 1);
+
+        while (!atomic_load(&pool->queued) && !atomic_load(&pool->stopping)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+
+        atomic_fetch_sub(&pool->sleeping, 1);
+
+        bool stop = atomic_load(&pool->stopping) && !atomic_load(&pool->queued);
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) {
+            break;
+        }
+    }
+
+    current = NULL;
+
+    return NULL;
+}
+
+/* === Pools === */
+
+struct tp_pool*
+tp_create(size_t nthreads)
+{
+    if (!nthreads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = online > 0 ? (size_t)online : 1;
+    }
+
+    struct tp_pool* pool = calloc(1, sizeof *pool);
+
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->workers = calloc(nthreads, sizeof *pool->workers);
+
+    if (!pool->workers) {
+        free(pool);
+
+        return NULL;
+    }
+
+    deque_init(&pool->shared);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->stopping, false);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (size_t i = 0; i + 1 < nthreads; i++) {
+        struct tp_worker* w = &pool->workers[pool->nworkers];
+
+        w->pool = pool;
+        w->index = pool->nworkers;
+        deque_init(&w->deque);
+
+        // fewer workers only mean less parallelism
+        if (pthread_create(&w->thread, NULL, worker_main, w)) {
+            deque_destroy(&w->deque);
+            break;
+        }
+
+        pool->nworkers++;
+    }
+
+    return pool;
+}
+
+void
+tp_free(struct tp_pool* pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stopping, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        deque_destroy(&pool->workers[i].deque);
+    }
+
+    deque_destroy(&pool->shared);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool);
+}
+
+size_t
+tp_size(const struct tp_pool* pool)
+{
+    return pool->nworkers + 1;
+}
+
+e_statuscode
+tp_shared_configure(size_t nthreads)
+{
+    pthread_mutex_lock(&shared_lock);
+
+    e_statuscode result = shared ? ST_NOT_OK : ST_OK;
+
+    if (!shared) {
+        shared_threads = nthreads;
+    }
+
+    pthread_mutex_unlock(&shared_lock);
+
+    return result;
+}
+
+struct tp_pool*
+tp_shared(void)
+{
+    pthread_mutex_lock(&shared_lock);
+
+    if (!shared) {
+        shared = tp_create(shared_threads);
+    }
+
+    struct tp_pool* pool = shared;
+
+    pthread_mutex_unlock(&shared_lock);
+
+    return pool;
+}
+
+void
+tp_shared_free(void)
+{
+    pthread_mutex_lock(&shared_lock);
+
+    tp_free(shared);
+    shared = NULL;
+
+    pthread_mutex_unlock(&shared_lock);
+}
+
+/* === Tasks === */
+
+void
+tp_group_init(struct tp_group* group)
+{
+    atomic_init(&group->pending, 0);
+}
+
+void
+tp_spawn(struct tp_pool* pool, struct tp_group* group, tp_task_fn fn,
+         void* arg)
+{
+    struct tp_worker* self = current && current->pool == pool ? current : NULL;
+    struct tp_deque* d = self ? &self->deque : &pool->shared;
+    struct tp_task task = {.fn = fn, .arg = arg, .group = group};
+
+    atomic_fetch_add(&group->pending, 1);
+
+    // counted before it is pushed, so queued never drops below zero
+    atomic_fetch_add(&pool->queued, 1);
+
+    if (!pool->nworkers || deque_push(d, task) != ST_OK) {
+        atomic_fetch_sub(&pool->queued, 1);
+        run_task(&task);
+
+        return;
+    }
+
+    if (atomic_load(&pool->sleeping)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void
+tp_wait(struct tp_pool* pool, struct tp_group* group)
+{
+    struct tp_worker* self = current && current->pool == pool ? current : NULL;
+
+    while (atomic_load(&group->pending)) {
+        struct tp_task task;
+
+        if (find_task(pool, self, &task)) {
+            run_task(&task);
+        } else {
+            // the rest of group is running on other threads
+            sched_yield();
+        }
+    }
+}
+
+struct for_job;
+
+struct for_range {
+    struct for_job* job;
+    size_t begin;
+    size_t end;
+};
+
+struct for_job {
+    struct tp_pool* pool;
+    struct tp_group group;
+    tp_range_fn fn;
+    void* data;
+    size_t grain;
+
+    struct for_range* ranges; // one per spawned task
+    atomic_size_t used;
+    size_t cap;
+};
+
+// Hands the upper half of the range to other workers until it is small
+// enough, then runs it
+static void
+for_run(void* arg)
+{
+    struct for_range* r = arg;
+    struct for_job* job = r->job;
+    size_t begin = r->begin;
+    size_t end = r->end;
+
+    while (end - begin > job->grain) {
+        size_t slot = atomic_fetch_add(&job->used, 1);
+
+        if (slot >= job->cap) {
+            break;
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+
+        job->ranges[slot] = (struct for_range){job, mid, end};
+        tp_spawn(job->pool, &job->group, for_run, &job->ranges[slot]);
+        end = mid;
+    }
+
+    job->fn(begin, end, job->data);
+}
+
+void
+tp_for(struct tp_pool* pool, size_t len, size_t grain, tp_range_fn fn,
+       void* data)
+{
+    if (!grain) {
+        grain = 1;
+    }
+
+    if (!len) {
+        return;
+    }
+
+    if (len <= grain || !pool->nworkers) {
+        fn(0, len, data);
+
+        return;
+    }
+
+    // halving leaves ranges of more than grain / 2 indices
+    struct for_job job = {
+        .pool = pool,
+        .fn = fn,
+        .data = data,
+        .grain = grain,
+        .cap = 2 * (len / grain + 1),
+    };
+
+    job.ranges = malloc(job.cap * sizeof *job.ranges);
+
+    if (!job.ranges) {
+        fn(0, len, data);
+
+        return;
+    }
+
+    tp_group_init(&job.group);
+    atomic_init(&job.used, 1);
+    job.ranges[0] = (struct for_range){&job, 0, len};
+
+    for_run(&job.ranges[0]);
+    tp_wait(pool, &job.group);
+
+    free(job.ranges);
+}
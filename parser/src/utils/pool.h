@@ -0,0 +1,102 @@
+/*
+Work-stealing thread pool.
+
+Every worker owns a deque: tasks it spawns are pushed to and popped from the
+back, idle workers steal from the front of others. Tasks spawned by threads
+outside the pool go to a shared queue. A thread waiting for a group runs
+queued tasks until the group is done, so waiting inside a task does not
+block a worker, and a pool without workers still makes progress.
+
+The shared pool is used by the parallel stages of the library (building,
+indexing, queries). Its size is set once, before first use.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "utils/statuscode.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef void (*tp_task_fn)(void* arg);
+
+// Runs fn for the indices begin .. end - 1
+typedef void (*tp_range_fn)(size_t begin, size_t end, void* data);
+
+struct tp_task {
+    tp_task_fn fn;
+    void* arg;
+    struct tp_group* group;
+};
+
+// Ring buffer of tasks, front is items[head]
+struct tp_deque {
+    pthread_mutex_t lock;
+    struct tp_task* items;
+    size_t head;
+    size_t len;
+    size_t cap;
+};
+
+struct tp_worker {
+    struct tp_pool* pool;
+    struct tp_deque deque;
+    pthread_t thread;
+    size_t index;
+};
+
+struct tp_pool {
+    struct tp_worker* workers;
+    size_t nworkers;
+
+    struct tp_deque shared; // tasks spawned from outside the pool
+
+    atomic_size_t queued; // tasks in all deques
+    atomic_int sleeping;
+    atomic_bool stopping;
+    pthread_mutex_t lock; // guards sleeping workers
+    pthread_cond_t wake;
+};
+
+// Tasks spawned into a group are waited for together
+struct tp_group {
+    atomic_size_t pending;
+};
+
+// Pool running tasks on nthreads threads, counting the thread that waits for
+// them: nthreads - 1 workers are started. 0 is one per online CPU
+struct tp_pool* tp_create(size_t nthreads);
+
+// Waits for the workers to finish their tasks and stops them
+void tp_free(struct tp_pool* pool);
+
+// Number of threads running tasks, including the waiting one
+size_t tp_size(const struct tp_pool* pool);
+
+// Sets the size of the shared pool. Fails with ST_NOT_OK once it exists
+e_statuscode tp_shared_configure(size_t nthreads);
+
+// Shared pool, created on first use
+struct tp_pool* tp_shared(void);
+
+// Stops the shared pool. It is created again by the next tp_shared()
+void tp_shared_free(void);
+
+void tp_group_init(struct tp_group* group);
+
+// Queues fn(arg) in group. If the task cannot be queued, it runs right away
+void tp_spawn(struct tp_pool* pool, struct tp_group* group, tp_task_fn fn,
+              void* arg);
+
+// Runs queued tasks until every task of group is done
+void tp_wait(struct tp_pool* pool, struct tp_group* group);
+
+// Calls fn over 0 .. len - 1 in ranges of at most grain indices, and waits
+// for all of them. Ranges are split in halves, so idle workers steal large
+// pieces first
+void tp_for(struct tp_pool* pool, size_t len, size_t grain, tp_range_fn fn,
+            void* data);
+
+#endif // POOL_H
@@ -76,20 +76,21 @@ pa_cap(struct ptr_arr* pa)
 void**
 pa_reserve(struct ptr_arr* pa)
 {
-    pa->len++;
-
-    if (pa->len > pa->cap) {
-        int mult_factor =
-            MULT_FACTOR * ((pa->len / pa->cap) + ((pa->len % pa->cap) != 0));
-
-        assert(mult_factor);
-        pa->cap *= mult_factor;
-        pa->mem = realloc(pa->mem, pa->cap * (sizeof(void*)));
+    if (pa->len == pa->cap) {
+        // doubling keeps pushes amortized O(1)
+        size_t cap = pa->cap * MULT_FACTOR;
+        void* mem = realloc(pa->mem, cap * (sizeof(void*)));
 
-        if (!pa->mem)
+        if (!mem) {
             return NULL;
+        }
+
+        pa->mem = mem;
+        pa->cap = cap;
     }
 
+    pa->len++;
+
     return pa_get_unsafe(pa, pa->len - 1);
 }
 
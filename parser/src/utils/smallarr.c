@@ -0,0 +1,76 @@
+#include "utils/smallarr.h"
+#include <string.h>
+
+void
+sa_init(struct small_arr* sa)
+{
+    sa->len = 0;
+    sa->cap = SA_INLINE;
+}
+
+void
+sa_destroy(struct small_arr* sa)
+{
+    if (!sa_is_inline(sa)) {
+        free(sa->mem.heap);
+    }
+
+    sa_init(sa);
+}
+
+e_statuscode
+sa_reserve(struct small_arr* sa, size_t cap)
+{
+    if (cap <= sa->cap) {
+        return ST_OK;
+    }
+
+    if (cap > UINT32_MAX) {
+        return ST_MALLOC_ERROR;
+    }
+
+    size_t grown = sa->cap * 2;
+
+    while (grown < cap) {
+        grown *= 2;
+    }
+
+    if (grown > UINT32_MAX) {
+        grown = UINT32_MAX;
+    }
+
+    void** heap;
+
+    if (sa_is_inline(sa)) {
+        // the slots are moved out before the union is reused for the pointer
+        heap = malloc(grown * sizeof *heap);
+
+        if (heap) {
+            memcpy(heap, sa->mem.slots, sa->len * sizeof *heap);
+        }
+    } else {
+        heap = realloc(sa->mem.heap, grown * sizeof *heap);
+    }
+
+    if (!heap) {
+        return ST_MALLOC_ERROR;
+    }
+
+    sa->mem.heap = heap;
+    sa->cap = (uint32_t)grown;
+
+    return ST_OK;
+}
+
+e_statuscode
+sa_push_slow(struct small_arr* sa, void* item)
+{
+    if (sa->len == sa->cap && sa_reserve(sa, (size_t)sa->len + 1) != ST_OK) {
+        return ST_MALLOC_ERROR;
+    }
+
+    // only reached once the inline slots are full, so the items are on the heap
+    sa->mem.heap[sa->len++] = item;
+
+    return ST_OK;
+}
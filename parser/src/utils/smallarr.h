@@ -0,0 +1,82 @@
+/*
+Pointer arrays with a few inline slots.
+
+Most records have no children and a value of at most three tokens, so the
+first SA_INLINE items are kept in the struct itself and the array only goes
+to the heap once it outgrows them. A zeroed struct is not valid, initialize
+with sa_init().
+*/
+
+#ifndef SMALLARR_H
+#define SMALLARR_H
+
+#include "utils/statuscode.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SA_INLINE 3
+
+struct small_arr {
+    uint32_t len;
+    uint32_t cap; // SA_INLINE while the items are inline
+
+    union {
+        void* slots[SA_INLINE];
+        void** heap;
+    } mem;
+};
+
+void sa_init(struct small_arr* sa);
+void sa_destroy(struct small_arr* sa);
+
+// Makes room for at least cap items
+e_statuscode sa_reserve(struct small_arr* sa, size_t cap);
+e_statuscode sa_push_slow(struct small_arr* sa, void* item);
+
+// len, get and push are on every tree walk's hot path, so they are kept inline
+
+static inline size_t
+sa_len(const struct small_arr* sa)
+{
+    return sa->len;
+}
+
+static inline bool
+sa_is_inline(const struct small_arr* sa)
+{
+    return sa->cap == SA_INLINE;
+}
+
+static inline void* const*
+sa_items(const struct small_arr* sa)
+{
+    return sa_is_inline(sa) ? sa->mem.slots : sa->mem.heap;
+}
+
+// NULL if index is out of range, like pa_get()
+static inline void*
+sa_get(const struct small_arr* sa, size_t index)
+{
+    return index < sa->len ? sa_items(sa)[index] : NULL;
+}
+
+static inline void*
+sa_back(const struct small_arr* sa)
+{
+    return sa->len ? sa_items(sa)[sa->len - 1] : NULL;
+}
+
+static inline e_statuscode
+sa_push(struct small_arr* sa, void* item)
+{
+    if (sa->len < SA_INLINE && sa_is_inline(sa)) {
+        sa->mem.slots[sa->len++] = item;
+
+        return ST_OK;
+    }
+
+    return sa_push_slow(sa, item);
+}
+
+#endif // SMALLARR_H
@@ -4,33 +4,35 @@
 #include <assert.h>
 #include <stdio.h>
 
+// Makes room for length more characters. The contents are always kept
+// terminated, so new space is left uninitialized
 static int
 sbuilder_reserve(struct sbuilder* builder, size_t length)
 {
     assert(builder->cap);
     assert(SBUILDER_DEFAULT_CAP_MULT /* sbuilder default cap mult not set */);
 
-    builder->len += length;
+    size_t required = builder->len + length;
 
-    if (builder->len >= builder->cap) {
-        builder->cap *=
-            SBUILDER_DEFAULT_CAP_MULT * ((builder->len / builder->cap) +
-                                         (builder->len % builder->cap != 0));
+    if (required <= builder->cap) {
+        return ST_OK;
+    }
 
-        if (builder->mem) {
-            size_t new_size = (sizeof *builder->mem) * (builder->cap + 1);
+    size_t cap = builder->cap;
 
-            builder->mem = realloc(builder->mem, new_size);
+    while (cap < required) {
+        cap *= SBUILDER_DEFAULT_CAP_MULT;
+    }
 
-            if (!builder->mem) {
-                return ST_MALLOC_ERROR;
-            }
+    char* mem = realloc(builder->mem, (sizeof *mem) * (cap + 1));
 
-            memset(builder->mem + builder->len, 0,
-                   builder->cap + 1 - builder->len);
-        }
+    if (!mem) {
+        return ST_MALLOC_ERROR;
     }
 
+    builder->mem = mem;
+    builder->cap = cap;
+
     return ST_OK;
 }
 
@@ -57,10 +59,12 @@ sbuilder_init(struct sbuilder* builder, size_t cap)
         builder->mem = NULL;
         return 1;
     } else {
-        builder->mem = calloc(cap + 1, sizeof *builder->mem);
+        builder->mem = malloc((cap + 1) * sizeof *builder->mem);
 
         if (!builder->mem)
             return 2;
+
+        builder->mem[0] = '\0';
     }
 
     return 0;
@@ -82,41 +86,61 @@ sbuilder_clear(struct sbuilder* builder)
     if (!builder->mem)
         return NULL;
 
-    char* ret = strdup(builder->mem);
+    char* ret = malloc(builder->len + 1);
 
-    builder->len = 0;
-    memset(builder->mem, 0, builder->cap + 1);
+    if (ret) {
+        memcpy(ret, builder->mem, builder->len + 1);
+    }
+
+    sbuilder_reset(builder);
 
     return ret;
 }
 
+void
+sbuilder_reset(struct sbuilder* builder)
+{
+    builder->len = 0;
+
+    if (builder->mem)
+        builder->mem[0] = '\0';
+}
+
 char*
-sbuilder_term(struct sbuilder* builder)
+sbuilder_take(struct sbuilder* builder, size_t* len)
 {
-    if (!builder->mem)
-        return NULL;
+    char* ret = builder->mem;
 
-    char* ret = strdup(builder->mem);
+    if (len)
+        *len = builder->len;
 
-    sbuilder_destroy(builder);
+    builder->mem = NULL;
+    builder->len = 0;
+    builder->cap = 0;
 
     return ret;
 }
 
+char*
+sbuilder_term(struct sbuilder* builder)
+{
+    return sbuilder_take(builder, NULL);
+}
+
 int
 sbuilder_write(struct sbuilder* builder, const char* addition)
 {
     if (!builder->cap)
         return 2;
 
-    int length = strlen(addition);
-    int initial_length = builder->len;
+    size_t length = strlen(addition);
 
     int verified = sbuilder_reserve(builder, length);
     if (verified != 0)
         return verified;
 
-    strncpy(builder->mem + initial_length, addition, length);
+    memcpy(builder->mem + builder->len, addition, length + 1);
+    builder->len += length;
 
     return 0;
 }
@@ -130,23 +154,27 @@ sbuilder_vwritef(struct sbuilder* builder, const char* fmt, va_list args)
     va_list copy;
     va_copy(copy, args);
 
-    int required = vsnprintf(NULL, 0, fmt, args) + 1;
+    // formatted straight into the free space, and once more after growing if
+    // it did not fit
+    size_t room = builder->cap - builder->len + 1;
+    int length = vsnprintf(builder->mem + builder->len, room, fmt, args);
+    int result = length < 0 ? 2 : 0;
 
-    if (required <= 0)
-        return 2;
-
-    char* mem = calloc(required, sizeof *mem);
-
-    if (!mem)
-        return 1;
+    if (!result && (size_t)length >= room) {
+        result = sbuilder_reserve(builder, length);
 
-    vsprintf(mem, fmt, copy);
+        if (!result) {
+            vsnprintf(builder->mem + builder->len, length + 1, fmt, copy);
+        } else {
+            // drop the truncated output
+            builder->mem[builder->len] = '\0';
+        }
+    }
 
     va_end(copy);
 
-    int result = sbuilder_write(builder, mem);
-
-    free(mem);
+    if (!result)
+        builder->len += length;
 
     return result;
 }
@@ -170,13 +198,12 @@ sbuilder_write_char(struct sbuilder* builder, char c)
     if (!builder->cap)
         return 2;
 
-    int initial_length = builder->len;
-
     int verified = sbuilder_reserve(builder, 1);
     if (verified != 0)
         return verified;
 
-    builder->mem[initial_length] = c;
+    builder->mem[builder->len++] = c;
+    builder->mem[builder->len] = '\0';
 
     return 0;
 }
@@ -21,11 +21,23 @@ struct sbuilder sbuilder_new();
 int sbuilder_init(struct sbuilder* builder, size_t cap);
 void sbuilder_destroy(struct sbuilder* builder);
 
+// The contents are kept terminated, and the memory past them is never
+// cleared, so none of these touch more than what is written
+
 // Clears the struct sbuilder to be reused, and then returns a heap allocated
-// char* (must be freed)
+// copy of the contents (must be freed)
 char* sbuilder_clear(struct sbuilder* builder);
 
-// Destroys the builder and returns a heap allocated char* (must be freed)
+// Clears the struct sbuilder to be reused, keeping its memory
+void sbuilder_reset(struct sbuilder* builder);
+
+// Hands over the memory of the builder without copying it (must be freed), and
+// stores the length of the contents in len unless it is NULL. The builder has
+// to be initialized again before it is reused
+char* sbuilder_take(struct sbuilder* builder, size_t* len);
+
+// Destroys the builder and returns a heap allocated char* (must be freed), see
+// sbuilder_take()
 char* sbuilder_term(struct sbuilder* builder);
 
 int sbuilder_write(struct sbuilder* builder, const char* addition);
@@ -0,0 +1,159 @@
+/*
+Typed dynamic arrays.
+
+VEC_DEFINE(name, type) defines
+
+    struct name {
+        type* mem;
+        size_t len;
+        size_t cap;
+    };
+
+and inline functions over it prefixed with name: init, destroy, reserve,
+push, append, get, at, back, pop, clear and shrink_to_fit. A zeroed struct
+is an empty vector. The capacity doubles when it runs out, so pushes are
+amortized O(1), and values are stored as they are instead of boxed in
+pointers like in a ptr_arr.
+*/
+
+#ifndef VEC_H
+#define VEC_H
+
+#include "utils/statuscode.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VEC_MIN_CAP 16
+
+#define VEC_DEFINE(name, type)                                                 \
+    struct name {                                                              \
+        type* mem;                                                             \
+        size_t len;                                                            \
+        size_t cap;                                                            \
+    };                                                                         \
+                                                                               \
+    static inline void name##_init(struct name* v)                            \
+    {                                                                          \
+        v->mem = NULL;                                                         \
+        v->len = 0;                                                            \
+        v->cap = 0;                                                            \
+    }                                                                          \
+                                                                               \
+    static inline void name##_destroy(struct name* v)                         \
+    {                                                                          \
+        free(v->mem);                                                          \
+        name##_init(v);                                                        \
+    }                                                                          \
+                                                                               \
+    /* Makes room for at least cap items */                                    \
+    static inline e_statuscode name##_reserve(struct name* v, size_t cap)     \
+    {                                                                          \
+        if (cap <= v->cap) {                                                   \
+            return ST_OK;                                                      \
+        }                                                                      \
+                                                                               \
+        size_t grown = v->cap ? v->cap : VEC_MIN_CAP;                          \
+                                                                               \
+        while (grown < cap) {                                                  \
+            grown *= 2;                                                        \
+        }                                                                      \
+                                                                               \
+        type* mem = realloc(v->mem, grown * sizeof *mem);                      \
+                                                                               \
+        if (!mem) {                                                            \
+            return ST_MALLOC_ERROR;                                            \
+        }                                                                      \
+                                                                               \
+        v->mem = mem;                                                          \
+        v->cap = grown;                                                        \
+                                                                               \
+        return ST_OK;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline e_statuscode name##_push(struct name* v, type value)        \
+    {                                                                          \
+        if (v->len == v->cap && name##_reserve(v, v->len + 1) != ST_OK) {      \
+            return ST_MALLOC_ERROR;                                            \
+        }                                                                      \
+                                                                               \
+        v->mem[v->len++] = value;                                              \
+                                                                               \
+        return ST_OK;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline e_statuscode name##_append(struct name* v,                  \
+                                             const type* items, size_t len)   \
+    {                                                                          \
+        if (name##_reserve(v, v->len + len) != ST_OK) {                        \
+            return ST_MALLOC_ERROR;                                            \
+        }                                                                      \
+                                                                               \
+        if (len) {                                                             \
+            memcpy(v->mem + v->len, items, len * sizeof *items);               \
+        }                                                                      \
+                                                                               \
+        v->len += len;                                                         \
+                                                                               \
+        return ST_OK;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline type name##_get(const struct name* v, size_t i)             \
+    {                                                                          \
+        assert(i < v->len);                                                    \
+                                                                               \
+        return v->mem[i];                                                      \
+    }                                                                          \
+                                                                               \
+    static inline type* name##_at(struct name* v, size_t i)                   \
+    {                                                                          \
+        assert(i < v->len);                                                    \
+                                                                               \
+        return &v->mem[i];                                                     \
+    }                                                                          \
+                                                                               \
+    static inline type name##_back(const struct name* v)                      \
+    {                                                                          \
+        assert(v->len);                                                        \
+                                                                               \
+        return v->mem[v->len - 1];                                             \
+    }                                                                          \
+                                                                               \
+    static inline type name##_pop(struct name* v)                             \
+    {                                                                          \
+        assert(v->len);                                                        \
+                                                                               \
+        return v->mem[--v->len];                                               \
+    }                                                                          \
+                                                                               \
+    static inline void name##_clear(struct name* v)                           \
+    {                                                                          \
+        v->len = 0;                                                            \
+    }                                                                          \
+                                                                               \
+    /* Gives back the capacity beyond len */                                   \
+    static inline e_statuscode name##_shrink_to_fit(struct name* v)           \
+    {                                                                          \
+        if (v->len == v->cap) {                                                \
+            return ST_OK;                                                      \
+        }                                                                      \
+                                                                               \
+        if (!v->len) {                                                         \
+            name##_destroy(v);                                                 \
+                                                                               \
+            return ST_OK;                                                      \
+        }                                                                      \
+                                                                               \
+        type* mem = realloc(v->mem, v->len * sizeof *mem);                     \
+                                                                               \
+        if (!mem) {                                                            \
+            return ST_MALLOC_ERROR;                                            \
+        }                                                                      \
+                                                                               \
+        v->mem = mem;                                                          \
+        v->cap = v->len;                                                       \
+                                                                               \
+        return ST_OK;                                                          \
+    }
+
+#endif // VEC_H
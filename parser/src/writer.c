@@ -0,0 +1,302 @@
+#include "writer.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CONC_TAG "CONC"
+#define CONT_TAG "CONT"
+
+static e_statuscode
+writer_open(struct ged_writer* w, FILE* fp, int fd)
+{
+    w->fp = fp;
+    w->fd = fd;
+    w->len = 0;
+    w->eol = "\n";
+    w->status = ST_OK;
+    w->buf = malloc(GW_BUFFER_SIZE);
+
+    if (!w->buf) {
+        return ST_MALLOC_ERROR;
+    }
+
+    if (sbuilder_init(&w->value, SBUILDER_DEFAULT_CAP)) {
+        free(w->buf);
+        w->buf = NULL;
+
+        return ST_MALLOC_ERROR;
+    }
+
+    return ST_OK;
+}
+
+e_statuscode
+gw_open_file(struct ged_writer* w, FILE* fp)
+{
+    return writer_open(w, fp, -1);
+}
+
+e_statuscode
+gw_open_fd(struct ged_writer* w, int fd)
+{
+    return writer_open(w, NULL, fd);
+}
+
+void
+gw_set_eol(struct ged_writer* w, const char* eol)
+{
+    w->eol = eol;
+}
+
+e_statuscode
+gw_flush(struct ged_writer* w)
+{
+    if (w->status != ST_OK || !w->len) {
+        w->len = 0;
+
+        return w->status;
+    }
+
+    if (w->fp) {
+        if (fwrite(w->buf, 1, w->len, w->fp) != w->len) {
+            w->status = ST_FILE_ERROR;
+        }
+    } else {
+        for (size_t done = 0; done < w->len;) {
+            ssize_t n = write(w->fd, w->buf + done, w->len - done);
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                w->status = ST_FILE_ERROR;
+                break;
+            }
+
+            done += (size_t)n;
+        }
+    }
+
+    w->len = 0;
+
+    return w->status;
+}
+
+e_statuscode
+gw_close(struct ged_writer* w)
+{
+    e_statuscode result = gw_flush(w);
+
+    free(w->buf);
+    w->buf = NULL;
+    sbuilder_destroy(&w->value);
+
+    return result;
+}
+
+static void
+put(struct ged_writer* w, const char* mem, size_t len)
+{
+    while (len) {
+        if (w->len == GW_BUFFER_SIZE && gw_flush(w) != ST_OK) {
+            return;
+        }
+
+        size_t room = GW_BUFFER_SIZE - w->len;
+        size_t n = len < room ? len : room;
+
+        memcpy(w->buf + w->len, mem, n);
+        w->len += n;
+        mem += n;
+        len -= n;
+    }
+}
+
+static size_t
+count_digits(unsigned value)
+{
+    size_t n = 1;
+
+    while (value >= 10) {
+        value /= 10;
+        n++;
+    }
+
+    return n;
+}
+
+static void
+put_level(struct ged_writer* w, unsigned level)
+{
+    char digits[4];
+    size_t n = count_digits(level);
+
+    for (size_t i = n; i--; level /= 10) {
+        digits[i] = (char)('0' + level % 10);
+    }
+
+    put(w, digits, n);
+}
+
+// Length in characters of the first len bytes of UTF-8 text
+static size_t
+utf8_chars(const char* text, size_t len)
+{
+    size_t chars = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        chars += ((unsigned char)text[i] & 0xC0) != 0x80;
+    }
+
+    return chars;
+}
+
+static bool
+is_char_start(const char* text, size_t i)
+{
+    return ((unsigned char)text[i] & 0xC0) != 0x80;
+}
+
+// Bytes of text that fit in room characters. If text is cut, the cut is moved
+// back until neither side of it is a space, as CONC lines may lose trailing
+// and leading spaces
+static size_t
+split_point(const char* text, size_t len, size_t room)
+{
+    size_t end = 0;
+
+    for (size_t chars = 0; end < len; end++) {
+        if (is_char_start(text, end) && chars++ == room) {
+            break;
+        }
+    }
+
+    if (end == len) {
+        return len;
+    }
+
+    for (size_t cut = end; cut > 1; cut--) {
+        if (is_char_start(text, cut) && text[cut] != ' ' &&
+            text[cut - 1] != ' ') {
+            return cut;
+        }
+    }
+
+    // nothing but spaces, cut anyway
+    return end;
+}
+
+static void
+put_line(struct ged_writer* w, unsigned level, const char* xref,
+         const char* tag, const char* value, size_t len)
+{
+    put_level(w, level);
+    put(w, " ", 1);
+
+    if (xref) {
+        put(w, xref, strlen(xref));
+        put(w, " ", 1);
+    }
+
+    put(w, tag, strlen(tag));
+
+    if (len) {
+        put(w, " ", 1);
+        put(w, value, len);
+    }
+
+    put(w, w->eol, strlen(w->eol));
+}
+
+// Characters of a line before its value: level, xref, tag and the spaces
+static size_t
+line_prefix(unsigned level, const char* xref, const char* tag)
+{
+    size_t len = count_digits(level) + 1 + utf8_chars(tag, strlen(tag)) + 1;
+
+    return xref ? len + utf8_chars(xref, strlen(xref)) + 1 : len;
+}
+
+// Writes the part of a value up to a line break, on a line at line_level and
+// as many CONC lines as needed. Continuation lines are all one level below
+// the record at level, whether they continue its first line or a CONT line
+static void
+put_segment(struct ged_writer* w, unsigned level, unsigned line_level,
+            const char* xref, const char* tag, const char* text, size_t len)
+{
+    size_t prefix = line_prefix(line_level, xref, tag);
+    size_t room = prefix < GW_LINE_MAX ? GW_LINE_MAX - prefix : 1;
+    size_t n = split_point(text, len, room);
+
+    put_line(w, line_level, xref, tag, text, n);
+
+    size_t conc_room = GW_LINE_MAX - line_prefix(level + 1, NULL, CONC_TAG);
+
+    for (size_t done = n; done < len; done += n) {
+        n = split_point(text + done, len - done, conc_room);
+        put_line(w, level + 1, NULL, CONC_TAG, text + done, n);
+    }
+}
+
+static void
+put_value_lines(struct ged_writer* w, unsigned level, const char* xref,
+                const char* tag, const char* value, size_t len)
+{
+    const char* newline = memchr(value, '\n', len);
+    size_t first = newline ? (size_t)(newline - value) : len;
+
+    put_segment(w, level, level, xref, tag, value, first);
+
+    // every further line break starts a CONT line
+    while (newline) {
+        const char* begin = newline + 1;
+        size_t rest = len - (begin - value);
+
+        newline = memchr(begin, '\n', rest);
+
+        size_t n = newline ? (size_t)(newline - begin) : rest;
+
+        put_segment(w, level, level + 1, NULL, CONT_TAG, begin, n);
+    }
+}
+
+e_statuscode
+gw_record(struct ged_writer* w, const struct ged_record* rec)
+{
+    if (w->status != ST_OK) {
+        return w->status;
+    }
+
+    sbuilder_reset(&w->value);
+
+    for (size_t i = 0; i < sa_len(&rec->value); i++) {
+        const struct lex_token* tok = sa_get(&rec->value, i);
+
+        if (tok->lexeme && sbuilder_write(&w->value, tok->lexeme)) {
+            w->status = ST_MALLOC_ERROR;
+
+            return w->status;
+        }
+    }
+
+    put_value_lines(w, rec->level, rec->xref, rec->tag, w->value.mem,
+                    w->value.len);
+
+    for (size_t i = 0; i < sa_len(&rec->children) && w->status == ST_OK; i++) {
+        gw_record(w, sa_get(&rec->children, i));
+    }
+
+    return w->status;
+}
+
+e_statuscode
+gw_document(struct ged_writer* w, const struct ged_document* doc)
+{
+    for (size_t i = 0; i < pa_len(doc->records) && w->status == ST_OK; i++) {
+        gw_record(w, pa_get(doc->records, i));
+    }
+
+    return w->status;
+}
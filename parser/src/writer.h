@@ -0,0 +1,50 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "gedcom.h"
+#include "utils/statuscode.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// GEDCOM lines must not exceed 255 characters, see grammar/summary.md
+#define GW_LINE_MAX 255
+#define GW_BUFFER_SIZE (1 << 18)
+
+/*
+Streaming GEDCOM writer.
+
+Lines are written to a large buffer, which is flushed to a FILE* or file
+descriptor when full. Values longer than a line allows are continued on CONC
+lines, split between characters that are not spaces. Line breaks in values
+become CONT lines.
+*/
+struct ged_writer {
+    FILE* fp; // NULL when writing to fd
+    int fd;
+
+    char* buf;
+    size_t len;
+
+    struct sbuilder value; // value of the line being written
+    const char* eol;
+    e_statuscode status; // first error, later writes are ignored
+};
+
+e_statuscode gw_open_file(struct ged_writer* w, FILE* fp);
+e_statuscode gw_open_fd(struct ged_writer* w, int fd);
+
+// Flushes the buffer and frees the writer. fp or fd is left open. Returns
+// the first error of any write
+e_statuscode gw_close(struct ged_writer* w);
+
+// Lines end with "\n" unless set to another terminator, e.g. "\r\n"
+void gw_set_eol(struct ged_writer* w, const char* eol);
+
+// Writes rec and its children, rec at its own level
+e_statuscode gw_record(struct ged_writer* w, const struct ged_record* rec);
+e_statuscode gw_document(struct ged_writer* w,
+                         const struct ged_document* doc);
+
+e_statuscode gw_flush(struct ged_writer* w);
+
+#endif // WRITER_H